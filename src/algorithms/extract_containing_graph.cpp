@@ -14,9 +14,14 @@ namespace algorithms {
 
 using namespace structures;
 
-void extract_containing_graph(const HandleGraph* source, Graph& g, const vector<pos_t>& positions,
-                              const vector<size_t>& forward_search_lengths,
-                              const vector<size_t>& backward_search_lengths) {
+/// Find the nodes and edges of the containing graph, passing each node to
+/// add_node (in its forward orientation) the first time it is found, and then
+/// each edge once to add_edge
+static void for_each_containing_node_and_edge(const HandleGraph* source, const vector<pos_t>& positions,
+                                              const vector<size_t>& forward_search_lengths,
+                                              const vector<size_t>& backward_search_lengths,
+                                              const function<void(const handle_t&)>& add_node,
+                                              const function<void(const handle_t&, const handle_t&)>& add_edge) {
     
     if (forward_search_lengths.size() != backward_search_lengths.size()
         || forward_search_lengths.size() != positions.size()) {
@@ -24,11 +29,6 @@ void extract_containing_graph(const HandleGraph* source, Graph& g, const vector<
         assert(false);
     }
     
-    if (g.node_size() || g.edge_size()) {
-        cerr << "error:[extract_containing_graph] must extract into an empty graph" << endl;
-        assert(false);
-    }
-    
 #ifdef debug_vg_algorithms
     cerr << "[extract_containing_graph] extracting containing graph from the following points:" << endl;
     for (size_t i = 0; i < positions.size(); i ++) {
@@ -48,8 +48,8 @@ void extract_containing_graph(const HandleGraph* source, Graph& g, const vector<
         }
     };
     
-    // a graph index that we will maintain as we extract the subgraph
-    unordered_map<id_t, Node*> graph;
+    // the nodes we have extracted so far, with their lengths
+    unordered_map<id_t, size_t> graph;
     
     size_t max_search_length = max(*std::max_element(forward_search_lengths.begin(), forward_search_lengths.end()),
                                    *std::max_element(backward_search_lengths.begin(), backward_search_lengths.end()));
@@ -63,19 +63,17 @@ void extract_containing_graph(const HandleGraph* source, Graph& g, const vector<
         const pos_t& pos = positions[i];
         // add all of the initial nodes to the graph
         if (!graph.count(id(pos))) {
-            Node* node = g.add_node();
             // TODO: this might require more get_handle calls than we want
             auto handle = source->get_handle(id(pos), false);
-            node->set_sequence(source->get_sequence(handle));
-            node->set_id(id(pos));
-            graph[id(pos)] = node;
+            graph[id(pos)] = source->get_length(handle);
+            add_node(handle);
         }
         
         // adding this extra distance allows us to keep the searches from all of the seed nodes in
         // the same priority queue so that we only need to do one Dijkstra traversal
         
         // add a traversal for each direction
-        size_t dist_forward = graph[id(pos)]->sequence().size() - offset(pos) + max_search_length - forward_search_lengths[i];
+        size_t dist_forward = graph[id(pos)] - offset(pos) + max_search_length - forward_search_lengths[i];
         size_t dist_backward = offset(pos) + max_search_length - backward_search_lengths[i];
         if (dist_forward < max_search_length) {
             queue.emplace(source->get_handle(id(pos), is_rev(pos)), dist_forward);
@@ -103,14 +101,12 @@ void extract_containing_graph(const HandleGraph* source, Graph& g, const vector<
             
             // make sure the node is in the graph
             if (!graph.count(next_id)) {
-                Node* node = g.add_node();
-                node->set_sequence(source->get_sequence(source->forward(next)));
-                node->set_id(next_id);
-                graph[next_id] = node;
+                graph[next_id] = source->get_length(next);
+                add_node(source->forward(next));
             }
             
             // distance to the end of this node
-            int64_t dist_thru = trav.dist + graph[next_id]->sequence().size();
+            int64_t dist_thru = trav.dist + graph[next_id];
             if (dist_thru < max_search_length) {
                 // we can add more nodes along same path without going over the max length
                 queue.emplace(next, dist_thru);
@@ -120,12 +116,49 @@ void extract_containing_graph(const HandleGraph* source, Graph& g, const vector<
     
     // add the edges to the graph
     for (const pair<handle_t, handle_t>& edge : observed_edges) {
+        add_edge(edge.first, edge.second);
+    }
+}
+
+void extract_containing_graph(const HandleGraph* source, Graph& g, const vector<pos_t>& positions,
+                              const vector<size_t>& forward_search_lengths,
+                              const vector<size_t>& backward_search_lengths) {
+    
+    if (g.node_size() || g.edge_size()) {
+        cerr << "error:[extract_containing_graph] must extract into an empty graph" << endl;
+        assert(false);
+    }
+    
+    for_each_containing_node_and_edge(source, positions, forward_search_lengths, backward_search_lengths,
+                                      [&](const handle_t& handle) {
+        Node* node = g.add_node();
+        node->set_sequence(source->get_sequence(handle));
+        node->set_id(source->get_id(handle));
+    }, [&](const handle_t& left, const handle_t& right) {
         Edge* e = g.add_edge();
-        e->set_from(source->get_id(edge.first));
-        e->set_from_start(source->get_is_reverse(edge.first));
-        e->set_to(source->get_id(edge.second));
-        e->set_to_end(source->get_is_reverse(edge.second));
+        e->set_from(source->get_id(left));
+        e->set_from_start(source->get_is_reverse(left));
+        e->set_to(source->get_id(right));
+        e->set_to_end(source->get_is_reverse(right));
+    });
+}
+
+void extract_containing_graph(const HandleGraph* source, HandleSubgraph& g, const vector<pos_t>& positions,
+                              const vector<size_t>& forward_search_lengths,
+                              const vector<size_t>& backward_search_lengths) {
+    
+    if (g.node_size()) {
+        cerr << "error:[extract_containing_graph] must extract into an empty graph" << endl;
+        assert(false);
     }
+    
+    for_each_containing_node_and_edge(source, positions, forward_search_lengths, backward_search_lengths,
+                                      [&](const handle_t& handle) {
+        g.add_node(source->get_id(handle));
+    }, [&](const handle_t& left, const handle_t& right) {
+        g.add_edge(left, right);
+    });
+    g.finalize();
 }
 
 void extract_containing_graph(const HandleGraph* source, Graph& g, const vector<pos_t>& positions, size_t max_dist) {
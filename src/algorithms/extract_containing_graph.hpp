@@ -14,6 +14,7 @@
 #include "../vg.hpp"
 #include "../vg.pb.h"
 #include "../handle.hpp"
+#include "../handle_subgraph.hpp"
 #include "../hash_map.hpp"
 
 namespace vg {
@@ -45,6 +46,12 @@ namespace algorithms {
     void extract_containing_graph(const HandleGraph* source, Graph& g, const vector<pos_t>& positions,
                                   const vector<size_t>& position_forward_max_dist,
                                   const vector<size_t>& position_backward_max_dist);
+    
+    /// Same semantics as previous except that the graph is extracted into a lightweight subgraph
+    /// of the source graph, which is finalized when extraction is done.
+    void extract_containing_graph(const HandleGraph* source, HandleSubgraph& g, const vector<pos_t>& positions,
+                                  const vector<size_t>& position_forward_max_dist,
+                                  const vector<size_t>& position_backward_max_dist);
 
 }
 }
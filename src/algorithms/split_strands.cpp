@@ -0,0 +1,80 @@
+#include "split_strands.hpp"
+
+namespace vg {
+namespace algorithms {
+
+using namespace std;
+
+bool is_single_stranded(const HandleGraph* graph) {
+    bool single_stranded = true;
+    graph->for_each_handle([&](const handle_t& handle) {
+        for (bool go_left : {false, true}) {
+            single_stranded = graph->follow_edges(handle, go_left, [&](const handle_t& next) {
+                return !graph->get_is_reverse(next);
+            });
+            if (!single_stranded) {
+                break;
+            }
+        }
+        return single_stranded;
+    });
+    return single_stranded;
+}
+
+unordered_map<id_t, pair<id_t, bool>> extract_strand(const HandleGraph* source, MutableHandleGraph* into,
+                                                     bool reverse) {
+    unordered_map<id_t, pair<id_t, bool>> node_translation;
+
+    source->for_each_handle([&](const handle_t& handle) {
+        id_t node_id = source->get_id(handle);
+        into->create_handle(source->get_sequence(reverse ? source->flip(handle) : handle), node_id);
+        node_translation[node_id] = make_pair(node_id, reverse);
+    });
+
+    source->for_each_handle([&](const handle_t& handle) {
+        handle_t oriented = reverse ? source->flip(handle) : handle;
+        source->follow_edges(oriented, false, [&](const handle_t& next) {
+            into->create_edge(into->get_handle(source->get_id(oriented)),
+                              into->get_handle(source->get_id(next)));
+        });
+    });
+
+    return node_translation;
+}
+
+unordered_map<id_t, pair<id_t, bool>> split_strands(const HandleGraph* source, MutableHandleGraph* into) {
+    unordered_map<id_t, pair<id_t, bool>> node_translation;
+
+    // the nodes of into that spell each orientation of a node of source
+    unordered_map<id_t, pair<id_t, id_t>> strand_nodes;
+    id_t next_id = 1;
+    source->for_each_handle([&](const handle_t& handle) {
+        id_t node_id = source->get_id(handle);
+        id_t forward_id = next_id++;
+        id_t reverse_id = next_id++;
+        into->create_handle(source->get_sequence(handle), forward_id);
+        into->create_handle(source->get_sequence(source->flip(handle)), reverse_id);
+        strand_nodes[node_id] = make_pair(forward_id, reverse_id);
+        node_translation[forward_id] = make_pair(node_id, false);
+        node_translation[reverse_id] = make_pair(node_id, true);
+    });
+
+    auto strand_node = [&](const handle_t& handle) {
+        auto& nodes = strand_nodes[source->get_id(handle)];
+        return into->get_handle(source->get_is_reverse(handle) ? nodes.second : nodes.first);
+    };
+
+    // each edge is followed once from each of the orientations it leaves
+    source->for_each_handle([&](const handle_t& handle) {
+        for (handle_t oriented : {handle, source->flip(handle)}) {
+            source->follow_edges(oriented, false, [&](const handle_t& next) {
+                into->create_edge(strand_node(oriented), strand_node(next));
+            });
+        }
+    });
+
+    return node_translation;
+}
+
+}
+}
@@ -0,0 +1,42 @@
+#ifndef VG_ALGORITHMS_SPLIT_STRANDS_HPP_INCLUDED
+#define VG_ALGORITHMS_SPLIT_STRANDS_HPP_INCLUDED
+
+/**
+ * \file split_strands.hpp
+ *
+ * Defines algorithms for turning a bidirected graph into a directed graph
+ * that spells one or both of its strands.
+ */
+
+#include "../handle.hpp"
+
+#include <unordered_map>
+#include <utility>
+
+namespace vg {
+namespace algorithms {
+
+using namespace std;
+
+/// Returns true if every edge of the graph connects two forward handles, so
+/// that the graph can be traversed on a single strand.
+bool is_single_stranded(const HandleGraph* graph);
+
+/// Fills the empty graph into with one strand of a single stranded graph
+/// source, keeping the node IDs. If reverse is set, the nodes hold the
+/// reverse complement sequences and the edges point the other way. Returns a
+/// translation from the nodes of into to the nodes and orientations of
+/// source.
+unordered_map<id_t, pair<id_t, bool>> extract_strand(const HandleGraph* source, MutableHandleGraph* into,
+                                                     bool reverse);
+
+/// Fills the empty graph into with a node for each orientation of each node of
+/// source, and an edge for each way of following an edge of source, so that
+/// every edge of into connects two forward handles. Returns a translation
+/// from the nodes of into to the nodes and orientations of source.
+unordered_map<id_t, pair<id_t, bool>> split_strands(const HandleGraph* source, MutableHandleGraph* into);
+
+}
+}
+
+#endif
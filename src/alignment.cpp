@@ -338,6 +338,108 @@ size_t paired_for_each_parallel_after_wait(function<bool(Alignment&, Alignment&)
     return nLines;
 }
 
+size_t max_batches_in_flight(size_t threads) {
+    // enough batches to keep all the other threads busy and some in reserve
+    return 4 * max<size_t>(threads, 1);
+}
+
+/// Read batches of items with get_item in this thread, and hand each batch,
+/// numbered from 0 in input order, to batch_lambda in an OpenMP task. Once
+/// enough batches are in flight to keep every thread busy, the reading thread
+/// maps a batch itself instead of reading further ahead, which bounds memory.
+/// No batch is started max_batches_in_flight() or more batches after the
+/// oldest unfinished one, so a straggler can't let the others run arbitrarily
+/// far ahead of it. Returns the number of batches.
+template<typename Item>
+static size_t for_each_batch_parallel(const function<bool(Item&)>& get_item,
+                                      const function<void(size_t, vector<Item>&)>& batch_lambda,
+                                      size_t batch_size) {
+    size_t batch_count = 0;
+    // number of batches currently being processed
+    uint64_t batches_outstanding = 0;
+    // the numbers of the batches that have been handed out but not finished
+    set<size_t> unfinished;
+#pragma omp parallel default(none) shared(batches_outstanding, batch_count, unfinished, get_item, batch_lambda, batch_size)
+#pragma omp single
+    {
+        const uint64_t max_batches_outstanding = max_batches_in_flight(omp_get_num_threads());
+        
+        // Run a batch and then forget about it
+        auto run_batch = [&](size_t batch_number, vector<Item>* batch) {
+            batch_lambda(batch_number, *batch);
+            delete batch;
+#pragma omp critical (batch_unfinished)
+            unfinished.erase(batch_number);
+#pragma omp atomic update
+            batches_outstanding--;
+        };
+        
+        bool more_data = true;
+        while (more_data) {
+            vector<Item>* batch = new vector<Item>(batch_size);
+            size_t filled = 0;
+            while (filled < batch_size && (more_data = get_item((*batch)[filled]))) {
+                filled++;
+            }
+            batch->resize(filled);
+            
+            if (batch->empty()) {
+                delete batch;
+                break;
+            }
+            size_t batch_number = batch_count++;
+            
+            bool too_far_ahead;
+#pragma omp critical (batch_unfinished)
+            {
+                too_far_ahead = !unfinished.empty() &&
+                    batch_number >= *unfinished.begin() + max_batches_outstanding;
+                if (!too_far_ahead) {
+                    unfinished.insert(batch_number);
+                }
+            }
+            if (too_far_ahead) {
+                // Some old batch is holding things up. Help run what's queued
+                // until it is done, so consumers that need batches in order
+                // never have to wait on a batch that can't get a thread.
+#pragma omp taskwait
+#pragma omp critical (batch_unfinished)
+                unfinished.insert(batch_number);
+            }
+            
+            uint64_t current_batches_outstanding;
+#pragma omp atomic capture
+            current_batches_outstanding = ++batches_outstanding;
+            
+            if (current_batches_outstanding >= max_batches_outstanding) {
+                // The workers are behind, so pitch in rather than reading more
+                run_batch(batch_number, batch);
+            } else {
+#pragma omp task default(none) firstprivate(batch, batch_number) shared(run_batch)
+                run_batch(batch_number, batch);
+            }
+        }
+        // run_batch has to outlive the tasks
+#pragma omp taskwait
+    }
+    return batch_count;
+}
+
+size_t unpaired_for_each_batch_parallel(function<bool(Alignment&)> get_read_if_available,
+                                        function<void(size_t, vector<Alignment>&)> batch_lambda,
+                                        size_t batch_size) {
+    return for_each_batch_parallel<Alignment>(get_read_if_available, batch_lambda, batch_size);
+}
+
+size_t paired_for_each_batch_parallel(function<bool(Alignment&, Alignment&)> get_pair_if_available,
+                                      function<void(size_t, vector<pair<Alignment, Alignment>>&)> batch_lambda,
+                                      size_t batch_size) {
+    function<bool(pair<Alignment, Alignment>&)> get_item = [&](pair<Alignment, Alignment>& p) {
+        return get_pair_if_available(p.first, p.second);
+    };
+    return for_each_batch_parallel<pair<Alignment, Alignment>>(get_item, batch_lambda, batch_size);
+}
+
 size_t fastq_unpaired_for_each_parallel(const string& filename, function<void(Alignment&)> lambda) {
     
     gzFile fp = (filename != "-") ? gzopen(filename.c_str(), "r") : gzdopen(fileno(stdin), "r");
@@ -420,6 +522,148 @@ size_t fastq_paired_two_files_for_each_parallel_after_wait(const string& file1,
     return nLines;
 }
 
+size_t fastq_unpaired_for_each_batch_parallel(const string& filename,
+                                              function<void(size_t, vector<Alignment>&)> batch_lambda) {
+    
+    gzFile fp = (filename != "-") ? gzopen(filename.c_str(), "r") : gzdopen(fileno(stdin), "r");
+    if (!fp) {
+        cerr << "[vg::alignment.cpp] couldn't open " << filename << endl; exit(1);
+    }
+    
+    size_t len = 2 << 22; // 4M
+    char* buf = new char[len];
+    
+    function<bool(Alignment&)> get_read = [&](Alignment& aln) {
+        return get_next_alignment_from_fastq(fp, buf, len, aln);
+    };
+    
+    size_t batch_count = unpaired_for_each_batch_parallel(get_read, batch_lambda);
+    
+    delete[] buf;
+    gzclose(fp);
+    return batch_count;
+}
+
+size_t fastq_paired_interleaved_for_each_batch_parallel(const string& filename,
+                                                        function<void(size_t, vector<pair<Alignment, Alignment>>&)> batch_lambda) {
+    
+    gzFile fp = (filename != "-") ? gzopen(filename.c_str(), "r") : gzdopen(fileno(stdin), "r");
+    if (!fp) {
+        cerr << "[vg::alignment.cpp] couldn't open " << filename << endl; exit(1);
+    }
+    
+    size_t len = 1 << 18; // 256k
+    char* buf = new char[len];
+    
+    function<bool(Alignment&, Alignment&)> get_pair = [&](Alignment& mate1, Alignment& mate2) {
+        return get_next_interleaved_alignment_pair_from_fastq(fp, buf, len, mate1, mate2);
+    };
+    
+    size_t batch_count = paired_for_each_batch_parallel(get_pair, batch_lambda);
+    
+    delete[] buf;
+    gzclose(fp);
+    return batch_count;
+}
+
+size_t fastq_paired_two_files_for_each_batch_parallel(const string& file1, const string& file2,
+                                                      function<void(size_t, vector<pair<Alignment, Alignment>>&)> batch_lambda) {
+    
+    gzFile fp1 = (file1 != "-") ? gzopen(file1.c_str(), "r") : gzdopen(fileno(stdin), "r");
+    if (!fp1) {
+        cerr << "[vg::alignment.cpp] couldn't open " << file1 << endl; exit(1);
+    }
+    gzFile fp2 = (file2 != "-") ? gzopen(file2.c_str(), "r") : gzdopen(fileno(stdin), "r");
+    if (!fp2) {
+        cerr << "[vg::alignment.cpp] couldn't open " << file2 << endl; exit(1);
+    }
+    
+    size_t len = 1 << 18; // 256k
+    char* buf = new char[len];
+    
+    function<bool(Alignment&, Alignment&)> get_pair = [&](Alignment& mate1, Alignment& mate2) {
+        return get_next_alignment_pair_from_fastqs(fp1, fp2, buf, len, mate1, mate2);
+    };
+    
+    size_t batch_count = paired_for_each_batch_parallel(get_pair, batch_lambda);
+    
+    delete[] buf;
+    gzclose(fp1);
+    gzclose(fp2);
+    return batch_count;
+}
+
+/// Parse a batch of framed messages into alignments, and let go of the data
+/// they point into.
+static void parse_framed_alignments(vector<stream::FramedMessage>& messages, vector<Alignment>& alignments) {
+    alignments.resize(messages.size());
+    for (size_t i = 0; i < messages.size(); i++) {
+        if (!alignments[i].ParseFromArray(messages[i].data, messages[i].length)) {
+            throw runtime_error("[vg::alignment.cpp] obsolete, invalid, or corrupt protobuf input");
+        }
+    }
+    vector<stream::FramedMessage>().swap(messages);
+}
+
+size_t gam_unpaired_for_each_batch_parallel(istream& in,
+                                            function<void(size_t, vector<Alignment>&)> batch_lambda,
+                                            size_t batch_size) {
+    
+    // The reading thread only splits the stream into messages, while the
+    // decompression runs ahead in tasks and each batch is parsed by the thread
+    // that gets it.
+    stream::MessageReader reader(in);
+    function<bool(stream::FramedMessage&)> get_message = [&](stream::FramedMessage& message) {
+        return reader.next(message);
+    };
+    function<void(size_t, vector<stream::FramedMessage>&)> parse_batch =
+        [&](size_t batch_number, vector<stream::FramedMessage>& messages) {
+        vector<Alignment> batch;
+        parse_framed_alignments(messages, batch);
+        batch_lambda(batch_number, batch);
+    };
+    
+    return for_each_batch_parallel<stream::FramedMessage>(get_message, parse_batch, batch_size);
+}
+
+size_t gam_paired_interleaved_for_each_batch_parallel(istream& in,
+                                                      function<void(size_t, vector<pair<Alignment, Alignment>>&)> batch_lambda,
+                                                      size_t batch_size) {
+    
+    stream::MessageReader reader(in);
+    function<bool(pair<stream::FramedMessage, stream::FramedMessage>&)> get_message_pair =
+        [&](pair<stream::FramedMessage, stream::FramedMessage>& messages) {
+        if (!reader.next(messages.first)) {
+            return false;
+        }
+        if (!reader.next(messages.second)) {
+            cerr << "[vg::alignment.cpp] interleaved GAM has an odd number of reads" << endl; exit(1);
+        }
+        return true;
+    };
+    function<void(size_t, vector<pair<stream::FramedMessage, stream::FramedMessage>>&)> parse_batch =
+        [&](size_t batch_number, vector<pair<stream::FramedMessage, stream::FramedMessage>>& message_pairs) {
+        vector<stream::FramedMessage> messages;
+        messages.reserve(2 * message_pairs.size());
+        for (auto& message_pair : message_pairs) {
+            messages.push_back(std::move(message_pair.first));
+            messages.push_back(std::move(message_pair.second));
+        }
+        vector<pair<stream::FramedMessage, stream::FramedMessage>>().swap(message_pairs);
+        vector<Alignment> alignments;
+        parse_framed_alignments(messages, alignments);
+        vector<pair<Alignment, Alignment>> batch(alignments.size() / 2);
+        for (size_t i = 0; i < batch.size(); i++) {
+            batch[i].first = std::move(alignments[2 * i]);
+            batch[i].second = std::move(alignments[2 * i + 1]);
+        }
+        batch_lambda(batch_number, batch);
+    };
+    
+    return for_each_batch_parallel<pair<stream::FramedMessage, stream::FramedMessage>>(get_message_pair, parse_batch,
+                                                                                      batch_size);
+}
+
 size_t fastq_unpaired_for_each(const string& filename, function<void(Alignment&)> lambda) {
     gzFile fp = (filename != "-") ? gzopen(filename.c_str(), "r") : gzdopen(fileno(stdin), "r");
     if (!fp) {
@@ -49,6 +49,52 @@ size_t fastq_paired_two_files_for_each_parallel_after_wait(const string& file1,
                                                            function<void(Alignment&, Alignment&)> lambda,
                                                            function<bool(void)> single_threaded_until_true);
 
+// batched parallel versions, which hand whole batches of reads, numbered from
+// 0 in input order, to the callback, and return the number of batches
+size_t fastq_unpaired_for_each_batch_parallel(const string& filename,
+                                              function<void(size_t, vector<Alignment>&)> batch_lambda);
+
+size_t fastq_paired_interleaved_for_each_batch_parallel(const string& filename,
+                                                        function<void(size_t, vector<pair<Alignment, Alignment>>&)> batch_lambda);
+
+size_t fastq_paired_two_files_for_each_batch_parallel(const string& file1, const string& file2,
+                                                      function<void(size_t, vector<pair<Alignment, Alignment>>&)> batch_lambda);
+
+/// How far the batched parallel drivers let a batch run ahead of the oldest
+/// batch that isn't finished yet, with the given number of threads. An ordered
+/// stream::BatchWriter fed by them must allow at least this big a backlog, or
+/// it can block every worker while the batch it needs is still waiting to run.
+size_t max_batches_in_flight(size_t threads);
+
+/// Read reads with get_read_if_available in one thread, and hand batches of
+/// them, numbered from 0 in input order, to batch_lambda in parallel. Returns
+/// the number of batches.
+size_t unpaired_for_each_batch_parallel(function<bool(Alignment&)> get_read_if_available,
+                                        function<void(size_t, vector<Alignment>&)> batch_lambda,
+                                        size_t batch_size = 512);
+
+/// Read pairs with get_pair_if_available in one thread, and hand batches of
+/// them, numbered from 0 in input order, to batch_lambda in parallel. Returns
+/// the number of batches.
+size_t paired_for_each_batch_parallel(function<bool(Alignment&, Alignment&)> get_pair_if_available,
+                                      function<void(size_t, vector<pair<Alignment, Alignment>>&)> batch_lambda,
+                                      size_t batch_size = 512);
+
+/// Hand batches of the reads in a GAM stream, numbered from 0 in input order,
+/// to batch_lambda in parallel. Decompression runs ahead of the reading thread,
+/// and each batch is parsed by the thread that processes it. Returns the number
+/// of batches.
+size_t gam_unpaired_for_each_batch_parallel(istream& in,
+                                            function<void(size_t, vector<Alignment>&)> batch_lambda,
+                                            size_t batch_size = 512);
+
+/// Hand batches of the interleaved pairs of reads in a GAM stream, numbered
+/// from 0 in input order, to batch_lambda in parallel, like
+/// gam_unpaired_for_each_batch_parallel(). Returns the number of batches.
+size_t gam_paired_interleaved_for_each_batch_parallel(istream& in,
+                                                      function<void(size_t, vector<pair<Alignment, Alignment>>&)> batch_lambda,
+                                                      size_t batch_size = 512);
+
 bam_hdr_t* hts_file_header(string& filename, string& header);
 bam_hdr_t* hts_string_header(string& header,
                              map<string, int64_t>& path_length,
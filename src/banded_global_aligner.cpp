@@ -8,6 +8,11 @@
 #include "banded_global_aligner.hpp"
 #include "json2pb.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BANDED_GLOBAL_ALIGNER_SIMD
+#endif
+
 //#define debug_banded_aligner_objects
 //#define debug_banded_aligner_graph_processing
 //#define debug_banded_aligner_fill_matrix
@@ -16,6 +21,262 @@
 
 using namespace vg;
 
+/// The vector instruction sets that matrix columns can be filled with
+enum BandedSimdLevel {BandedSimdNone, BandedSimdSSE41, BandedSimdAVX2};
+
+static BandedSimdLevel detect_banded_simd_level() {
+#ifdef BANDED_GLOBAL_ALIGNER_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return BandedSimdAVX2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return BandedSimdSSE41;
+    }
+#endif
+    return BandedSimdNone;
+}
+
+static const BandedSimdLevel supported_banded_simd_level = detect_banded_simd_level();
+static BandedSimdLevel banded_simd_level = supported_banded_simd_level;
+
+void vg::set_banded_global_simd(bool allowed) {
+    banded_simd_level = allowed ? supported_banded_simd_level : BandedSimdNone;
+}
+
+const char* vg::banded_global_simd_kernel() {
+    switch (banded_simd_level) {
+        case BandedSimdAVX2:
+            return "avx2";
+        case BandedSimdSSE41:
+            return "sse4.1";
+        default:
+            return "scalar";
+    }
+}
+
+/*
+ * Kernels for the interior of a band column. The match and column gap scores of a cell only
+ * depend on the previous column, so a whole run of them can be computed at once. The prev_
+ * arrays start at the cell on the same diagonal in the previous column, and a column gap comes
+ * from the cell one below that. The row gap scores depend on the cell above and are left to
+ * the caller.
+ *
+ * Scores that do not fit in the integer type are clamped to its range. The kernels also set
+ * saturated if a score reaches the top of the range, or if it is at or below low_limit without
+ * being min_inf. Below low_limit, a real score can't be told apart from one that was built up
+ * from min_inf, which a wider integer type would have kept far away from the real scores (see
+ * fill_matrices()).
+ */
+
+/// Clamp a score to the range of IntType, noting if it is outside the range that can be trusted
+template<class IntType>
+static inline IntType saturate_score(int64_t score, IntType min_inf, IntType low_limit, bool& saturated) {
+    if (score >= numeric_limits<IntType>::max()) {
+        saturated = true;
+        return numeric_limits<IntType>::max();
+    }
+    else if (score <= low_limit && score != min_inf) {
+        saturated = true;
+        return max<int64_t>(score, numeric_limits<IntType>::min());
+    }
+    return score;
+}
+
+template<class IntType>
+static void fill_band_column_scalar(IntType* match, IntType* insert_col, const IntType* prev_match,
+                                    const IntType* prev_insert_row, const IntType* prev_insert_col,
+                                    const IntType* match_scores, int64_t count, int8_t gap_open,
+                                    int8_t gap_extend, IntType min_inf, IntType low_limit, bool& saturated) {
+    for (int64_t k = 0; k < count; k++) {
+        match[k] = saturate_score<IntType>(match_scores[k] + max(max(prev_match[k], prev_insert_row[k]),
+                                                                 prev_insert_col[k]), min_inf, low_limit, saturated);
+        insert_col[k] = saturate_score<IntType>(max(max(prev_match[k + 1] - gap_open, prev_insert_row[k + 1] - gap_open),
+                                                    prev_insert_col[k + 1] - gap_extend), min_inf, low_limit, saturated);
+    }
+}
+
+#ifdef BANDED_GLOBAL_ALIGNER_SIMD
+
+// Vector operations for each instruction set and integer width
+
+struct SSE41Int8 {
+    typedef __m128i vec_t;
+    static const int64_t width = 16;
+    __attribute__((target("sse4.1"))) static inline vec_t load(const int8_t* p) { return _mm_loadu_si128((const __m128i*) p); }
+    __attribute__((target("sse4.1"))) static inline void store(int8_t* p, vec_t v) { _mm_storeu_si128((__m128i*) p, v); }
+    __attribute__((target("sse4.1"))) static inline vec_t set1(int8_t x) { return _mm_set1_epi8(x); }
+    __attribute__((target("sse4.1"))) static inline vec_t max(vec_t a, vec_t b) { return _mm_max_epi8(a, b); }
+    __attribute__((target("sse4.1"))) static inline vec_t add(vec_t a, vec_t b) { return _mm_adds_epi8(a, b); }
+    __attribute__((target("sse4.1"))) static inline vec_t sub(vec_t a, vec_t b) { return _mm_subs_epi8(a, b); }
+    __attribute__((target("sse4.1"))) static inline vec_t eq(vec_t a, vec_t b) { return _mm_cmpeq_epi8(a, b); }
+    __attribute__((target("sse4.1"))) static inline vec_t gt(vec_t a, vec_t b) { return _mm_cmpgt_epi8(a, b); }
+    __attribute__((target("sse4.1"))) static inline vec_t bit_andnot(vec_t a, vec_t b) { return _mm_andnot_si128(a, b); }
+    __attribute__((target("sse4.1"))) static inline vec_t bit_or(vec_t a, vec_t b) { return _mm_or_si128(a, b); }
+    __attribute__((target("sse4.1"))) static inline bool any(vec_t a) { return !_mm_testz_si128(a, a); }
+};
+
+struct SSE41Int16 {
+    typedef __m128i vec_t;
+    static const int64_t width = 8;
+    __attribute__((target("sse4.1"))) static inline vec_t load(const int16_t* p) { return _mm_loadu_si128((const __m128i*) p); }
+    __attribute__((target("sse4.1"))) static inline void store(int16_t* p, vec_t v) { _mm_storeu_si128((__m128i*) p, v); }
+    __attribute__((target("sse4.1"))) static inline vec_t set1(int16_t x) { return _mm_set1_epi16(x); }
+    __attribute__((target("sse4.1"))) static inline vec_t max(vec_t a, vec_t b) { return _mm_max_epi16(a, b); }
+    __attribute__((target("sse4.1"))) static inline vec_t add(vec_t a, vec_t b) { return _mm_adds_epi16(a, b); }
+    __attribute__((target("sse4.1"))) static inline vec_t sub(vec_t a, vec_t b) { return _mm_subs_epi16(a, b); }
+    __attribute__((target("sse4.1"))) static inline vec_t eq(vec_t a, vec_t b) { return _mm_cmpeq_epi16(a, b); }
+    __attribute__((target("sse4.1"))) static inline vec_t gt(vec_t a, vec_t b) { return _mm_cmpgt_epi16(a, b); }
+    __attribute__((target("sse4.1"))) static inline vec_t bit_andnot(vec_t a, vec_t b) { return _mm_andnot_si128(a, b); }
+    __attribute__((target("sse4.1"))) static inline vec_t bit_or(vec_t a, vec_t b) { return _mm_or_si128(a, b); }
+    __attribute__((target("sse4.1"))) static inline bool any(vec_t a) { return !_mm_testz_si128(a, a); }
+};
+
+struct AVX2Int8 {
+    typedef __m256i vec_t;
+    static const int64_t width = 32;
+    __attribute__((target("avx2"))) static inline vec_t load(const int8_t* p) { return _mm256_loadu_si256((const __m256i*) p); }
+    __attribute__((target("avx2"))) static inline void store(int8_t* p, vec_t v) { _mm256_storeu_si256((__m256i*) p, v); }
+    __attribute__((target("avx2"))) static inline vec_t set1(int8_t x) { return _mm256_set1_epi8(x); }
+    __attribute__((target("avx2"))) static inline vec_t max(vec_t a, vec_t b) { return _mm256_max_epi8(a, b); }
+    __attribute__((target("avx2"))) static inline vec_t add(vec_t a, vec_t b) { return _mm256_adds_epi8(a, b); }
+    __attribute__((target("avx2"))) static inline vec_t sub(vec_t a, vec_t b) { return _mm256_subs_epi8(a, b); }
+    __attribute__((target("avx2"))) static inline vec_t eq(vec_t a, vec_t b) { return _mm256_cmpeq_epi8(a, b); }
+    __attribute__((target("avx2"))) static inline vec_t gt(vec_t a, vec_t b) { return _mm256_cmpgt_epi8(a, b); }
+    __attribute__((target("avx2"))) static inline vec_t bit_andnot(vec_t a, vec_t b) { return _mm256_andnot_si256(a, b); }
+    __attribute__((target("avx2"))) static inline vec_t bit_or(vec_t a, vec_t b) { return _mm256_or_si256(a, b); }
+    __attribute__((target("avx2"))) static inline bool any(vec_t a) { return !_mm256_testz_si256(a, a); }
+};
+
+struct AVX2Int16 {
+    typedef __m256i vec_t;
+    static const int64_t width = 16;
+    __attribute__((target("avx2"))) static inline vec_t load(const int16_t* p) { return _mm256_loadu_si256((const __m256i*) p); }
+    __attribute__((target("avx2"))) static inline void store(int16_t* p, vec_t v) { _mm256_storeu_si256((__m256i*) p, v); }
+    __attribute__((target("avx2"))) static inline vec_t set1(int16_t x) { return _mm256_set1_epi16(x); }
+    __attribute__((target("avx2"))) static inline vec_t max(vec_t a, vec_t b) { return _mm256_max_epi16(a, b); }
+    __attribute__((target("avx2"))) static inline vec_t add(vec_t a, vec_t b) { return _mm256_adds_epi16(a, b); }
+    __attribute__((target("avx2"))) static inline vec_t sub(vec_t a, vec_t b) { return _mm256_subs_epi16(a, b); }
+    __attribute__((target("avx2"))) static inline vec_t eq(vec_t a, vec_t b) { return _mm256_cmpeq_epi16(a, b); }
+    __attribute__((target("avx2"))) static inline vec_t gt(vec_t a, vec_t b) { return _mm256_cmpgt_epi16(a, b); }
+    __attribute__((target("avx2"))) static inline vec_t bit_andnot(vec_t a, vec_t b) { return _mm256_andnot_si256(a, b); }
+    __attribute__((target("avx2"))) static inline vec_t bit_or(vec_t a, vec_t b) { return _mm256_or_si256(a, b); }
+    __attribute__((target("avx2"))) static inline bool any(vec_t a) { return !_mm256_testz_si256(a, a); }
+};
+
+// The same loop, compiled once per instruction set so that each copy can inline its operations
+
+#define BANDED_COLUMN_KERNEL_BODY                                                                   \
+    typedef typename Ops::vec_t vec_t;                                                              \
+    const vec_t open = Ops::set1(gap_open);                                                         \
+    const vec_t extend = Ops::set1(gap_extend);                                                     \
+    const vec_t infinity = Ops::set1(min_inf);                                                      \
+    const vec_t above_limit = Ops::set1(low_limit + 1);                                             \
+    const vec_t highest = Ops::set1(numeric_limits<IntType>::max());                                \
+    vec_t at_limit = Ops::set1(0);                                                                  \
+    int64_t k = 0;                                                                                  \
+    for (; k + Ops::width <= count; k += Ops::width) {                                              \
+        vec_t best = Ops::max(Ops::max(Ops::load(prev_match + k), Ops::load(prev_insert_row + k)),  \
+                              Ops::load(prev_insert_col + k));                                      \
+        vec_t diag = Ops::add(Ops::load(match_scores + k), best);                                   \
+        Ops::store(match + k, diag);                                                                \
+        vec_t gap = Ops::max(Ops::max(Ops::sub(Ops::load(prev_match + k + 1), open),                \
+                                      Ops::sub(Ops::load(prev_insert_row + k + 1), open)),          \
+                             Ops::sub(Ops::load(prev_insert_col + k + 1), extend));                 \
+        Ops::store(insert_col + k, gap);                                                            \
+        at_limit = Ops::bit_or(at_limit, Ops::bit_or(Ops::eq(diag, highest),                        \
+                                                     Ops::eq(gap, highest)));                       \
+        at_limit = Ops::bit_or(at_limit, Ops::bit_andnot(Ops::eq(diag, infinity),                  \
+                                                         Ops::gt(above_limit, diag)));              \
+        at_limit = Ops::bit_or(at_limit, Ops::bit_andnot(Ops::eq(gap, infinity),                   \
+                                                         Ops::gt(above_limit, gap)));               \
+    }                                                                                               \
+    if (Ops::any(at_limit)) {                                                                       \
+        saturated = true;                                                                           \
+    }                                                                                               \
+    fill_band_column_scalar(match + k, insert_col + k, prev_match + k, prev_insert_row + k,         \
+                            prev_insert_col + k, match_scores + k, count - k, gap_open, gap_extend, \
+                            min_inf, low_limit, saturated);
+
+template<class Ops, class IntType>
+__attribute__((target("sse4.1")))
+static void fill_band_column_sse41(IntType* match, IntType* insert_col, const IntType* prev_match,
+                                   const IntType* prev_insert_row, const IntType* prev_insert_col,
+                                   const IntType* match_scores, int64_t count, int8_t gap_open,
+                                   int8_t gap_extend, IntType min_inf, IntType low_limit, bool& saturated) {
+    BANDED_COLUMN_KERNEL_BODY
+}
+
+template<class Ops, class IntType>
+__attribute__((target("avx2")))
+static void fill_band_column_avx2(IntType* match, IntType* insert_col, const IntType* prev_match,
+                                  const IntType* prev_insert_row, const IntType* prev_insert_col,
+                                  const IntType* match_scores, int64_t count, int8_t gap_open,
+                                  int8_t gap_extend, IntType min_inf, IntType low_limit, bool& saturated) {
+    BANDED_COLUMN_KERNEL_BODY
+}
+
+#undef BANDED_COLUMN_KERNEL_BODY
+
+#endif
+
+/// Fill the interior of a band column with the fastest available kernel
+template<class IntType>
+static inline void fill_band_column(IntType* match, IntType* insert_col, const IntType* prev_match,
+                                    const IntType* prev_insert_row, const IntType* prev_insert_col,
+                                    const IntType* match_scores, int64_t count, int8_t gap_open,
+                                    int8_t gap_extend, IntType min_inf, IntType low_limit, bool& saturated) {
+    // only the 8 and 16 bit scores pack enough lanes to be worth it
+    fill_band_column_scalar(match, insert_col, prev_match, prev_insert_row, prev_insert_col,
+                            match_scores, count, gap_open, gap_extend, min_inf, low_limit, saturated);
+}
+
+#ifdef BANDED_GLOBAL_ALIGNER_SIMD
+
+template<>
+inline void fill_band_column<int8_t>(int8_t* match, int8_t* insert_col, const int8_t* prev_match,
+                                     const int8_t* prev_insert_row, const int8_t* prev_insert_col,
+                                     const int8_t* match_scores, int64_t count, int8_t gap_open,
+                                     int8_t gap_extend, int8_t min_inf, int8_t low_limit, bool& saturated) {
+    switch (banded_simd_level) {
+        case BandedSimdAVX2:
+            fill_band_column_avx2<AVX2Int8>(match, insert_col, prev_match, prev_insert_row, prev_insert_col,
+                                            match_scores, count, gap_open, gap_extend, min_inf, low_limit, saturated);
+            break;
+        case BandedSimdSSE41:
+            fill_band_column_sse41<SSE41Int8>(match, insert_col, prev_match, prev_insert_row, prev_insert_col,
+                                              match_scores, count, gap_open, gap_extend, min_inf, low_limit, saturated);
+            break;
+        default:
+            fill_band_column_scalar(match, insert_col, prev_match, prev_insert_row, prev_insert_col,
+                                    match_scores, count, gap_open, gap_extend, min_inf, low_limit, saturated);
+            break;
+    }
+}
+
+template<>
+inline void fill_band_column<int16_t>(int16_t* match, int16_t* insert_col, const int16_t* prev_match,
+                                      const int16_t* prev_insert_row, const int16_t* prev_insert_col,
+                                      const int16_t* match_scores, int64_t count, int8_t gap_open,
+                                      int8_t gap_extend, int16_t min_inf, int16_t low_limit, bool& saturated) {
+    switch (banded_simd_level) {
+        case BandedSimdAVX2:
+            fill_band_column_avx2<AVX2Int16>(match, insert_col, prev_match, prev_insert_row, prev_insert_col,
+                                             match_scores, count, gap_open, gap_extend, min_inf, low_limit, saturated);
+            break;
+        case BandedSimdSSE41:
+            fill_band_column_sse41<SSE41Int16>(match, insert_col, prev_match, prev_insert_row, prev_insert_col,
+                                               match_scores, count, gap_open, gap_extend, min_inf, low_limit, saturated);
+            break;
+        default:
+            fill_band_column_scalar(match, insert_col, prev_match, prev_insert_row, prev_insert_col,
+                                    match_scores, count, gap_open, gap_extend, min_inf, low_limit, saturated);
+            break;
+    }
+}
+
+#endif
+
 template<class IntType>
 BandedGlobalAligner<IntType>::BABuilder::BABuilder(Alignment& alignment) :
                                                    alignment(alignment),
@@ -214,7 +475,8 @@ BandedGlobalAligner<IntType>::BAMatrix::BAMatrix(Alignment& alignment, Node* nod
                                                  cumulative_seq_len(cumulative_seq_len),
                                                  match(nullptr),
                                                  insert_col(nullptr),
-                                                 insert_row(nullptr)
+                                                 insert_row(nullptr),
+                                                 saturated(false)
 {
     // nothing to do
 #ifdef debug_banded_aligner_objects
@@ -240,12 +502,17 @@ BandedGlobalAligner<IntType>::BAMatrix::~BAMatrix() {
 
 template <class IntType>
 void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_table, int8_t gap_open,
-                                                         int8_t gap_extend, bool qual_adjusted, IntType min_inf) {
+                                                         int8_t gap_extend, bool qual_adjusted, IntType min_inf,
+                                                         IntType low_limit) {
     
 #ifdef debug_banded_aligner_fill_matrix
     cerr << "[BAMatrix::fill_matrix] beginning DP on matrix for node " << node->id() << endl;;
 #endif
     
+    auto saturate = [&](int64_t score) {
+        return saturate_score<IntType>(score, min_inf, low_limit, saturated);
+    };
+    
     // note: bottom has the higher index
     int64_t band_height = bottom_diag - top_diag + 1;
     int64_t ncols = node->sequence().length();
@@ -280,6 +547,9 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
      * also note that the internal structure of each column is preserved and each row
      * in the rectangularized band corresponds to a diagonal in the original matrix
      *
+     * the rectangle is stored column by column, so that the cells of a column, which are
+     * filled together, are contiguous
+     *
      * the initial row and column can be reached via an implied row or column insertion
      * that is not represented in the matrix (this requires a number of edge cases)
      */
@@ -296,7 +566,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
     
     // initialize with min infs (identity of max function)
     for (int64_t i = iter_start; i < iter_stop; i++) {
-        idx = i * ncols;
+        idx = i;
         match[idx] = min_inf;
         insert_col[idx] = min_inf;
         // can skip insert row since it doesn't cross node boundaries
@@ -304,7 +574,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
     
     // make sure this one insert row value is there so we can use it for checking band boundaries
     // later
-    insert_row[iter_start * ncols] = min_inf;
+    insert_row[iter_start] = min_inf;
     
     // we will allow the alignment to treat this node as a source if it has no seeds or if it
     // is connected to a source node by a length 0 path (which we will check later)
@@ -331,6 +601,8 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
 #endif
         
         int64_t seed_node_seq_len = seed->node->sequence().length();
+        // index where the last column of the seed's band starts
+        int64_t seed_last_col_idx = (seed_node_seq_len - 1) * (seed->bottom_diag - seed->top_diag + 1);
         
         if (seed_node_seq_len == 0) {
 #ifdef debug_banded_aligner_fill_matrix
@@ -363,7 +635,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         cerr << "[BAMatrix::fill_matrix]: this seed reaches diagonals " << seed_next_top_diag << " to " << seed_next_bottom_diag << " out of matrix range " << top_diag << " to " << bottom_diag << endl;
 #endif
         // special logic for first row
-        idx = (seed_next_top_diag_iter - top_diag) * ncols;
+        idx = seed_next_top_diag_iter - top_diag;
         
         IntType match_score;
         if (qual_adjusted) {
@@ -378,49 +650,49 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
             // paths through this node into both the match and insert row from a lead gap
             
             // match after implied gap along top edge
-            match[idx] = max<IntType>(match_score - gap_open - (extended_cumulative_seq_len - 1) * gap_extend, match[idx]);
+            match[idx] = saturate(max<int64_t>(match_score - gap_open - (extended_cumulative_seq_len - 1) * gap_extend, match[idx]));
             // gap open after implied gap along top edge
-            insert_row[idx] = max<IntType>(-2 * gap_open - extended_cumulative_seq_len * gap_extend, insert_row[idx]);
+            insert_row[idx] = saturate(max<int64_t>(-2 * gap_open - extended_cumulative_seq_len * gap_extend, insert_row[idx]));
         }
         else if (abutting_top_of_matrix) {
             // the implied cell above this cell is not in the extended band, but the one diagonal is, so we can extend
             // into match from a lead gap but not insert row
             
             // match after implied gap along top edge
-            match[idx] = max<IntType>(match_score - gap_open - (extended_cumulative_seq_len - 1) * gap_extend, match[idx]);
+            match[idx] = saturate(max<int64_t>(match_score - gap_open - (extended_cumulative_seq_len - 1) * gap_extend, match[idx]));
             
         }
         else {
 #ifdef debug_banded_aligner_fill_matrix
             cerr << "[BAMatrix::fill_matrix]: top cell in match matrix is reachable without a lead gap" << endl;
 #endif
-            diag_idx = (seed_next_top_diag_iter - seed_next_top_diag) * seed_node_seq_len + seed_node_seq_len - 1;
+            diag_idx = seed_last_col_idx + seed_next_top_diag_iter - seed_next_top_diag;
             
-            match[idx] = max<IntType>(match_score + max<IntType>(max<IntType>(seed->match[diag_idx],
-                                                                              seed->insert_row[diag_idx]),
-                                                                 seed->insert_col[diag_idx]), match[idx]);
+            match[idx] = saturate(max<int64_t>(match_score + max<IntType>(max<IntType>(seed->match[diag_idx],
+                                                                                       seed->insert_row[diag_idx]),
+                                                                          seed->insert_col[diag_idx]), match[idx]));
         }
         
         if (seed_next_top_diag < seed_next_bottom_diag) {
 #ifdef debug_banded_aligner_fill_matrix
             cerr << "[BAMatrix::fill_matrix]: seed band is greater than height 1, can extend column gap into first row" << endl;
 #endif
-            left_idx = (seed_next_top_diag_iter - seed_next_top_diag + 2) * seed_node_seq_len - 1;
-            insert_col[idx] = max<IntType>(max<IntType>(max<IntType>(seed->match[left_idx] - gap_open,
-                                                                     seed->insert_row[left_idx] - gap_open),
-                                                        seed->insert_col[left_idx] - gap_extend), insert_col[idx]);
+            left_idx = seed_last_col_idx + seed_next_top_diag_iter - seed_next_top_diag + 1;
+            insert_col[idx] = saturate(max<int64_t>(max(max(seed->match[left_idx] - gap_open,
+                                                            seed->insert_row[left_idx] - gap_open),
+                                                        seed->insert_col[left_idx] - gap_extend), insert_col[idx]));
         }
         
         
         for (int64_t diag = seed_next_top_diag_iter + 1; diag < seed_next_bottom_diag_iter; diag++) {
-            idx = (diag - top_diag) * ncols;
+            idx = diag - top_diag;
             
 #ifdef debug_banded_aligner_fill_matrix
             cerr << "[BAMatrix::fill_matrix]: extending a match and column gap into matrix coord (" << diag << ", 0)" << ", rectangular coord coord (" << diag - top_diag << ", 0)" << endl;
 #endif
             
             // extend a match
-            diag_idx = (diag - seed_next_top_diag) * seed_node_seq_len + seed_node_seq_len - 1;
+            diag_idx = seed_last_col_idx + diag - seed_next_top_diag;
             if (qual_adjusted) {
                 match_score = score_mat[25 * base_quality[diag] + 5 * nt_table[node_seq[0]] + nt_table[read[diag]]];
             }
@@ -432,19 +704,19 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
             cerr << "[BAMatrix::fill_matrix]: extending match from rectangular coord (" << diag - seed_next_top_diag << ", " << seed_node_seq_len - 1 << ")" << " with match score " << (int) match_score << ", scores are " << (int) seed->match[diag_idx] << " (M), " << (int) seed->insert_row[diag_idx] << " (Ir), and " << (int) seed->insert_col[diag_idx] << " (Ic), current score is " << (int) match[idx] << endl;
 #endif
             
-            match[idx] = max<IntType>(match_score + max<IntType>(max<IntType>(seed->match[diag_idx],
-                                                                              seed->insert_row[diag_idx]),
-                                                                 seed->insert_col[diag_idx]), match[idx]);
+            match[idx] = saturate(max<int64_t>(match_score + max<IntType>(max<IntType>(seed->match[diag_idx],
+                                                                                       seed->insert_row[diag_idx]),
+                                                                          seed->insert_col[diag_idx]), match[idx]));
             
             // extend a column gap
-            left_idx = (diag - seed_next_top_diag + 2) * seed_node_seq_len - 1;
+            left_idx = seed_last_col_idx + diag - seed_next_top_diag + 1;
             
 #ifdef debug_banded_aligner_fill_matrix
             cerr << "[BAMatrix::fill_matrix]: extending match from rectangular coord (" << diag - seed_next_top_diag + 1 << ", " << seed_node_seq_len - 1 << ")" << ", scores are " << (int) seed->match[left_idx] << " (M), " << (int) seed->insert_row[left_idx] << " (Ir), and " << (int) seed->insert_col[left_idx] << " (Ic), current score is " << (int) insert_col[idx] << endl;
 #endif
-            insert_col[idx] = max<IntType>(max<IntType>(max<IntType>(seed->match[left_idx] - gap_open,
-                                                                     seed->insert_row[left_idx] - gap_open),
-                                                        seed->insert_col[left_idx] - gap_extend), insert_col[idx]);
+            insert_col[idx] = saturate(max<int64_t>(max(max(seed->match[left_idx] - gap_open,
+                                                            seed->insert_row[left_idx] - gap_open),
+                                                        seed->insert_col[left_idx] - gap_extend), insert_col[idx]));
             
 #ifdef debug_banded_aligner_fill_matrix
             cerr << "[BAMatrix::fill_matrix]: score is now " << (int) insert_col[idx] << endl;
@@ -459,8 +731,8 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
 #endif
             
             // may only be able to extend a match on last iteration
-            idx = (seed_next_bottom_diag_iter - top_diag) * ncols;
-            diag_idx = (seed_next_bottom_diag_iter - seed_next_top_diag) * seed_node_seq_len + seed_node_seq_len - 1;
+            idx = seed_next_bottom_diag_iter - top_diag;
+            diag_idx = seed_last_col_idx + seed_next_bottom_diag_iter - seed_next_top_diag;
             if (qual_adjusted) {
                 match_score = score_mat[25 * base_quality[seed_next_bottom_diag_iter] + 5 * nt_table[node_seq[0]] + nt_table[read[seed_next_bottom_diag_iter]]];
             }
@@ -471,19 +743,19 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
 #ifdef debug_banded_aligner_fill_matrix
             cerr << "[BAMatrix::fill_matrix]: extending match from rectangular coord (" << seed_next_bottom_diag_iter - seed_next_top_diag << ", " << seed_node_seq_len - 1 << ")" << " with match score " << (int) match_score << ", scores are " << (int) seed->match[diag_idx] << " (M), " << (int) seed->insert_row[diag_idx] << " (Ir), and " << (int) seed->insert_col[diag_idx] << " (Ic), current score is " << (int) match[idx] << endl;
 #endif
-            match[idx] = max<IntType>(match_score + max<IntType>(max<IntType>(seed->match[diag_idx],
-                                                                              seed->insert_row[diag_idx]),
-                                                                 seed->insert_col[diag_idx]), match[idx]);
+            match[idx] = saturate(max<int64_t>(match_score + max<IntType>(max<IntType>(seed->match[diag_idx],
+                                                                                       seed->insert_row[diag_idx]),
+                                                                          seed->insert_col[diag_idx]), match[idx]));
             
             // can only extend column gap if the bottom of the matrix was hit in the last seed
             if (beyond_bottom_of_matrix) {
 #ifdef debug_banded_aligner_fill_matrix
                 cerr << "[BAMatrix::fill_matrix]: can also extend a column gap since already reached edge of matrix" << endl;
 #endif
-                left_idx = (seed_next_bottom_diag_iter - seed_next_top_diag + 2) * seed_node_seq_len - 1;
-                insert_col[idx] = max<IntType>(max<IntType>(max<IntType>(seed->match[left_idx] - gap_open,
-                                                                         seed->insert_row[left_idx] - gap_open),
-                                                            seed->insert_col[left_idx] - gap_extend), insert_col[idx]);
+                left_idx = seed_last_col_idx + seed_next_bottom_diag_iter - seed_next_top_diag + 1;
+                insert_col[idx] = saturate(max<int64_t>(max(max(seed->match[left_idx] - gap_open,
+                                                                seed->insert_row[left_idx] - gap_open),
+                                                            seed->insert_col[left_idx] - gap_extend), insert_col[idx]));
             }
         }
     }
@@ -503,7 +775,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         
         // find position of the first cell in the rectangularized band
         int64_t iter_start = -top_diag;
-        idx = iter_start * ncols;
+        idx = iter_start;
         
         // cap stop index if last diagonal is below bottom of matrix
         int64_t iter_stop = bottom_diag > (int64_t) read.length() ? band_height + (int64_t) read.length() - bottom_diag - 1 : band_height;
@@ -521,12 +793,12 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         }
         
         // only way to end an alignment in a gap here is to row and column gap
-        insert_row[idx] = max<IntType>(-2 * gap_open, insert_row[idx]);
-        insert_col[idx] = max<IntType>(-2 * gap_open, insert_col[idx]);
+        insert_row[idx] = saturate(max<int64_t>(-2 * gap_open, insert_row[idx]));
+        insert_col[idx] = saturate(max<int64_t>(-2 * gap_open, insert_col[idx]));
         
         for (int64_t i = iter_start + 1; i < iter_stop; i++) {
-            idx = i * ncols;
-            up_idx = idx - ncols;
+            idx = i;
+            up_idx = i - 1;
             // score of a match in this cell
             IntType match_score;
             if (qual_adjusted) {
@@ -536,12 +808,12 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
                 match_score = score_mat[5 * nt_table[node_seq[0]] + nt_table[read[top_diag + i]]];
             }
             // must take one lead gap to get into first column
-            match[idx] = max<IntType>(match_score - gap_open - (top_diag + i - 1) * gap_extend, match[idx]);
+            match[idx] = saturate(max<int64_t>(match_score - gap_open - (top_diag + i - 1) * gap_extend, match[idx]));
             // normal iteration along column
-            insert_row[idx] = max<IntType>(max<IntType>(match[up_idx] - gap_open, insert_row[up_idx] - gap_extend),
-                                           insert_col[up_idx] - gap_open);
+            insert_row[idx] = saturate(max(max(match[up_idx] - gap_open, insert_row[up_idx] - gap_extend),
+                                           insert_col[up_idx] - gap_open));
             // must take two gaps to get into first column
-            insert_col[idx] = max<IntType>(-2 * gap_open - (top_diag + i) * gap_extend, insert_col[idx]);
+            insert_col[idx] = saturate(max<int64_t>(-2 * gap_open - (top_diag + i) * gap_extend, insert_col[idx]));
 
 #ifdef debug_banded_aligner_fill_matrix
             cerr << "[BAMatrix::fill_matrix]: on left edge of matrix at rectangle coords (" << i << ", " << 0 << "), match score of node char " << 0 << " (" << node_seq[0] << ") and read char " << i + top_diag << " (" << read[i + top_diag] << ") is " << (int) match_score << ", leading gap length is " << top_diag + i << " for total match matrix score of " << (int) match[idx] << endl;
@@ -555,11 +827,11 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         // compute the insert row scores without any cases for lead gaps (these can be safely computed after
         // the POA iterations since they do not cross node boundaries)
         for (int64_t i = iter_start + 1; i < iter_stop; i++) {
-            idx = i * ncols;
-            up_idx = (i - 1) * ncols;
+            idx = i;
+            up_idx = i - 1;
             
-            insert_row[idx] = max<IntType>(max<IntType>(match[up_idx] - gap_open, insert_row[up_idx] - gap_extend),
-                                           insert_col[up_idx] - gap_open);
+            insert_row[idx] = saturate(max(max(match[up_idx] - gap_open, insert_row[up_idx] - gap_extend),
+                                           insert_col[up_idx] - gap_open));
         }
     }
     
@@ -567,6 +839,9 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
     cerr << "[BAMatrix::fill_matrix]: seeding finished, moving to subsequent columns" << endl;
 #endif
     
+    // scores of matching each row's read base to the current column's node base
+    vector<IntType> match_scores(band_height);
+    
     // iterate through the rest of the columns
     for (int64_t j = 1; j < ncols; j++) {
         
@@ -578,7 +853,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         int64_t iter_start = top_diag_outside ? -(top_diag + j) : 0;
         int64_t iter_stop = bottom_diag_outside ? band_height + (int64_t) read.length() - bottom_diag - j - 1 : band_height;
         
-        idx = iter_start * ncols + j;
+        idx = j * band_height + iter_start;
         
         IntType match_score;
         if (qual_adjusted) {
@@ -589,21 +864,21 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         }
         if (top_diag_outside || top_diag_abutting) {
             // match after implied gap along top edge
-            match[idx] = match_score - gap_open - (cumulative_seq_len + j - 1) * gap_extend;
+            match[idx] = saturate(match_score - gap_open - (cumulative_seq_len + j - 1) * gap_extend);
             
 #ifdef debug_banded_aligner_fill_matrix
             cerr << "[BAMatrix::fill_matrix]: on upper edge of matrix at rectangle coords (" << iter_start << ", " << j << "), match score of node char " << j << " (" << node_seq[j] << ") and read char " << iter_start + top_diag + j << " (" << read[iter_start + top_diag + j] << ") is " << (int) match_score << ", leading gap length is " << cumulative_seq_len + j << " for total match matrix score of " << (int) match[idx] << endl;
 #endif
         }
         else {
-            diag_idx = iter_start * ncols + (j - 1);
+            diag_idx = (j - 1) * band_height + iter_start;
             // cells should be present to do normal diagonal iteration
-            match[idx] = match_score + max(max(match[diag_idx], insert_row[diag_idx]), insert_col[diag_idx]);
+            match[idx] = saturate(match_score + max(max(match[diag_idx], insert_row[diag_idx]), insert_col[diag_idx]));
         }
         
         if (top_diag_outside) {
             // gap open after implied gap along top edge
-            insert_row[idx] = -2 * gap_open - (cumulative_seq_len + j) * gap_extend;
+            insert_row[idx] = saturate(-2 * gap_open - (cumulative_seq_len + j) * gap_extend);
         }
         else {
             // cannot reach this node with row insert (outside the diagonal)
@@ -612,39 +887,47 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         
         // normal iteration along row unless band height is 1
         if (band_height != 1) {
-            int64_t left_idx = (iter_start + 1) * ncols + (j - 1);
-            insert_col[idx] = max(max(match[left_idx] - gap_open, insert_row[left_idx] - gap_open),
-                                  insert_col[left_idx] - gap_extend);
+            int64_t left_idx = (j - 1) * band_height + iter_start + 1;
+            insert_col[idx] = saturate(max(max(match[left_idx] - gap_open, insert_row[left_idx] - gap_open),
+                                           insert_col[left_idx] - gap_extend));
         }
         else {
             insert_col[idx] = min_inf;
         }
         
         
-        for (int64_t i = iter_start + 1; i < iter_stop - 1; i++) {
-            // indices of the current and previous cells in the rectangularized band
-            idx = i * ncols + j;
-            up_idx = (i - 1) * ncols + j;
-            diag_idx = i * ncols + (j - 1);
-            left_idx = (i + 1) * ncols + (j - 1);
-            
-            if (qual_adjusted) {
-                match_score = score_mat[25 * base_quality[i + top_diag + j] + 5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag + j]]];
-            }
-            else {
-                match_score = score_mat[5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag + j]]];
+        // the match and column gap scores in the interior of the column only depend on the
+        // previous column, so they can be filled all at once
+        int64_t interior_start = iter_start + 1;
+        int64_t interior_count = iter_stop - 1 - interior_start;
+        if (interior_count > 0) {
+            for (int64_t i = interior_start; i < iter_stop - 1; i++) {
+                if (qual_adjusted) {
+                    match_scores[i] = score_mat[25 * base_quality[i + top_diag + j] + 5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag + j]]];
+                }
+                else {
+                    match_scores[i] = score_mat[5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag + j]]];
+                }
             }
             
-            match[idx] = match_score + max(max(match[diag_idx], insert_row[diag_idx]), insert_col[diag_idx]);
-            
-            insert_row[idx] = max(max(match[up_idx] - gap_open, insert_row[up_idx] - gap_extend),
-                                  insert_col[up_idx] - gap_open);
+            int64_t col_idx = j * band_height + interior_start;
+            int64_t prev_col_idx = (j - 1) * band_height + interior_start;
+            fill_band_column(match + col_idx, insert_col + col_idx, match + prev_col_idx, insert_row + prev_col_idx,
+                             insert_col + prev_col_idx, match_scores.data() + interior_start, interior_count,
+                             gap_open, gap_extend, min_inf, low_limit, saturated);
+        }
+        
+        // the row gap scores depend on the cell above, so they go one at a time
+        for (int64_t i = interior_start; i < iter_stop - 1; i++) {
+            // indices of the current cell and the one above it in the rectangularized band
+            idx = j * band_height + i;
+            up_idx = idx - 1;
             
-            insert_col[idx] = max(max(match[left_idx] - gap_open, insert_row[left_idx] - gap_open),
-                                  insert_col[left_idx] - gap_extend);
+            insert_row[idx] = saturate(max(max(match[up_idx] - gap_open, insert_row[up_idx] - gap_extend),
+                                           insert_col[up_idx] - gap_open));
             
 #ifdef debug_banded_aligner_fill_matrix
-            cerr << "[BAMatrix::fill_matrix]: in interior of matrix at rectangle coords (" << i << ", " << j << "), match score of node char " << j << " (" << node_seq[j] << ") and read char " << i + top_diag + j << " (" << read[i + top_diag + j] << ") is " << (int) match_score << ", leading gap length is " << cumulative_seq_len + j << " for total match matrix score of " << (int) match[idx] << endl;
+            cerr << "[BAMatrix::fill_matrix]: in interior of matrix at rectangle coords (" << i << ", " << j << "), match score of node char " << j << " (" << node_seq[j] << ") and read char " << i + top_diag + j << " (" << read[i + top_diag + j] << ") is " << (int) match_scores[i] << ", leading gap length is " << cumulative_seq_len + j << " for total match matrix score of " << (int) match[idx] << endl;
 #endif
         }
         
@@ -652,9 +935,9 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         
         // skip this step in edge case where read length is 1
         if (iter_stop - 1 > iter_start) {
-            idx = (iter_stop - 1) * ncols + j;
-            up_idx = (iter_stop - 2) * ncols + j;
-            diag_idx = (iter_stop - 1) * ncols + (j - 1);
+            idx = j * band_height + iter_stop - 1;
+            up_idx = j * band_height + iter_stop - 2;
+            diag_idx = (j - 1) * band_height + iter_stop - 1;
             
             if (qual_adjusted) {
                 match_score = score_mat[25 * base_quality[iter_stop + top_diag + j - 1] + 5 * nt_table[node_seq[j]] + nt_table[read[iter_stop + top_diag + j - 1]]];
@@ -663,16 +946,16 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
                 match_score = score_mat[5 * nt_table[node_seq[j]] + nt_table[read[iter_stop + top_diag + j - 1]]];
             }
             
-            match[idx] = match_score + max(max(match[diag_idx], insert_row[diag_idx]), insert_col[diag_idx]);
+            match[idx] = saturate(match_score + max(max(match[diag_idx], insert_row[diag_idx]), insert_col[diag_idx]));
             
-            insert_row[idx] = max(max(match[up_idx] - gap_open, insert_row[up_idx] - gap_extend),
-                                  insert_col[up_idx] - gap_open);
+            insert_row[idx] = saturate(max(max(match[up_idx] - gap_open, insert_row[up_idx] - gap_extend),
+                                           insert_col[up_idx] - gap_open));
             
             if (bottom_diag_outside) {
                 // along the bottom edge of the matrix, so the cell to the right is still there
-                left_idx = iter_stop * ncols + (j - 1);
-                insert_col[idx] = max(max(match[left_idx] - gap_open, insert_row[left_idx] - gap_open),
-                                      insert_col[left_idx] - gap_extend);
+                left_idx = (j - 1) * band_height + iter_stop;
+                insert_col[idx] = saturate(max(max(match[left_idx] - gap_open, insert_row[left_idx] - gap_open),
+                                               insert_col[left_idx] - gap_extend));
                 
             }
             else {
@@ -782,7 +1065,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
         }
         
         // find optimal traceback
-        idx = i * ncols + j;
+        idx = j * band_height + i;
         bool found_trace = false;
         switch (curr_mat) {
             case Match:
@@ -800,7 +1083,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
                 }
                 
                 curr_score = match[idx];
-                next_idx = i * ncols + j - 1;
+                next_idx = (j - 1) * band_height + i;
                 
                 IntType match_score;
                 if (qual_adjusted) {
@@ -888,7 +1171,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
                 }
                 
                 curr_score = insert_row[idx];
-                next_idx = (i - 1) * ncols + j;
+                next_idx = j * band_height + i - 1;
                 
                 source_score = match[next_idx];
                 score_diff = curr_score - (source_score - gap_open);
@@ -947,7 +1230,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
                 }
                 
                 curr_score = insert_col[idx];
-                next_idx = (i + 1) * ncols + j - 1;
+                next_idx = (j - 1) * band_height + i + 1;
 
                 source_score = match[next_idx];
                 score_diff = curr_score - (source_score - gap_open);
@@ -1203,7 +1486,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
         switch (curr_mat) {
             case Match:
             {
-                curr_score = match[i * ncols];
+                curr_score = match[i];
                 if (qual_adjusted) {
                     match_score = score_mat[25 * base_quality[i + top_diag] + 5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag]]];
                 }
@@ -1215,7 +1498,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
                 
             case InsertCol:
             {
-                curr_score = insert_col[i * ncols];
+                curr_score = insert_col[i];
                 break;
             }
                 
@@ -1294,7 +1577,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
             
             int64_t seed_col = seed_ncols - 1;
             int64_t seed_row = -(seed_extended_top_diag - top_diag) + i + (curr_mat == InsertCol);
-            next_idx = seed_row * seed_ncols + seed_col;
+            next_idx = seed_col * (seed->bottom_diag - seed->top_diag + 1) + seed_row;
             
 #ifdef debug_banded_aligner_traceback
             cerr << "[BAMatrix::traceback_internal] checking seed rectangular coordinates (" << seed_row << ", " << seed_col << "), with indices calculated from current diagonal " << curr_diag << " (top diag " << top_diag << " + offset " << i << "), seed top diagonal " << seed->top_diag << ", seed seq length " << seed_ncols << " with insert column offset " << (curr_mat == InsertCol) << endl;
@@ -1670,6 +1953,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::print_matrix(matrix_t which_mat) {
     }
     cerr << endl;
     
+    int64_t band_height = bottom_diag - top_diag + 1;
     int64_t ncols = node_seq.length();
     
     for (int64_t i = 0; i < (int64_t) read.length(); i++) {
@@ -1680,7 +1964,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::print_matrix(matrix_t which_mat) {
                 cerr << "\t.";
             }
             else {
-                cerr << "\t" << (int) band_rect[(diag - top_diag) * ncols + j];
+                cerr << "\t" << (int) band_rect[j * band_height + diag - top_diag];
             }
         }
         cerr << endl;
@@ -1735,7 +2019,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::print_band(matrix_t which_mat) {
                 cerr << "\t.";
             }
             else {
-                cerr << "\t" << (int) band_rect[i * ncols + j];
+                cerr << "\t" << (int) band_rect[j * band_height + i];
             }
         }
         cerr << endl;
@@ -2225,12 +2509,55 @@ void BandedGlobalAligner<IntType>::shortest_seq_paths(vector<vector<int64_t>>& n
 template <class IntType>
 void BandedGlobalAligner<IntType>::align(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend) {
     
-    // small enough number to never be accepted in alignment but also not trigger underflow
+    IntType min_inf = fill_matrices(score_mat, nt_table, gap_open, gap_extend);
+    traceback(score_mat, nt_table, gap_open, gap_extend, min_inf);
+}
+
+template <class IntType>
+bool BandedGlobalAligner<IntType>::align_if_fits(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend) {
+    
+    IntType min_inf = fill_matrices(score_mat, nt_table, gap_open, gap_extend);
+    
+    for (BAMatrix* band_matrix : banded_matrices) {
+        if (band_matrix != nullptr && band_matrix->is_saturated()) {
+#ifdef debug_banded_aligner_fill_matrix
+            cerr << "[BandedGlobalAligner::align_if_fits] scores saturated on node " << band_matrix->node->id() << ", not tracing back" << endl;
+#endif
+            return false;
+        }
+    }
+    
+    traceback(score_mat, nt_table, gap_open, gap_extend, min_inf);
+    return true;
+}
+
+template <class IntType>
+IntType BandedGlobalAligner<IntType>::fill_matrices(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend) {
+    
+    // small enough number to never be accepted in alignment but also not trigger underflow, with
+    // one to spare so that a single penalty from it doesn't reach the limit and look like saturation
     IntType max_mismatch = numeric_limits<IntType>::max();
     for (int i = 0; i < 25; i++) {
         max_mismatch = min<IntType>(max_mismatch, score_mat[i]);
     }
-    IntType min_inf = numeric_limits<IntType>::min() + max<IntType>((IntType) -max_mismatch, max<IntType>(gap_open, gap_extend));
+    IntType min_inf = numeric_limits<IntType>::min() + max<IntType>((IntType) -max_mismatch, max<IntType>(gap_open, gap_extend)) + 1;
+    
+    // parts of a band that can't be reached from a source still get scores, built up from min_inf.
+    // each read base can add at most the best match score to them, so any score above this limit
+    // must be a real one. below it, a real score could have lost out to one of the built up scores,
+    // which it never would with a wide enough IntType, so we flag the scores there as saturated
+    int64_t max_match = 0;
+    int64_t max_quality = 0;
+    if (adjust_for_base_quality) {
+        for (char quality : alignment.quality()) {
+            max_quality = max<int64_t>(max_quality, quality);
+        }
+    }
+    for (int64_t i = 0; i < 25 * (max_quality + 1); i++) {
+        max_match = max<int64_t>(max_match, score_mat[i]);
+    }
+    IntType low_limit = min<int64_t>(min_inf + max_match * (int64_t) alignment.sequence().size(),
+                                     numeric_limits<IntType>::max() - 1);
     
     
     // fill each nodes matrix in topological order
@@ -2239,23 +2566,24 @@ void BandedGlobalAligner<IntType>::align(int8_t* score_mat, int8_t* nt_table, in
         int64_t node_idx = node_id_to_idx.at(node->id());
         BAMatrix* band_matrix = banded_matrices[node_idx];
 #ifdef debug_banded_aligner_fill_matrix
-        cerr << "[BandedGlobalAligner::align] checking node " << node->id() << " at index " << node_idx << " with sequence " << node->sequence() << " and topological position " << i << endl;
+        cerr << "[BandedGlobalAligner::fill_matrices] checking node " << node->id() << " at index " << node_idx << " with sequence " << node->sequence() << " and topological position " << i << endl;
 #endif
         
         // skip masked nodes
         if (band_matrix == nullptr) {
 #ifdef debug_banded_aligner_fill_matrix
-            cerr << "[BandedGlobalAligner::align] node is masked, skipping" << endl;
+            cerr << "[BandedGlobalAligner::fill_matrices] node is masked, skipping" << endl;
 #endif
             continue;
         }
 #ifdef debug_banded_aligner_fill_matrix
-        cerr << "[BandedGlobalAligner::align] node is not masked, filling matrix" << endl;
+        cerr << "[BandedGlobalAligner::fill_matrices] node is not masked, filling matrix" << endl;
 #endif
-        band_matrix->fill_matrix(score_mat, nt_table, gap_open, gap_extend, adjust_for_base_quality, min_inf);
+        band_matrix->fill_matrix(score_mat, nt_table, gap_open, gap_extend, adjust_for_base_quality, min_inf,
+                                 low_limit);
     }
     
-    traceback(score_mat, nt_table, gap_open, gap_extend, min_inf);
+    return min_inf;
 }
 
 template <class IntType>
@@ -2406,7 +2734,7 @@ BandedGlobalAligner<IntType>::AltTracebackStack::AltTracebackStack(int64_t max_m
                 int64_t final_col = ncols - 1;
                 int64_t final_row = band_matrix->bottom_diag + ncols > read_length ? read_length - band_matrix->top_diag - ncols : band_matrix->bottom_diag - band_matrix->top_diag;
                 
-                int64_t final_idx = final_row * ncols + final_col;
+                int64_t final_idx = final_col * (band_matrix->bottom_diag - band_matrix->top_diag + 1) + final_row;
                 
                 if (band_matrix->alignment.sequence().empty()) {
                     // if the read sequence is empty then we can only insert relative to the graph
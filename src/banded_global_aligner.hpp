@@ -32,6 +32,14 @@ namespace vg {
         static const string message;
     };
     
+    /// Allow or forbid filling banded global alignment matrices with vector instructions. They are
+    /// allowed by default, and only used for 8 and 16 bit scores on CPUs with SSE4.1 or AVX2.
+    void set_banded_global_simd(bool allowed);
+    
+    /// Name of the instruction set banded global alignment currently fills matrices with:
+    /// "avx2", "sse4.1" or "scalar"
+    const char* banded_global_simd_kernel();
+    
     /**
      * The outward-facing interface for banded global graph alignment. It computes optimal alignment
      * of a DNA sequence to a DAG with POA. The alignment will start at any source node in the graph and
@@ -91,6 +99,13 @@ namespace vg {
         ///              use QualAdjAligner's scaled penalty)
         void align(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend);
         
+        /// Like align(), but gives up and returns false if any score got too close to the limits of
+        /// IntType, in which case the alignment may not be the one a wider IntType would find and
+        /// should be redone with one. Leaves the alignment objects untouched if it gives up, and
+        /// returns true otherwise.
+        ///
+        /// Note: the check is conservative, so this can give up on alignments that would have fit
+        bool align_if_fits(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend);
         
     private:
         
@@ -128,6 +143,9 @@ namespace vg {
                             int64_t band_padding, bool permissive_banding = false,
                             bool adjust_for_base_quality = false);
         
+        /// Fill the dynamic programming matrices of all nodes and return the score used as -infinity
+        IntType fill_matrices(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend);
+        
         /// Traceback through dynamic programming matrices to compute alignment
         void traceback(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend, IntType min_inf);
         
@@ -159,9 +177,13 @@ namespace vg {
                  BAMatrix** seeds, int64_t num_seeds, int64_t cumulative_seq_len);
         ~BAMatrix();
         
-        /// Use DP to fill the band with alignment scores
+        /// Use DP to fill the band with alignment scores. Scores that come out above IntType's maximum or
+        /// at or below low_limit (other than min_inf itself) mark the matrix as saturated.
         void fill_matrix(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend, bool qual_adjusted,
-                         IntType min_inf);
+                         IntType min_inf, IntType low_limit);
+        
+        /// Did any score get too close to the limits of IntType while filling the band? See fill_matrix().
+        bool is_saturated() const { return saturated; }
         
         /// Traceback through the band after using DP to fill it
         void traceback(BABuilder& builder, AltTracebackStack& traceback_stack, matrix_t start_mat, int8_t* score_mat,
@@ -196,6 +218,9 @@ namespace vg {
         /// DP matrix
         IntType* insert_row;
         
+        /// Might the last fill have computed a score that doesn't match what a wider IntType would get?
+        bool saturated;
+        
         void traceback_internal(BABuilder& builder, AltTracebackStack& traceback_stack, int64_t start_row,
                                 int64_t start_col, matrix_t start_mat, bool in_lead_gap, int8_t* score_mat,
                                 int8_t* nt_table, int8_t gap_open, int8_t gap_extend, bool qual_adjusted,
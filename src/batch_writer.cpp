@@ -0,0 +1,101 @@
+#include "batch_writer.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+
+namespace stream {
+
+using namespace std;
+
+BatchWriter::BatchWriter(ostream& out, bool ordered, size_t max_backlog) : out(out), ordered(ordered),
+    max_backlog(max(max_backlog, (size_t) 1)) {
+    writer_thread = thread(&BatchWriter::write_loop, this);
+}
+
+BatchWriter::~BatchWriter() {
+    if (!finished) {
+        // Don't throw from a destructor; just get everything out that we can.
+        {
+            lock_guard<mutex> lock(queue_mutex);
+            finishing = true;
+        }
+        data_ready.notify_all();
+        writer_thread.join();
+    }
+}
+
+void BatchWriter::submit(size_t batch_number, string&& data) {
+    unique_lock<mutex> lock(queue_mutex);
+    if (ordered) {
+        // Only hold up batches too far ahead of the one the writer is waiting
+        // for. That bounds the backlog, and the batch we need next can always
+        // get in.
+        space_ready.wait(lock, [&]() {
+            return batch_number < next_batch + max_backlog;
+        });
+        ordered_queue.emplace(batch_number, std::move(data));
+    } else {
+        space_ready.wait(lock, [&]() {
+            return unordered_queue.size() < max_backlog;
+        });
+        unordered_queue.emplace_back(std::move(data));
+    }
+    lock.unlock();
+    data_ready.notify_one();
+}
+
+void BatchWriter::finish() {
+    if (finished) {
+        return;
+    }
+    {
+        lock_guard<mutex> lock(queue_mutex);
+        finishing = true;
+    }
+    data_ready.notify_all();
+    writer_thread.join();
+    finished = true;
+
+    if (!ordered_queue.empty()) {
+        throw runtime_error("[stream::BatchWriter] batch " + to_string(next_batch) + " was never submitted");
+    }
+    out.flush();
+}
+
+void BatchWriter::write_loop() {
+    unique_lock<mutex> lock(queue_mutex);
+    while (true) {
+        // Wait for something we can write
+        data_ready.wait(lock, [&]() {
+            return finishing || !unordered_queue.empty() ||
+                (!ordered_queue.empty() && ordered_queue.begin()->first == next_batch);
+        });
+
+        // Take everything we can write right now
+        deque<string> to_write;
+        if (ordered) {
+            while (!ordered_queue.empty() && ordered_queue.begin()->first == next_batch) {
+                to_write.emplace_back(std::move(ordered_queue.begin()->second));
+                ordered_queue.erase(ordered_queue.begin());
+                next_batch++;
+            }
+        } else {
+            to_write.swap(unordered_queue);
+        }
+
+        if (to_write.empty() && finishing) {
+            // Nothing else is coming
+            break;
+        }
+
+        // Write without holding the lock, so workers can keep submitting
+        lock.unlock();
+        space_ready.notify_all();
+        for (auto& data : to_write) {
+            out.write(data.data(), data.size());
+        }
+        lock.lock();
+    }
+}
+
+}
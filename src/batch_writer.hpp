@@ -0,0 +1,83 @@
+#ifndef VG_BATCH_WRITER_HPP_INCLUDED
+#define VG_BATCH_WRITER_HPP_INCLUDED
+
+/** \file
+ *
+ * Provides a writer stage for multithreaded pipelines. Worker threads encode
+ * (serialize and compress) their own batches of output, and hand the finished
+ * bytes to a BatchWriter, which writes them out from a dedicated thread. No
+ * worker ever holds a lock while compressing or doing I/O.
+ */
+
+#include <iostream>
+#include <string>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace stream {
+
+using namespace std;
+
+class BatchWriter {
+public:
+
+    /// Make a writer that writes batches to the given stream. If ordered is
+    /// set, batches are written in order of their batch numbers, which must
+    /// count up from 0 with no gaps. Otherwise they are written as they come
+    /// in. To bound memory use, submitting threads block once max_backlog
+    /// batches are waiting, or, in ordered mode, when their batch is
+    /// max_backlog or more ahead of the next one to write. In ordered mode,
+    /// the producer must never start a batch max_backlog or more ahead of one
+    /// that isn't submitted yet, or every worker can end up blocked here; the
+    /// batched parallel readers in alignment.hpp keep within
+    /// max_batches_in_flight().
+    BatchWriter(ostream& out, bool ordered = false, size_t max_backlog = 256);
+
+    /// Write out everything still waiting and stop the writer thread.
+    ~BatchWriter();
+
+    /// Hand over the encoded bytes for a batch. In ordered mode, every batch
+    /// number must be submitted exactly once, even if its data is empty.
+    /// Thread safe.
+    void submit(size_t batch_number, string&& data);
+
+    /// Wait until everything submitted has been written, and stop the writer
+    /// thread. Throws if not all batches were submitted in ordered mode. No
+    /// more batches may be submitted afterward.
+    void finish();
+
+private:
+
+    /// Run the writer thread
+    void write_loop();
+
+    ostream& out;
+    bool ordered;
+    size_t max_backlog;
+
+    mutex queue_mutex;
+    /// Signaled when there is something new to write, or we are finishing
+    condition_variable data_ready;
+    /// Signaled when the backlog shrinks
+    condition_variable space_ready;
+
+    /// Batches waiting to be written in unordered mode
+    deque<string> unordered_queue;
+    /// Batches waiting to be written in ordered mode, by batch number
+    map<size_t, string> ordered_queue;
+    /// The next batch number to write in ordered mode
+    size_t next_batch = 0;
+    /// Set when no more batches are coming
+    bool finishing = false;
+    /// Set once finish() has run
+    bool finished = false;
+
+    thread writer_thread;
+};
+
+}
+
+#endif
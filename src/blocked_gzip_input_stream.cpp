@@ -0,0 +1,311 @@
+#include "blocked_gzip_input_stream.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+namespace stream {
+
+using namespace std;
+
+/// How much compressed data to read from the istream at a time. Must be at
+/// least the maximum BGZF block size.
+static const size_t INPUT_BUFFER_SIZE = 64 * 1024;
+
+/// Size of the gzip header on a BGZF block
+static const size_t BGZF_HEADER_SIZE = 18;
+
+/// How much decompressed data to buffer at a time. Must be at least 64 KiB so
+/// that the within-member part of any virtual offset is reachable.
+static const size_t OUTPUT_BUFFER_SIZE = 64 * 1024;
+
+BlockedGzipInputStream::BlockedGzipInputStream(std::istream& stream) :
+    handle(stream), seekable(true), in_buffer(INPUT_BUFFER_SIZE), in_buffer_start(0),
+    in_buffer_size(0), out_buffer(OUTPUT_BUFFER_SIZE), out_size(0), out_cursor(0),
+    member_start(0), member_offset(0), member_finished(false), byte_count(0) {
+
+    zstream.zalloc = Z_NULL;
+    zstream.zfree = Z_NULL;
+    zstream.opaque = Z_NULL;
+    zstream.next_in = Z_NULL;
+    zstream.avail_in = 0;
+    // Accept either gzip or zlib headers
+    if (inflateInit2(&zstream, 15 + 32) != Z_OK) {
+        throw runtime_error("[stream::BlockedGzipInputStream] could not initialize zlib");
+    }
+
+    // See where we are starting, if the stream can tell us.
+    int64_t start = handle.tellg();
+    if (start < 0) {
+        // We can't seek, but we can still count offsets from where we started.
+        seekable = false;
+        start = 0;
+        handle.clear();
+    }
+    reset_to(start);
+}
+
+BlockedGzipInputStream::~BlockedGzipInputStream() {
+    inflateEnd(&zstream);
+}
+
+bool BlockedGzipInputStream::Next(const void** data, int* size) {
+    if (out_cursor == out_size) {
+        // We need more data
+        if (!fill_buffer()) {
+            return false;
+        }
+    }
+
+    // Hand out everything we have
+    *data = (const void*) (out_buffer.data() + out_cursor);
+    *size = out_size - out_cursor;
+    byte_count += *size;
+    out_cursor = out_size;
+
+    return true;
+}
+
+void BlockedGzipInputStream::BackUp(int count) {
+    assert((size_t) count <= out_cursor);
+    out_cursor -= count;
+    byte_count -= count;
+}
+
+bool BlockedGzipInputStream::Skip(int count) {
+    while (count > 0) {
+        const void* data;
+        int size;
+        if (!Next(&data, &size)) {
+            // Ran out of data
+            return false;
+        }
+        if (size > count) {
+            // Give back what we don't want to skip
+            BackUp(size - count);
+            count = 0;
+        } else {
+            count -= size;
+        }
+    }
+    return true;
+}
+
+::google::protobuf::int64 BlockedGzipInputStream::ByteCount() const {
+    return byte_count;
+}
+
+int64_t BlockedGzipInputStream::Tell() const {
+    if (out_cursor == out_size && member_finished) {
+        // The next byte will come from the start of the next member, which
+        // begins right after the compressed data we have consumed.
+        return (in_buffer_start + (int64_t) in_buffer_size - (int64_t) zstream.avail_in) << 16;
+    }
+
+    int64_t offset = member_offset + out_cursor;
+    if (offset > 0xffff) {
+        // Too far into the member to express
+        return -1;
+    }
+    return (member_start << 16) | offset;
+}
+
+bool BlockedGzipInputStream::Seek(int64_t virtual_offset) {
+    if (!seekable || virtual_offset < 0) {
+        return false;
+    }
+
+    reset_to(virtual_offset >> 16);
+    if (!handle) {
+        return false;
+    }
+
+    // Get to the right place in the member
+    return Skip(virtual_offset & 0xffff);
+}
+
+bool BlockedGzipInputStream::ReadRawBlocks(std::string& blocks, size_t target_bytes) {
+    if (out_cursor != out_size || !(member_finished || (zstream.total_in == 0 && out_size == 0))) {
+        // We're partway through some decompressed data
+        return false;
+    }
+
+    size_t appended = 0;
+    while (appended < target_bytes) {
+        if (!ensure_input(BGZF_HEADER_SIZE)) {
+            // No complete header here
+            break;
+        }
+
+        const unsigned char* header = (const unsigned char*) zstream.next_in;
+        if (header[0] != 0x1f || header[1] != 0x8b || header[2] != 8 || !(header[3] & 4) ||
+            header[10] != 6 || header[11] != 0 || header[12] != 'B' || header[13] != 'C' ||
+            header[14] != 2 || header[15] != 0) {
+            // This isn't a BGZF block
+            break;
+        }
+
+        size_t block_size = ((size_t) header[16] | ((size_t) header[17] << 8)) + 1;
+        if (!ensure_input(block_size)) {
+            throw runtime_error("[stream::BlockedGzipInputStream] truncated BGZF block");
+        }
+
+        blocks.append((const char*) zstream.next_in, block_size);
+        zstream.next_in += block_size;
+        zstream.avail_in -= block_size;
+        appended += block_size;
+    }
+
+    if (appended > 0) {
+        // We are now between members; the next one starts wherever we stopped.
+        member_finished = true;
+        out_size = 0;
+        out_cursor = 0;
+        return true;
+    }
+    return false;
+}
+
+void BlockedGzipInputStream::InflateBlocks(const std::string& blocks, std::string& data) {
+    z_stream block_stream;
+    block_stream.zalloc = Z_NULL;
+    block_stream.zfree = Z_NULL;
+    block_stream.opaque = Z_NULL;
+    block_stream.next_in = Z_NULL;
+    block_stream.avail_in = 0;
+    if (inflateInit2(&block_stream, 15 + 16) != Z_OK) {
+        throw runtime_error("[stream::BlockedGzipInputStream] could not initialize zlib");
+    }
+
+    size_t cursor = 0;
+    while (cursor < blocks.size()) {
+        const unsigned char* header = (const unsigned char*) blocks.data() + cursor;
+        size_t block_size = ((size_t) header[16] | ((size_t) header[17] << 8)) + 1;
+        // The uncompressed length is the last 4 bytes of the block
+        const unsigned char* footer = header + block_size - 4;
+        size_t length = (size_t) footer[0] | ((size_t) footer[1] << 8) |
+            ((size_t) footer[2] << 16) | ((size_t) footer[3] << 24);
+
+        size_t start = data.size();
+        data.resize(start + length);
+
+        inflateReset(&block_stream);
+        block_stream.next_in = (Bytef*) header;
+        block_stream.avail_in = block_size;
+        block_stream.next_out = (Bytef*) &data[start];
+        block_stream.avail_out = length;
+        int status = inflate(&block_stream, Z_FINISH);
+        if (status != Z_STREAM_END || block_stream.avail_out != 0) {
+            inflateEnd(&block_stream);
+            throw runtime_error("[stream::BlockedGzipInputStream] corrupt BGZF block");
+        }
+
+        cursor += block_size;
+    }
+
+    inflateEnd(&block_stream);
+}
+
+bool BlockedGzipInputStream::ensure_input(size_t bytes) {
+    if (zstream.avail_in >= bytes) {
+        return true;
+    }
+
+    // Move what we have left to the front of the buffer
+    size_t consumed = in_buffer_size - zstream.avail_in;
+    if (zstream.avail_in > 0) {
+        memmove(in_buffer.data(), in_buffer.data() + consumed, zstream.avail_in);
+    }
+    in_buffer_start += consumed;
+    in_buffer_size = zstream.avail_in;
+    if (in_buffer.size() < bytes) {
+        in_buffer.resize(bytes);
+    }
+
+    // And fill in the rest
+    handle.read(in_buffer.data() + in_buffer_size, in_buffer.size() - in_buffer_size);
+    in_buffer_size += handle.gcount();
+    zstream.next_in = (Bytef*) in_buffer.data();
+    zstream.avail_in = in_buffer_size;
+
+    return zstream.avail_in >= bytes;
+}
+
+void BlockedGzipInputStream::reset_to(int64_t compressed_offset) {
+    if (seekable && handle.tellg() != compressed_offset) {
+        handle.clear();
+        handle.seekg(compressed_offset);
+    }
+
+    in_buffer_start = compressed_offset;
+    in_buffer_size = 0;
+    zstream.next_in = (Bytef*) in_buffer.data();
+    zstream.avail_in = 0;
+    inflateReset(&zstream);
+
+    member_start = compressed_offset;
+    member_offset = 0;
+    member_finished = false;
+    out_size = 0;
+    out_cursor = 0;
+}
+
+bool BlockedGzipInputStream::fill_buffer() {
+    assert(out_cursor == out_size);
+
+    // Throw out what has been read
+    member_offset += out_size;
+    out_size = 0;
+    out_cursor = 0;
+
+    while (true) {
+        if (member_finished) {
+            // Start the next member where the last one ended
+            member_start = in_buffer_start + in_buffer_size - zstream.avail_in;
+            member_offset = 0;
+            member_finished = false;
+            inflateReset(&zstream);
+        }
+
+        if (zstream.avail_in == 0) {
+            // Get more compressed data
+            in_buffer_start += in_buffer_size;
+            handle.read(in_buffer.data(), in_buffer.size());
+            in_buffer_size = handle.gcount();
+            zstream.next_in = (Bytef*) in_buffer.data();
+            zstream.avail_in = in_buffer_size;
+
+            if (in_buffer_size == 0) {
+                if (zstream.total_in == 0 && out_size == 0) {
+                    // We ended cleanly between members
+                    return false;
+                }
+                throw runtime_error("[stream::BlockedGzipInputStream] truncated gzip input");
+            }
+        }
+
+        zstream.next_out = (Bytef*) (out_buffer.data() + out_size);
+        zstream.avail_out = out_buffer.size() - out_size;
+
+        int status = inflate(&zstream, Z_NO_FLUSH);
+        out_size = out_buffer.size() - zstream.avail_out;
+
+        if (status == Z_STREAM_END) {
+            // We finished a member. Don't let the buffer span members, so we
+            // can keep track of virtual offsets.
+            member_finished = true;
+            if (out_size > 0) {
+                return true;
+            }
+            // Otherwise this was an empty member (like an EOF marker block) and
+            // we should go on to the next one.
+        } else if (status != Z_OK && status != Z_BUF_ERROR) {
+            throw runtime_error("[stream::BlockedGzipInputStream] corrupt gzip input");
+        } else if (out_size == out_buffer.size()) {
+            // Buffer is full
+            return true;
+        }
+    }
+}
+
+}
@@ -0,0 +1,134 @@
+#ifndef VG_BLOCKED_GZIP_INPUT_STREAM_HPP_INCLUDED
+#define VG_BLOCKED_GZIP_INPUT_STREAM_HPP_INCLUDED
+
+/** \file
+ *
+ * Provides a Protobuf ZeroCopyInputStream that reads multi-member gzip data,
+ * such as BGZF, and can report and seek to BGZF-style virtual offsets.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <zlib.h>
+
+#include "google/protobuf/io/zero_copy_stream.h"
+
+namespace stream {
+
+/**
+ * A ZeroCopyInputStream that decompresses gzip data from a C++ istream. Any
+ * sequence of gzip members can be read; the output of
+ * BlockedGzipOutputStream, where every member is a BGZF block, additionally
+ * supports random access.
+ *
+ * Virtual offsets have the compressed offset of the start of a gzip member in
+ * the high 48 bits and an offset into that member's uncompressed data in the
+ * low 16 bits. A position more than 64 KiB into a member (as can happen in
+ * files written by a plain gzip stream) has no virtual offset.
+ */
+class BlockedGzipInputStream : public ::google::protobuf::io::ZeroCopyInputStream {
+public:
+    /// Make a new stream reading from the given istream.
+    BlockedGzipInputStream(std::istream& stream);
+
+    virtual ~BlockedGzipInputStream();
+
+    // Explicitly specify that we aren't copyable
+    BlockedGzipInputStream(const BlockedGzipInputStream& other) = delete;
+    BlockedGzipInputStream& operator=(const BlockedGzipInputStream& other) = delete;
+
+    /// Get a buffer of decompressed data. Returns false at the end of the
+    /// data. Throws if the data is corrupt.
+    virtual bool Next(const void** data, int* size);
+
+    /// Say that the last count bytes of the most recent buffer were not read.
+    virtual void BackUp(int count);
+
+    /// Skip the given number of bytes. Returns false if the end of the data
+    /// was reached first.
+    virtual bool Skip(int count);
+
+    /// Get the total number of uncompressed bytes read.
+    virtual ::google::protobuf::int64 ByteCount() const;
+
+    /// Get the virtual offset of the next byte to be read, or -1 if it does
+    /// not have one.
+    int64_t Tell() const;
+
+    /// Go to the given virtual offset, which must be at the start of a gzip
+    /// member plus some within-member offset. Returns false if the underlying
+    /// istream can't seek.
+    bool Seek(int64_t virtual_offset);
+
+    /// If the stream is between gzip members and the next member is a BGZF
+    /// block, consume whole BGZF blocks without decompressing them, appending
+    /// their compressed data to the given string, until at least target_bytes
+    /// have been appended or a non-BGZF member or the end of the data is
+    /// reached. Returns false if no blocks could be read, in which case the
+    /// data must be read through Next().
+    bool ReadRawBlocks(std::string& blocks, size_t target_bytes);
+
+    /// Decompress a run of whole BGZF blocks, as produced by ReadRawBlocks(),
+    /// appending the data to the given string. Does not depend on any stream,
+    /// so runs can be decompressed in parallel. Throws if the data is corrupt.
+    static void InflateBlocks(const std::string& blocks, std::string& data);
+
+private:
+    /// Make sure at least the given number of unconsumed compressed bytes are
+    /// in in_buffer, if possible. Returns false if the data ends first.
+    bool ensure_input(size_t bytes);
+
+    /// Decompress more data into the buffer, moving on to the next member as
+    /// needed. Returns false at the end of the data. May only be called when
+    /// the buffer has been completely read.
+    bool fill_buffer();
+
+    /// Put the reader at the start of a member at the given compressed offset,
+    /// with nothing buffered.
+    void reset_to(int64_t compressed_offset);
+
+    /// The istream we read compressed data from
+    std::istream& handle;
+
+    /// Whether we can seek the istream
+    bool seekable;
+
+    /// Compressed data read from the istream and not yet decompressed
+    std::vector<char> in_buffer;
+
+    /// Compressed offset of the start of in_buffer
+    int64_t in_buffer_start;
+
+    /// How much of in_buffer is filled with data
+    size_t in_buffer_size;
+
+    /// Decompressed data
+    std::vector<char> out_buffer;
+
+    /// How much of out_buffer is filled with data
+    size_t out_size;
+
+    /// How much of out_buffer has been handed out
+    size_t out_cursor;
+
+    /// Compressed offset of the member that out_buffer came from
+    int64_t member_start;
+
+    /// Uncompressed offset in the member of the start of out_buffer
+    int64_t member_offset;
+
+    /// Set when we have decompressed through the end of the current member
+    bool member_finished;
+
+    /// Total uncompressed bytes read
+    int64_t byte_count;
+
+    /// The zlib decompression state
+    z_stream zstream;
+};
+
+}
+
+#endif
@@ -0,0 +1,166 @@
+#include "blocked_gzip_output_stream.hpp"
+
+#include <cassert>
+#include <stdexcept>
+#include <zlib.h>
+
+namespace stream {
+
+using namespace std;
+
+/// Size of the fixed BGZF gzip header, including the extra field that holds
+/// the block size.
+static const size_t BGZF_HEADER_SIZE = 18;
+
+/// Size of the gzip footer (CRC32 and uncompressed length)
+static const size_t BGZF_FOOTER_SIZE = 8;
+
+/// Store the low 16 bits of a value at the given location, little-endian.
+static inline void pack_uint16(char* dest, uint16_t value) {
+    dest[0] = (char) (value & 0xff);
+    dest[1] = (char) (value >> 8);
+}
+
+/// Store a 32-bit value at the given location, little-endian.
+static inline void pack_uint32(char* dest, uint32_t value) {
+    for (size_t i = 0; i < 4; i++) {
+        dest[i] = (char) ((value >> (8 * i)) & 0xff);
+    }
+}
+
+BlockedGzipOutputStream::BlockedGzipOutputStream(std::ostream& stream) :
+    handle(stream), buffer(BGZF_BLOCK_DATA_SIZE), buffer_used(0),
+    compressed(BGZF_MAX_BLOCK_SIZE), byte_count(0), block_start(-1), had_error(false) {
+
+    // See where we are starting, if the stream can tell us.
+    block_start = handle.tellp();
+    if (block_start < 0) {
+        // This is a pipe or something; we can't produce virtual offsets.
+        block_start = -1;
+        handle.clear();
+    }
+}
+
+BlockedGzipOutputStream::~BlockedGzipOutputStream() {
+    // Don't lose any buffered data
+    Flush();
+}
+
+bool BlockedGzipOutputStream::Next(void** data, int* size) {
+    if (had_error) {
+        return false;
+    }
+
+    if (buffer_used == buffer.size()) {
+        // We need a new block
+        if (!Flush()) {
+            return false;
+        }
+    }
+
+    // Hand out all the rest of the block
+    *data = (void*) (buffer.data() + buffer_used);
+    *size = buffer.size() - buffer_used;
+    byte_count += *size;
+    buffer_used = buffer.size();
+
+    return true;
+}
+
+void BlockedGzipOutputStream::BackUp(int count) {
+    assert((size_t) count <= buffer_used);
+    buffer_used -= count;
+    byte_count -= count;
+}
+
+::google::protobuf::int64 BlockedGzipOutputStream::ByteCount() const {
+    return byte_count;
+}
+
+int64_t BlockedGzipOutputStream::Tell() const {
+    if (block_start < 0) {
+        return -1;
+    }
+    return (block_start << 16) | (int64_t) buffer_used;
+}
+
+bool BlockedGzipOutputStream::Flush() {
+    if (had_error) {
+        return false;
+    }
+    if (buffer_used > 0) {
+        if (!write_block(buffer.data(), buffer_used)) {
+            return false;
+        }
+        buffer_used = 0;
+    }
+    return true;
+}
+
+bool BlockedGzipOutputStream::EndFile() {
+    // An EOF marker is just a block with nothing in it.
+    return Flush() && write_block(nullptr, 0);
+}
+
+bool BlockedGzipOutputStream::write_block(const char* data, size_t length) {
+    assert(length <= BGZF_BLOCK_DATA_SIZE);
+
+    // Compress the data as a raw deflate stream, after where the header goes
+    z_stream zstream;
+    zstream.zalloc = Z_NULL;
+    zstream.zfree = Z_NULL;
+    zstream.opaque = Z_NULL;
+    if (deflateInit2(&zstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw runtime_error("[stream::BlockedGzipOutputStream] could not initialize zlib");
+    }
+
+    zstream.next_in = (Bytef*) data;
+    zstream.avail_in = length;
+    zstream.next_out = (Bytef*) (compressed.data() + BGZF_HEADER_SIZE);
+    zstream.avail_out = compressed.size() - BGZF_HEADER_SIZE - BGZF_FOOTER_SIZE;
+
+    int status = deflate(&zstream, Z_FINISH);
+    size_t deflated_size = zstream.total_out;
+    deflateEnd(&zstream);
+    if (status != Z_STREAM_END) {
+        // Even incompressible data should fit, because of the limit on
+        // uncompressed block size.
+        throw runtime_error("[stream::BlockedGzipOutputStream] could not compress block");
+    }
+
+    size_t block_size = BGZF_HEADER_SIZE + deflated_size + BGZF_FOOTER_SIZE;
+
+    // Fill in the gzip header, with the BGZF extra field giving the block size
+    char* header = compressed.data();
+    header[0] = (char) 0x1f; // gzip magic
+    header[1] = (char) 0x8b;
+    header[2] = 8; // deflate
+    header[3] = 4; // FEXTRA flag
+    pack_uint32(header + 4, 0); // no modification time
+    header[8] = 0; // no extra flags
+    header[9] = (char) 0xff; // unknown OS
+    pack_uint16(header + 10, 6); // extra field length
+    header[12] = 'B'; // BGZF subfield ID
+    header[13] = 'C';
+    pack_uint16(header + 14, 2); // subfield length
+    pack_uint16(header + 16, block_size - 1); // total block size - 1
+
+    // And the footer
+    char* footer = compressed.data() + BGZF_HEADER_SIZE + deflated_size;
+    pack_uint32(footer, crc32(crc32(0L, Z_NULL, 0), (const Bytef*) data, length));
+    pack_uint32(footer + 4, length);
+
+    handle.write(compressed.data(), block_size);
+    if (!handle) {
+        had_error = true;
+        return false;
+    }
+
+    if (block_start >= 0) {
+        block_start += block_size;
+    }
+
+    return true;
+}
+
+}
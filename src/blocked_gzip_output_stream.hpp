@@ -0,0 +1,102 @@
+#ifndef VG_BLOCKED_GZIP_OUTPUT_STREAM_HPP_INCLUDED
+#define VG_BLOCKED_GZIP_OUTPUT_STREAM_HPP_INCLUDED
+
+/** \file
+ *
+ * Provides a Protobuf ZeroCopyOutputStream that compresses its data as a
+ * series of independent BGZF blocks, so that readers can seek to any block
+ * using BGZF-style virtual offsets.
+ */
+
+#include <iostream>
+#include <vector>
+#include <cstdint>
+
+#include "google/protobuf/io/zero_copy_stream.h"
+
+namespace stream {
+
+/// Largest amount of uncompressed data we will put in a single block. This is
+/// the same limit that htslib's BGZF uses, and it guarantees that the
+/// compressed block always fits in the 16-bit block size field.
+const size_t BGZF_BLOCK_DATA_SIZE = 0xff00;
+
+/// Largest size a whole compressed block, including header and footer, may be.
+const size_t BGZF_MAX_BLOCK_SIZE = 0x10000;
+
+/**
+ * A ZeroCopyOutputStream that writes BGZF-compatible blocked gzip data to a
+ * C++ ostream. Each block is a complete gzip member, so the output is also
+ * readable as a normal multi-member gzip file.
+ *
+ * Virtual offsets are 64-bit values with the compressed offset of the start of
+ * a block in the high 48 bits and the offset of a byte in the block's
+ * uncompressed data in the low 16 bits.
+ *
+ * Any partially filled block is written out when the stream is destroyed.
+ */
+class BlockedGzipOutputStream : public ::google::protobuf::io::ZeroCopyOutputStream {
+public:
+    /// Make a new stream writing to the given ostream. If the ostream knows
+    /// its position, virtual offsets will be available through Tell().
+    BlockedGzipOutputStream(std::ostream& stream);
+
+    /// Destroy the stream, writing out any buffered data as a final block.
+    virtual ~BlockedGzipOutputStream();
+
+    // Explicitly specify that we aren't copyable
+    BlockedGzipOutputStream(const BlockedGzipOutputStream& other) = delete;
+    BlockedGzipOutputStream& operator=(const BlockedGzipOutputStream& other) = delete;
+
+    /// Get a buffer to write to. Returns false on an I/O error.
+    virtual bool Next(void** data, int* size);
+
+    /// Say that the last count bytes of the most recent buffer were not used.
+    virtual void BackUp(int count);
+
+    /// Get the total number of uncompressed bytes written.
+    virtual ::google::protobuf::int64 ByteCount() const;
+
+    /// Get the virtual offset at which the next byte written will appear, or
+    /// -1 if the position of the underlying ostream is unknown.
+    int64_t Tell() const;
+
+    /// Write out any buffered data as a block, so that the next byte written
+    /// starts a new block. Returns false on an I/O error.
+    bool Flush();
+
+    /// Write an empty BGZF block, which htslib uses to mark the end of a file.
+    /// Returns false on an I/O error.
+    bool EndFile();
+
+private:
+    /// Compress the given data and write it out as a single block. Returns
+    /// false on an I/O error.
+    bool write_block(const char* data, size_t length);
+
+    /// The ostream we write compressed blocks to
+    std::ostream& handle;
+
+    /// Uncompressed data for the block we are building
+    std::vector<char> buffer;
+
+    /// How many bytes of the buffer are actually in use
+    size_t buffer_used;
+
+    /// Scratch space for compressed blocks
+    std::vector<char> compressed;
+
+    /// Total uncompressed bytes written
+    int64_t byte_count;
+
+    /// Compressed offset at which the block we are building will start, or
+    /// -1 if unknown
+    int64_t block_start;
+
+    /// Set if we had an error writing
+    bool had_error;
+};
+
+}
+
+#endif
@@ -8,6 +8,7 @@ void build_gcsa_lcp(VG& graph,
                     int kmer_size,
                     size_t doubling_steps,
                     size_t size_limit,
+                    size_t kmer_memory_limit,
                     const string& base_file_name) {
     id_t max_id=0;
     graph.for_each_handle([&max_id,&graph](const handle_t& h) { max_id = max(graph.get_id(h), max_id); });
@@ -23,10 +24,19 @@ void build_gcsa_lcp(VG& graph,
 
     // Generate the kmers and reduce the size limit by their size.
     size_t kmer_bytes = params.getLimitBytes();
-    string tmpfile = write_gcsa_kmers_to_tmpfile(graph, kmer_size,
-                                                 kmer_bytes,
-                                                 head_id, tail_id,
-                                                 base_file_name);
+    string tmpfile;
+    try {
+        tmpfile = write_gcsa_kmers_to_tmpfile(graph, kmer_size,
+                                              kmer_bytes,
+                                              head_id, tail_id,
+                                              base_file_name,
+                                              kmer_memory_limit);
+    } catch (...) {
+        // leave the graph as we found it
+        graph.destroy_node(head_node);
+        graph.destroy_node(tail_node);
+        throw;
+    }
     params.reduceLimit(kmer_bytes);
 
     graph.destroy_node(head_node);
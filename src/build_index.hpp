@@ -19,12 +19,17 @@ namespace vg {
 
 using namespace std;
 
+/// Build the GCSA2 and LCP indexes of the graph. size_limit is the GCSA2 disk
+/// limit in gigabytes, and kmer_memory_limit is roughly how many bytes of
+/// kmers are held in memory while writing them. Throws a runtime_error if the
+/// kmers can't be written.
 void build_gcsa_lcp(VG& graph,
                     gcsa::GCSA*& gcsa,
                     gcsa::LCPArray*& lcp,
                     int kmer_size,
                     size_t doubling_steps = 3,
                     size_t size_limit = 500,
+                    size_t kmer_memory_limit = 1024 * 1024 * 1024,
                     const string& base_file_name = "vg-kmers-tmp-");
 
 }
@@ -1,4 +1,5 @@
 #include "cached_position.hpp"
+#include "xg_position.hpp"
 
 namespace vg {
 
@@ -15,9 +16,7 @@ Node xg_cached_node(id_t id, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache) {
 vector<Edge> xg_cached_edges_of(id_t id, xg::XG* xgidx, LRUCache<id_t, vector<Edge> >& edge_cache) {
     pair<vector<Edge>, bool> cached = edge_cache.retrieve(id);
     if(!cached.second) {
-        for (auto& edge : xgidx->edges_of(id)) {
-            cached.first.push_back(edge);
-        }
+        cached.first = xgidx->edges_of(id);
         edge_cache.put(id, cached.first);
     }
     return cached.first;
@@ -99,127 +98,33 @@ char xg_cached_pos_char(pos_t pos, xg::XG* xgidx, LRUCache<id_t, Node>& node_cac
     }
 }
 
-map<pos_t, char> xg_cached_next_pos_chars(pos_t pos, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache, LRUCache<id_t, vector<Edge> >& edge_cache) {
+map<pos_t, char> xg_cached_next_pos_chars(pos_t pos, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache) {
 
     map<pos_t, char> nexts;
-    // See if the node is cached (did we just visit it?)
-    pair<Node, bool> cached = node_cache.retrieve(id(pos));
-    if(!cached.second) {
-        // If it's not in the cache, put it in
-        cached.first = xgidx->node(id(pos));
-        node_cache.put(id(pos), cached.first);
-    }
-    Node& node = cached.first;
+    handle_t handle = xgidx->get_handle(id(pos), is_rev(pos));
     // if we are still in the node, return the next position and character
-    if (offset(pos) < node.sequence().size()-1) {
+    if (offset(pos) < xgidx->get_length(handle)-1) {
         ++get_offset(pos);
         nexts[pos] = xg_cached_pos_char(pos, xgidx, node_cache);
     } else {
-        // helper
-        auto is_inverting = [](const Edge& e) {
-            return !(e.from_start() == e.to_end())
-            && (e.from_start() || e.to_end());
-        };
-        // check our cache
-        pair<vector<Edge>, bool> cached = edge_cache.retrieve(id(pos));
-        if(!cached.second) {
-            // If it's not in the cache, put it in
-            for (auto& edge : xgidx->edges_of(id(pos))) {
-                cached.first.push_back(edge);
-            }
-            edge_cache.put(id(pos), cached.first);
-        }
-        auto& edges = cached.first;
-        // look at the next positions we could reach
-        if (!is_rev(pos)) {
-            // we are on the forward strand, the next things from this node come off the end
-            for (auto& edge : edges) {
-                if((edge.to() == id(pos) && edge.to_end()) || (edge.from() == id(pos) && !edge.from_start())) {
-                    id_t nid = (edge.from() == id(pos) ?
-                                edge.to()
-                                : edge.from());
-                    pos_t p = make_pos_t(nid, is_inverting(edge), 0);
-                    nexts[p] = xg_cached_pos_char(p, xgidx, node_cache);
-                }
-            }
-        } else {
-            // we are on the reverse strand, the next things from this node come off the start
-            for (auto& edge : edges) {
-                if((edge.to() == id(pos) && !edge.to_end()) || (edge.from() == id(pos) && edge.from_start())) {
-                    id_t nid = (edge.to() == id(pos) ?
-                                edge.from()
-                                : edge.to());
-                    pos_t p = make_pos_t(nid, !is_inverting(edge), 0);
-                    nexts[p] = xg_cached_pos_char(p, xgidx, node_cache);
-                }
-            }
-        }
+        // look at the next positions we could reach off the end of the node
+        // in our orientation; walking the graph vector is cheaper than
+        // copying a cached edge list
+        xgidx->follow_edges_inline(handle, false, [&](const handle_t& next) {
+            pos_t p = make_pos_t(xgidx->get_id(next), xgidx->get_is_reverse(next), 0);
+            nexts[p] = xg_cached_pos_char(p, xgidx, node_cache);
+            return true;
+        });
     }
     return nexts;
 }
 
-set<pos_t> xg_cached_next_pos(pos_t pos, bool whole_node, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache, LRUCache<id_t, vector<Edge> >& edge_cache) {
-    set<pos_t> nexts;
-    // See if the node is cached (did we just visit it?)
-    pair<Node, bool> cached = node_cache.retrieve(id(pos));
-    if(!cached.second) {
-        // If it's not in the cache, put it in
-        cached.first = xgidx->node(id(pos));
-        node_cache.put(id(pos), cached.first);
-    }
-    Node& node = cached.first;
-    // if we are still in the node, return the next position and character
-    if (!whole_node && offset(pos) < node.sequence().size()-1) {
-        ++get_offset(pos);
-        nexts.insert(pos);
-    } else {
-        // helper
-        auto is_inverting = [](const Edge& e) {
-            return !(e.from_start() == e.to_end())
-            && (e.from_start() || e.to_end());
-        };
-        // check our cache
-        pair<vector<Edge>, bool> cached = edge_cache.retrieve(id(pos));
-        if(!cached.second) {
-            // If it's not in the cache, put it in
-            for (auto& edge : xgidx->edges_of(id(pos))) {
-                cached.first.push_back(edge);
-            }
-            edge_cache.put(id(pos), cached.first);
-        }
-        auto& edges = cached.first;
-        // look at the next positions we could reach
-        if (!is_rev(pos)) {
-            // we are on the forward strand, the next things from this node come off the end
-            for (auto& edge : edges) {
-                if((edge.to() == id(pos) && edge.to_end()) || (edge.from() == id(pos) && !edge.from_start())) {
-                    id_t nid = (edge.from() == id(pos) ?
-                                edge.to()
-                                : edge.from());
-                    nexts.insert(make_pos_t(nid, is_inverting(edge), 0));
-                }
-            }
-        } else {
-            // we are on the reverse strand, the next things from this node come off the start
-            for (auto& edge : edges) {
-                if((edge.to() == id(pos) && !edge.to_end()) || (edge.from() == id(pos) && edge.from_start())) {
-                    id_t nid = (edge.to() == id(pos) ?
-                                edge.from()
-                                : edge.to());
-                    nexts.insert(make_pos_t(nid, !is_inverting(edge), 0));
-                }
-            }
-        }
-    }
-    return nexts;
-}
-
-int64_t xg_cached_distance(pos_t pos1, pos_t pos2, int64_t maximum, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache, LRUCache<id_t, vector<Edge> >& edge_cache) {
+int64_t xg_cached_distance(pos_t pos1, pos_t pos2, int64_t maximum, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache) {
     //cerr << "distance from " << pos1 << " to " << pos2 << endl;
     if (pos1 == pos2) return 0;
     int64_t adj = (offset(pos1) == xg_cached_node_length(id(pos1), xgidx, node_cache) ? 0 : 1);
     set<pos_t> seen;
-    set<pos_t> nexts = xg_cached_next_pos(pos1, false, xgidx, node_cache, edge_cache);
+    set<pos_t> nexts = xg_next_pos(pos1, false, xgidx);
     int64_t distance = 0;
     while (!nexts.empty()) {
         set<pos_t> todo;
@@ -233,7 +138,7 @@ int64_t xg_cached_distance(pos_t pos1, pos_t pos2, int64_t maximum, xg::XG* xgid
                 if (make_pos_t(id(next), is_rev(next), offset(next)+1) == pos2) {
                     return distance+adj+1;
                 }
-                for (auto& x : xg_cached_next_pos(next, false, xgidx, node_cache, edge_cache)) {
+                for (auto& x : xg_next_pos(next, false, xgidx)) {
                     todo.insert(x);
                 }
             }
@@ -247,7 +152,7 @@ int64_t xg_cached_distance(pos_t pos1, pos_t pos2, int64_t maximum, xg::XG* xgid
     return numeric_limits<int64_t>::max();
 }
 
-set<pos_t> xg_cached_positions_bp_from(pos_t pos, int64_t distance, bool rev, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache, LRUCache<id_t, vector<Edge> >& edge_cache) {
+set<pos_t> xg_cached_positions_bp_from(pos_t pos, int64_t distance, bool rev, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache) {
     // handle base case
     //size_t xg_cached_node_length(id_t id, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache);
     if (rev) {
@@ -259,7 +164,7 @@ set<pos_t> xg_cached_positions_bp_from(pos_t pos, int64_t distance, bool rev, xg
         //return positions;
     } else {
         set<pos_t> seen;
-        set<pos_t> nexts = xg_cached_next_pos(pos, false, xgidx, node_cache, edge_cache);
+        set<pos_t> nexts = xg_next_pos(pos, false, xgidx);
         int64_t walked = 0;
         while (!nexts.empty()) {
             if (walked+1 == distance) {
@@ -272,7 +177,7 @@ set<pos_t> xg_cached_positions_bp_from(pos_t pos, int64_t distance, bool rev, xg
             for (auto& next : nexts) {
                 if (!seen.count(next)) {
                     seen.insert(next);
-                    for (auto& x : xg_cached_next_pos(next, false, xgidx, node_cache, edge_cache)) {
+                    for (auto& x : xg_next_pos(next, false, xgidx)) {
                         todo.insert(x);
                     }
                 }
@@ -293,4 +198,95 @@ set<pos_t> xg_cached_positions_bp_from(pos_t pos, int64_t distance, bool rev, xg
 }
 
 
+shared_ptr<const CachedNode> xg_cached_node(id_t id, xg::XG* xgidx, NodeCache& node_cache) {
+    return node_cache.get_or_make(id, [&]() {
+        CachedNode decoded;
+        handle_t handle = xgidx->get_handle(id, false);
+        decoded.sequence = xgidx->get_sequence(handle);
+        xgidx->follow_edges_inline(handle, false, [&](const handle_t& next) {
+            decoded.next_forward.push_back(make_pos_t(xgidx->get_id(next), xgidx->get_is_reverse(next), 0));
+            return true;
+        });
+        xgidx->follow_edges_inline(xgidx->flip(handle), false, [&](const handle_t& next) {
+            decoded.next_reverse.push_back(make_pos_t(xgidx->get_id(next), xgidx->get_is_reverse(next), 0));
+            return true;
+        });
+        return decoded;
+    });
+}
+
+size_t xg_cached_node_length(id_t id, xg::XG* xgidx, NodeCache& node_cache) {
+    return xg_cached_node(id, xgidx, node_cache)->sequence.size();
+}
+
+char xg_cached_pos_char(pos_t pos, xg::XG* xgidx, NodeCache& node_cache) {
+    auto node = xg_cached_node(id(pos), xgidx, node_cache);
+    if (is_rev(pos)) {
+        return reverse_complement(node->sequence.at(node->sequence.size() - offset(pos) - 1));
+    } else {
+        return node->sequence.at(offset(pos));
+    }
+}
+
+map<pos_t, char> xg_cached_next_pos_chars(pos_t pos, xg::XG* xgidx, NodeCache& node_cache) {
+    map<pos_t, char> nexts;
+    auto node = xg_cached_node(id(pos), xgidx, node_cache);
+    // if we are still in the node, return the next position and character
+    if (offset(pos) < node->sequence.size()-1) {
+        ++get_offset(pos);
+        nexts[pos] = xg_cached_pos_char(pos, xgidx, node_cache);
+    } else {
+        for (auto& next : (is_rev(pos) ? node->next_reverse : node->next_forward)) {
+            nexts[next] = xg_cached_pos_char(next, xgidx, node_cache);
+        }
+    }
+    return nexts;
+}
+
+set<pos_t> xg_cached_next_pos(pos_t pos, bool whole_node, xg::XG* xgidx, NodeCache& node_cache) {
+    set<pos_t> nexts;
+    auto node = xg_cached_node(id(pos), xgidx, node_cache);
+    // if we are still in the node, return the next position
+    if (!whole_node && offset(pos) < node->sequence.size()-1) {
+        ++get_offset(pos);
+        nexts.insert(pos);
+    } else {
+        auto& next_positions = (is_rev(pos) ? node->next_reverse : node->next_forward);
+        nexts.insert(next_positions.begin(), next_positions.end());
+    }
+    return nexts;
+}
+
+int64_t xg_cached_distance(pos_t pos1, pos_t pos2, int64_t maximum, xg::XG* xgidx, NodeCache& node_cache) {
+    if (pos1 == pos2) return 0;
+    int64_t adj = (offset(pos1) == xg_cached_node_length(id(pos1), xgidx, node_cache) ? 0 : 1);
+    set<pos_t> seen;
+    set<pos_t> nexts = xg_cached_next_pos(pos1, false, xgidx, node_cache);
+    int64_t distance = 0;
+    while (!nexts.empty()) {
+        set<pos_t> todo;
+        for (auto& next : nexts) {
+            if (!seen.count(next)) {
+                seen.insert(next);
+                if (next == pos2) {
+                    return distance+adj;
+                }
+                // handle the edge case that we are looking for the position after the end of this node
+                if (make_pos_t(id(next), is_rev(next), offset(next)+1) == pos2) {
+                    return distance+adj+1;
+                }
+                for (auto& x : xg_cached_next_pos(next, false, xgidx, node_cache)) {
+                    todo.insert(x);
+                }
+            }
+        }
+        if (distance == maximum) {
+            break;
+        }
+        nexts = todo;
+        ++distance;
+    }
+    return numeric_limits<int64_t>::max();
+}
+
 }
@@ -5,6 +5,7 @@
 #include "types.hpp"
 #include "xg.hpp"
 #include "lru_cache.h"
+#include "clock_cache.hpp"
 #include "utility.hpp"
 #include "json2pb.h"
 #include <gcsa/gcsa.h>
@@ -28,16 +29,39 @@ int64_t xg_cached_node_start(id_t id, xg::XG* xgidx, LRUCache<id_t, int64_t>& no
 /// Get the character at a position in an xg::XG index, with cacheing of deserialized nodes.
 char xg_cached_pos_char(pos_t pos, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache);
 /// Get the characters at positions after the given position from an xg::XG index, with cacheing of deserialized nodes.
-map<pos_t, char> xg_cached_next_pos_chars(pos_t pos, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache, LRUCache<id_t, vector<Edge> >& edge_cache);
-set<pos_t> xg_cached_next_pos(pos_t pos, bool whole_node, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache, LRUCache<id_t, vector<Edge> >& edge_cache);
-int64_t xg_cached_distance(pos_t pos1, pos_t pos2, int64_t maximum, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache, LRUCache<id_t, vector<Edge> >& edge_cache);
-set<pos_t> xg_cached_positions_bp_from(pos_t pos, int64_t distance, bool rev, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache, LRUCache<id_t, vector<Edge> >& edge_cache);
+map<pos_t, char> xg_cached_next_pos_chars(pos_t pos, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache);
+int64_t xg_cached_distance(pos_t pos1, pos_t pos2, int64_t maximum, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache);
+set<pos_t> xg_cached_positions_bp_from(pos_t pos, int64_t distance, bool rev, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache);
 //void xg_cached_graph_context(VG& graph, const pos_t& pos, int length, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache, LRUCache<id_t, vector<Edge> >& edge_cache);
 Node xg_cached_node(id_t id, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache);
 vector<Edge> xg_cached_edges_of(id_t id, xg::XG* xgidx, LRUCache<id_t, vector<Edge> >& edge_cache);
 vector<Edge> xg_cached_edges_on_start(id_t id, xg::XG* xgidx, LRUCache<id_t, vector<Edge> >& edge_cache);
 vector<Edge> xg_cached_edges_on_end(id_t id, xg::XG* xgidx, LRUCache<id_t, vector<Edge> >& edge_cache);
 
+/// A node's sequence and the positions reachable from each of its strands,
+/// decoded from an xg::XG index once and then shared by all threads through a
+/// NodeCache.
+struct CachedNode {
+    /// Forward strand sequence
+    string sequence;
+    /// Positions at the starts of the nodes reachable off the end of the forward strand
+    vector<pos_t> next_forward;
+    /// Positions at the starts of the nodes reachable off the end of the reverse strand
+    vector<pos_t> next_reverse;
+};
+
+/// A cache of decoded nodes that can be shared between threads
+typedef ClockCache<id_t, CachedNode> NodeCache;
+
+// The same helpers again, using a NodeCache shared between threads
+/// Get the decoded node from the shared cache, decoding and caching it on a miss.
+shared_ptr<const CachedNode> xg_cached_node(id_t id, xg::XG* xgidx, NodeCache& node_cache);
+size_t xg_cached_node_length(id_t id, xg::XG* xgidx, NodeCache& node_cache);
+char xg_cached_pos_char(pos_t pos, xg::XG* xgidx, NodeCache& node_cache);
+map<pos_t, char> xg_cached_next_pos_chars(pos_t pos, xg::XG* xgidx, NodeCache& node_cache);
+set<pos_t> xg_cached_next_pos(pos_t pos, bool whole_node, xg::XG* xgidx, NodeCache& node_cache);
+int64_t xg_cached_distance(pos_t pos1, pos_t pos2, int64_t maximum, xg::XG* xgidx, NodeCache& node_cache);
+
 }
 
 #endif
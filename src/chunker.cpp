@@ -228,4 +228,60 @@ int64_t PathChunker::extract_gam_for_ids(vector<vg::id_t>& graph_ids,
 
 }
 
+int64_t PathChunker::extract_gam_for_subgraph(VG& subgraph, const GAMIndex& index, istream& sorted_gam,
+                                              ostream* out_stream, bool only_fully_contained) {
+    vector<vg::id_t> graph_ids;
+    subgraph.for_each_node([&](Node* node) {
+        graph_ids.push_back(node->id());
+    });
+    return extract_gam_for_ids(graph_ids, index, sorted_gam, out_stream, false, only_fully_contained);
+}
+
+int64_t PathChunker::extract_gam_for_ids(vector<vg::id_t>& graph_ids, const GAMIndex& index, istream& sorted_gam,
+                                         ostream* out_stream, bool contiguous, bool only_fully_contained) {
+
+    // Turn the IDs into inclusive ranges
+    vector<pair<vg::id_t, vg::id_t>> ranges;
+    if (contiguous) {
+        ranges.emplace_back(graph_ids.front(), graph_ids.back());
+    } else {
+        std::sort(graph_ids.begin(), graph_ids.end());
+        for (auto& id : graph_ids) {
+            if (!ranges.empty() && id <= ranges.back().second + 1) {
+                ranges.back().second = max(ranges.back().second, id);
+            } else {
+                ranges.emplace_back(id, id);
+            }
+        }
+    }
+
+    // Is a node in any of the ranges?
+    auto in_ranges = [&](vg::id_t node_id) {
+        auto it = upper_bound(ranges.begin(), ranges.end(), make_pair(node_id, numeric_limits<vg::id_t>::max()));
+        return it != ranges.begin() && (--it)->second >= node_id;
+    };
+
+    vector<Alignment> gam_buffer;
+    int64_t gam_count = 0;
+
+    stream::ProtobufIterator<Alignment> cursor(sorted_gam);
+    index.find(cursor, ranges, [&](const Alignment& alignment) {
+        if (only_fully_contained) {
+            for (size_t i = 0; i < alignment.path().mapping_size(); ++i) {
+                if (!in_ranges(alignment.path().mapping(i).position().node_id())) {
+                    return;
+                }
+            }
+        }
+        gam_buffer.push_back(alignment);
+        ++gam_count;
+        stream::write_buffered(*out_stream, gam_buffer, gam_buffer_size);
+    });
+
+    // flush buffer
+    stream::write_buffered(*out_stream, gam_buffer, 0);
+
+    return gam_count;
+}
+
 }
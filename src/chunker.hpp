@@ -11,6 +11,7 @@
 #include "json2pb.h"
 #include "region.hpp"
 #include "index.hpp"
+#include "gam_index.hpp"
 
 namespace vg {
 
@@ -65,6 +66,18 @@ public:
                                 bool only_fully_contained = false,
                                 bool search_all_positions = false,
                                 bool unsorted_index = false);
+
+    /** Extract all alignments that touch a node in a subgraph from a sorted
+     * GAM indexed with a GAMIndex, and write them to an output stream */
+    int64_t extract_gam_for_subgraph(VG& subgraph, const GAMIndex& index, istream& sorted_gam,
+                                     ostream* out_stream, bool only_fully_contained = false);
+
+    /** Like extract_gam_for_ids above, but using a sorted GAM and its GAMIndex.
+     * If contiguous_id_range is set, the first and last IDs give an inclusive
+     * range to look in. */
+    int64_t extract_gam_for_ids(vector<vg::id_t>& graph_ids, const GAMIndex& index, istream& sorted_gam,
+                                ostream* out_stream, bool contiguous_id_range = false,
+                                bool only_fully_contained = false);
     
 };
 
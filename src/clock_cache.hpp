@@ -0,0 +1,222 @@
+#ifndef VG_CLOCK_CACHE_HPP_INCLUDED
+#define VG_CLOCK_CACHE_HPP_INCLUDED
+
+/** \file
+ *
+ * A fixed-capacity cache that many threads can share, for values that are
+ * expensive to decode and read far more often than they are written.
+ *
+ * The cache is split into shards by key hash, each with its own lock, so
+ * threads looking up different keys rarely wait on each other. Within a shard,
+ * eviction uses the CLOCK approximation of LRU: a hit only sets a reference
+ * bit, instead of relinking a list node. Values are handed out as shared
+ * pointers to const, so an evicted value stays alive for anyone still using it.
+ */
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+
+namespace vg {
+
+using namespace std;
+
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class ClockCache {
+public:
+
+    /// Make a cache that holds up to about the given number of values, split
+    /// over the given number of shards.
+    ClockCache(size_t capacity, size_t shard_count = 64);
+
+    /// Get the cached value for a key, or null if it isn't cached. Counts as a
+    /// hit or a miss.
+    shared_ptr<const Value> retrieve(const Key& key);
+
+    /// Store a value for a key, evicting something if the key's shard is full.
+    /// If the key is already cached, the value already there is kept. Returns
+    /// the value now in the cache.
+    shared_ptr<const Value> put(const Key& key, Value value);
+
+    /// Get the cached value for a key, or, on a miss, call make() to produce
+    /// it and cache that. make() runs without holding any lock, so two threads
+    /// missing at once may both make the value; only one copy is kept.
+    template<typename Make>
+    shared_ptr<const Value> get_or_make(const Key& key, const Make& make);
+
+    /// Get the number of lookups that found a value
+    size_t hits() const;
+
+    /// Get the number of lookups that did not find a value
+    size_t misses() const;
+
+    /// Get the number of values cached right now
+    size_t size() const;
+
+    /// Get the most values the cache will hold
+    size_t capacity() const;
+
+    /// Drop everything cached, and zero the counters
+    void clear();
+
+private:
+
+    struct Slot {
+        Key key;
+        shared_ptr<const Value> value;
+        /// Set on each hit and cleared as the clock hand passes
+        bool referenced;
+    };
+
+    struct Shard {
+        mutable mutex shard_mutex;
+        vector<Slot> slots;
+        unordered_map<Key, size_t, Hash> slot_of;
+        /// Where the clock hand points
+        size_t hand = 0;
+        /// Counters live with the shard so that they are protected by its
+        /// lock and don't make every thread fight over one cache line.
+        size_t hit_count = 0;
+        size_t miss_count = 0;
+    };
+
+    /// Find the shard that a key goes in
+    Shard& shard_for(const Key& key);
+
+    size_t shard_capacity;
+    vector<unique_ptr<Shard>> shards;
+    Hash hasher;
+};
+
+template<typename Key, typename Value, typename Hash>
+ClockCache<Key, Value, Hash>::ClockCache(size_t capacity, size_t shard_count) {
+    // Don't make shards that can hold nothing
+    shard_count = max<size_t>(1, min(shard_count, capacity));
+    shard_capacity = max<size_t>(1, (capacity + shard_count - 1) / shard_count);
+    for (size_t i = 0; i < shard_count; i++) {
+        shards.emplace_back(new Shard());
+    }
+}
+
+template<typename Key, typename Value, typename Hash>
+typename ClockCache<Key, Value, Hash>::Shard& ClockCache<Key, Value, Hash>::shard_for(const Key& key) {
+    // Mix the hash so that sequential keys (like node IDs, which std::hash
+    // leaves alone) spread over the shards.
+    uint64_t mixed = (uint64_t) hasher(key) * 0x9E3779B97F4A7C15ull;
+    return *shards[(mixed >> 32) % shards.size()];
+}
+
+template<typename Key, typename Value, typename Hash>
+shared_ptr<const Value> ClockCache<Key, Value, Hash>::retrieve(const Key& key) {
+    Shard& shard = shard_for(key);
+    lock_guard<mutex> guard(shard.shard_mutex);
+    auto found = shard.slot_of.find(key);
+    if (found == shard.slot_of.end()) {
+        shard.miss_count++;
+        return nullptr;
+    }
+    shard.hit_count++;
+    Slot& slot = shard.slots[found->second];
+    slot.referenced = true;
+    return slot.value;
+}
+
+template<typename Key, typename Value, typename Hash>
+shared_ptr<const Value> ClockCache<Key, Value, Hash>::put(const Key& key, Value value) {
+    // Allocate outside the lock
+    shared_ptr<const Value> made = make_shared<const Value>(std::move(value));
+
+    Shard& shard = shard_for(key);
+    lock_guard<mutex> guard(shard.shard_mutex);
+    auto found = shard.slot_of.find(key);
+    if (found != shard.slot_of.end()) {
+        // Someone else got here first
+        return shard.slots[found->second].value;
+    }
+
+    if (shard.slots.size() < shard_capacity) {
+        // There's still room
+        shard.slot_of[key] = shard.slots.size();
+        shard.slots.push_back(Slot{key, made, false});
+        return made;
+    }
+
+    // Sweep the hand around until we find a slot that hasn't been used since
+    // we last passed it. This terminates within one full turn.
+    while (shard.slots[shard.hand].referenced) {
+        shard.slots[shard.hand].referenced = false;
+        shard.hand = (shard.hand + 1) % shard.slots.size();
+    }
+    Slot& victim = shard.slots[shard.hand];
+    shard.slot_of.erase(victim.key);
+    victim.key = key;
+    victim.value = made;
+    shard.slot_of[key] = shard.hand;
+    shard.hand = (shard.hand + 1) % shard.slots.size();
+    return made;
+}
+
+template<typename Key, typename Value, typename Hash>
+template<typename Make>
+shared_ptr<const Value> ClockCache<Key, Value, Hash>::get_or_make(const Key& key, const Make& make) {
+    shared_ptr<const Value> cached = retrieve(key);
+    if (cached) {
+        return cached;
+    }
+    return put(key, make());
+}
+
+template<typename Key, typename Value, typename Hash>
+size_t ClockCache<Key, Value, Hash>::hits() const {
+    size_t total = 0;
+    for (auto& shard : shards) {
+        lock_guard<mutex> guard(shard->shard_mutex);
+        total += shard->hit_count;
+    }
+    return total;
+}
+
+template<typename Key, typename Value, typename Hash>
+size_t ClockCache<Key, Value, Hash>::misses() const {
+    size_t total = 0;
+    for (auto& shard : shards) {
+        lock_guard<mutex> guard(shard->shard_mutex);
+        total += shard->miss_count;
+    }
+    return total;
+}
+
+template<typename Key, typename Value, typename Hash>
+size_t ClockCache<Key, Value, Hash>::size() const {
+    size_t total = 0;
+    for (auto& shard : shards) {
+        lock_guard<mutex> guard(shard->shard_mutex);
+        total += shard->slots.size();
+    }
+    return total;
+}
+
+template<typename Key, typename Value, typename Hash>
+size_t ClockCache<Key, Value, Hash>::capacity() const {
+    return shard_capacity * shards.size();
+}
+
+template<typename Key, typename Value, typename Hash>
+void ClockCache<Key, Value, Hash>::clear() {
+    for (auto& shard : shards) {
+        lock_guard<mutex> guard(shard->shard_mutex);
+        shard->slots.clear();
+        shard->slot_of.clear();
+        shard->hand = 0;
+        shard->hit_count = 0;
+        shard->miss_count = 0;
+    }
+}
+
+}
+
+#endif
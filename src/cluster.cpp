@@ -2,10 +2,13 @@
 #include <algorithm>
 #include <utility>
 #include <cstring>
+#include <tuple>
+#include <memory>
 
 #include "cluster.hpp"
 
 //#define debug_od_clusterer
+//#define debug_sparse_chain
 
 using namespace std;
 using namespace structures;
@@ -391,9 +394,11 @@ OrientedDistanceClusterer::OrientedDistanceClusterer(const Alignment& alignment,
                                                      bool unstranded,
                                                      paths_of_node_memo_t* paths_of_node_memo,
                                                      oriented_occurences_memo_t* oriented_occurences_memo,
-                                                     handle_memo_t* handle_memo) :
+                                                     handle_memo_t* handle_memo,
+                                                     const DistanceIndex* distance_index) :
     OrientedDistanceClusterer(alignment, mems, nullptr, &aligner, xgindex, max_expected_dist_approx_error,
-                              min_mem_length, unstranded, paths_of_node_memo, oriented_occurences_memo, handle_memo) {
+                              min_mem_length, unstranded, paths_of_node_memo, oriented_occurences_memo, handle_memo,
+                              distance_index) {
     // nothing else to do
 }
 
@@ -406,9 +411,11 @@ OrientedDistanceClusterer::OrientedDistanceClusterer(const Alignment& alignment,
                                                      bool unstranded,
                                                      paths_of_node_memo_t* paths_of_node_memo,
                                                      oriented_occurences_memo_t* oriented_occurences_memo,
-                                                     handle_memo_t* handle_memo) :
+                                                     handle_memo_t* handle_memo,
+                                                     const DistanceIndex* distance_index) :
     OrientedDistanceClusterer(alignment, mems, &aligner, nullptr, xgindex, max_expected_dist_approx_error,
-                              min_mem_length, unstranded, paths_of_node_memo, oriented_occurences_memo, handle_memo) {
+                              min_mem_length, unstranded, paths_of_node_memo, oriented_occurences_memo, handle_memo,
+                              distance_index) {
     // nothing else to do
 }
 
@@ -422,11 +429,18 @@ OrientedDistanceClusterer::OrientedDistanceClusterer(const Alignment& alignment,
                                                      bool unstranded,
                                                      paths_of_node_memo_t* paths_of_node_memo,
                                                      oriented_occurences_memo_t* oriented_occurences_memo,
-                                                     handle_memo_t* handle_memo) : aligner(aligner), qual_adj_aligner(qual_adj_aligner) {
+                                                     handle_memo_t* handle_memo,
+                                                     const DistanceIndex* distance_index) : aligner(aligner), qual_adj_aligner(qual_adj_aligner) {
     
     // there generally will be at least as many nodes as MEMs, so we can speed up the reallocation
     nodes.reserve(mems.size());
     
+    // MEMs overlap heavily, so pack the read once to score them against its qualities
+    unique_ptr<PackedRead> packed_read;
+    if (!aligner) {
+        packed_read.reset(new PackedRead(alignment.sequence(), alignment.quality()));
+    }
+    
     for (const MaximalExactMatch& mem : mems) {
         
         //#pragma omp atomic
@@ -447,8 +461,8 @@ OrientedDistanceClusterer::OrientedDistanceClusterer(const Alignment& alignment,
             mem_score = aligner->score_exact_match(mem.begin, mem.end);
         }
         else {
-            mem_score = qual_adj_aligner->score_exact_match(mem.begin, mem.end, alignment.quality().begin()
-                                                            + (mem.begin - alignment.sequence().begin()));
+            mem_score = qual_adj_aligner->score_exact_match(*packed_read, mem.begin - alignment.sequence().begin(),
+                                                            mem.length());
         }
         
 #ifdef debug_od_clusterer
@@ -473,7 +487,8 @@ OrientedDistanceClusterer::OrientedDistanceClusterer(const Alignment& alignment,
                                                                                                      },
                                                                                                      paths_of_node_memo,
                                                                                                      oriented_occurences_memo,
-                                                                                                     handle_memo);
+                                                                                                     handle_memo,
+                                                                                                     distance_index);
     
     // Flatten the trees to maps of relative position by node ID.
     vector<unordered_map<size_t, int64_t>> strand_relative_position = flatten_distance_tree(nodes.size(), recorded_finite_dists);
@@ -638,7 +653,8 @@ unordered_map<pair<size_t, size_t>, int64_t> OrientedDistanceClusterer::get_on_s
                                                                                                     const function<int64_t(size_t)>& get_offset,
                                                                                                     paths_of_node_memo_t* paths_of_node_memo,
                                                                                                     oriented_occurences_memo_t* oriented_occurences_memo,
-                                                                                                    handle_memo_t* handle_memo) {
+                                                                                                    handle_memo_t* handle_memo,
+                                                                                                    const DistanceIndex* distance_index) {
     
     // for recording the distance of any pair that we check with a finite distance
     unordered_map<pair<size_t, size_t>, int64_t> recorded_finite_dists;
@@ -672,7 +688,7 @@ unordered_map<pair<size_t, size_t>, int64_t> OrientedDistanceClusterer::get_on_s
     size_t nlogn = ceil(num_items * log(num_items));
     extend_dist_tree_by_permutations(max_failed_distance_probes, 50, nlogn, num_possible_merges_remaining, component_union_find,
                                      recorded_finite_dists, num_infinite_dists, unstranded, num_items, xgindex, get_position, get_offset, paths_of_node_memo,
-                                     oriented_occurences_memo, handle_memo);
+                                     oriented_occurences_memo, handle_memo, distance_index);
     
     return recorded_finite_dists;
 }
@@ -811,7 +827,7 @@ void OrientedDistanceClusterer::extend_dist_tree_by_path_buckets(int64_t max_fai
         // TODO: magic number (matches the distance used in the permutations step)
         if (trav_dist <= 50) {
             bool go_left = offset(pos) < right_dist;
-            function<bool(const handle_t&)> bucket_using_neighbors = [&](const handle_t& handle) {
+            auto bucket_using_neighbors = [&](const handle_t& handle) {
                 id_t neighbor_id = xgindex->get_id(handle);
                 bool neighbor_rev = xgindex->get_is_reverse(handle);
                 if (!paths_of_node_memo->count(neighbor_id)) {
@@ -827,7 +843,7 @@ void OrientedDistanceClusterer::extend_dist_tree_by_path_buckets(int64_t max_fai
                 }
                 return true;
             };
-            xgindex->follow_edges(handle, go_left, bucket_using_neighbors);
+            xgindex->follow_edges_inline(handle, go_left, bucket_using_neighbors);
         }
     }
     
@@ -987,7 +1003,7 @@ void OrientedDistanceClusterer::extend_dist_tree_by_strand_buckets(int64_t max_f
         // TODO: magic number (matches the distance used in the permutations step)
         if (trav_dist <= 50) {
             bool go_left = offset(pos) < right_dist;
-            function<bool(const handle_t&)> bucket_using_neighbors = [&](const handle_t& handle) {
+            auto bucket_using_neighbors = [&](const handle_t& handle) {
                 id_t neighbor_id = xgindex->get_id(handle);
                 bool neighbor_rev = xgindex->get_is_reverse(handle);
                 if (!paths_of_node_memo->count(neighbor_id)) {
@@ -1008,7 +1024,7 @@ void OrientedDistanceClusterer::extend_dist_tree_by_strand_buckets(int64_t max_f
                 }
                 return true;
             };
-            xgindex->follow_edges(handle, go_left, bucket_using_neighbors);
+            xgindex->follow_edges_inline(handle, go_left, bucket_using_neighbors);
         }
     }
     
@@ -1102,7 +1118,8 @@ void OrientedDistanceClusterer::extend_dist_tree_by_permutations(int64_t max_fai
                                                                  const function<int64_t(size_t)>& get_offset,
                                                                  paths_of_node_memo_t* paths_of_node_memo,
                                                                  oriented_occurences_memo_t* oriented_occurences_memo,
-                                                                 handle_memo_t* handle_memo) {
+                                                                 handle_memo_t* handle_memo,
+                                                                 const DistanceIndex* distance_index) {
     
     // We want to run through all possible pairsets of node numbers in a permuted order.
     ShuffledPairs shuffled_pairs(num_items);
@@ -1175,7 +1192,11 @@ void OrientedDistanceClusterer::extend_dist_tree_by_permutations(int64_t max_fai
         const pos_t& pos_2 = get_position(node_pair.second);
         
         int64_t oriented_dist;
-        if (unstranded) {
+        if (distance_index && !unstranded && distance_index->has_node(id(pos_1)) && distance_index->has_node(id(pos_2))) {
+            // the index gives the exact distance, whether or not there's a path nearby
+            oriented_dist = distance_index->oriented_distance(pos_1, pos_2);
+        }
+        else if (unstranded) {
             oriented_dist = xgindex->closest_shared_path_unstranded_distance(id(pos_1), offset(pos_1), is_rev(pos_1),
                                                                              id(pos_2), offset(pos_2), is_rev(pos_2),
                                                                              max_search_distance_to_path, paths_of_node_memo,
@@ -1928,7 +1949,8 @@ vector<pair<pair<size_t, size_t>, int64_t>> OrientedDistanceClusterer::pair_clus
                                                                                      bool unstranded,
                                                                                      paths_of_node_memo_t* paths_of_node_memo,
                                                                                      oriented_occurences_memo_t* oriented_occurences_memo,
-                                                                                     handle_memo_t* handle_memo) {
+                                                                                     handle_memo_t* handle_memo,
+                                                                                     const DistanceIndex* distance_index) {
     
 #ifdef debug_od_clusterer
     cerr << "beginning clustering of MEM cluster pairs for " << left_clusters.size() << " left clusters and " << right_clusters.size() << " right clusters" << endl;
@@ -1988,7 +2010,7 @@ vector<pair<pair<size_t, size_t>, int64_t>> OrientedDistanceClusterer::pair_clus
                  return alignment_2.sequence().end() - right_clusters[alt_anchor.first]->at(alt_anchor.second).first->begin;
              }
          },
-         paths_of_node_memo, oriented_occurences_memo, handle_memo);
+         paths_of_node_memo, oriented_occurences_memo, handle_memo, distance_index);
     
     // Flatten the distance tree to a set of linear spaces, one per tree.
     vector<unordered_map<size_t, int64_t>> linear_spaces = flatten_distance_tree(total_cluster_positions, distance_tree);
@@ -2472,6 +2494,320 @@ size_t OrientedDistanceClusterer::median_mem_coverage(const vector<size_t>& comp
 }
     
     
+/**
+ * A segment tree over a fixed number of slots, each holding a score and the index of the hit that
+ * gave it, that finds the maximum over a range of slots.
+ */
+class SparseChainClusterer::RangeMaxTree {
+public:
+    RangeMaxTree(size_t size) : size(size), tree(2 * size, make_pair(numeric_limits<int64_t>::min(), int64_t(-1))) {}
+    
+    /// Set the value in a slot
+    void set(size_t slot, int64_t score, int64_t hit_idx) {
+        size_t i = slot + size;
+        tree[i] = make_pair(score, hit_idx);
+        for (i /= 2; i > 0; i /= 2) {
+            tree[i] = max(tree[2 * i], tree[2 * i + 1]);
+        }
+    }
+    
+    /// Empty a slot
+    void clear(size_t slot) {
+        set(slot, numeric_limits<int64_t>::min(), -1);
+    }
+    
+    /// Returns the maximum value in the slots from begin to end, past-the-last, with a hit index of
+    /// -1 if they are all empty
+    pair<int64_t, int64_t> max_in(size_t begin, size_t end) const {
+        pair<int64_t, int64_t> best(numeric_limits<int64_t>::min(), -1);
+        for (size_t lo = begin + size, hi = end + size; lo < hi; lo /= 2, hi /= 2) {
+            if (lo & 1) {
+                best = max(best, tree[lo++]);
+            }
+            if (hi & 1) {
+                best = max(best, tree[--hi]);
+            }
+        }
+        return best;
+    }
+    
+private:
+    size_t size;
+    vector<pair<int64_t, int64_t>> tree;
+};
+
+SparseChainClusterer::SparseChainClusterer(const Alignment& alignment,
+                                           const vector<MaximalExactMatch>& mems,
+                                           const QualAdjAligner& aligner,
+                                           xg::XG* xgindex,
+                                           size_t max_expected_dist_approx_error,
+                                           size_t min_mem_length) :
+    SparseChainClusterer(alignment, mems, nullptr, &aligner, [&](pos_t pos) {
+        if (is_rev(pos)) {
+            pos = reverse(pos, xgindex->node_length(id(pos)));
+        }
+        return (int64_t) xgindex->node_start(id(pos)) + (int64_t) offset(pos);
+    }, max_expected_dist_approx_error, min_mem_length) {
+    // nothing else to do
+}
+
+SparseChainClusterer::SparseChainClusterer(const Alignment& alignment,
+                                           const vector<MaximalExactMatch>& mems,
+                                           const Aligner& aligner,
+                                           xg::XG* xgindex,
+                                           size_t max_expected_dist_approx_error,
+                                           size_t min_mem_length) :
+    SparseChainClusterer(alignment, mems, &aligner, nullptr, [&](pos_t pos) {
+        if (is_rev(pos)) {
+            pos = reverse(pos, xgindex->node_length(id(pos)));
+        }
+        return (int64_t) xgindex->node_start(id(pos)) + (int64_t) offset(pos);
+    }, max_expected_dist_approx_error, min_mem_length) {
+    // nothing else to do
+}
+
+SparseChainClusterer::SparseChainClusterer(const Alignment& alignment,
+                                           const vector<MaximalExactMatch>& mems,
+                                           const Aligner& aligner,
+                                           const function<int64_t(pos_t)>& approx_position,
+                                           size_t max_expected_dist_approx_error,
+                                           size_t min_mem_length) :
+    SparseChainClusterer(alignment, mems, &aligner, nullptr, approx_position,
+                         max_expected_dist_approx_error, min_mem_length) {
+    // nothing else to do
+}
+
+SparseChainClusterer::SparseChainClusterer(const Alignment& alignment,
+                                           const vector<MaximalExactMatch>& mems,
+                                           const Aligner* aligner,
+                                           const QualAdjAligner* qual_adj_aligner,
+                                           const function<int64_t(pos_t)>& approx_position,
+                                           size_t max_expected_dist_approx_error,
+                                           size_t min_mem_length) : aligner(aligner), qual_adj_aligner(qual_adj_aligner) {
+    
+    int64_t max_gap;
+    if (aligner) {
+        match_score = aligner->match;
+        gap_open_score = aligner->gap_open;
+        gap_extension_score = aligner->gap_extension;
+        max_gap = aligner->longest_detectable_gap(alignment);
+    }
+    else {
+        match_score = qual_adj_aligner->match;
+        gap_open_score = qual_adj_aligner->gap_open;
+        gap_extension_score = qual_adj_aligner->gap_extension;
+        max_gap = qual_adj_aligner->longest_detectable_gap(alignment);
+    }
+    max_diagonal_diff = max_gap + max_expected_dist_approx_error;
+    
+    // MEMs overlap heavily, so pack the read once to score them against its qualities
+    unique_ptr<PackedRead> packed_read;
+    if (!aligner) {
+        packed_read.reset(new PackedRead(alignment.sequence(), alignment.quality()));
+    }
+    
+    hits.reserve(mems.size());
+    for (const MaximalExactMatch& mem : mems) {
+        if (mem.length() < min_mem_length) {
+            continue;
+        }
+        
+        int32_t mem_score;
+        if (aligner) {
+            mem_score = aligner->score_exact_match(mem.begin, mem.end);
+        }
+        else {
+            mem_score = qual_adj_aligner->score_exact_match(*packed_read, mem.begin - alignment.sequence().begin(),
+                                                            mem.length());
+        }
+        
+        int64_t read_begin = mem.begin - alignment.sequence().begin();
+        for (gcsa::node_type mem_hit : mem.nodes) {
+            pos_t pos = make_pos_t(mem_hit);
+            // positions on the reverse strand run backwards, so negate them to keep chains increasing
+            int64_t strand_pos = is_rev(pos) ? -approx_position(pos) : approx_position(pos);
+            hits.emplace_back(mem, pos, read_begin, strand_pos - read_begin, mem_score);
+        }
+    }
+    
+#ifdef debug_sparse_chain
+    cerr << "made " << hits.size() << " hits to chain with maximum diagonal difference " << max_diagonal_diff << endl;
+#endif
+}
+
+void SparseChainClusterer::perform_dp() {
+    
+    // give each hit a slot in the order of strand and diagonal, so that the hits a hit could follow
+    // are in a few contiguous ranges of slots
+    vector<size_t> diagonal_order(hits.size());
+    for (size_t i = 0; i < hits.size(); i++) {
+        diagonal_order[i] = i;
+    }
+    sort(diagonal_order.begin(), diagonal_order.end(), [&](size_t i, size_t j) {
+        return make_tuple(is_rev(hits[i].pos), hits[i].diagonal, i) < make_tuple(is_rev(hits[j].pos), hits[j].diagonal, j);
+    });
+    vector<pair<bool, int64_t>> slot_keys(hits.size());
+    for (size_t slot = 0; slot < diagonal_order.size(); slot++) {
+        ChainHit& hit = hits[diagonal_order[slot]];
+        hit.diagonal_rank = slot;
+        slot_keys[slot] = make_pair(is_rev(hit.pos), hit.diagonal);
+    }
+    auto first_slot = [&](bool rev, int64_t diagonal) {
+        return lower_bound(slot_keys.begin(), slot_keys.end(), make_pair(rev, diagonal)) - slot_keys.begin();
+    };
+    
+    // the score of a predecessor chain with a gap of g = |diagonal difference| is
+    //   prev dp score - gap open + gap extend - g * gap extend
+    // so we can split by which side the predecessor's diagonal is on and fold the part that
+    // depends on the predecessor into its key (and likewise for the read overlap of predecessors
+    // that haven't ended yet, which costs match * overlap)
+    RangeMaxTree ended_below(hits.size()), ended_above(hits.size());
+    RangeMaxTree open_below(hits.size()), open_above(hits.size());
+    
+    vector<size_t> begin_order = diagonal_order, end_order = diagonal_order;
+    sort(begin_order.begin(), begin_order.end(), [&](size_t i, size_t j) {
+        return hits[i].read_begin < hits[j].read_begin;
+    });
+    sort(end_order.begin(), end_order.end(), [&](size_t i, size_t j) {
+        return hits[i].read_end < hits[j].read_end;
+    });
+    
+    size_t next_end = 0;
+    for (size_t group_begin = 0; group_begin < begin_order.size();) {
+        int64_t read_pos = hits[begin_order[group_begin]].read_begin;
+        
+        // hits that end before this read position no longer overlap
+        for (; next_end < end_order.size() && hits[end_order[next_end]].read_end <= read_pos; next_end++) {
+            ChainHit& ended = hits[end_order[next_end]];
+            open_below.clear(ended.diagonal_rank);
+            open_above.clear(ended.diagonal_rank);
+            ended_below.set(ended.diagonal_rank, ended.dp_score + gap_extension_score * ended.diagonal, end_order[next_end]);
+            ended_above.set(ended.diagonal_rank, ended.dp_score - gap_extension_score * ended.diagonal, end_order[next_end]);
+        }
+        
+        // hits that start at the same read position can't chain to each other
+        size_t group_end = group_begin;
+        for (; group_end < begin_order.size() && hits[begin_order[group_end]].read_begin == read_pos; group_end++) {
+            ChainHit& hit = hits[begin_order[group_end]];
+            bool rev = is_rev(hit.pos);
+            size_t below_begin = first_slot(rev, hit.diagonal - max_diagonal_diff);
+            size_t same_begin = first_slot(rev, hit.diagonal);
+            size_t above_begin = first_slot(rev, hit.diagonal + 1);
+            size_t above_end = first_slot(rev, hit.diagonal + max_diagonal_diff + 1);
+            
+            int64_t gap_adjust = gap_open_score - gap_extension_score;
+            int64_t overlap_adjust = match_score * hit.read_begin;
+            
+            // a chain can always start fresh here
+            hit.dp_score = hit.score;
+            hit.prev = -1;
+            auto consider = [&](const pair<int64_t, int64_t>& best, int64_t adjust) {
+                if (best.second >= 0 && best.first + adjust + hit.score > hit.dp_score) {
+                    hit.dp_score = best.first + adjust + hit.score;
+                    hit.prev = best.second;
+                }
+            };
+            consider(ended_below.max_in(same_begin, above_begin), -gap_extension_score * hit.diagonal);
+            consider(open_below.max_in(same_begin, above_begin), -gap_extension_score * hit.diagonal + overlap_adjust);
+            consider(ended_below.max_in(below_begin, same_begin), -gap_extension_score * hit.diagonal - gap_adjust);
+            consider(open_below.max_in(below_begin, same_begin), -gap_extension_score * hit.diagonal - gap_adjust + overlap_adjust);
+            consider(ended_above.max_in(above_begin, above_end), gap_extension_score * hit.diagonal - gap_adjust);
+            consider(open_above.max_in(above_begin, above_end), gap_extension_score * hit.diagonal - gap_adjust + overlap_adjust);
+            
+#ifdef debug_sparse_chain
+            cerr << "hit " << begin_order[group_end] << " at read " << hit.read_begin << ", diagonal " << hit.diagonal
+                 << " has DP score " << hit.dp_score << " following " << hit.prev << endl;
+#endif
+        }
+        
+        for (size_t i = group_begin; i < group_end; i++) {
+            ChainHit& hit = hits[begin_order[i]];
+            int64_t overlap_key = hit.dp_score - match_score * hit.read_end;
+            open_below.set(hit.diagonal_rank, overlap_key + gap_extension_score * hit.diagonal, begin_order[i]);
+            open_above.set(hit.diagonal_rank, overlap_key - gap_extension_score * hit.diagonal, begin_order[i]);
+        }
+        group_begin = group_end;
+    }
+}
+
+vector<SparseChainClusterer::cluster_t> SparseChainClusterer::clusters(const Alignment& alignment,
+                                                                       int32_t max_qual_score,
+                                                                       double log_likelihood_approx_factor) {
+    
+    vector<cluster_t> to_return;
+    if (hits.empty()) {
+        return to_return;
+    }
+    
+    perform_dp();
+    
+    // trace back from the best chain ends first
+    vector<size_t> score_order(hits.size());
+    for (size_t i = 0; i < hits.size(); i++) {
+        score_order[i] = i;
+    }
+    sort(score_order.begin(), score_order.end(), [&](size_t i, size_t j) {
+        return hits[i].dp_score > hits[j].dp_score || (hits[i].dp_score == hits[j].dp_score && i < j);
+    });
+    
+    // estimate the minimum score a cluster must obtain to even affect the mapping quality
+    int64_t top_score = hits[score_order.front()].dp_score;
+    const BaseAligner* base_aligner = aligner ? (BaseAligner*) aligner : (BaseAligner*) qual_adj_aligner;
+    int64_t suboptimal_score_cutoff = top_score - log_likelihood_approx_factor * base_aligner->mapping_quality_score_diff(max_qual_score);
+    
+    // which cluster each hit went into, -1 for none yet and -2 for a discarded chain
+    vector<int64_t> hit_cluster(hits.size(), -1);
+    vector<size_t> chain;
+    for (size_t end_idx : score_order) {
+        if (hit_cluster[end_idx] != -1) {
+            continue;
+        }
+        
+        // follow the chain back until it runs out or joins one we've already seen
+        chain.clear();
+        int64_t trace_idx = end_idx;
+        while (trace_idx >= 0 && hit_cluster[trace_idx] == -1) {
+            chain.push_back(trace_idx);
+            trace_idx = hits[trace_idx].prev;
+        }
+        
+        int64_t cluster_idx;
+        if (trace_idx >= 0) {
+            // a lower scoring branch of an existing cluster goes with it
+            cluster_idx = hit_cluster[trace_idx];
+        }
+        else if (hits[end_idx].dp_score >= suboptimal_score_cutoff) {
+            cluster_idx = to_return.size();
+            to_return.emplace_back();
+        }
+        else {
+            // too low scoring to affect the mapping quality
+            cluster_idx = -2;
+        }
+        
+        for (size_t chain_idx : chain) {
+            hit_cluster[chain_idx] = cluster_idx;
+            if (cluster_idx >= 0) {
+                to_return[cluster_idx].emplace_back(hits[chain_idx].mem, hits[chain_idx].pos);
+            }
+        }
+    }
+    
+    for (cluster_t& cluster : to_return) {
+        // put the cluster in order by read position
+        sort(cluster.begin(), cluster.end(), [](const hit_t& hit_1, const hit_t& hit_2) {
+            return hit_1.first->begin < hit_2.first->begin ||
+                   (hit_1.first->begin == hit_2.first->begin && hit_1.first->end < hit_2.first->end);
+        });
+    }
+    
+#ifdef debug_sparse_chain
+    cerr << "chained " << hits.size() << " hits into " << to_return.size() << " clusters with top score " << top_score << endl;
+#endif
+    
+    return to_return;
+}
+    
 // collect node starts to build out graph
 vector<pair<gcsa::node_type, size_t> > mem_node_start_positions(const xg::XG& xg, const vg::MaximalExactMatch& mem) {
     // walk the match, getting all the nodes that it touches
@@ -2508,7 +2844,7 @@ vector<pair<gcsa::node_type, size_t> > mem_node_start_positions(const xg::XG& xg
                 // if we continue past this node, insert our next nodes into nexts
                 if (mem_todo - overlap > 0) {
                     size_t new_off = query_offset + overlap;
-                    xg.follow_edges(handle, false, [&](const handle_t& next) {
+                    xg.follow_edges_inline(handle, false, [&](const handle_t& next) {
                             todo.insert(make_pair(gcsa::Node::encode(xg.get_id(next), 0, xg.get_is_reverse(next)), new_off));
                             return true;
                         });
@@ -10,6 +10,7 @@
 #include "mem.hpp"
 #include "xg.hpp"
 #include "handle.hpp"
+#include "distance_index.hpp"
 
 #include <functional>
 #include <string>
@@ -178,7 +179,8 @@ public:
                               bool unstranded = false,
                               paths_of_node_memo_t* paths_of_node_memo = nullptr,
                               oriented_occurences_memo_t* oriented_occurences_memo = nullptr,
-                              handle_memo_t* handle_memo = nullptr);
+                              handle_memo_t* handle_memo = nullptr,
+                              const DistanceIndex* distance_index = nullptr);
     
     /// Constructor using Aligner, optionally memoizing succinct data structure operations
     OrientedDistanceClusterer(const Alignment& alignment,
@@ -190,7 +192,8 @@ public:
                               bool unstranded = false,
                               paths_of_node_memo_t* paths_of_node_memo = nullptr,
                               oriented_occurences_memo_t* oriented_occurences_memo = nullptr,
-                              handle_memo_t* handle_memo = nullptr);
+                              handle_memo_t* handle_memo = nullptr,
+                              const DistanceIndex* distance_index = nullptr);
     
     /// Returns a vector of clusters. Each cluster is represented a vector of MEM hits. Each hit
     /// contains a pointer to the original MEM and the position of that particular hit in the graph.
@@ -217,7 +220,8 @@ public:
                                                                      bool unstranded,
                                                                      paths_of_node_memo_t* paths_of_node_memo = nullptr,
                                                                      oriented_occurences_memo_t* oriented_occurences_memo = nullptr,
-                                                                     handle_memo_t* handle_memo = nullptr);
+                                                                     handle_memo_t* handle_memo = nullptr,
+                                                                     const DistanceIndex* distance_index = nullptr);
     
     //static size_t PRUNE_COUNTER;
     //static size_t CLUSTER_TOTAL;
@@ -240,7 +244,8 @@ private:
                               bool unstranded,
                               paths_of_node_memo_t* paths_of_node_memo,
                               oriented_occurences_memo_t* oriented_occurences_memo,
-                              handle_memo_t* handle_memo);
+                              handle_memo_t* handle_memo,
+                              const DistanceIndex* distance_index);
     
     /**
      * Given a certain number of items, and a callback to get each item's
@@ -250,7 +255,7 @@ private:
      *
      * We use the distance approximation to cluster the MEM hits according to
      * the strand they fall on using the oriented distance estimation function
-     * in xg.
+     * in xg, or the exact distances from a distance index if one is given.
      *
      * Returns a map from item pair (lower number first) to distance (which may
      * be negative) from the first to the second along the items' forward
@@ -261,11 +266,13 @@ private:
                                                                                     const function<int64_t(size_t)>& get_offset,
                                                                                     paths_of_node_memo_t* paths_of_node_memo,
                                                                                     oriented_occurences_memo_t* oriented_occurences_memo,
-                                                                                    handle_memo_t* handle_memo);
+                                                                                    handle_memo_t* handle_memo,
+                                                                                    const DistanceIndex* distance_index);
     
     /**
      * Adds edges into the distance tree by estimating the distance between pairs
-     * generated by a high entropy deterministic permutation
+     * generated by a high entropy deterministic permutation, measuring stranded
+     * distances with the distance index if there is one
      */
     static void extend_dist_tree_by_permutations(int64_t max_failed_distance_probes,
                                                  int64_t max_search_distance_to_path,
@@ -281,7 +288,8 @@ private:
                                                  const function<int64_t(size_t)>& get_offset,
                                                  paths_of_node_memo_t* paths_of_node_memo,
                                                  oriented_occurences_memo_t* oriented_occurences_memo,
-                                                 handle_memo_t* handle_memo);
+                                                 handle_memo_t* handle_memo,
+                                                 const DistanceIndex* distance_index);
     
     
     /**
@@ -431,6 +439,113 @@ public:
     }
 };
 
+/**
+ * A clusterer that chains MEM hits colinearly with sparse dynamic programming. Hits are laid out
+ * along the read and along an approximate linear position in the graph, and each hit's best
+ * predecessor is found with range-max queries over the hits' diagonals, so chaining takes
+ * O(n log n) time in the number of hits instead of building explicit edges between them. Scoring
+ * of chains follows the OrientedDistanceClusterer, and it can be used in place of it.
+ */
+class SparseChainClusterer {
+public:
+
+    using hit_t = OrientedDistanceClusterer::hit_t;
+    using cluster_t = OrientedDistanceClusterer::cluster_t;
+
+    /// Constructor using QualAdjAligner, with approximate positions from an xg index
+    SparseChainClusterer(const Alignment& alignment,
+                         const vector<MaximalExactMatch>& mems,
+                         const QualAdjAligner& aligner,
+                         xg::XG* xgindex,
+                         size_t max_expected_dist_approx_error = 8,
+                         size_t min_mem_length = 1);
+
+    /// Constructor using Aligner, with approximate positions from an xg index
+    SparseChainClusterer(const Alignment& alignment,
+                         const vector<MaximalExactMatch>& mems,
+                         const Aligner& aligner,
+                         xg::XG* xgindex,
+                         size_t max_expected_dist_approx_error = 8,
+                         size_t min_mem_length = 1);
+
+    /// Constructor using Aligner, with approximate positions from a function that gives the
+    /// approximate linear position on the forward strand of the base at a position
+    SparseChainClusterer(const Alignment& alignment,
+                         const vector<MaximalExactMatch>& mems,
+                         const Aligner& aligner,
+                         const function<int64_t(pos_t)>& approx_position,
+                         size_t max_expected_dist_approx_error = 8,
+                         size_t min_mem_length = 1);
+
+    /// Returns a vector of clusters, in descending order of score. Each cluster is the hits of a
+    /// chain, along with the hits of any lower scoring chains that join it, ordered by read
+    /// position. Clusters that score too low to affect the mapping quality of the best one are not
+    /// returned, as in OrientedDistanceClusterer::clusters().
+    vector<cluster_t> clusters(const Alignment& alignment,
+                               int32_t max_qual_score = 60,
+                               double log_likelihood_approx_factor = 0.0);
+
+private:
+    class ChainHit;
+    class RangeMaxTree;
+
+    /// Internal constructor that public constructors filter into
+    SparseChainClusterer(const Alignment& alignment,
+                         const vector<MaximalExactMatch>& mems,
+                         const Aligner* aligner,
+                         const QualAdjAligner* qual_adj_aligner,
+                         const function<int64_t(pos_t)>& approx_position,
+                         size_t max_expected_dist_approx_error,
+                         size_t min_mem_length);
+
+    /// Compute the DP score and best predecessor of every hit
+    void perform_dp();
+
+    vector<ChainHit> hits;
+
+    const Aligner* aligner;
+    const QualAdjAligner* qual_adj_aligner;
+
+    int64_t match_score;
+    int64_t gap_open_score;
+    int64_t gap_extension_score;
+    /// The largest difference in diagonal that two hits in a chain can have
+    int64_t max_diagonal_diff;
+};
+
+class SparseChainClusterer::ChainHit {
+public:
+    ChainHit(const MaximalExactMatch& mem, pos_t pos, int64_t read_begin, int64_t diagonal, int32_t score) :
+    mem(&mem), pos(pos), read_begin(read_begin), read_end(read_begin + mem.length()), diagonal(diagonal), score(score) {}
+    ChainHit() = default;
+    ~ChainHit() = default;
+
+    const MaximalExactMatch* mem;
+
+    /// Position of GCSA hit in the graph
+    pos_t pos;
+
+    /// Interval of the read covered by the MEM
+    int64_t read_begin;
+    int64_t read_end;
+
+    /// Approximate position of the hit on its strand minus its position in the read, which stays the
+    /// same along a chain without indels
+    int64_t diagonal;
+
+    /// Score of the exact match this hit represents
+    int32_t score;
+
+    /// Score of the best chain ending at this hit
+    int64_t dp_score;
+
+    /// Index of the previous hit in the best chain ending here, or -1 if it starts here
+    int64_t prev = -1;
+
+    /// Index of the hit in the order of strand and diagonal
+    size_t diagonal_rank;
+};
+
 /// get the handles that a mem covers
 vector<pair<gcsa::node_type, size_t> > mem_node_start_positions(const xg::XG& xg, const vg::MaximalExactMatch& mem);
 /// use walking to get the hits
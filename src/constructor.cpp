@@ -13,6 +13,7 @@
 #include <list>
 #include <algorithm>
 #include <memory>
+#include <omp.h>
 
 //#define debug
 
@@ -1484,6 +1485,70 @@ namespace vg {
             callback(chunk.graph);
         };
 
+        // Chunks only depend on each other through wiring, which renumbers
+        // their nodes, so we collect a batch of chunks and construct them in
+        // parallel, and then wire and emit them in order. Reading the
+        // reference and the VCF stays in this thread.
+        struct QueuedChunk {
+            string reference_sequence;
+            vector<vcflib::Variant> variants;
+            size_t start;
+            size_t end;
+        };
+        vector<QueuedChunk> chunk_queue;
+        size_t max_queued_chunks = 2 * omp_get_max_threads();
+
+        auto construct_queued_chunks = [&]() {
+            vector<ConstructedChunk> results(chunk_queue.size());
+            auto construct_queued = [&](size_t i) {
+                auto& queued = chunk_queue[i];
+                results[i] = construct_chunk(std::move(queued.reference_sequence), reference_contig,
+                    std::move(queued.variants), queued.start);
+            };
+            if (omp_in_parallel()) {
+                // Our callback is feeding something that already has a thread
+                // team running, like an XG build, so hand the chunks to its
+                // threads as tasks.
+                for (size_t i = 0; i < chunk_queue.size(); i++) {
+                    #pragma omp task firstprivate(i)
+                    construct_queued(i);
+                }
+                #pragma omp taskwait
+            } else {
+                #pragma omp parallel for schedule(dynamic, 1)
+                for (size_t i = 0; i < chunk_queue.size(); i++) {
+                    construct_queued(i);
+                }
+            }
+
+            for (size_t i = 0; i < results.size(); i++) {
+                // Wire up and emit the chunk graph
+                wire_and_emit(results[i]);
+                // Free it as soon as it's out
+                results[i] = ConstructedChunk();
+
+                // Say we've completed the chunk
+                update_progress(chunk_queue[i].end - leading_offset);
+            }
+            chunk_queue.clear();
+        };
+
+        // Take the variants we have collected, and the reference sequence from
+        // start to end, as the next chunk
+        auto queue_chunk = [&](size_t start, size_t end) {
+            chunk_queue.emplace_back();
+            auto& queued = chunk_queue.back();
+            // Get the ref sequence we need
+            queued.reference_sequence = reference.getSubSequence(reference_contig, start, end - start);
+            swap(queued.variants, chunk_variants);
+            queued.start = start;
+            queued.end = end;
+
+            if (chunk_queue.size() >= max_queued_chunks) {
+                construct_queued_chunks();
+            }
+        };
+
         bool do_external_insertions = false;
         FastaReference* insertion_fasta;
 
@@ -1615,17 +1680,8 @@ namespace vg {
                             min((size_t) reference_end,
                                 (size_t) (chunk_start + bases_per_chunk))));
 
-                // Get the ref sequence we need
-                auto chunk_ref = reference.getSubSequence(reference_contig, chunk_start, chunk_end - chunk_start);
-
-                // Call the construction
-                auto result = construct_chunk(chunk_ref, reference_contig, chunk_variants, chunk_start);
-
-                // Wire up and emit the chunk graph
-                wire_and_emit(result);
-
-                // Say we've completed the chunk
-                update_progress(chunk_end - leading_offset);
+                // Queue up the chunk to be constructed
+                queue_chunk(chunk_start, chunk_end);
 
                 // Set up a new chunk
                 chunk_start = chunk_end;
@@ -1647,17 +1703,8 @@ namespace vg {
                     min((size_t) reference_end,
                         (size_t) (chunk_start + bases_per_chunk)));
 
-            // Get the ref sequence we need
-            auto chunk_ref = reference.getSubSequence(reference_contig, chunk_start, chunk_end - chunk_start);
-
-            // Call the construction
-            auto result = construct_chunk(chunk_ref, reference_contig, chunk_variants, chunk_start);
-
-            // Wire up and emit the chunk graph
-            wire_and_emit(result);
-
-            // Say we've completed the chunk
-            update_progress(chunk_end - leading_offset);
+            // Queue up the chunk to be constructed
+            queue_chunk(chunk_start, chunk_end);
 
             // Set up a new chunk
             chunk_start = chunk_end;
@@ -1665,6 +1712,9 @@ namespace vg {
             chunk_variants.clear();
         }
 
+        // Construct whatever is still queued
+        construct_queued_chunks();
+
         // All the chunks have been wired and emitted.
         
         if (last_node_buffer.id() != 0) {
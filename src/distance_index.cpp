@@ -0,0 +1,869 @@
+#include "distance_index.hpp"
+#include "position.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <initializer_list>
+#include <limits>
+#include <queue>
+#include <stdexcept>
+#include <unordered_set>
+
+//#define debug_distance_index
+
+namespace vg {
+
+using namespace std;
+
+/// Magic number at the start of a serialized distance index
+static const char DISTANCE_INDEX_MAGIC[4] = {'D', 'S', 'T', '!'};
+
+/// Version of the serialized format we write
+static const uint32_t DISTANCE_INDEX_VERSION = 1;
+
+/// Stands in for the distance between things that aren't connected. Small
+/// enough that a few of them can be added without overflowing.
+static const int64_t UNREACHABLE = numeric_limits<int64_t>::max() / 4;
+
+/// Add up distances, any of which may be unreachable
+static inline int64_t dist_sum(initializer_list<int64_t> terms) {
+    int64_t total = 0;
+    for (int64_t term : terms) {
+        if (term >= UNREACHABLE) {
+            return UNREACHABLE;
+        }
+        total += term;
+    }
+    return total;
+}
+
+/// Distance between two coordinates along a chain, given with the number of
+/// uncrossable snarls before them
+static inline int64_t coordinate_distance(const pair<int64_t, size_t>& from, const pair<int64_t, size_t>& to) {
+    return to.second != from.second ? UNREACHABLE : to.first - from.first;
+}
+
+/// Vertices of the small graphs made by DistanceIndex::chain_graph(): the four
+/// sides of the chain come first, then the four sides of each slot asked
+/// about, then a source and a sink for the caller to connect
+enum ChainGraphSide {LEFT_OUT = 0, RIGHT_OUT = 1, LEFT_IN = 2, RIGHT_IN = 3};
+
+static inline size_t chain_vertex(ChainGraphSide side) {
+    return side;
+}
+
+static inline size_t slot_vertex(size_t slot_number, ChainGraphSide side) {
+    return 4 * (slot_number + 1) + side;
+}
+
+static inline size_t chain_graph_size(size_t num_slots) {
+    return 4 * (num_slots + 1) + 2;
+}
+
+/// Find the shortest distances from a vertex in a small graph given as a dense
+/// matrix of edge weights
+static vector<int64_t> shortest_distances(const vector<int64_t>& edges, size_t size, size_t source) {
+    vector<int64_t> distances(size, UNREACHABLE);
+    vector<bool> done(size, false);
+    distances[source] = 0;
+    while (true) {
+        size_t closest = size;
+        for (size_t i = 0; i < size; i++) {
+            if (!done[i] && distances[i] < UNREACHABLE && (closest == size || distances[i] < distances[closest])) {
+                closest = i;
+            }
+        }
+        if (closest == size) {
+            break;
+        }
+        done[closest] = true;
+        for (size_t i = 0; i < size; i++) {
+            distances[i] = min(distances[i], dist_sum({distances[closest], edges[closest * size + i]}));
+        }
+    }
+    return distances;
+}
+
+template<typename T>
+static void write_vector(ostream& out, const vector<T>& data) {
+    uint64_t size = data.size();
+    out.write((const char*) &size, sizeof(size));
+    out.write((const char*) data.data(), data.size() * sizeof(T));
+}
+
+template<typename T>
+static void read_vector(istream& in, vector<T>& data) {
+    uint64_t size = 0;
+    in.read((char*) &size, sizeof(size));
+    if (!in) {
+        throw runtime_error("[vg::DistanceIndex] truncated distance index");
+    }
+    data.resize(size);
+    in.read((char*) data.data(), data.size() * sizeof(T));
+}
+
+DistanceIndex::DistanceIndex(const HandleGraph* graph, const SnarlManager* snarl_manager) {
+
+    // Lay out the snarl tree top down, so every chain comes after the snarl
+    // that contains it and every snarl comes after its chain
+    vector<const Chain*> chain_ptrs;
+    vector<const Snarl*> snarl_ptrs;
+    vector<vector<size_t>> child_chains;
+
+    auto add_child_chains = [&](const Snarl* parent, int64_t parent_rank) {
+        for (const Chain& chain : snarl_manager->chains_of(parent)) {
+            if (parent_rank >= 0) {
+                child_chains[parent_rank].push_back(chains.size());
+            }
+            chains.emplace_back();
+            chains.back().parent = parent_rank;
+            chain_ptrs.push_back(&chain);
+        }
+    };
+
+    // The boundary nodes of each chain, in chain orientation, and where its snarls start
+    vector<vector<handle_t>> boundaries;
+    vector<size_t> first_snarls;
+
+    add_child_chains(nullptr, -1);
+    for (size_t i = 0; i < chains.size(); i++) {
+        const Chain& chain = *chain_ptrs[i];
+        boundaries.emplace_back();
+        first_snarls.push_back(snarls.size());
+        size_t rank = 1;
+        for (auto it = chain_begin(chain); it != chain_end(chain); ++it) {
+            const Snarl* snarl = it->first;
+            bool backward = it->second;
+
+            handle_t start = graph->get_handle(snarl->start().node_id(), snarl->start().backward());
+            handle_t end = graph->get_handle(snarl->end().node_id(), snarl->end().backward());
+            if (boundaries[i].empty()) {
+                boundaries[i].push_back(backward ? graph->flip(end) : start);
+            }
+            boundaries[i].push_back(backward ? graph->flip(start) : end);
+
+            snarls.emplace_back();
+            snarls.back().chain = i;
+            snarls.back().rank_in_chain = rank++;
+            snarls.back().reversed_in_chain = backward;
+            snarl_ptrs.push_back(snarl);
+            child_chains.emplace_back();
+
+            add_child_chains(snarl, snarls.size() - 1);
+        }
+
+        // Chain boundaries belong to the chain
+        for (size_t j = 0; j < boundaries[i].size(); j++) {
+            const handle_t& boundary = boundaries[i][j];
+            id_t node_id = graph->get_id(boundary);
+            if (!nodes.count(node_id)) {
+                NodeRecord& record = nodes[node_id];
+                record.in_chain = true;
+                record.record = i;
+                record.rank = j;
+                record.reversed = graph->get_is_reverse(boundary);
+                record.length = graph->get_length(boundary);
+            }
+        }
+    }
+
+#ifdef debug_distance_index
+    cerr << "[DistanceIndex] indexing " << snarls.size() << " snarls in " << chains.size() << " chains" << endl;
+#endif
+
+    // Lengths and loops of chains, seen as nodes of their parents' net graphs
+    auto chain_length = [&](const ChainRecord& chain, bool leftward) {
+        size_t last_slot = 2 * chain.boundary_lengths.size() - 2;
+        return leftward ? coordinate_distance(reverse_coordinate(chain, last_slot, true), reverse_coordinate(chain, 0, false))
+                        : coordinate_distance(forward_coordinate(chain, 0, false), forward_coordinate(chain, last_slot, true));
+    };
+    auto chain_loop = [&](const ChainRecord& chain, bool from_right) {
+        size_t last = chain.boundary_lengths.size() - 1;
+        return from_right ? dist_sum({chain.boundary_lengths[last], chain.left_loops[last], chain.boundary_lengths[last]})
+                          : dist_sum({chain.boundary_lengths[0], chain.right_loops[0], chain.boundary_lengths[0]});
+    };
+
+    // Index the net graph of a snarl, whose child chains are already indexed
+    auto index_snarl = [&](size_t snarl_rank) {
+        const Snarl* snarl = snarl_ptrs[snarl_rank];
+        SnarlRecord& record = snarls[snarl_rank];
+
+        handle_t start = graph->get_handle(snarl->start().node_id(), snarl->start().backward());
+        handle_t end = graph->get_handle(snarl->end().node_id(), snarl->end().backward());
+
+        // Child chains by the handles that read into them, and whether that
+        // enters them backward
+        unordered_map<handle_t, pair<size_t, bool>> chain_entries;
+        for (size_t chain_rank : child_chains[snarl_rank]) {
+            chain_entries.emplace(boundaries[chain_rank].front(), make_pair(chain_rank, false));
+            chain_entries.emplace(graph->flip(boundaries[chain_rank].back()), make_pair(chain_rank, true));
+        }
+
+        // Find the net graph nodes, starting with the boundaries
+        vector<pair<bool, size_t>> net_nodes;
+        unordered_map<id_t, size_t> node_ranks;
+        unordered_map<size_t, size_t> chain_ranks;
+
+        vector<handle_t> to_explore;
+        unordered_set<handle_t> explored;
+        auto add_node = [&](id_t node_id) {
+            node_ranks[node_id] = net_nodes.size();
+            net_nodes.emplace_back(false, node_id);
+        };
+        add_node(graph->get_id(start));
+        if (!node_ranks.count(graph->get_id(end))) {
+            add_node(graph->get_id(end));
+        }
+        to_explore.push_back(start);
+        to_explore.push_back(graph->flip(end));
+
+        while (!to_explore.empty()) {
+            handle_t here = to_explore.back();
+            to_explore.pop_back();
+            if (explored.count(here) || here == end || here == graph->flip(start)) {
+                // we've been here, or it leads out of the snarl
+                continue;
+            }
+            explored.insert(here);
+
+            graph->follow_edges(here, false, [&](const handle_t& next) {
+                auto entry = chain_entries.find(next);
+                if (entry != chain_entries.end()) {
+                    size_t chain_rank = entry->second.first;
+                    if (!chain_ranks.count(chain_rank)) {
+                        chain_ranks[chain_rank] = net_nodes.size();
+                        chains[chain_rank].rank_in_parent = net_nodes.size();
+                        net_nodes.emplace_back(true, chain_rank);
+                        to_explore.push_back(boundaries[chain_rank].back());
+                        to_explore.push_back(graph->flip(boundaries[chain_rank].front()));
+                    }
+                    return;
+                }
+                id_t node_id = graph->get_id(next);
+                if (node_ranks.count(node_id)) {
+                    return;
+                }
+                auto found = nodes.find(node_id);
+                if (found != nodes.end() && found->second.in_chain) {
+                    // the inside of some other chain, which we can't get to
+                    // from a well-formed snarl
+                    return;
+                }
+                add_node(node_id);
+                to_explore.push_back(graph->get_handle(node_id, false));
+                to_explore.push_back(graph->get_handle(node_id, true));
+            });
+        }
+
+        size_t num_states = 2 * net_nodes.size();
+        record.net_size = net_nodes.size();
+        record.start_state = 2 * node_ranks[graph->get_id(start)] + graph->get_is_reverse(start);
+        record.end_state = 2 * node_ranks[graph->get_id(end)] + graph->get_is_reverse(end);
+
+        // Nodes that aren't chain boundaries belong to the snarl
+        for (size_t i = 0; i < net_nodes.size(); i++) {
+            if (!net_nodes[i].first && !nodes.count(net_nodes[i].second)) {
+                NodeRecord& node_record = nodes[net_nodes[i].second];
+                node_record.in_chain = false;
+                node_record.record = snarl_rank;
+                node_record.rank = i;
+                node_record.length = graph->get_length(graph->get_handle(net_nodes[i].second));
+            }
+        }
+
+        // Oriented net graph nodes that follow a handle, or -1 if it leaves the snarl
+        auto state_of = [&](const handle_t& handle) -> int64_t {
+            auto entry = chain_entries.find(handle);
+            if (entry != chain_entries.end()) {
+                auto rank = chain_ranks.find(entry->second.first);
+                return rank == chain_ranks.end() ? -1 : 2 * rank->second + entry->second.second;
+            }
+            auto rank = node_ranks.find(graph->get_id(handle));
+            return rank == node_ranks.end() ? -1 : 2 * rank->second + graph->get_is_reverse(handle);
+        };
+        auto states_after = [&](const handle_t& handle, vector<size_t>& states) {
+            graph->follow_edges(handle, false, [&](const handle_t& next) {
+                int64_t state = state_of(next);
+                if (state >= 0) {
+                    states.push_back(state);
+                }
+            });
+        };
+
+        // The ways out of the far end of each oriented node, and for chains
+        // the ways to turn around inside them
+        vector<int64_t> through_lengths(num_states, UNREACHABLE);
+        vector<vector<size_t>> through_next(num_states);
+        vector<int64_t> turn_lengths(num_states, UNREACHABLE);
+        vector<vector<size_t>> turn_next(num_states);
+        for (size_t state = 0; state < num_states; state++) {
+            bool is_reverse = state % 2;
+            const pair<bool, size_t>& net_node = net_nodes[state / 2];
+            if (net_node.first) {
+                const ChainRecord& chain = chains[net_node.second];
+                const handle_t& chain_start = boundaries[net_node.second].front();
+                const handle_t& chain_end = boundaries[net_node.second].back();
+                through_lengths[state] = chain_length(chain, is_reverse);
+                states_after(is_reverse ? graph->flip(chain_start) : chain_end, through_next[state]);
+                turn_lengths[state] = chain_loop(chain, is_reverse);
+                states_after(is_reverse ? chain_end : graph->flip(chain_start), turn_next[state]);
+            }
+            else {
+                handle_t handle = graph->get_handle(net_node.second, is_reverse);
+                if (handle == end || handle == graph->flip(start)) {
+                    // leaving the snarl
+                    continue;
+                }
+                through_lengths[state] = graph->get_length(handle);
+                states_after(handle, through_next[state]);
+            }
+        }
+
+        // Find all the distances from each oriented node
+        record.distances.assign(num_states * num_states, UNREACHABLE);
+        for (size_t source = 0; source < num_states; source++) {
+            int64_t* distances = record.distances.data() + source * num_states;
+
+            priority_queue<pair<int64_t, size_t>, vector<pair<int64_t, size_t>>, greater<pair<int64_t, size_t>>> queue;
+            for (size_t next : through_next[source]) {
+                queue.emplace(0, next);
+            }
+
+            while (!queue.empty()) {
+                int64_t distance = queue.top().first;
+                size_t state = queue.top().second;
+                queue.pop();
+                if (distances[state] != UNREACHABLE) {
+                    continue;
+                }
+                distances[state] = distance;
+
+                if (through_lengths[state] < UNREACHABLE) {
+                    for (size_t next : through_next[state]) {
+                        if (distances[next] == UNREACHABLE) {
+                            queue.emplace(distance + through_lengths[state], next);
+                        }
+                    }
+                }
+                if (turn_lengths[state] < UNREACHABLE) {
+                    for (size_t next : turn_next[state]) {
+                        if (distances[next] == UNREACHABLE) {
+                            queue.emplace(distance + turn_lengths[state], next);
+                        }
+                    }
+                }
+            }
+        }
+
+#ifdef debug_distance_index
+        cerr << "[DistanceIndex] snarl " << pb2json(*snarl) << " has " << net_nodes.size() << " net graph nodes" << endl;
+#endif
+    };
+
+    // Index the chains and snarls bottom up
+    for (size_t i = chains.size(); i > 0; i--) {
+        size_t chain_rank = i - 1;
+        ChainRecord& record = chains[chain_rank];
+        if (boundaries[chain_rank].empty()) {
+            throw runtime_error("[vg::DistanceIndex] snarl manager has an empty chain");
+        }
+
+        size_t num_boundaries = boundaries[chain_rank].size();
+        record.boundary_lengths.resize(num_boundaries);
+        for (size_t j = 0; j < num_boundaries; j++) {
+            record.boundary_lengths[j] = graph->get_length(boundaries[chain_rank][j]);
+        }
+
+        // Index the snarls in the chain, and get the distances through them
+        record.forward_lengths.assign(num_boundaries, 0);
+        record.reverse_lengths.assign(num_boundaries, 0);
+        vector<int64_t> left_turns(num_boundaries, UNREACHABLE);
+        vector<int64_t> right_turns(num_boundaries, UNREACHABLE);
+        for (size_t j = 1; j < num_boundaries; j++) {
+            size_t snarl_rank = first_snarls[chain_rank] + j - 1;
+            index_snarl(snarl_rank);
+
+            // the inward left and outward right boundaries in chain orientation
+            const SnarlRecord& snarl = snarls[snarl_rank];
+            size_t left = snarl.reversed_in_chain ? snarl.end_state ^ 1 : snarl.start_state;
+            size_t right = snarl.reversed_in_chain ? snarl.start_state ^ 1 : snarl.end_state;
+            record.forward_lengths[j] = snarl_distance(snarl, left, right);
+            record.reverse_lengths[j] = snarl_distance(snarl, right ^ 1, left ^ 1);
+            left_turns[j] = snarl_distance(snarl, left, left ^ 1);
+            right_turns[j] = snarl_distance(snarl, right ^ 1, right);
+        }
+
+        record.forward_prefix.assign(num_boundaries, 0);
+        record.forward_unreachable.assign(num_boundaries, 0);
+        for (size_t j = 1; j < num_boundaries; j++) {
+            bool crossable = record.forward_lengths[j] < UNREACHABLE;
+            record.forward_prefix[j] = record.forward_prefix[j - 1] + record.boundary_lengths[j - 1]
+                                     + (crossable ? record.forward_lengths[j] : 0);
+            record.forward_unreachable[j] = record.forward_unreachable[j - 1] + !crossable;
+        }
+        record.reverse_prefix.assign(num_boundaries, 0);
+        record.reverse_unreachable.assign(num_boundaries, 0);
+        for (size_t j = num_boundaries - 1; j > 0; j--) {
+            bool crossable = record.reverse_lengths[j] < UNREACHABLE;
+            record.reverse_prefix[j - 1] = record.reverse_prefix[j] + record.boundary_lengths[j]
+                                         + (crossable ? record.reverse_lengths[j] : 0);
+            record.reverse_unreachable[j - 1] = record.reverse_unreachable[j] + !crossable;
+        }
+
+        // Turning around inside the chain
+        record.right_loops = left_turns;
+        record.right_loops.erase(record.right_loops.begin());
+        record.right_loops.push_back(UNREACHABLE);
+        record.left_loops = right_turns;
+        record.left_loops[0] = UNREACHABLE;
+        for (size_t j = num_boundaries - 1; j > 0; j--) {
+            record.right_loops[j - 1] = min(record.right_loops[j - 1],
+                                            dist_sum({record.forward_lengths[j], record.boundary_lengths[j], record.right_loops[j],
+                                                      record.boundary_lengths[j], record.reverse_lengths[j]}));
+        }
+        for (size_t j = 1; j < num_boundaries; j++) {
+            record.left_loops[j] = min(record.left_loops[j],
+                                       dist_sum({record.reverse_lengths[j], record.boundary_lengths[j - 1], record.left_loops[j - 1],
+                                                 record.boundary_lengths[j - 1], record.forward_lengths[j]}));
+        }
+        record.first_snarl = first_snarls[chain_rank];
+    }
+
+    // Now find the ways around the outside of each chain and snarl, top down,
+    // since they go through the parents
+    for (ChainRecord& record : chains) {
+        record.outer_distances.assign(4, UNREACHABLE);
+        if (record.parent >= 0) {
+            const SnarlRecord& parent = snarls[record.parent];
+            size_t forward_state = 2 * record.rank_in_parent;
+            size_t reverse_state = forward_state + 1;
+            record.outer_distances[0] = outer_snarl_distance(parent, reverse_state, forward_state);
+            record.outer_distances[1] = outer_snarl_distance(parent, reverse_state, reverse_state);
+            record.outer_distances[2] = outer_snarl_distance(parent, forward_state, forward_state);
+            record.outer_distances[3] = outer_snarl_distance(parent, forward_state, reverse_state);
+        }
+
+        for (size_t j = 1; j < record.boundary_lengths.size(); j++) {
+            SnarlRecord& snarl = snarls[record.first_snarl + j - 1];
+            vector<int64_t> edges = chain_graph(record, vector<size_t>{2 * j - 1});
+            snarl.outer_distances.assign(4, UNREACHABLE);
+            for (bool leaves_through_end : {false, true}) {
+                // the snarl's start is on the left unless it's backward
+                bool leaves_right = leaves_through_end != snarl.reversed_in_chain;
+                vector<int64_t> distances = shortest_distances(edges, chain_graph_size(1),
+                                                               slot_vertex(0, leaves_right ? RIGHT_OUT : LEFT_OUT));
+                for (bool enters_through_end : {false, true}) {
+                    bool enters_right = enters_through_end != snarl.reversed_in_chain;
+                    snarl.outer_distances[2 * leaves_through_end + enters_through_end] =
+                        distances[slot_vertex(0, enters_right ? RIGHT_IN : LEFT_IN)];
+                }
+            }
+        }
+    }
+}
+
+inline int64_t DistanceIndex::snarl_distance(const SnarlRecord& snarl, size_t from, size_t to) const {
+    return snarl.distances[from * 2 * snarl.net_size + to];
+}
+
+pair<int64_t, size_t> DistanceIndex::forward_coordinate(const ChainRecord& chain, size_t slot, bool right_side) const {
+    // the side of a snarl is the side of the boundary next to it
+    size_t boundary = slot % 2 ? (right_side ? slot / 2 + 1 : slot / 2) : slot / 2;
+    bool boundary_right_side = slot % 2 ? !right_side : right_side;
+    return make_pair(chain.forward_prefix[boundary] + (boundary_right_side ? chain.boundary_lengths[boundary] : 0),
+                     chain.forward_unreachable[boundary]);
+}
+
+pair<int64_t, size_t> DistanceIndex::reverse_coordinate(const ChainRecord& chain, size_t slot, bool right_side) const {
+    size_t boundary = slot % 2 ? (right_side ? slot / 2 + 1 : slot / 2) : slot / 2;
+    bool boundary_right_side = slot % 2 ? !right_side : right_side;
+    return make_pair(chain.reverse_prefix[boundary] + (boundary_right_side ? 0 : chain.boundary_lengths[boundary]),
+                     chain.reverse_unreachable[boundary]);
+}
+
+int64_t DistanceIndex::slot_length(const ChainRecord& chain, size_t slot, bool leftward) const {
+    if (slot % 2) {
+        return leftward ? chain.reverse_lengths[slot / 2 + 1] : chain.forward_lengths[slot / 2 + 1];
+    }
+    return chain.boundary_lengths[slot / 2];
+}
+
+int64_t DistanceIndex::slot_loop(const ChainRecord& chain, size_t slot, bool left_side) const {
+    if (slot % 2) {
+        // go over the boundary next to the snarl, turn around, and come back
+        size_t boundary = left_side ? slot / 2 : slot / 2 + 1;
+        return dist_sum({chain.boundary_lengths[boundary],
+                         left_side ? chain.left_loops[boundary] : chain.right_loops[boundary],
+                         chain.boundary_lengths[boundary]});
+    }
+    return left_side ? chain.left_loops[slot / 2] : chain.right_loops[slot / 2];
+}
+
+int64_t DistanceIndex::slot_turn(const ChainRecord& chain, size_t slot, bool left_side) const {
+    if (slot % 2 == 0) {
+        // can't turn around in a node
+        return UNREACHABLE;
+    }
+    const SnarlRecord& snarl = snarls[chain.first_snarl + slot / 2];
+    size_t left = snarl.reversed_in_chain ? snarl.end_state ^ 1 : snarl.start_state;
+    size_t right = snarl.reversed_in_chain ? snarl.start_state ^ 1 : snarl.end_state;
+    return left_side ? snarl_distance(snarl, left, left ^ 1) : snarl_distance(snarl, right ^ 1, right);
+}
+
+int64_t DistanceIndex::outer_snarl_distance(const SnarlRecord& snarl, size_t from, size_t to) const {
+    int64_t best = snarl_distance(snarl, from, to);
+    size_t exits[2] = {snarl.start_state ^ 1, snarl.end_state};
+    size_t entries[2] = {snarl.start_state, snarl.end_state ^ 1};
+    for (size_t i = 0; i < 2; i++) {
+        for (size_t j = 0; j < 2; j++) {
+            best = min(best, dist_sum({snarl_distance(snarl, from, exits[i]), snarl.outer_distances[2 * i + j],
+                                       snarl_distance(snarl, entries[j], to)}));
+        }
+    }
+    return best;
+}
+
+vector<int64_t> DistanceIndex::chain_graph(const ChainRecord& chain, const vector<size_t>& slots) const {
+    size_t size = chain_graph_size(slots.size());
+    vector<int64_t> edges(size * size, UNREACHABLE);
+    auto add_edge = [&](size_t from, size_t to, int64_t distance) {
+        edges[from * size + to] = min(edges[from * size + to], distance);
+    };
+
+    size_t last_slot = 2 * chain.boundary_lengths.size() - 2;
+    size_t last = chain.boundary_lengths.size() - 1;
+
+    // around the outside of the chain
+    add_edge(chain_vertex(LEFT_OUT), chain_vertex(LEFT_IN), chain.outer_distances[0]);
+    add_edge(chain_vertex(LEFT_OUT), chain_vertex(RIGHT_IN), chain.outer_distances[1]);
+    add_edge(chain_vertex(RIGHT_OUT), chain_vertex(LEFT_IN), chain.outer_distances[2]);
+    add_edge(chain_vertex(RIGHT_OUT), chain_vertex(RIGHT_IN), chain.outer_distances[3]);
+    // turning around inside it from either end
+    add_edge(chain_vertex(LEFT_IN), chain_vertex(LEFT_OUT),
+             dist_sum({chain.boundary_lengths[0], chain.right_loops[0], chain.boundary_lengths[0]}));
+    add_edge(chain_vertex(RIGHT_IN), chain_vertex(RIGHT_OUT),
+             dist_sum({chain.boundary_lengths[last], chain.left_loops[last], chain.boundary_lengths[last]}));
+
+    // walk along the chain from the left end to the right end, connecting
+    // each slot to the last thing on its left
+    size_t prev_rightward = chain_vertex(LEFT_IN);
+    size_t prev_leftward = chain_vertex(LEFT_OUT);
+    pair<int64_t, size_t> prev_forward = forward_coordinate(chain, 0, false);
+    pair<int64_t, size_t> prev_reverse = reverse_coordinate(chain, 0, false);
+    for (size_t i = 0; i < slots.size(); i++) {
+        size_t slot = slots[i];
+        add_edge(prev_rightward, slot_vertex(i, LEFT_IN),
+                 coordinate_distance(prev_forward, forward_coordinate(chain, slot, false)));
+        add_edge(slot_vertex(i, LEFT_OUT), prev_leftward,
+                 coordinate_distance(reverse_coordinate(chain, slot, false), prev_reverse));
+
+        // through the slot, turning around inside it, and turning around next to it
+        add_edge(slot_vertex(i, LEFT_IN), slot_vertex(i, RIGHT_OUT), slot_length(chain, slot, false));
+        add_edge(slot_vertex(i, RIGHT_IN), slot_vertex(i, LEFT_OUT), slot_length(chain, slot, true));
+        add_edge(slot_vertex(i, LEFT_IN), slot_vertex(i, LEFT_OUT), slot_turn(chain, slot, true));
+        add_edge(slot_vertex(i, RIGHT_IN), slot_vertex(i, RIGHT_OUT), slot_turn(chain, slot, false));
+        add_edge(slot_vertex(i, LEFT_OUT), slot_vertex(i, LEFT_IN), slot_loop(chain, slot, true));
+        add_edge(slot_vertex(i, RIGHT_OUT), slot_vertex(i, RIGHT_IN), slot_loop(chain, slot, false));
+
+        prev_rightward = slot_vertex(i, RIGHT_OUT);
+        prev_leftward = slot_vertex(i, RIGHT_IN);
+        prev_forward = forward_coordinate(chain, slot, true);
+        prev_reverse = reverse_coordinate(chain, slot, true);
+    }
+    add_edge(prev_rightward, chain_vertex(RIGHT_OUT),
+             coordinate_distance(prev_forward, forward_coordinate(chain, last_slot, true)));
+    add_edge(chain_vertex(RIGHT_IN), prev_leftward,
+             coordinate_distance(reverse_coordinate(chain, last_slot, true), prev_reverse));
+
+    return edges;
+}
+
+int64_t DistanceIndex::min_distance(const pos_t& pos1, const pos_t& pos2) const {
+
+    auto found1 = nodes.find(id(pos1));
+    auto found2 = nodes.find(id(pos2));
+    if (found1 == nodes.end() || found2 == nodes.end()) {
+        return numeric_limits<int64_t>::max();
+    }
+
+    int64_t best = UNREACHABLE;
+    if (id(pos1) == id(pos2) && is_rev(pos1) == is_rev(pos2) && offset(pos2) >= offset(pos1)) {
+        best = offset(pos2) - offset(pos1);
+    }
+
+    // One step up the snarl tree from a position: the snarl or chain, the
+    // oriented net graph nodes or chain slot the position is in, and how far
+    // they are from the position
+    struct Level {
+        bool is_chain;
+        size_t record;
+        vector<pair<size_t, int64_t>> states;
+        size_t slot;
+        SideDistances sides;
+    };
+
+    // Walk up the tree from each position, getting distances to leave from
+    // the first and to arrive at the second
+    auto climb = [&](const NodeRecord& node, const pos_t& pos, bool leaving) {
+        vector<Level> levels;
+        Level level;
+        level.is_chain = node.in_chain;
+        level.record = node.record;
+        if (node.in_chain) {
+            level.slot = 2 * node.rank;
+            int64_t distance = leaving ? node.length - offset(pos) : offset(pos);
+            bool rightward = is_rev(pos) == node.reversed;
+            level.sides.left = rightward == leaving ? UNREACHABLE : distance;
+            level.sides.right = rightward == leaving ? distance : UNREACHABLE;
+        }
+        else {
+            level.states.emplace_back(2 * node.rank + is_rev(pos), leaving ? node.length - offset(pos) : offset(pos));
+        }
+
+        while (true) {
+            if (level.is_chain) {
+                const ChainRecord& chain = chains[level.record];
+                levels.push_back(level);
+                if (chain.parent < 0) {
+                    break;
+                }
+                vector<int64_t> edges = chain_graph(chain, vector<size_t>{level.slot});
+                size_t size = chain_graph_size(1);
+                size_t source = size - 2;
+                size_t sink = size - 1;
+                SideDistances sides;
+                if (leaving) {
+                    edges[source * size + slot_vertex(0, LEFT_OUT)] = level.sides.left;
+                    edges[source * size + slot_vertex(0, RIGHT_OUT)] = level.sides.right;
+                    vector<int64_t> distances = shortest_distances(edges, size, source);
+                    sides.left = distances[chain_vertex(LEFT_OUT)];
+                    sides.right = distances[chain_vertex(RIGHT_OUT)];
+                }
+                else {
+                    edges[slot_vertex(0, LEFT_IN) * size + sink] = level.sides.left;
+                    edges[slot_vertex(0, RIGHT_IN) * size + sink] = level.sides.right;
+                    sides.left = shortest_distances(edges, size, chain_vertex(LEFT_IN))[sink];
+                    sides.right = shortest_distances(edges, size, chain_vertex(RIGHT_IN))[sink];
+                }
+                level.is_chain = false;
+                level.record = chain.parent;
+                level.states.clear();
+                level.states.emplace_back(2 * chain.rank_in_parent, leaving ? sides.right : sides.left);
+                level.states.emplace_back(2 * chain.rank_in_parent + 1, leaving ? sides.left : sides.right);
+            }
+            else {
+                const SnarlRecord& snarl = snarls[level.record];
+                SideDistances sides{UNREACHABLE, UNREACHABLE};
+                for (auto& state : level.states) {
+                    if (leaving) {
+                        sides.left = min(sides.left, dist_sum({state.second, snarl_distance(snarl, state.first, snarl.start_state ^ 1)}));
+                        sides.right = min(sides.right, dist_sum({state.second, snarl_distance(snarl, state.first, snarl.end_state)}));
+                    }
+                    else {
+                        sides.left = min(sides.left, dist_sum({snarl_distance(snarl, snarl.start_state, state.first), state.second}));
+                        sides.right = min(sides.right, dist_sum({snarl_distance(snarl, snarl.end_state ^ 1, state.first), state.second}));
+                    }
+                }
+                level.sides = snarl.reversed_in_chain ? SideDistances{sides.right, sides.left} : sides;
+                level.slot = 2 * snarl.rank_in_chain - 1;
+                levels.push_back(level);
+
+                level.is_chain = true;
+                level.record = snarl.chain;
+                level.states.clear();
+            }
+        }
+        return levels;
+    };
+
+    vector<Level> levels1 = climb(found1->second, pos1, true);
+    vector<Level> levels2 = climb(found2->second, pos2, false);
+
+    // Find the lowest common ancestor
+    auto it1 = levels1.rbegin();
+    auto it2 = levels2.rbegin();
+    if (it1->record != it2->record) {
+        // different root chains
+        return best == UNREACHABLE ? numeric_limits<int64_t>::max() : best;
+    }
+    while (it1 + 1 != levels1.rend() && it2 + 1 != levels2.rend()
+           && (it1 + 1)->is_chain == (it2 + 1)->is_chain && (it1 + 1)->record == (it2 + 1)->record) {
+        ++it1;
+        ++it2;
+    }
+
+    if (it1->is_chain) {
+        // find the shortest walk between the slots in the common chain
+        vector<size_t> slots{min(it1->slot, it2->slot), max(it1->slot, it2->slot)};
+        if (slots[0] == slots[1]) {
+            slots.pop_back();
+        }
+        size_t from = it1->slot == slots[0] ? 0 : 1;
+        size_t to = it2->slot == slots[0] ? 0 : 1;
+        vector<int64_t> edges = chain_graph(chains[it1->record], slots);
+        size_t size = chain_graph_size(slots.size());
+        size_t source = size - 2;
+        size_t sink = size - 1;
+        edges[source * size + slot_vertex(from, LEFT_OUT)] = it1->sides.left;
+        edges[source * size + slot_vertex(from, RIGHT_OUT)] = it1->sides.right;
+        edges[slot_vertex(to, LEFT_IN) * size + sink] = it2->sides.left;
+        edges[slot_vertex(to, RIGHT_IN) * size + sink] = it2->sides.right;
+        best = min(best, shortest_distances(edges, size, source)[sink]);
+    }
+    else {
+        const SnarlRecord& snarl = snarls[it1->record];
+        for (auto& state1 : it1->states) {
+            for (auto& state2 : it2->states) {
+                best = min(best, dist_sum({state1.second, outer_snarl_distance(snarl, state1.first, state2.first),
+                                           state2.second}));
+            }
+        }
+    }
+
+#ifdef debug_distance_index
+    cerr << "[DistanceIndex] distance from " << pos1 << " to " << pos2 << " is " << best << endl;
+#endif
+
+    return best == UNREACHABLE ? numeric_limits<int64_t>::max() : best;
+}
+
+int64_t DistanceIndex::oriented_distance(const pos_t& pos1, const pos_t& pos2) const {
+    int64_t forward = min_distance(pos1, pos2);
+    int64_t backward = min_distance(pos2, pos1);
+    if (forward == numeric_limits<int64_t>::max() && backward == numeric_limits<int64_t>::max()) {
+        return numeric_limits<int64_t>::max();
+    }
+    return forward <= backward ? forward : -backward;
+}
+
+bool DistanceIndex::has_node(id_t node_id) const {
+    return nodes.count(node_id);
+}
+
+void DistanceIndex::save(ostream& out) const {
+    out.write(DISTANCE_INDEX_MAGIC, sizeof(DISTANCE_INDEX_MAGIC));
+    out.write((const char*) &DISTANCE_INDEX_VERSION, sizeof(DISTANCE_INDEX_VERSION));
+
+    uint64_t node_count = nodes.size();
+    out.write((const char*) &node_count, sizeof(node_count));
+    for (auto& node : nodes) {
+        int64_t fields[5] = {node.first, node.second.in_chain, (int64_t) node.second.record,
+                             (int64_t) node.second.rank, node.second.reversed};
+        out.write((const char*) fields, sizeof(fields));
+        out.write((const char*) &node.second.length, sizeof(node.second.length));
+    }
+
+    uint64_t snarl_count = snarls.size();
+    out.write((const char*) &snarl_count, sizeof(snarl_count));
+    for (auto& snarl : snarls) {
+        uint64_t fields[5] = {snarl.net_size, snarl.start_state, snarl.end_state, snarl.chain, snarl.rank_in_chain};
+        out.write((const char*) fields, sizeof(fields));
+        out.write((const char*) &snarl.reversed_in_chain, sizeof(snarl.reversed_in_chain));
+        write_vector(out, snarl.distances);
+        write_vector(out, snarl.outer_distances);
+    }
+
+    uint64_t chain_count = chains.size();
+    out.write((const char*) &chain_count, sizeof(chain_count));
+    for (auto& chain : chains) {
+        out.write((const char*) &chain.parent, sizeof(chain.parent));
+        uint64_t ranks[2] = {chain.rank_in_parent, chain.first_snarl};
+        out.write((const char*) ranks, sizeof(ranks));
+        write_vector(out, chain.boundary_lengths);
+        write_vector(out, chain.forward_lengths);
+        write_vector(out, chain.reverse_lengths);
+        write_vector(out, chain.forward_prefix);
+        write_vector(out, chain.forward_unreachable);
+        write_vector(out, chain.reverse_prefix);
+        write_vector(out, chain.reverse_unreachable);
+        write_vector(out, chain.right_loops);
+        write_vector(out, chain.left_loops);
+        write_vector(out, chain.outer_distances);
+    }
+
+    if (!out) {
+        throw runtime_error("[vg::DistanceIndex] could not write index");
+    }
+}
+
+void DistanceIndex::load(istream& in) {
+    char magic[sizeof(DISTANCE_INDEX_MAGIC)];
+    uint32_t version = 0;
+    in.read(magic, sizeof(magic));
+    in.read((char*) &version, sizeof(version));
+    if (!in || !equal(magic, magic + sizeof(magic), DISTANCE_INDEX_MAGIC)) {
+        throw runtime_error("[vg::DistanceIndex] data is not a distance index");
+    }
+    if (version != DISTANCE_INDEX_VERSION) {
+        throw runtime_error("[vg::DistanceIndex] unsupported distance index version " + to_string(version));
+    }
+
+    nodes.clear();
+    snarls.clear();
+    chains.clear();
+
+    uint64_t node_count = 0;
+    in.read((char*) &node_count, sizeof(node_count));
+    nodes.reserve(node_count);
+    for (uint64_t i = 0; i < node_count && in; i++) {
+        int64_t fields[5];
+        in.read((char*) fields, sizeof(fields));
+        NodeRecord& record = nodes[fields[0]];
+        record.in_chain = fields[1];
+        record.record = fields[2];
+        record.rank = fields[3];
+        record.reversed = fields[4];
+        in.read((char*) &record.length, sizeof(record.length));
+    }
+
+    uint64_t snarl_count = 0;
+    in.read((char*) &snarl_count, sizeof(snarl_count));
+    for (uint64_t i = 0; i < snarl_count && in; i++) {
+        snarls.emplace_back();
+        SnarlRecord& snarl = snarls.back();
+        uint64_t fields[5];
+        in.read((char*) fields, sizeof(fields));
+        snarl.net_size = fields[0];
+        snarl.start_state = fields[1];
+        snarl.end_state = fields[2];
+        snarl.chain = fields[3];
+        snarl.rank_in_chain = fields[4];
+        in.read((char*) &snarl.reversed_in_chain, sizeof(snarl.reversed_in_chain));
+        read_vector(in, snarl.distances);
+        read_vector(in, snarl.outer_distances);
+        if (snarl.distances.size() != 4 * snarl.net_size * snarl.net_size || snarl.outer_distances.size() != 4) {
+            throw runtime_error("[vg::DistanceIndex] corrupt distance index");
+        }
+    }
+
+    uint64_t chain_count = 0;
+    in.read((char*) &chain_count, sizeof(chain_count));
+    for (uint64_t i = 0; i < chain_count && in; i++) {
+        chains.emplace_back();
+        ChainRecord& chain = chains.back();
+        in.read((char*) &chain.parent, sizeof(chain.parent));
+        uint64_t ranks[2] = {0, 0};
+        in.read((char*) ranks, sizeof(ranks));
+        chain.rank_in_parent = ranks[0];
+        chain.first_snarl = ranks[1];
+        read_vector(in, chain.boundary_lengths);
+        read_vector(in, chain.forward_lengths);
+        read_vector(in, chain.reverse_lengths);
+        read_vector(in, chain.forward_prefix);
+        read_vector(in, chain.forward_unreachable);
+        read_vector(in, chain.reverse_prefix);
+        read_vector(in, chain.reverse_unreachable);
+        read_vector(in, chain.right_loops);
+        read_vector(in, chain.left_loops);
+        read_vector(in, chain.outer_distances);
+        if (chain.outer_distances.size() != 4) {
+            throw runtime_error("[vg::DistanceIndex] corrupt distance index");
+        }
+    }
+
+    if (!in) {
+        throw runtime_error("[vg::DistanceIndex] truncated distance index");
+    }
+}
+
+}
@@ -0,0 +1,183 @@
+#ifndef VG_DISTANCE_INDEX_HPP_INCLUDED
+#define VG_DISTANCE_INDEX_HPP_INCLUDED
+
+/** \file
+ *
+ * Provides a minimum distance index over the snarl decomposition of a graph.
+ *
+ * Each snarl stores the minimum distances between all the oriented nodes and
+ * child chains of its net graph, and each chain stores prefix sums of the
+ * lengths of its boundary nodes and snarls, along with the shortest ways to
+ * turn around at each boundary. The minimum distance between two positions is
+ * then found by walking up the snarl tree from each position to their lowest
+ * common ancestor, so queries take time proportional to the depth of the snarl
+ * tree and don't need the graph or any embedded paths.
+ *
+ * Walks may leave a snarl or chain and come back into it, so each snarl and
+ * chain also stores the shortest ways to get from each of its sides back to
+ * each of its sides through the rest of the graph.
+ */
+
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include <cstdint>
+
+#include "handle.hpp"
+#include "snarls.hpp"
+#include "types.hpp"
+
+namespace vg {
+
+using namespace std;
+
+class DistanceIndex {
+public:
+
+    /// Make an empty index, to load into.
+    DistanceIndex() = default;
+
+    /// Index the minimum distances in a graph, using its snarl decomposition.
+    /// Every node of the graph that queries will touch must be in a snarl or
+    /// be the boundary of one.
+    DistanceIndex(const HandleGraph* graph, const SnarlManager* snarl_manager);
+
+    /// Save the index to a stream
+    void save(ostream& out) const;
+
+    /// Load an index from a stream, replacing the current contents. Throws
+    /// if the data is not a distance index.
+    void load(istream& in);
+
+    /// Get the minimum distance from the first position to the second, reading
+    /// in the orientation of the first position. The distance is the
+    /// difference between the offsets of the positions along the shortest walk
+    /// that visits them both in order, like xg_distance(). Returns
+    /// numeric_limits<int64_t>::max() if there is no such walk or either
+    /// position is on a node that isn't indexed.
+    int64_t min_distance(const pos_t& pos1, const pos_t& pos2) const;
+
+    /// Get the distance between two positions, positive if the second position
+    /// comes after the first in the orientation of the first and negative if
+    /// it comes before it, like XG::closest_shared_path_oriented_distance().
+    /// If both are possible, the one of smaller magnitude is returned. Returns
+    /// numeric_limits<int64_t>::max() if the positions are not connected.
+    int64_t oriented_distance(const pos_t& pos1, const pos_t& pos2) const;
+
+    /// Return true if the given node is in the index
+    bool has_node(id_t node_id) const;
+
+private:
+
+    /// Where a node lives in the snarl tree: in the net graph of a snarl, or as
+    /// a boundary node of a chain
+    struct NodeRecord {
+        /// Is the node a chain boundary rather than a node in a snarl?
+        bool in_chain = false;
+        /// Index of the snarl or chain
+        size_t record = 0;
+        /// Index of the node in the snarl's net graph, or of the boundary in
+        /// the chain
+        size_t rank = 0;
+        /// Is the node reversed relative to the chain? Always false for nodes
+        /// in snarls.
+        bool reversed = false;
+        int64_t length = 0;
+    };
+
+    struct SnarlRecord {
+        /// Number of nodes and child chains in the net graph
+        size_t net_size = 0;
+        /// Minimum number of bases strictly between the end of one oriented
+        /// net graph node and the start of another, without leaving the snarl,
+        /// indexed by 2 * net_size * (2 * rank + is_reverse) + 2 * rank + is_reverse.
+        /// Child chains are forward when they are entered through their start.
+        vector<int64_t> distances;
+        /// Oriented net graph nodes of the inward-facing start and outward-facing end
+        size_t start_state = 0;
+        size_t end_state = 0;
+        /// The chain the snarl is in, the snarl's rank in the chain (starting
+        /// at 1), and whether it is backward in the chain
+        size_t chain = 0;
+        size_t rank_in_chain = 0;
+        bool reversed_in_chain = false;
+        /// Minimum distance to leave through the start or end and come back
+        /// in through the start or end without passing through the snarl,
+        /// indexed by 2 * leaves_through_end + enters_through_end
+        vector<int64_t> outer_distances;
+    };
+
+    struct ChainRecord {
+        /// The snarl whose net graph contains the chain, or -1 for a root chain
+        int64_t parent = -1;
+        /// Rank of the chain in its parent's net graph
+        size_t rank_in_parent = 0;
+        /// Index of the first snarl in the chain; the rest follow it
+        size_t first_snarl = 0;
+        /// Lengths of the boundary nodes, in chain order
+        vector<int64_t> boundary_lengths;
+        /// Minimum distance through each snarl left to right and right to left
+        /// in chain orientation, between the boundaries (indexed from 1)
+        vector<int64_t> forward_lengths;
+        vector<int64_t> reverse_lengths;
+        /// Distance from the left side of the first boundary to the left side
+        /// of each boundary, ignoring snarls that can't be crossed, and how many
+        /// of those there are on the way
+        vector<int64_t> forward_prefix;
+        vector<size_t> forward_unreachable;
+        /// Distance from the right side of the last boundary to the right side
+        /// of each boundary, going leftward, in the same way
+        vector<int64_t> reverse_prefix;
+        vector<size_t> reverse_unreachable;
+        /// Shortest distance from the right side of each boundary to come back
+        /// to it going leftward, and from the left side going rightward,
+        /// without leaving the chain
+        vector<int64_t> right_loops;
+        vector<int64_t> left_loops;
+        /// Minimum distance to leave through the left or right end and come
+        /// back in through the left or right end without passing through the
+        /// chain, indexed by 2 * leaves_right + enters_right
+        vector<int64_t> outer_distances;
+    };
+
+    /// Distances between a position and the left and right sides of a chain
+    /// or one of its slots. A chain's slots are its boundary nodes (at slot
+    /// 2 * rank) and the snarls between them (at slot 2 * rank - 1).
+    struct SideDistances {
+        int64_t left;
+        int64_t right;
+    };
+
+    unordered_map<id_t, NodeRecord> nodes;
+    vector<SnarlRecord> snarls;
+    vector<ChainRecord> chains;
+
+    /// Distance between oriented net graph nodes in a snarl
+    inline int64_t snarl_distance(const SnarlRecord& snarl, size_t from, size_t to) const;
+
+    /// Positions of the sides of chain slots along the chain, going right
+    /// from the left side of the first boundary or left from the right side of
+    /// the last one, with the number of uncrossable snarls on the way
+    pair<int64_t, size_t> forward_coordinate(const ChainRecord& chain, size_t slot, bool right_side) const;
+    pair<int64_t, size_t> reverse_coordinate(const ChainRecord& chain, size_t slot, bool right_side) const;
+    /// Minimum distance to cross a chain slot left to right or right to left
+    int64_t slot_length(const ChainRecord& chain, size_t slot, bool leftward) const;
+    /// Shortest way to turn around off the right or left side of a chain slot
+    int64_t slot_loop(const ChainRecord& chain, size_t slot, bool left_side) const;
+    /// Shortest way to turn around inside a chain slot, entering and leaving
+    /// through its left or right side
+    int64_t slot_turn(const ChainRecord& chain, size_t slot, bool left_side) const;
+    /// Distance between oriented net graph nodes in a snarl, allowing walks
+    /// that leave the snarl and come back
+    int64_t outer_snarl_distance(const SnarlRecord& snarl, size_t from, size_t to) const;
+
+    /// Make the edge weights of a small graph of the ways to get between the
+    /// sides of a chain and the sides of the given slots, which must be
+    /// sorted and distinct. See distance_index.cpp for the vertex layout.
+    vector<int64_t> chain_graph(const ChainRecord& chain, const vector<size_t>& slots) const;
+};
+
+}
+
+#endif
@@ -0,0 +1,204 @@
+#include "gam_index.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace vg {
+
+using namespace std;
+
+/// Magic number at the start of a serialized GAM index
+static const char GAM_INDEX_MAGIC[4] = {'G', 'A', 'I', '!'};
+
+/// Version of the serialized format we write
+static const uint32_t GAM_INDEX_VERSION = 1;
+
+GAMIndex::GAMIndex(id_t bin_size) : bin_size(bin_size) {
+    if (bin_size < 1) {
+        throw runtime_error("[vg::GAMIndex] bin size must be positive");
+    }
+}
+
+void GAMIndex::index(istream& sorted_gam) {
+    // Collect the first group offset for each bin. Alignments come in file
+    // order, so the first offset we see for a bin is the earliest.
+    unordered_map<id_t, int64_t> first_group;
+
+    id_t last_key = numeric_limits<id_t>::min();
+    function<void(int64_t, Alignment&)> lambda = [&](int64_t group_offset, Alignment& alignment) {
+        id_t key = get_sort_key(alignment);
+        if (key < last_key) {
+            throw runtime_error("[vg::GAMIndex] GAM is not sorted; alignment " + alignment.name() +
+                                " is out of order");
+        }
+        last_key = key;
+
+        auto range = get_id_range(alignment);
+        if (range.first > range.second) {
+            // Unmapped reads don't go in any bin
+            return;
+        }
+
+        if (group_offset < 0) {
+            throw runtime_error("[vg::GAMIndex] GAM groups can't be sought to; rewrite the GAM with this version of vg");
+        }
+
+        for (id_t bin = range.first / bin_size; bin <= range.second / bin_size; bin++) {
+            first_group.emplace(bin, group_offset);
+        }
+    };
+    stream::for_each_with_group_offsets(sorted_gam, lambda);
+
+    bin_starts.assign(first_group.begin(), first_group.end());
+    std::sort(bin_starts.begin(), bin_starts.end());
+}
+
+void GAMIndex::save(ostream& out) const {
+    out.write(GAM_INDEX_MAGIC, sizeof(GAM_INDEX_MAGIC));
+    out.write((const char*) &GAM_INDEX_VERSION, sizeof(GAM_INDEX_VERSION));
+    int64_t bin_size_out = bin_size;
+    out.write((const char*) &bin_size_out, sizeof(bin_size_out));
+    uint64_t bin_count = bin_starts.size();
+    out.write((const char*) &bin_count, sizeof(bin_count));
+    for (auto& bin_start : bin_starts) {
+        int64_t bin = bin_start.first;
+        out.write((const char*) &bin, sizeof(bin));
+        out.write((const char*) &bin_start.second, sizeof(bin_start.second));
+    }
+    if (!out) {
+        throw runtime_error("[vg::GAMIndex] could not write index");
+    }
+}
+
+void GAMIndex::load(istream& in) {
+    char magic[sizeof(GAM_INDEX_MAGIC)];
+    uint32_t version = 0;
+    in.read(magic, sizeof(magic));
+    in.read((char*) &version, sizeof(version));
+    if (!in || !equal(magic, magic + sizeof(magic), GAM_INDEX_MAGIC)) {
+        throw runtime_error("[vg::GAMIndex] data is not a GAM index");
+    }
+    if (version != GAM_INDEX_VERSION) {
+        throw runtime_error("[vg::GAMIndex] unsupported GAM index version " + to_string(version));
+    }
+
+    int64_t bin_size_in = 0;
+    uint64_t bin_count = 0;
+    in.read((char*) &bin_size_in, sizeof(bin_size_in));
+    in.read((char*) &bin_count, sizeof(bin_count));
+    if (!in || bin_size_in < 1) {
+        throw runtime_error("[vg::GAMIndex] corrupt GAM index");
+    }
+    bin_size = bin_size_in;
+
+    bin_starts.resize(bin_count);
+    for (auto& bin_start : bin_starts) {
+        int64_t bin = 0;
+        in.read((char*) &bin, sizeof(bin));
+        in.read((char*) &bin_start.second, sizeof(bin_start.second));
+        bin_start.first = bin;
+    }
+    if (!in) {
+        throw runtime_error("[vg::GAMIndex] truncated GAM index");
+    }
+}
+
+int64_t GAMIndex::find_start(id_t min_id, id_t max_id) const {
+    // Look at all the bins overlapping the range
+    auto it = lower_bound(bin_starts.begin(), bin_starts.end(), make_pair(min_id / bin_size, numeric_limits<int64_t>::min()));
+    int64_t earliest = -1;
+    for (; it != bin_starts.end() && it->first <= max_id / bin_size; ++it) {
+        if (earliest == -1 || it->second < earliest) {
+            earliest = it->second;
+        }
+    }
+    return earliest;
+}
+
+void GAMIndex::find(stream::ProtobufIterator<Alignment>& cursor, vector<pair<id_t, id_t>> ranges,
+                    const function<void(const Alignment&)>& iteratee) const {
+
+    // Sort and merge the ranges
+    std::sort(ranges.begin(), ranges.end());
+    vector<pair<id_t, id_t>> merged;
+    for (auto& range : ranges) {
+        if (!merged.empty() && range.first <= merged.back().second + 1) {
+            merged.back().second = max(merged.back().second, range.second);
+        } else {
+            merged.push_back(range);
+        }
+    }
+
+    // Does an alignment touch any of the ranges?
+    auto touches = [&](const Alignment& alignment) {
+        for (size_t i = 0; i < alignment.path().mapping_size(); i++) {
+            id_t id = alignment.path().mapping(i).position().node_id();
+            auto it = upper_bound(merged.begin(), merged.end(), make_pair(id, numeric_limits<id_t>::max()));
+            if (it != merged.begin() && (--it)->second >= id) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // Whatever the cursor is on when we finish a range has not been looked at
+    // yet. We only ever move forward, so each alignment is looked at once.
+    bool started = false;
+    for (auto& range : merged) {
+        int64_t start = find_start(range.first, range.second);
+        if (start == -1) {
+            // Nothing touches this range
+            continue;
+        }
+
+        if (started && !cursor.has_next()) {
+            // We already looked at everything
+            break;
+        }
+
+        if (!started || start > cursor.tell_group()) {
+            // We need to jump ahead to get to this range.
+            if (!cursor.seek_group(start)) {
+                throw runtime_error("[vg::GAMIndex] can't seek in GAM");
+            }
+            started = true;
+        }
+
+        while (cursor.has_next()) {
+            Alignment alignment = *cursor;
+            if (get_sort_key(alignment) > range.second) {
+                // Everything from here on only visits IDs past this range
+                break;
+            }
+            if (touches(alignment)) {
+                iteratee(alignment);
+            }
+            cursor.get_next();
+        }
+    }
+}
+
+void GAMIndex::find(istream& sorted_gam, id_t min_id, id_t max_id,
+                    const function<void(const Alignment&)>& iteratee) const {
+    stream::ProtobufIterator<Alignment> cursor(sorted_gam);
+    find(cursor, {make_pair(min_id, max_id)}, iteratee);
+}
+
+id_t GAMIndex::get_sort_key(const Alignment& alignment) {
+    // Unmapped alignments get the max ID from the empty range
+    return get_id_range(alignment).first;
+}
+
+pair<id_t, id_t> GAMIndex::get_id_range(const Alignment& alignment) {
+    pair<id_t, id_t> range(numeric_limits<id_t>::max(), numeric_limits<id_t>::min());
+    for (size_t i = 0; i < alignment.path().mapping_size(); i++) {
+        id_t id = alignment.path().mapping(i).position().node_id();
+        range.first = min(range.first, id);
+        range.second = max(range.second, id);
+    }
+    return range;
+}
+
+}
@@ -0,0 +1,86 @@
+#ifndef VG_GAM_INDEX_HPP_INCLUDED
+#define VG_GAM_INDEX_HPP_INCLUDED
+
+/** \file
+ *
+ * Provides a lightweight index for finding alignments that touch ranges of
+ * node IDs in a sorted GAM file, without a RocksDB database.
+ *
+ * The GAM must be sorted by the lowest node ID anywhere on each alignment's
+ * path, as produced by GAMSorter. The index divides the node ID
+ * space into fixed-size bins, and remembers the virtual offset of the first
+ * group in the file that has an alignment touching each bin, like the linear
+ * index of a BAI file.
+ */
+
+#include <iostream>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <cstdint>
+
+#include "vg.pb.h"
+#include "stream.hpp"
+#include "types.hpp"
+
+namespace vg {
+
+using namespace std;
+
+class GAMIndex {
+public:
+
+    /// Make an empty index with the given number of node IDs per bin.
+    GAMIndex(id_t bin_size = 256);
+
+    /// Index a GAM file, which must be sorted. Throws if it isn't sorted or
+    /// can't be sought in.
+    void index(istream& sorted_gam);
+
+    /// Save the index to a stream
+    void save(ostream& out) const;
+
+    /// Load an index from a stream, replacing the current contents. Throws
+    /// if the data is not a GAM index.
+    void load(istream& in);
+
+    /// Get the virtual offset of the earliest group that might have an
+    /// alignment touching the given inclusive range of node IDs, or -1 if no
+    /// alignment touches it.
+    int64_t find_start(id_t min_id, id_t max_id) const;
+
+    /// Call the given callback on each alignment in the sorted GAM being read
+    /// by the given iterator that touches any of the given inclusive node ID
+    /// ranges. Each alignment is reported only once, in file order. The
+    /// iterator is left wherever the search finished.
+    void find(stream::ProtobufIterator<Alignment>& cursor, vector<pair<id_t, id_t>> ranges,
+              const function<void(const Alignment&)>& iteratee) const;
+
+    /// Call the given callback on each alignment in the sorted GAM on the given
+    /// stream that touches the given inclusive range of node IDs.
+    void find(istream& sorted_gam, id_t min_id, id_t max_id,
+              const function<void(const Alignment&)>& iteratee) const;
+
+    /// Get the node ID that a sorted GAM is sorted on for an alignment: the
+    /// lowest node ID anywhere on its path, so that nothing after it in the
+    /// file can touch a lower ID. Alignments with no path sort last, and get
+    /// the maximum ID.
+    static id_t get_sort_key(const Alignment& alignment);
+
+    /// Get the lowest and highest node IDs that an alignment visits, or
+    /// (max, min) if it visits none.
+    static pair<id_t, id_t> get_id_range(const Alignment& alignment);
+
+private:
+
+    /// How many node IDs go in each bin
+    id_t bin_size;
+
+    /// For each bin that anything touches, the virtual offset of the first
+    /// group with an alignment touching it. Kept sorted by bin.
+    vector<pair<id_t, int64_t>> bin_starts;
+};
+
+}
+
+#endif
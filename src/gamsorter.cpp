@@ -1,4 +1,9 @@
 #include "gamsorter.hpp"
+#include "utility.hpp"
+
+#include <limits>
+#include <memory>
+#include <omp.h>
 /*
 *  GAMSorter: sort a gam by position and offset
 *  dumbly store unmapped reads at the end.
@@ -8,131 +13,133 @@ using namespace std;
 using namespace vg;
 
 
-class AlnSorter{
-    bool invert = false;
-public:
-  bool operator() (const Alignment& a_one, const Alignment& a_two) const
-  {
-
-        // Unmapped case
-        int xf_size = a_one.path().mapping_size();
-        int xb_size = a_two.path().mapping_size();
-        
-        if (xf_size == 0 || xb_size == 0){
-            bool both_zero = (xf_size == xb_size);
-            if (both_zero){
-                return false;
-            }
-            else{
-                return (xf_size > xb_size) ? false : true;
-            }
-        }
+GAMSorter::GAMSorter(size_t max_buffer_bytes, bool show_progress) :
+    max_buffer_bytes(max_buffer_bytes), show_progress(show_progress)
+{
+    // Nothing to do
+}
 
-        Position x_front = a_one.path().mapping(0).position();
-        Position x_back = a_one.path().mapping(a_one.path().mapping_size() - 1).position();
+GAMSortKey GAMSorter::get_sort_key(const Alignment& aln)
+{
+    GAMSortKey key;
+    auto& path = aln.path();
+    if (path.mapping_size() == 0)
+    {
+        // Unmapped reads go at the end
+        key.node_id = numeric_limits<id_t>::max();
+        key.offset = numeric_limits<size_t>::max();
+        return key;
+    }
 
-        Position lhs;
-        Position rhs;
-        if (x_front.node_id() < x_back.node_id())
-        {
-            lhs = x_front;
-        }
-        else
-        {
-            lhs = x_back;
-        }
-        Position y_front = a_two.path().mapping(0).position();
-        Position y_back = a_two.path().mapping(a_two.path().mapping_size() - 1).position();
-        if (y_front.node_id() < y_back.node_id())
-        {
-            rhs = y_front;
-        }
-        else
+    // Use the first visit to the lowest node anywhere on the path, so the
+    // sorted GAM can be searched with a GAMIndex
+    const Position* lowest = &path.mapping(0).position();
+    for (size_t i = 1; i < path.mapping_size(); i++)
+    {
+        auto& position = path.mapping(i).position();
+        if (position.node_id() < lowest->node_id())
         {
-            rhs = y_back;
+            lowest = &position;
         }
+    }
+    key.node_id = lowest->node_id();
+    key.offset = lowest->offset();
+    return key;
+}
 
-        if (lhs.node_id() == rhs.node_id())
-        {
-            return lhs.offset() < rhs.offset();
-        }
-        else
-        {
-            return lhs.node_id() < rhs.node_id();
-        }
-  }
-};
+void GAMSorter::sort(vector<Alignment> &alns)
+{
+    auto keys = sort_run(alns);
 
+    // Apply the permutation
+    vector<Alignment> sorted;
+    sorted.reserve(alns.size());
+    for (auto& key : keys)
+    {
+        sorted.emplace_back(std::move(alns[key.index]));
+    }
+    alns = std::move(sorted);
+}
 
-struct custom_pos_sort_key
+vector<GAMSorter::PackedSortKey> GAMSorter::sort_run(const vector<Alignment>& run)
 {
-    bool operator()(const Position lhs, const Position rhs)
+    if (run.size() > numeric_limits<uint32_t>::max())
     {
-        if (lhs.node_id() == rhs.node_id())
-        {
-            return lhs.offset() < rhs.offset();
-        }
-        else
-        {
-            return lhs.node_id() < rhs.node_id();
-        }
+        throw runtime_error("[vg::GAMSorter] too many alignments to sort in one run");
     }
-} possortkey;
 
-struct custom_aln_sort_key
+    vector<PackedSortKey> keys(run.size());
+#pragma omp parallel for if (!omp_in_parallel())
+    for (size_t i = 0; i < run.size(); i++)
+    {
+        GAMSortKey key = get_sort_key(run[i]);
+        keys[i].node_id = key.node_id;
+        // No node is 4 Gbp long, and unmapped reads saturate.
+        keys[i].offset = (uint32_t) min<size_t>(key.offset, numeric_limits<uint32_t>::max());
+        keys[i].index = i;
+    }
+
+    parallel_sort(keys);
+    return keys;
+}
+
+void GAMSorter::parallel_sort(vector<PackedSortKey>& keys)
 {
-    bool operator()(const Alignment a_one, const Alignment a_two)
+    size_t threads = omp_in_parallel() ? 1 : omp_get_max_threads();
+    if (threads < 2 || keys.size() < threads * 1024)
     {
-        int xf_size = a_one.path().mapping_size();
-        int xb_size = a_two.path().mapping_size();
-        
-        if (xf_size == 0 || xb_size == 0){
-            bool both_zero = (xf_size == xb_size);
-            if (both_zero){
-                return false;
-            }
-            else{
-                return (xf_size > xb_size) ? false : true;
-            }
-        }
-        Position x_front = a_one.path().mapping(0).position();
-        Position x_back = a_one.path().mapping(a_one.path().mapping_size() - 1).position();
+        // Not worth splitting up
+        std::sort(keys.begin(), keys.end());
+        return;
+    }
 
-        Position lhs;
-        Position rhs;
-        if (x_front.node_id() < x_back.node_id())
-        {
-            lhs = x_front;
-        }
-        else
-        {
-            lhs = x_back;
-        }
-        Position y_front = a_two.path().mapping(0).position();
-        Position y_back = a_two.path().mapping(a_two.path().mapping_size() - 1).position();
-        if (y_front.node_id() < y_back.node_id())
-        {
-            rhs = y_front;
-        }
-        else
-        {
-            rhs = y_back;
-        }
+    // Sort a slice in each thread
+    vector<size_t> bounds(threads + 1);
+    for (size_t i = 0; i <= threads; i++)
+    {
+        bounds[i] = keys.size() * i / threads;
+    }
+#pragma omp parallel for
+    for (size_t i = 0; i < threads; i++)
+    {
+        std::sort(keys.begin() + bounds[i], keys.begin() + bounds[i + 1]);
+    }
 
-        if (lhs.node_id() == rhs.node_id())
-        {
-            return lhs.offset() < rhs.offset();
-        }
-        else
+    // Merge adjacent slices until there is only one
+    for (size_t width = 1; width < threads; width *= 2)
+    {
+#pragma omp parallel for
+        for (size_t i = 0; i < threads; i += 2 * width)
         {
-            return lhs.node_id() < rhs.node_id();
+            if (i + width < threads)
+            {
+                std::inplace_merge(keys.begin() + bounds[i], keys.begin() + bounds[i + width],
+                                   keys.begin() + bounds[min(i + 2 * width, threads)]);
+            }
         }
     }
-} alnsortkey;
+}
 
-void GAMSorter::sort(vector<Alignment> &alns)
+void GAMSorter::write_run(vector<Alignment>& run, const vector<PackedSortKey>& keys, ostream& out)
 {
-    std::sort(alns.begin(), alns.end(), alnsortkey);
+    // Runs are written from parallel tasks, each to its own stream, so we
+    // emit groups with stream::write directly instead of going through
+    // write_buffered and its global critical section.
+    vector<Alignment> buffer;
+    buffer.reserve(output_group_size);
+    std::function<Alignment(uint64_t)> lambda = [&](uint64_t i) {
+        return buffer[i];
+    };
+    for (auto& key : keys)
+    {
+        buffer.emplace_back(std::move(run[key.index]));
+        if (buffer.size() >= output_group_size) {
+            stream::write(out, buffer.size(), lambda);
+            buffer.clear();
+        }
+    }
+    // Write the rest, or an empty group to end the stream
+    stream::write(out, buffer.size(), lambda);
 }
 
 void GAMSorter::paired_sort(string gamfile)
@@ -179,211 +186,197 @@ void GAMSorter::paired_sort(string gamfile)
     }
 }
 
-void GAMSorter::write_temp(vector<Alignment>& alns)
+void GAMSorter::dumb_sort(istream& gam_in, ostream& gam_out)
 {
-    string t_name = "tmp_sort_" + std::to_string(tmp_filenames.size());
-    tmp_filenames.push_back(t_name);
-    ofstream t_file;
-    t_file.open(t_name);
-    stream::write_buffered(t_file, alns, 0);
-    t_file.close();
-}
-
-void GAMSorter::dumb_sort(string gamfile)
-{
-    std::vector<Alignment> buf;
-    buf.reserve(1000000);
-
+    vector<Alignment> run;
     std::function<void(Alignment&)> presort = [&](Alignment &aln) {
-        buf.push_back(aln);
+        run.emplace_back(std::move(aln));
     };
-    ifstream gammy;
-    gammy.open(gamfile);
-    stream::for_each(gammy, presort);
+    stream::for_each(gam_in, presort);
 
-    std::sort(buf.begin(), buf.end(), alnsortkey);
-
-    std::function<void(uint64_t)> x_buf_func = [&](uint64_t) {
-
-    };
-
-    ofstream outfi;
-    outfi.open(gamfile + ".sorted.gam");
-    stream::write_buffered(outfi, buf, buf.size());
+    auto keys = sort_run(run);
+    write_run(run, keys, gam_out);
 }
 
-void GAMSorter::stream_sort(string gamfile){
-
-    std::vector<Alignment> buffer;
-    buffer.reserve(1000);
-    std::function<void(Alignment&)> firstpass_bufsort = [&](Alignment& a){
-        #pragma omp critical
-        buffer.push_back(a);
-        if (buffer.size() == max_buf_size){
-                sort(buffer);
-                write_temp(buffer);
-                buffer.clear();
-        }
-    };
-
-    
-
-
-    ifstream gammy;
-    gammy.open(gamfile);
-    stream::for_each(gammy, firstpass_bufsort);
-
-    sort(buffer);
-    write_temp(buffer);
-    buffer.clear();
-
-
-
-   
-    int num_valid = tmp_filenames.size();
-    vector<bool> still_valid(tmp_filenames.size());
-    vector<uint64_t> curr_file_count (tmp_filenames.size());
-    typedef priority_queue<Alignment,std::vector<Alignment>, AlnSorter> AlnHeap;
-    
-
-    for (int i = 0; i < tmp_filenames.size(); ++i){
-        ifstream tfile;
-        tfile.open(tmp_filenames[i]);
-        tmp_files.emplace_back(&tfile);
+void GAMSorter::dumb_sort(string gamfile)
+{
+    ifstream gam_in(gamfile);
+    if (!gam_in) {
+        throw runtime_error("[vg::GAMSorter] could not open GAM " + gamfile);
     }
+    ofstream gam_out(gamfile + ".sorted.gam");
+    dumb_sort(gam_in, gam_out);
+}
 
+void GAMSorter::stream_sort(istream& gam_in, ostream& gam_out)
+{
+    // Each thread can be sorting a run while we fill another, and all the
+    // runs together must fit in the buffer limit. Runs are measured by
+    // serialized size, so the parsed alignments in memory take a small
+    // multiple of the limit.
+    size_t threads = omp_get_max_threads();
+    size_t run_bytes = max<size_t>(max_buffer_bytes / (threads + 1), 1);
+
+    vector<string> run_filenames;
+
+    // The run we are filling
+    vector<Alignment>* run = new vector<Alignment>();
+    size_t run_size = 0;
+    // How many full runs are being sorted?
+    size_t runs_in_flight = 0;
+    size_t total_alignments = 0;
+
+#pragma omp parallel
+#pragma omp single
+    {
+        // Sort the given run and write it out to a temp file in a task.
+        auto spill_run = [&](vector<Alignment>* full_run) {
+            if (runs_in_flight >= threads) {
+                // Wait for the runs we have so we don't go over the memory
+                // limit.
+#pragma omp taskwait
+                runs_in_flight = 0;
+            }
 
-    
+            // temp_file isn't thread safe, so make the file here.
+            string filename = temp_file::create("vg-gamsort-");
+            run_filenames.push_back(filename);
+            runs_in_flight++;
 
-    vector<::google::protobuf::io::CodedInputStream*> protostreams;
-    vector<::google::protobuf::io::GzipInputStream*> zipstreams;
+            if (show_progress) {
+                cerr << "[vg::GAMSorter] sorting run " << run_filenames.size() << " of "
+                     << full_run->size() << " alignments" << endl;
+            }
 
-    for (auto x : tmp_files){
-        ::google::protobuf::io::ZeroCopyInputStream *raw_in =
-          new ::google::protobuf::io::IstreamInputStream(x);
-        ::google::protobuf::io::GzipInputStream *gzip_in =
-          new ::google::protobuf::io::GzipInputStream(raw_in);
-        ::google::protobuf::io::CodedInputStream *pstream =
-          new ::google::protobuf::io::CodedInputStream(gzip_in);
+#pragma omp task firstprivate(full_run, filename)
+            {
+                auto keys = sort_run(*full_run);
+                ofstream run_out(filename);
+                if (!run_out) {
+                    cerr << "error[vg::GAMSorter]: could not write temp file " << filename << endl;
+                    exit(1);
+                }
+                write_run(*full_run, keys, run_out);
+                delete full_run;
+            }
+        };
+
+        std::function<void(Alignment&)> add_to_run = [&](Alignment& aln) {
+            run_size += aln.ByteSizeLong();
+            run->emplace_back(std::move(aln));
+            total_alignments++;
+            if (run_size >= run_bytes) {
+                spill_run(run);
+                run = new vector<Alignment>();
+                run_size = 0;
+            }
+        };
+        stream::for_each(gam_in, add_to_run);
 
-        protostreams.push_back(pstream);
-        zipstreams.push_back(gzip_in);
+        if (!run_filenames.empty() && !run->empty()) {
+            // Spill the last bit too, so we can merge it with the rest
+            spill_run(run);
+            run = nullptr;
+        }
+        // Everything has to be written before we merge
+#pragma omp taskwait
     }
 
-    std::function<bool(int)> handle_count_line = [&](int tmp_index){
-        uint64_t count;
-        protostreams[tmp_index]->ReadVarint64((::google::protobuf::uint64*) &count);
-        curr_file_count[tmp_index] = count;
-        cerr << std::to_string(count) << endl;
-        if (!count){
-            return false;
+    if (run != nullptr) {
+        // Everything fit in memory
+        auto keys = sort_run(*run);
+        write_run(*run, keys, gam_out);
+        delete run;
+    } else {
+        if (show_progress) {
+            cerr << "[vg::GAMSorter] merging " << run_filenames.size() << " runs of "
+                 << total_alignments << " alignments" << endl;
         }
-        return true;
-    };
-
-    for (int i = 0; i < protostreams.size(); i++){
-        handle_count_line(i);
+        merge_runs(run_filenames, gam_out);
     }
 
-    
-    
-    std::function<bool(int, Alignment&)> read_dat_buf = [&](int tmp_index, Alignment& ret){
-
-        // Read our message of size count.
-        std::string s;
-        //for (uint64_t i = 0; i < count; ++i) {
-            (curr_file_count[tmp_index])--;
-            if (curr_file_count[tmp_index] <= 0){
-                return handle_count_line(tmp_index);
-            }
-            uint32_t msgSize = 0;
-            delete (protostreams[tmp_index]);
-            (protostreams[tmp_index]) = new ::google::protobuf::io::CodedInputStream( (zipstreams[tmp_index]));
-            // the messages are prefixed by their size
-            (protostreams[tmp_index])->ReadVarint32(&msgSize);
-            if ((msgSize > 0) &&
-                (protostreams[tmp_index]->ReadString(&s, msgSize))) {
-                ret.ParseFromString(s);
-                return true;
-            }
-        //}
-        
-        return false;
-     };
-
-
-    // Heap of size (tmp_files.size())
-    AlnHeap lil_heap;
-    for(int i = 0; i < tmp_files.size(); i++){
-        Alignment a;
-        read_dat_buf(i, a);
-        lil_heap.push( a );
+    for (auto& filename : run_filenames) {
+        temp_file::remove(filename);
     }
+}
 
-    
-    // Rotating index within the tmp_files array,
-    // for accessing the ifstream and associated Proto readers/writers
-    int tmp_file_index = 0;
-
-    // This is just an output buffer.
-    vector<Alignment> sorted_out_buf;
-    sorted_out_buf.reserve(1000);
-
-    // Our output stream
-    string outname = gamfile + ".sorted.gam";
-    ofstream ofile;
-    ofile.open(outname);
-
-    cerr << "in the loop" << endl;
-
-    while(!lil_heap.empty()){
+void GAMSorter::stream_sort(string gamfile)
+{
+    ifstream gam_in(gamfile);
+    if (!gam_in) {
+        throw runtime_error("[vg::GAMSorter] could not open GAM " + gamfile);
+    }
+    ofstream gam_out(gamfile + ".sorted.gam");
+    stream_sort(gam_in, gam_out);
+}
 
-        Alignment a;
-        bool valid = read_dat_buf(tmp_file_index, a);
-        if (valid){
-            lil_heap.push(a);
-        }
-        else{
-            //handle_count_line(tmp_file_index);
+void GAMSorter::merge_runs(const vector<string>& run_filenames, ostream& out)
+{
+    // Open all the runs
+    vector<unique_ptr<ifstream>> run_streams;
+    vector<unique_ptr<stream::ProtobufIterator<Alignment>>> cursors;
+    for (auto& filename : run_filenames) {
+        run_streams.emplace_back(new ifstream(filename));
+        if (!*run_streams.back()) {
+            throw runtime_error("[vg::GAMSorter] could not read temp file " + filename);
         }
-        
+        cursors.emplace_back(new stream::ProtobufIterator<Alignment>(*run_streams.back()));
+    }
 
-        
-        sorted_out_buf.push_back(lil_heap.top());
-        cerr << "writing " << lil_heap.top().name() << endl;
-        if (sorted_out_buf.size() % 100 == 0){
-            cerr << "Done " << sorted_out_buf.size() << " records" << endl;
+    // The alignment each run is on, which we move out of the cursor
+    vector<Alignment> current(run_filenames.size());
+
+    // Min-heap of the key of the current alignment in each run, and the run
+    // number, so ties go to the earlier run.
+    using HeapEntry = pair<GAMSortKey, size_t>;
+    auto heap_order = [](const HeapEntry& a, const HeapEntry& b) {
+        return b.first < a.first || (!(a.first < b.first) && b.second < a.second);
+    };
+    priority_queue<HeapEntry, vector<HeapEntry>, decltype(heap_order)> heap(heap_order);
+
+    // Load the next alignment from a run, if it has one, into the heap.
+    auto advance = [&](size_t i) {
+        auto& cursor = *cursors[i];
+        if (cursor.has_next()) {
+            current[i] = cursor.take();
+            cursor.get_next();
+            heap.emplace(get_sort_key(current[i]), i);
         }
-        lil_heap.pop();
-        stream::write_buffered(ofile, sorted_out_buf, 1000);
-        tmp_file_index = (tmp_file_index + 1) % tmp_files.size();
+    };
 
+    for (size_t i = 0; i < cursors.size(); i++) {
+        advance(i);
     }
-    cerr << "out the loop" << endl;
-
-    // write any remaining records in our buffer
-    stream::write_buffered(ofile, sorted_out_buf, 0);
 
+    vector<Alignment> buffer;
+    buffer.reserve(output_group_size);
+    while (!heap.empty()) {
+        size_t i = heap.top().second;
+        heap.pop();
+        buffer.emplace_back(std::move(current[i]));
+        stream::write_buffered(out, buffer, output_group_size);
+        advance(i);
+    }
+    stream::write_buffered(out, buffer, 0);
 }
 
-void GAMSorter::write_index(string gamfile, string outfile, bool isSorted)
+void GAMSorter::write_index(string gamfile, string outfile)
 {
+    ifstream gam_in;
+    gam_in.open(gamfile);
+    if (!gam_in) {
+        throw runtime_error("[vg::GAMSorter] could not open GAM " + gamfile);
+    }
 
-    map<int64_t, vector<string>> node_to_alns;
+    GAMIndex index;
+    index.index(gam_in);
 
-    std::function<void(Alignment &)> node_grabber = [&](Alignment &aln) {
-        vector<int64_t> ret;
-        Path p = aln.path();
-        for (int i = 0; i < p.mapping_size(); i++)
-        {
-            Mapping m = p.mapping(i);
-            ret.push_back(m.position().node_id());
-        }
-        for (auto x : ret)
-        {
-            node_to_alns[x].push_back(aln.name());
-        }
-    };
+    ofstream index_out;
+    index_out.open(outfile);
+    if (!index_out) {
+        throw runtime_error("[vg::GAMSorter] could not open index " + outfile);
+    }
+    index.save(index_out);
 }
 
 bool GAMSorter::min_aln_first(Alignment &a, Alignment &b)
@@ -3,6 +3,8 @@
 
 #include "vg.pb.h"
 #include "stream.hpp"
+#include "gam_index.hpp"
+#include "types.hpp"
 #include <string>
 #include <queue>
 #include <sstream>
@@ -27,28 +29,54 @@ using namespace std;
 namespace vg
 {
 
+/// The position that a GAMSorter sorts an alignment on: the first position on
+/// the lowest-ID node of its path. Unmapped alignments sort after everything
+/// else.
+struct GAMSortKey
+{
+    id_t node_id;
+    size_t offset;
 
+    inline bool operator<(const GAMSortKey& other) const {
+        return node_id < other.node_id || (node_id == other.node_id && offset < other.offset);
+    }
+};
 
 class GAMSorter
 {
 
   
   public:
-    // vector<Alignment> merge(vector<vector<Alignment>> a);
 
-    // void merge(map<int, vector<Alignment>> m, map<int, int> split_to_sz);
+    /// Make a GAMSorter that keeps at most about max_buffer_bytes of
+    /// serialized alignment data in memory at once. Bigger inputs are sorted
+    /// in runs that are spilled to temporary files in temp_file::get_dir()
+    /// and then merged. The limit counts ByteSizeLong() of the buffered
+    /// reads, not their parsed Alignment objects, which take more space, so
+    /// the real footprint is a small multiple of the limit.
+    GAMSorter(size_t max_buffer_bytes = 1024UL * 1024 * 1024, bool show_progress = false);
 
     void sort(vector<Alignment>& alns);
 
     void paired_sort(string gamfile);
 
-    void write_temp(vector<Alignment>& alns);
+    /// Sort all the alignments from gam_in to gam_out, with an external merge
+    /// sort that keeps memory use under the buffer limit. Sorted runs are
+    /// made in parallel on OpenMP threads. Alignments with equal keys stay in
+    /// input order.
+    void stream_sort(istream& gam_in, ostream& gam_out);
 
+    /// Sort gamfile to gamfile.sorted.gam with stream_sort.
     void stream_sort(string gamfile);
 
+    /// Sort all the alignments from gam_in to gam_out in memory.
+    void dumb_sort(istream& gam_in, ostream& gam_out);
+
+    /// Sort gamfile to gamfile.sorted.gam with dumb_sort.
     void dumb_sort(string gamfile);
 
-    // vector<Alignment> split(vector<Alignment> a, int s);
+    /// Get the key that an alignment is sorted on.
+    static GAMSortKey get_sort_key(const Alignment& aln);
 
     bool min_aln_first(Alignment& a, Alignment& b);
 
@@ -56,7 +84,8 @@ class GAMSorter
 
     Position get_min_position(Path p);
 
-    void write_index(string gamfile, string outfile, bool isSorted = false);
+    /// Write a GAMIndex for the sorted GAM file gamfile to outfile.
+    void write_index(string gamfile, string outfile);
 
     bool equal_to(Position a, Position b);
 
@@ -65,10 +94,41 @@ class GAMSorter
     bool greater_than(Position a, Position b);
 
   private:
-    map<int, int> split_to_split_size;
-    vector<string> tmp_filenames;
-    vector<ifstream*> tmp_files;
-    int max_buf_size = 20000;
+    /// A compact sort key for an alignment in a run, which refers back to
+    /// the alignment by its index in the run. Sorting on these instead of on
+    /// the alignments themselves avoids moving whole protobufs around, and
+    /// the index breaks ties so the sort is stable.
+    struct PackedSortKey
+    {
+        id_t node_id;
+        uint32_t offset;
+        uint32_t index;
+
+        inline bool operator<(const PackedSortKey& other) const {
+            return tie(node_id, offset, index) < tie(other.node_id, other.offset, other.index);
+        }
+    };
+
+    /// Compute the packed keys for a run of alignments, and sort them, using
+    /// all the OpenMP threads if we aren't already in a parallel region.
+    vector<PackedSortKey> sort_run(const vector<Alignment>& run);
+
+    /// Write out the alignments in a run in the order of the given sorted
+    /// keys. The alignments are moved out of the run.
+    void write_run(vector<Alignment>& run, const vector<PackedSortKey>& keys, ostream& out);
+
+    /// Sort packed keys in parallel, by sorting a slice per thread and then
+    /// merging the slices pairwise.
+    static void parallel_sort(vector<PackedSortKey>& keys);
+
+    /// Merge sorted runs from the given files to the output stream, with a
+    /// heap. Ties go to the earlier run.
+    void merge_runs(const vector<string>& run_filenames, ostream& out);
+
+    size_t max_buffer_bytes;
+    bool show_progress;
+    /// How many alignments to write per group
+    size_t output_group_size = 1000;
     /**
     * We want to keep pairs together, with the lowest-coordinate pair coming first.
     * If one read is unmapped, it follows its partner in the sorted GAM file.
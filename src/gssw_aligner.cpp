@@ -1,3 +1,9 @@
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
 #include "gssw_aligner.hpp"
 #include "json2pb.h"
 
@@ -12,10 +18,224 @@ BaseAligner::~BaseAligner(void) {
     free(score_matrix);
 }
 
+size_t GSSWGraphWorkspace::max_arena_bytes = 4 * 1024 * 1024;
+
+/// Banded global alignments finished at each integer width by all aligners
+static atomic<uint64_t> banded_width_finished[BANDED_WIDTH_COUNT];
+/// Banded global alignments thrown away because their scores saturated
+static atomic<uint64_t> banded_width_retries(0);
+
+GSSWGraphWorkspace& GSSWGraphWorkspace::local() {
+    thread_local GSSWGraphWorkspace workspace;
+    return workspace;
+}
+
+GSSWGraphWorkspace::~GSSWGraphWorkspace() {
+    if (live_graph) {
+        release(live_graph);
+    }
+    free(arena);
+}
+
+size_t GSSWGraphWorkspace::padded(size_t bytes) {
+    const size_t alignment = alignof(max_align_t);
+    return (bytes + alignment - 1) / alignment * alignment;
+}
+
+void* GSSWGraphWorkspace::allocate(size_t bytes) {
+    void* allocated = arena + used;
+    used += padded(bytes);
+    assert(used <= capacity);
+    return allocated;
+}
+
+void GSSWGraphWorkspace::reserve(size_t bytes) {
+    used = 0;
+    if (bytes > capacity) {
+        // grow geometrically so a run of slightly bigger graphs doesn't
+        // reallocate every time
+        size_t new_capacity = min(max(bytes, 2 * capacity), max(bytes, max_arena_bytes));
+        free(arena);
+        arena = (char*) malloc(new_capacity);
+        if (arena == nullptr) {
+            capacity = 0;
+            throw bad_alloc();
+        }
+        capacity = new_capacity;
+    }
+}
+
+size_t GSSWGraphWorkspace::arena_capacity() const {
+    return capacity;
+}
+
+int64_t GSSWGraphWorkspace::node_index(int64_t node_id) const {
+    if (dense_ids) {
+        if (node_id < min_id || node_id - min_id >= (int64_t) index_by_offset.size()) {
+            return -1;
+        }
+        return index_by_offset[node_id - min_id];
+    }
+    auto found = lower_bound(index_by_id.begin(), index_by_id.end(), make_pair(node_id, (int32_t) -1));
+    if (found == index_by_id.end() || found->first != node_id) {
+        return -1;
+    }
+    return found->second;
+}
+
+gssw_graph* GSSWGraphWorkspace::build(Graph& g, int8_t* nt_table) {
+    
+    if (live_graph != nullptr || g.node_size() == 0) {
+        return nullptr;
+    }
+    size_t node_count = g.node_size();
+    
+    // index the nodes by ID, in a flat table if the IDs are close together
+    min_id = numeric_limits<int64_t>::max();
+    int64_t max_id = numeric_limits<int64_t>::min();
+    size_t sequence_bytes = 0;
+    for (size_t i = 0; i < node_count; i++) {
+        const Node& n = g.node(i);
+        min_id = min(min_id, n.id());
+        max_id = max(max_id, n.id());
+        // room for the sequence, its terminator, and its numerical encoding
+        sequence_bytes += padded(n.sequence().size() + 1) + padded(n.sequence().size());
+    }
+    dense_ids = (uint64_t) max_id - (uint64_t) min_id < 4 * node_count + 1024;
+    if (dense_ids) {
+        index_by_offset.assign(max_id - min_id + 1, -1);
+        for (size_t i = 0; i < node_count; i++) {
+            index_by_offset[g.node(i).id() - min_id] = i;
+        }
+    } else {
+        index_by_id.clear();
+        for (size_t i = 0; i < node_count; i++) {
+            index_by_id.emplace_back(g.node(i).id(), i);
+        }
+        sort(index_by_id.begin(), index_by_id.end());
+    }
+    
+    // work out which nodes each edge joins, in gssw's end to start orientation
+    edge_ends.clear();
+    for (size_t i = 0; i < g.edge_size(); i++) {
+        const Edge& e = g.edge(i);
+        int64_t from, to;
+        if (!e.from_start() && !e.to_end()) {
+            from = node_index(e.from());
+            to = node_index(e.to());
+        } else if (e.from_start() && e.to_end()) {
+            from = node_index(e.to());
+            to = node_index(e.from());
+        } else {
+            // reversing edges are reported when the graph is built the usual way
+            return nullptr;
+        }
+        if (from < 0 || to < 0) {
+            return nullptr;
+        }
+        edge_ends.emplace_back(from, to);
+    }
+    
+    size_t required_bytes = padded(sizeof(gssw_graph))
+                            + padded(node_count * sizeof(gssw_node*))
+                            + node_count * padded(sizeof(gssw_node))
+                            + sequence_bytes
+                            + 2 * padded(edge_ends.size() * sizeof(gssw_node*));
+    if (required_bytes > max_arena_bytes) {
+        return nullptr;
+    }
+    reserve(required_bytes);
+    
+    gssw_graph* graph = (gssw_graph*) allocate(sizeof(gssw_graph));
+    memset(graph, 0, sizeof(gssw_graph));
+    graph->nodes = (gssw_node**) allocate(node_count * sizeof(gssw_node*));
+    graph->size = node_count;
+    
+    for (size_t i = 0; i < node_count; i++) {
+        Node* n = g.mutable_node(i);
+        const string& sequence = n->sequence();
+        
+        gssw_node* node = (gssw_node*) allocate(sizeof(gssw_node));
+        memset(node, 0, sizeof(gssw_node));
+        node->data = n;
+        node->id = n->id();
+        node->len = sequence.size();
+        node->seq = (char*) allocate(sequence.size() + 1);
+        node->num = (int8_t*) allocate(sequence.size());
+        for (size_t j = 0; j < sequence.size(); j++) {
+            // switch any non-ATGCN characters from the node sequence to N
+            char b = sequence[j];
+            if (b != 'A' && b != 'T' && b != 'G' && b != 'C' && b != 'N') {
+                b = 'N';
+            }
+            node->seq[j] = b;
+            node->num[j] = nt_table[(int) b];
+        }
+        node->seq[sequence.size()] = '\0';
+        
+        graph->nodes[i] = node;
+    }
+    
+    // lay out every node's edge lists in one block per direction, in the same
+    // order gssw_nodes_add_edge would give them
+    for (auto& ends : edge_ends) {
+        graph->nodes[ends.first]->count_next++;
+        graph->nodes[ends.second]->count_prev++;
+    }
+    gssw_node** next_block = (gssw_node**) allocate(edge_ends.size() * sizeof(gssw_node*));
+    gssw_node** prev_block = (gssw_node**) allocate(edge_ends.size() * sizeof(gssw_node*));
+    for (size_t i = 0; i < node_count; i++) {
+        gssw_node* node = graph->nodes[i];
+        if (node->count_next) {
+            node->next = next_block;
+            next_block += node->count_next;
+        }
+        if (node->count_prev) {
+            node->prev = prev_block;
+            prev_block += node->count_prev;
+        }
+        node->count_next = 0;
+        node->count_prev = 0;
+    }
+    for (auto& ends : edge_ends) {
+        gssw_node* from = graph->nodes[ends.first];
+        gssw_node* to = graph->nodes[ends.second];
+        from->next[from->count_next++] = to;
+        to->prev[to->count_prev++] = from;
+    }
+    
+    live_graph = graph;
+    return graph;
+}
+
+bool GSSWGraphWorkspace::holds(const gssw_graph* graph) const {
+    return graph != nullptr && graph == live_graph;
+}
+
+void GSSWGraphWorkspace::release(gssw_graph* graph) {
+    assert(holds(graph));
+    // the alignments were allocated by gssw when the graph was filled
+    for (size_t i = 0; i < graph->size; i++) {
+        gssw_node* node = graph->nodes[i];
+        if (node->alignment) {
+            gssw_align_destroy(node->alignment);
+            node->alignment = nullptr;
+        }
+    }
+    live_graph = nullptr;
+    used = 0;
+}
+
 gssw_graph* BaseAligner::create_gssw_graph(Graph& g) {
     
+    // build the graph in this thread's reusable memory if it will fit
+    gssw_graph* graph = GSSWGraphWorkspace::local().build(g, nt_table);
+    if (graph != nullptr) {
+        return graph;
+    }
+    
     // add a dummy sink node if we're pinning
-    gssw_graph* graph = gssw_graph_create(g.node_size());
+    graph = gssw_graph_create(g.node_size());
     unordered_map<int64_t, gssw_node*> nodes;
     
     for (int i = 0; i < g.node_size(); ++i) {
@@ -67,6 +287,15 @@ gssw_graph* BaseAligner::create_gssw_graph(Graph& g) {
     
 }
 
+void BaseAligner::destroy_gssw_graph(gssw_graph* graph) {
+    GSSWGraphWorkspace& workspace = GSSWGraphWorkspace::local();
+    if (workspace.holds(graph)) {
+        workspace.release(graph);
+    } else {
+        gssw_graph_destroy(graph);
+    }
+}
+
 void BaseAligner::load_scoring_matrix(istream& matrix_stream) {
     if(score_matrix) free(score_matrix);
     score_matrix = (int8_t*)calloc(25, sizeof(int8_t));
@@ -210,6 +439,116 @@ void BaseAligner::gssw_mapping_to_alignment(gssw_graph* graph,
     alignment.set_identity(identity(alignment.path()));
 }
 
+template<typename IntType>
+bool BaseAligner::align_global_banded_width(Alignment& alignment, vector<Alignment>* alt_alignments, Graph& g,
+                                            int32_t max_alt_alns, int32_t band_padding, bool permissive_banding,
+                                            bool adjust_for_base_quality, bool check_fit) {
+    
+    bool fit = true;
+    if (alt_alignments) {
+        BandedGlobalAligner<IntType> band_graph(alignment,
+                                                g,
+                                                *alt_alignments,
+                                                max_alt_alns,
+                                                band_padding,
+                                                permissive_banding,
+                                                adjust_for_base_quality);
+        if (check_fit) {
+            fit = band_graph.align_if_fits(score_matrix, nt_table, gap_open, gap_extension);
+        }
+        else {
+            band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
+        }
+    }
+    else {
+        BandedGlobalAligner<IntType> band_graph(alignment,
+                                                g,
+                                                band_padding,
+                                                permissive_banding,
+                                                adjust_for_base_quality);
+        if (check_fit) {
+            fit = band_graph.align_if_fits(score_matrix, nt_table, gap_open, gap_extension);
+        }
+        else {
+            band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
+        }
+    }
+    
+    if (fit) {
+        BandedWidth width = sizeof(IntType) == 1 ? BandedWidth8 :
+                            sizeof(IntType) == 2 ? BandedWidth16 :
+                            sizeof(IntType) == 4 ? BandedWidth32 : BandedWidth64;
+        banded_width_finished[width].fetch_add(1, memory_order_relaxed);
+    }
+    else {
+        banded_width_retries.fetch_add(1, memory_order_relaxed);
+    }
+    return fit;
+}
+
+void BaseAligner::align_global_banded_adaptive(Alignment& alignment, vector<Alignment>* alt_alignments, Graph& g,
+                                               int32_t max_alt_alns, int32_t band_padding, bool permissive_banding,
+                                               bool adjust_for_base_quality) {
+    
+    // the read's best possible score has to fit, so don't bother with any width narrower than that
+    // (the BandedGlobalAligner will complain if quality adjusted alignment is missing its qualities)
+    int64_t best_score = 0;
+    if (!adjust_for_base_quality || alignment.quality().size() == alignment.sequence().size()) {
+        best_score = score_exact_match(alignment, 0, alignment.sequence().size());
+    }
+    
+    if (best_score < numeric_limits<int8_t>::max()
+        && align_global_banded_width<int8_t>(alignment, alt_alignments, g, max_alt_alns, band_padding,
+                                             permissive_banding, adjust_for_base_quality, true)) {
+        return;
+    }
+    if (best_score < numeric_limits<int16_t>::max()
+        && align_global_banded_width<int16_t>(alignment, alt_alignments, g, max_alt_alns, band_padding,
+                                              permissive_banding, adjust_for_base_quality, true)) {
+        return;
+    }
+    if (best_score < numeric_limits<int32_t>::max()
+        && align_global_banded_width<int32_t>(alignment, alt_alignments, g, max_alt_alns, band_padding,
+                                              permissive_banding, adjust_for_base_quality, true)) {
+        return;
+    }
+    // nothing to escalate to after this
+    align_global_banded_width<int64_t>(alignment, alt_alignments, g, max_alt_alns, band_padding,
+                                       permissive_banding, adjust_for_base_quality, false);
+}
+
+BandedWidthCounts BaseAligner::banded_width_counts() {
+    BandedWidthCounts counts;
+    for (size_t i = 0; i < BANDED_WIDTH_COUNT; i++) {
+        counts.finished[i] = banded_width_finished[i].load(memory_order_relaxed);
+    }
+    counts.retries = banded_width_retries.load(memory_order_relaxed);
+    return counts;
+}
+
+void BaseAligner::report_banded_widths(ostream& out, const BandedWidthCounts& counts) {
+    static const char* width_names[BANDED_WIDTH_COUNT] = {"int8", "int16", "int32", "int64"};
+    out << "banded_width\talignments" << endl;
+    for (size_t i = 0; i < BANDED_WIDTH_COUNT; i++) {
+        out << width_names[i] << "\t" << counts.finished[i] << endl;
+    }
+    out << "retried\t" << counts.retries << endl;
+}
+
+bool BaseAligner::align_xdrop(Alignment& alignment, Graph& g, bool pinned, bool pin_left, bool traceback_aln,
+                              bool adjust_for_base_quality) {
+    if (!XdropAligner::is_supported(g)) {
+        return false;
+    }
+    
+    XdropAligner xdrop(alignment, g, xdrop_threshold, pinned, pin_left, adjust_for_base_quality);
+    xdrop.align(score_matrix, nt_table, gap_open, gap_extension, full_length_bonus, traceback_aln);
+    if (traceback_aln) {
+        alignment.set_identity(identity(alignment.path()));
+    }
+    return true;
+}
+
 void BaseAligner::reverse_graph(Graph& g, Graph& reversed_graph_out) {
     if (reversed_graph_out.node_size()) {
         cerr << "error:[Aligner::reverse_graph] output graph is not empty" << endl;
@@ -718,6 +1057,10 @@ size_t BaseAligner::longest_detectable_gap(const Alignment& alignment, const str
     return gap_length >= 0 && overhang_length > 0 ? gap_length : 0;
 }
 
+unique_ptr<PackedRead> BaseAligner::pack_read(const Alignment& aln) const {
+    return nullptr;
+}
+
 size_t BaseAligner::longest_detectable_gap(const Alignment& alignment) const {
     // longest detectable gap across entire read is in the middle
     return longest_detectable_gap(alignment, alignment.sequence().begin() + (alignment.sequence().size() / 2));
@@ -730,6 +1073,10 @@ int32_t BaseAligner::score_gappy_alignment(const Alignment& aln, const function<
     int score = 0;
     int read_offset = 0;
     auto& path = aln.path();
+    
+    // pack the read once so that each match can be scored in bulk, if the
+    // aligner needs the read's qualities to score it
+    unique_ptr<PackedRead> packed_read = pack_read(aln);
 
     // We keep track of whether the last edit was a deletion for coalescing
     // adjacent deletions across node boundaries
@@ -744,7 +1091,8 @@ int32_t BaseAligner::score_gappy_alignment(const Alignment& aln, const function<
             
             // Score the edit according to its type
             if (edit_is_match(edit)) {
-                score += score_exact_match(aln, read_offset, edit.to_length());
+                score += packed_read ? score_exact_match(*packed_read, read_offset, edit.to_length())
+                                     : score_exact_match(aln, read_offset, edit.to_length());
                 last_was_deletion = false;
             } else if (edit_is_sub(edit)) {
                 score -= mismatch * edit.sequence().size();
@@ -859,6 +1207,14 @@ void Aligner::align_internal(Alignment& alignment, vector<Alignment>* multi_alig
         cerr << "error:[Aligner] cannot specify maximum number of alignments in single alignment" << endl;
         exit(EXIT_FAILURE);
     }
+    
+    // the X-drop aligner only finds the optimal alignment
+    if (xdrop_threshold > 0 && max_alt_alns == 1 && align_xdrop(alignment, g, pinned, pin_left, traceback_aln, false)) {
+        if (multi_alignments) {
+            multi_alignments->emplace_back(alignment);
+        }
+        return;
+    }
 
     // alignment pinning algorithm is based on pinning in bottom right corner, if pinning in top
     // left we need to reverse all the sequences first and translate the alignment back later
@@ -1008,7 +1364,7 @@ void Aligner::align_internal(Alignment& alignment, vector<Alignment>* multi_alig
     
     //gssw_graph_print_score_matrices(graph, sequence.c_str(), sequence.size(), stderr);
     
-    gssw_graph_destroy(graph);
+    destroy_gssw_graph(graph);
 }
 
 void Aligner::align(Alignment& alignment, Graph& g, bool traceback_aln, bool print_score_matrices) {
@@ -1035,6 +1391,11 @@ void Aligner::align_pinned_multi(Alignment& alignment, vector<Alignment>& alt_al
 void Aligner::align_global_banded(Alignment& alignment, Graph& g,
                                   int32_t band_padding, bool permissive_banding) {
     
+    if (adaptive_banded_width) {
+        align_global_banded_adaptive(alignment, nullptr, g, 0, band_padding, permissive_banding, false);
+        return;
+    }
+    
     // We need to figure out what size ints we need to use.
     // Get upper and lower bounds on the scores. TODO: if these overflow int64 we're out of luck
     int64_t best_score = alignment.sequence().size() * match;
@@ -1044,51 +1405,33 @@ void Aligner::align_global_banded(Alignment& alignment, Graph& g,
     }
     int64_t worst_score = max(alignment.sequence().size(), total_bases) * -max(max(mismatch, gap_open), gap_extension);
     
-    // TODO: put this all into another template somehow?
-    
-    if (best_score <= numeric_limits<int8_t>::max() && worst_score >= numeric_limits<int8_t>::min()) {
-        // We'll fit in int8
-        BandedGlobalAligner<int8_t> band_graph(alignment,
-                                               g,
-                                               band_padding,
-                                               permissive_banding,
-                                               false);
-        
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
-    } else if (best_score <= numeric_limits<int16_t>::max() && worst_score >= numeric_limits<int16_t>::min()) {
-        // We'll fit in int16
-        BandedGlobalAligner<int16_t> band_graph(alignment,
-                                                g,
-                                                band_padding,
-                                                permissive_banding,
-                                                false);
-        
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
-    } else if (best_score <= numeric_limits<int32_t>::max() && worst_score >= numeric_limits<int32_t>::min()) {
-        // We'll fit in int32
-        BandedGlobalAligner<int32_t> band_graph(alignment,
-                                                g,
-                                                band_padding,
-                                                permissive_banding,
-                                                false);
-        
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
-    } else {
-        // Fall back to int64
-        BandedGlobalAligner<int64_t> band_graph(alignment,
-                                                g,
-                                                band_padding,
-                                                permissive_banding,
-                                                false);
-        
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
+    // start at the narrowest width the bounds allow, and only move up if the scores still don't fit
+    if (best_score <= numeric_limits<int8_t>::max() && worst_score >= numeric_limits<int8_t>::min()
+        && align_global_banded_width<int8_t>(alignment, nullptr, g, 0, band_padding, permissive_banding, false, true)) {
+        return;
+    }
+    if (best_score <= numeric_limits<int16_t>::max() && worst_score >= numeric_limits<int16_t>::min()
+        && align_global_banded_width<int16_t>(alignment, nullptr, g, 0, band_padding, permissive_banding, false, true)) {
+        return;
     }
+    if (best_score <= numeric_limits<int32_t>::max() && worst_score >= numeric_limits<int32_t>::min()
+        && align_global_banded_width<int32_t>(alignment, nullptr, g, 0, band_padding, permissive_banding, false, true)) {
+        return;
+    }
+    // nothing to fall back to after this
+    align_global_banded_width<int64_t>(alignment, nullptr, g, 0, band_padding, permissive_banding, false, false);
 
 }
 
 void Aligner::align_global_banded_multi(Alignment& alignment, vector<Alignment>& alt_alignments, Graph& g,
                                         int32_t max_alt_alns, int32_t band_padding, bool permissive_banding) {
-                                        
+    
+    if (adaptive_banded_width) {
+        align_global_banded_adaptive(alignment, &alt_alignments, g, max_alt_alns, band_padding, permissive_banding,
+                                     false);
+        return;
+    }
+    
     // We need to figure out what size ints we need to use.
     // Get upper and lower bounds on the scores. TODO: if these overflow int64 we're out of luck
     int64_t best_score = alignment.sequence().size() * match;
@@ -1098,51 +1441,25 @@ void Aligner::align_global_banded_multi(Alignment& alignment, vector<Alignment>&
     }
     int64_t worst_score = max(alignment.sequence().size(), total_bases) * -max(max(mismatch, gap_open), gap_extension);
     
-    if (best_score <= numeric_limits<int8_t>::max() && worst_score >= numeric_limits<int8_t>::min()) {
-        // We'll fit in int8
-        BandedGlobalAligner<int8_t> band_graph(alignment,
-                                               g,
-                                               alt_alignments,
-                                               max_alt_alns,
-                                               band_padding,
-                                               permissive_banding,
-                                               false);
-        
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
-    } else if (best_score <= numeric_limits<int16_t>::max() && worst_score >= numeric_limits<int16_t>::min()) {
-        // We'll fit in int16
-        BandedGlobalAligner<int16_t> band_graph(alignment,
-                                                g,
-                                                alt_alignments,
-                                                max_alt_alns,
-                                                band_padding,
-                                                permissive_banding,
-                                                false);
-        
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
-    } else if (best_score <= numeric_limits<int32_t>::max() && worst_score >= numeric_limits<int32_t>::min()) {
-        // We'll fit in int32
-        BandedGlobalAligner<int32_t> band_graph(alignment,
-                                                g,
-                                                alt_alignments,
-                                                max_alt_alns,
-                                                band_padding,
-                                                permissive_banding,
-                                                false);
-        
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
-    } else {
-        // Fall back to int64
-        BandedGlobalAligner<int64_t> band_graph(alignment,
-                                                g,
-                                                alt_alignments,
-                                                max_alt_alns,
-                                                band_padding,
-                                                permissive_banding,
-                                                false);
-        
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
+    // start at the narrowest width the bounds allow, and only move up if the scores still don't fit
+    if (best_score <= numeric_limits<int8_t>::max() && worst_score >= numeric_limits<int8_t>::min()
+        && align_global_banded_width<int8_t>(alignment, &alt_alignments, g, max_alt_alns, band_padding,
+                                                permissive_banding, false, true)) {
+        return;
     }
+    if (best_score <= numeric_limits<int16_t>::max() && worst_score >= numeric_limits<int16_t>::min()
+        && align_global_banded_width<int16_t>(alignment, &alt_alignments, g, max_alt_alns, band_padding,
+                                                permissive_banding, false, true)) {
+        return;
+    }
+    if (best_score <= numeric_limits<int32_t>::max() && worst_score >= numeric_limits<int32_t>::min()
+        && align_global_banded_width<int32_t>(alignment, &alt_alignments, g, max_alt_alns, band_padding,
+                                                permissive_banding, false, true)) {
+        return;
+    }
+    // nothing to fall back to after this
+    align_global_banded_width<int64_t>(alignment, &alt_alignments, g, max_alt_alns, band_padding,
+                                       permissive_banding, false, false);
 }
 
 // Scoring an exact match is very simple in an ordinary Aligner
@@ -1168,8 +1485,12 @@ int32_t Aligner::score_exact_match(string::const_iterator seq_begin, string::con
     return score_exact_match(seq_begin, seq_end);
 }
 
+int32_t Aligner::score_exact_match(const PackedRead& read, size_t read_offset, size_t length) const {
+    return match * length;
+}
+
 int32_t Aligner::score_partial_alignment(const Alignment& alignment, VG& graph, const Path& path,
-                                         string::const_iterator seq_begin) const{
+                                         string::const_iterator seq_begin, const PackedRead* packed_read) const{
     
     int32_t score = 0;
     string::const_iterator read_pos = seq_begin;
@@ -1246,6 +1567,14 @@ QualAdjAligner::QualAdjAligner(int8_t _match,
     mismatch *= scale_factor;
     full_length_bonus *= scale_factor;
     
+    // pull the match scores off the diagonals of the 5 x 5 matrices for each quality
+    exact_match_scores.resize(5 * (size_t(max_qual_score) + 1));
+    for (size_t qual = 0; qual <= max_qual_score; qual++) {
+        for (size_t code = 0; code < 5; code++) {
+            exact_match_scores[5 * qual + code] = score_matrix[25 * qual + 6 * code];
+        }
+    }
+    
     BaseAligner::init_mapping_quality(gc_content);
 }
 
@@ -1266,6 +1595,15 @@ void QualAdjAligner::align_internal(Alignment& alignment, vector<Alignment>* mul
         exit(EXIT_FAILURE);
     }
     
+    // the X-drop aligner only finds the optimal alignment
+    if (xdrop_threshold > 0 && max_alt_alns == 1 && alignment.quality().size() == alignment.sequence().size()
+        && align_xdrop(alignment, g, pinned, pin_left, traceback_aln, true)) {
+        if (multi_alignments) {
+            multi_alignments->emplace_back(alignment);
+        }
+        return;
+    }
+    
     // alignment pinning algorithm is based on pinning in bottom right corner, if pinning in top
     // left we need to reverse all the sequences first and translate the alignment back later
     
@@ -1423,7 +1761,7 @@ void QualAdjAligner::align_internal(Alignment& alignment, vector<Alignment>* mul
     
     //gssw_graph_print_score_matrices(graph, sequence.c_str(), sequence.size(), stderr);
     
-    gssw_graph_destroy(graph);
+    destroy_gssw_graph(graph);
     
 }
 
@@ -1446,27 +1784,41 @@ void QualAdjAligner::align_pinned_multi(Alignment& alignment, vector<Alignment>&
 void QualAdjAligner::align_global_banded(Alignment& alignment, Graph& g,
                                          int32_t band_padding, bool permissive_banding) {
     
-    BandedGlobalAligner<int16_t> band_graph = BandedGlobalAligner<int16_t>(alignment,
-                                                                           g,
-                                                                           band_padding,
-                                                                           permissive_banding,
-                                                                           true);
+    if (adaptive_banded_width) {
+        align_global_banded_adaptive(alignment, nullptr, g, 0, band_padding, permissive_banding, true);
+        return;
+    }
     
-    band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
+    // quality adjusted scores don't have easy bounds, so start at 16 bits and move up if they don't fit
+    if (align_global_banded_width<int16_t>(alignment, nullptr, g, 0, band_padding, permissive_banding, true, true)) {
+        return;
+    }
+    if (align_global_banded_width<int32_t>(alignment, nullptr, g, 0, band_padding, permissive_banding, true, true)) {
+        return;
+    }
+    align_global_banded_width<int64_t>(alignment, nullptr, g, 0, band_padding, permissive_banding, true, false);
 }
 
 void QualAdjAligner::align_global_banded_multi(Alignment& alignment, vector<Alignment>& alt_alignments, Graph& g,
                                                int32_t max_alt_alns, int32_t band_padding, bool permissive_banding) {
     
-    BandedGlobalAligner<int16_t> band_graph = BandedGlobalAligner<int16_t>(alignment,
-                                                                           g,
-                                                                           alt_alignments,
-                                                                           max_alt_alns,
-                                                                           band_padding,
-                                                                           permissive_banding,
-                                                                           true);
+    if (adaptive_banded_width) {
+        align_global_banded_adaptive(alignment, &alt_alignments, g, max_alt_alns, band_padding, permissive_banding,
+                                     true);
+        return;
+    }
     
-    band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
+    // quality adjusted scores don't have easy bounds, so start at 16 bits and move up if they don't fit
+    if (align_global_banded_width<int16_t>(alignment, &alt_alignments, g, max_alt_alns, band_padding,
+                                           permissive_banding, true, true)) {
+        return;
+    }
+    if (align_global_banded_width<int32_t>(alignment, &alt_alignments, g, max_alt_alns, band_padding,
+                                           permissive_banding, true, true)) {
+        return;
+    }
+    align_global_banded_width<int64_t>(alignment, &alt_alignments, g, max_alt_alns, band_padding,
+                                       permissive_banding, true, false);
 }
 
 int32_t QualAdjAligner::score_exact_match(const Alignment& aln, size_t read_offset, size_t length) const {
@@ -1504,8 +1856,23 @@ int32_t QualAdjAligner::score_exact_match(string::const_iterator seq_begin, stri
     return score;
 }
 
+int32_t QualAdjAligner::score_exact_match(const PackedRead& read, size_t read_offset, size_t length) const {
+    if (!read.has_quality()) {
+        throw runtime_error("[vg::QualAdjAligner] cannot score a read without base qualities");
+    }
+    return score_exact_match_by_quality(read, read_offset, read_offset + length, exact_match_scores.data(),
+                                        max_qual_score);
+}
+
+unique_ptr<PackedRead> QualAdjAligner::pack_read(const Alignment& aln) const {
+    if (aln.quality().size() != aln.sequence().size()) {
+        return nullptr;
+    }
+    return unique_ptr<PackedRead>(new PackedRead(aln.sequence(), aln.quality()));
+}
+
 int32_t QualAdjAligner::score_partial_alignment(const Alignment& alignment, VG& graph, const Path& path,
-                                                string::const_iterator seq_begin) const{
+                                                string::const_iterator seq_begin, const PackedRead* packed_read) const{
     
     int32_t score = 0;
     string::const_iterator read_pos = seq_begin;
@@ -1530,9 +1897,16 @@ int32_t QualAdjAligner::score_partial_alignment(const Alignment& alignment, VG&
             if (edit.from_length() > 0) {
                 if (edit.to_length() > 0) {
                     
-                    for (auto siter = read_pos, riter = ref_pos, qiter = qual_pos;
-                         siter != read_pos + edit.from_length(); siter++, qiter++, riter++) {
-                        score += score_matrix[25 * (*qiter) + 5 * nt_table[*riter] + nt_table[*siter]];
+                    if (packed_read && edit.sequence().empty()) {
+                        // the read matches the reference, so we can score it from the packed read alone
+                        score += score_exact_match(*packed_read, read_pos - alignment.sequence().begin(),
+                                                   edit.from_length());
+                    }
+                    else {
+                        for (auto siter = read_pos, riter = ref_pos, qiter = qual_pos;
+                             siter != read_pos + edit.from_length(); siter++, qiter++, riter++) {
+                            score += score_matrix[25 * (*qiter) + 5 * nt_table[*riter] + nt_table[*siter]];
+                        }
                     }
                     
                     // apply full length bonus
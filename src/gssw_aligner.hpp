@@ -2,11 +2,13 @@
 #define VG_GSSW_ALIGNER_HPP_INCLUDED
 
 #include <algorithm>
+#include <iostream>
 #include <utility>
 #include <vector>
 #include <set>
 #include <string>
 #include <unordered_map>
+#include <memory>
 #include "gssw.h"
 #include "vg.pb.h"
 #include "vg.hpp"
@@ -15,6 +17,8 @@
 #include "path.hpp"
 #include "utility.hpp"
 #include "banded_global_aligner.hpp"
+#include "xdrop_aligner.hpp"
+#include "score_kernels.hpp"
 
 namespace vg {
 
@@ -30,6 +34,97 @@ namespace vg {
     
     
     class VG; // forward declaration
+    
+    /// Integer widths that banded global alignment can be done with
+    enum BandedWidth {BandedWidth8 = 0, BandedWidth16, BandedWidth32, BandedWidth64, BANDED_WIDTH_COUNT};
+    
+    /// How many banded global alignments were finished at each integer width, and how many attempts
+    /// were thrown away because the scores didn't fit
+    struct BandedWidthCounts {
+        uint64_t finished[BANDED_WIDTH_COUNT] = {};
+        uint64_t retries = 0;
+    };
+
+    /**
+     * Reusable memory for building gssw graphs. The graph, its node structs,
+     * their sequences and their edge lists are bump-allocated out of one arena
+     * that is kept between graphs, and node IDs are resolved through a flat
+     * table instead of a hash map, so once the workspace has grown to fit the
+     * subgraphs a thread usually sees, building a graph makes no heap
+     * allocations of its own. The dynamic programming matrices are still
+     * allocated by gssw when the graph is filled.
+     *
+     * Not thread safe; use the calling thread's workspace from local().
+     */
+    class GSSWGraphWorkspace {
+    public:
+        /// Graphs that would need a bigger arena than this many bytes are not
+        /// built in the workspace, so one huge subgraph can't pin its memory
+        /// for the rest of the run.
+        static size_t max_arena_bytes;
+
+        /// Get the calling thread's workspace
+        static GSSWGraphWorkspace& local();
+
+        GSSWGraphWorkspace() = default;
+        ~GSSWGraphWorkspace();
+
+        // The arena holds raw pointers into itself
+        GSSWGraphWorkspace(const GSSWGraphWorkspace& other) = delete;
+        GSSWGraphWorkspace& operator=(const GSSWGraphWorkspace& other) = delete;
+
+        /// Build a gssw graph for the given Graph in the workspace. Returns
+        /// nullptr if a graph built here is still in use or the graph is too
+        /// big for the arena, in which case the caller should build it with
+        /// gssw's own allocators.
+        gssw_graph* build(Graph& g, int8_t* nt_table);
+
+        /// Return true if the given graph was built in this workspace and has
+        /// not been released
+        bool holds(const gssw_graph* graph) const;
+
+        /// Free the alignment data gssw attached to the nodes of a graph built
+        /// here, and make the arena available for the next graph.
+        void release(gssw_graph* graph);
+
+        /// The number of bytes the arena currently holds on to
+        size_t arena_capacity() const;
+
+    private:
+
+        /// Bump-allocate the given number of bytes, aligned for any of the
+        /// gssw structs. Must fit in the space reserved by reserve().
+        void* allocate(size_t bytes);
+
+        /// Make sure the arena has room for the given number of bytes, throwing
+        /// away anything in it
+        void reserve(size_t bytes);
+
+        /// Round a number of bytes up to the arena alignment
+        static size_t padded(size_t bytes);
+
+        /// Find the index of the node with the given ID in the graph being
+        /// built, or -1 if it isn't there
+        int64_t node_index(int64_t node_id) const;
+
+        char* arena = nullptr;
+        size_t capacity = 0;
+        size_t used = 0;
+
+        /// The graph currently built in the arena, if any
+        gssw_graph* live_graph = nullptr;
+
+        /// If the node IDs are dense, the index of each node by ID minus
+        /// min_id, or -1 for IDs not in the graph
+        vector<int32_t> index_by_offset;
+        int64_t min_id = 0;
+        /// Otherwise, pairs of node ID and index, sorted by ID
+        vector<pair<int64_t, int32_t>> index_by_id;
+        bool dense_ids = true;
+
+        /// The from and to node indexes of each edge, in gssw orientation
+        vector<pair<int32_t, int32_t>> edge_ends;
+    };
 
     /**
      * The interface that any Aligner should implement, with some default implementations.
@@ -42,11 +137,32 @@ namespace vg {
         // for construction
         // needed when constructing an alignable graph from the nodes
         gssw_graph* create_gssw_graph(Graph& g);
+        // free a graph made by create_gssw_graph, wherever it was built
+        void destroy_gssw_graph(gssw_graph* graph);
         void visit_node(gssw_node* node,
                         list<gssw_node*>& sorted_nodes,
                         set<gssw_node*>& unmarked_nodes,
                         set<gssw_node*>& temporary_marks);
         
+        /// Make a banded global alignment with the narrowest integer width the scores fit in. Starts
+        /// from the narrowest width that can hold the best possible score of the read, and redoes the
+        /// alignment one width up whenever the scores saturate.
+        void align_global_banded_adaptive(Alignment& alignment, vector<Alignment>* alt_alignments, Graph& g,
+                                          int32_t max_alt_alns, int32_t band_padding, bool permissive_banding,
+                                          bool adjust_for_base_quality);
+        
+        /// Make a banded global alignment with the given integer width. If check_fit is set, gives up
+        /// and returns false when the scores saturate; otherwise always returns true.
+        template<typename IntType>
+        bool align_global_banded_width(Alignment& alignment, vector<Alignment>* alt_alignments, Graph& g,
+                                       int32_t max_alt_alns, int32_t band_padding, bool permissive_banding,
+                                       bool adjust_for_base_quality, bool check_fit);
+        
+        /// Make a single local or pinned alignment with X-drop pruning (see XdropAligner). Returns false
+        /// without aligning if the graph is not one the X-drop aligner can handle.
+        bool align_xdrop(Alignment& alignment, Graph& g, bool pinned, bool pin_left, bool traceback_aln,
+                         bool adjust_for_base_quality);
+        
         // create a reversed graph for left-pinned alignment
         void reverse_graph(Graph& g, Graph& reversed_graph_out);
         // reverse all node sequences (other aspects of graph object not unreversed)
@@ -137,9 +253,18 @@ namespace vg {
         /// Qualities may be ignored by some implementations.
         virtual int32_t score_exact_match(string::const_iterator seq_begin, string::const_iterator seq_end,
                                           string::const_iterator base_qual_begin) const = 0;
+        /// Compute the score of an exact match of the given length from the given offset in a packed
+        /// read. Packing a read once is faster than the overloads above when scoring many matches along it.
+        virtual int32_t score_exact_match(const PackedRead& read, size_t read_offset, size_t length) const = 0;
+        /// Pack the read of an alignment for the overload above, or return null if its matches score
+        /// just as fast without packing, because the aligner doesn't look at the bases or the read
+        /// has no base qualities.
+        virtual unique_ptr<PackedRead> pack_read(const Alignment& aln) const;
         /// Compute the score of a path against the given range of subsequence with the given qualities.
+        /// If the alignment's read has been packed, the matches can be scored from the packed read.
         virtual int32_t score_partial_alignment(const Alignment& alignment, VG& graph, const Path& path,
-                                                string::const_iterator seq_begin) const = 0;
+                                                string::const_iterator seq_begin,
+                                                const PackedRead* packed_read = nullptr) const = 0;
         
         /// Returns the score of an insert or deletion of the given length
         int32_t score_gap(size_t gap_length);
@@ -230,6 +355,23 @@ namespace vg {
         // log of the base of the logarithm underlying the log-odds interpretation of the scores
         double log_base = 0.0;
         
+        /// Should banded global alignment try the narrowest integer width first and move up only if
+        /// the scores saturate? Otherwise the width is picked up front from bounds on the scores.
+        bool adaptive_banded_width = true;
+        
+        /// If positive, single local and pinned alignments abandon DP cells whose score falls this far
+        /// below the best score earlier on their path, and the nodes that only abandoned cells lead
+        /// to. Local alignments also abandon cells that can no longer beat the best alignment (see
+        /// XdropAligner). Multiple alignments and graphs that are not sorted DAGs still get the full
+        /// DP.
+        int32_t xdrop_threshold = 0;
+        
+        /// Get the number of banded global alignments done at each integer width by all aligners so far
+        static BandedWidthCounts banded_width_counts();
+        
+        /// Write a table of the given banded global alignment width counts
+        static void report_banded_widths(ostream& out, const BandedWidthCounts& counts);
+        
     };
     
     /**
@@ -299,9 +441,11 @@ namespace vg {
                                   string::const_iterator base_qual_begin) const;
         int32_t score_exact_match(const string& sequence) const;
         int32_t score_exact_match(string::const_iterator seq_begin, string::const_iterator seq_end) const;
+        int32_t score_exact_match(const PackedRead& read, size_t read_offset, size_t length) const;
 
         int32_t score_partial_alignment(const Alignment& alignment, VG& graph, const Path& path,
-                                        string::const_iterator seq_begin) const;
+                                        string::const_iterator seq_begin,
+                                        const PackedRead* packed_read = nullptr) const;
     };
 
     /**
@@ -338,14 +482,21 @@ namespace vg {
         int32_t score_exact_match(const string& sequence, const string& base_quality) const;
         int32_t score_exact_match(string::const_iterator seq_begin, string::const_iterator seq_end,
                                   string::const_iterator base_qual_begin) const;
+        int32_t score_exact_match(const PackedRead& read, size_t read_offset, size_t length) const;
+        unique_ptr<PackedRead> pack_read(const Alignment& aln) const;
         
         int32_t score_partial_alignment(const Alignment& alignment, VG& graph, const Path& path,
-                                        string::const_iterator seq_begin) const;
+                                        string::const_iterator seq_begin,
+                                        const PackedRead* packed_read = nullptr) const;
         
         uint8_t max_qual_score;
         int8_t scale_factor;
         
     private:
+        
+        /// The score of an exact match of each base code at each quality, 5 * quality + code,
+        /// for the packed read kernels
+        vector<int32_t> exact_match_scores;
 
         void align_internal(Alignment& alignment, vector<Alignment>* multi_alignments, Graph& g,
                             bool pinned, bool pin_left, int32_t max_alt_alns,
@@ -0,0 +1,179 @@
+#include "handle_subgraph.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace vg {
+
+using namespace std;
+
+HandleSubgraph::HandleSubgraph(const HandleGraph* super) : super(super) {
+    // nothing to do
+}
+
+inline handle_t HandleSubgraph::rank_handle(size_t rank, bool is_reverse) const {
+    return as_handle(int64_t(2 * rank + is_reverse));
+}
+
+void HandleSubgraph::add_node(id_t node_id) {
+    if (node_rank.count(node_id)) {
+        return;
+    }
+    node_rank[node_id] = node_ids.size();
+    node_ids.push_back(node_id);
+    finalized = false;
+}
+
+void HandleSubgraph::add_edge(const handle_t& left, const handle_t& right) {
+    auto left_rank = node_rank.find(super->get_id(left));
+    auto right_rank = node_rank.find(super->get_id(right));
+    if (left_rank == node_rank.end() || right_rank == node_rank.end()) {
+        throw runtime_error("[vg::HandleSubgraph] cannot add an edge to a node that is not in the subgraph");
+    }
+    edges.emplace_back(rank_handle(left_rank->second, super->get_is_reverse(left)),
+                       rank_handle(right_rank->second, super->get_is_reverse(right)));
+    finalized = false;
+}
+
+void HandleSubgraph::extend(const HandleSubgraph& other) {
+    for (id_t node_id : other.node_ids) {
+        add_node(node_id);
+    }
+    for (auto& edge : other.edges) {
+        edges.emplace_back(get_handle(other.get_id(edge.first), other.get_is_reverse(edge.first)),
+                           get_handle(other.get_id(edge.second), other.get_is_reverse(edge.second)));
+    }
+    finalized = false;
+}
+
+void HandleSubgraph::finalize() {
+    // put edges in their canonical orientation so that duplicates match
+    for (auto& edge : edges) {
+        edge = edge_handle(edge.first, edge.second);
+    }
+    sort(edges.begin(), edges.end(), [](const pair<handle_t, handle_t>& a, const pair<handle_t, handle_t>& b) {
+        return make_pair(as_integer(a.first), as_integer(a.second)) < make_pair(as_integer(b.first), as_integer(b.second));
+    });
+    edges.erase(unique(edges.begin(), edges.end()), edges.end());
+
+    // count the handles leaving each handle, in both directions along each
+    // edge, then lay them out by handle
+    size_t handle_count = 2 * node_ids.size();
+    adjacency_start.assign(handle_count + 1, 0);
+    for (auto& edge : edges) {
+        adjacency_start[as_integer(edge.first) + 1]++;
+        if (edge.first != flip(edge.second)) {
+            // the reverse traversal of a reversing self loop is the same edge
+            adjacency_start[as_integer(flip(edge.second)) + 1]++;
+        }
+    }
+    for (size_t i = 0; i < handle_count; i++) {
+        adjacency_start[i + 1] += adjacency_start[i];
+    }
+    adjacency.resize(adjacency_start.back());
+    vector<size_t> next_slot(adjacency_start.begin(), adjacency_start.end() - 1);
+    for (auto& edge : edges) {
+        adjacency[next_slot[as_integer(edge.first)]++] = edge.second;
+        if (edge.first != flip(edge.second)) {
+            adjacency[next_slot[as_integer(flip(edge.second))]++] = flip(edge.first);
+        }
+    }
+    finalized = true;
+}
+
+handle_t HandleSubgraph::get_handle(const id_t& node_id, bool is_reverse) const {
+    auto found = node_rank.find(node_id);
+    if (found == node_rank.end()) {
+        throw runtime_error("[vg::HandleSubgraph] node " + to_string(node_id) + " is not in the subgraph");
+    }
+    return rank_handle(found->second, is_reverse);
+}
+
+id_t HandleSubgraph::get_id(const handle_t& handle) const {
+    return node_ids[get_rank(handle)];
+}
+
+bool HandleSubgraph::get_is_reverse(const handle_t& handle) const {
+    return as_integer(handle) % 2;
+}
+
+handle_t HandleSubgraph::flip(const handle_t& handle) const {
+    return as_handle(as_integer(handle) ^ 1);
+}
+
+size_t HandleSubgraph::get_length(const handle_t& handle) const {
+    return super->get_length(get_underlying_handle(handle));
+}
+
+string HandleSubgraph::get_sequence(const handle_t& handle) const {
+    return super->get_sequence(get_underlying_handle(handle));
+}
+
+bool HandleSubgraph::follow_edges(const handle_t& handle, bool go_left,
+                                  const function<bool(const handle_t&)>& iteratee) const {
+    if (!finalized) {
+        throw runtime_error("[vg::HandleSubgraph] subgraph must be finalized before following edges");
+    }
+    // going left is going right from the other orientation
+    handle_t from = go_left ? flip(handle) : handle;
+    for (size_t i = adjacency_start[as_integer(from)]; i < adjacency_start[as_integer(from) + 1]; i++) {
+        if (!iteratee(go_left ? flip(adjacency[i]) : adjacency[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void HandleSubgraph::for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel) const {
+    // subgraphs are small, so we always go in serial
+    for (size_t i = 0; i < node_ids.size(); i++) {
+        if (!iteratee(rank_handle(i, false))) {
+            break;
+        }
+    }
+}
+
+size_t HandleSubgraph::node_size() const {
+    return node_ids.size();
+}
+
+bool HandleSubgraph::has_node(id_t node_id) const {
+    return node_rank.count(node_id);
+}
+
+id_t HandleSubgraph::min_node_id() const {
+    return node_ids.empty() ? 0 : *min_element(node_ids.begin(), node_ids.end());
+}
+
+id_t HandleSubgraph::max_node_id() const {
+    return node_ids.empty() ? 0 : *max_element(node_ids.begin(), node_ids.end());
+}
+
+const HandleGraph* HandleSubgraph::get_super() const {
+    return super;
+}
+
+size_t HandleSubgraph::get_rank(const handle_t& handle) const {
+    return as_integer(handle) / 2;
+}
+
+handle_t HandleSubgraph::get_underlying_handle(const handle_t& handle) const {
+    return super->get_handle(get_id(handle), get_is_reverse(handle));
+}
+
+void HandleSubgraph::to_graph(Graph& graph) const {
+    for (size_t i = 0; i < node_ids.size(); i++) {
+        Node* node = graph.add_node();
+        node->set_id(node_ids[i]);
+        node->set_sequence(super->get_sequence(super->get_handle(node_ids[i], false)));
+    }
+    for (auto& edge : edges) {
+        Edge* e = graph.add_edge();
+        e->set_from(get_id(edge.first));
+        e->set_from_start(get_is_reverse(edge.first));
+        e->set_to(get_id(edge.second));
+        e->set_to_end(get_is_reverse(edge.second));
+    }
+}
+
+}
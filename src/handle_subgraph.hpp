@@ -0,0 +1,120 @@
+#ifndef VG_HANDLE_SUBGRAPH_HPP_INCLUDED
+#define VG_HANDLE_SUBGRAPH_HPP_INCLUDED
+
+/** \file
+ *
+ * Provides a lightweight read-only subgraph of a backing HandleGraph, for the
+ * many short-lived graphs that mapping extracts around read hits.
+ *
+ * The subgraph stores only node IDs and edges. Sequences come from the backing
+ * graph on demand, and once the subgraph is finalized its edges are kept in
+ * one flat adjacency array, so making one doesn't allocate per node or edge
+ * the way building a VG does.
+ */
+
+#include <vector>
+#include <utility>
+
+#include "handle.hpp"
+#include "hash_map.hpp"
+#include "vg.pb.h"
+
+namespace vg {
+
+using namespace std;
+
+class HandleSubgraph : public HandleGraph {
+public:
+
+    /// Make an empty subgraph of the given backing graph
+    HandleSubgraph(const HandleGraph* super);
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Construction
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Add a node of the backing graph by ID, if it isn't already present
+    void add_node(id_t node_id);
+
+    /// Add an edge of the backing graph, given as a pair of backing graph
+    /// handles. Both nodes must already be in the subgraph. Duplicates are
+    /// removed when the subgraph is finalized.
+    void add_edge(const handle_t& left, const handle_t& right);
+
+    /// Add all the nodes and edges of another subgraph of the same backing
+    /// graph
+    void extend(const HandleSubgraph& other);
+
+    /// Index the edges so the subgraph can be traversed. Must be called after
+    /// the last node or edge is added and before following edges.
+    void finalize();
+
+    ////////////////////////////////////////////////////////////////////////////
+    // HandleGraph interface
+    ////////////////////////////////////////////////////////////////////////////
+
+    handle_t get_handle(const id_t& node_id, bool is_reverse = false) const;
+    id_t get_id(const handle_t& handle) const;
+    bool get_is_reverse(const handle_t& handle) const;
+    handle_t flip(const handle_t& handle) const;
+    size_t get_length(const handle_t& handle) const;
+    string get_sequence(const handle_t& handle) const;
+    bool follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const;
+    void for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel = false) const;
+    size_t node_size() const;
+
+    using HandleGraph::follow_edges;
+    using HandleGraph::for_each_handle;
+    using HandleGraph::get_handle;
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Other queries
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Return true if the node is in the subgraph
+    bool has_node(id_t node_id) const;
+
+    /// Smallest and largest node IDs, or 0 if the subgraph is empty
+    id_t min_node_id() const;
+    id_t max_node_id() const;
+
+    /// Get the backing graph
+    const HandleGraph* get_super() const;
+
+    /// Get the rank of a handle's node, counting from 0 in the order the nodes
+    /// were added. Ranks run from 0 to node_size() - 1, so they can index
+    /// per-node arrays.
+    size_t get_rank(const handle_t& handle) const;
+
+    /// Get the backing graph's handle for a handle of this subgraph
+    handle_t get_underlying_handle(const handle_t& handle) const;
+
+    /// Copy the subgraph into a protobuf Graph, with nodes in the order they
+    /// were added
+    void to_graph(Graph& graph) const;
+
+private:
+
+    const HandleGraph* super;
+
+    /// The IDs of the nodes, in the order they were added. Handles of this
+    /// graph are 2 * rank + is_reverse.
+    vector<id_t> node_ids;
+    hash_map<id_t, size_t> node_rank;
+
+    /// Edges as pairs of handles of this graph
+    vector<pair<handle_t, handle_t>> edges;
+
+    /// After finalizing, the handles reached by leaving the end of each of
+    /// our handles are adjacency[adjacency_start[h] .. adjacency_start[h + 1]]
+    vector<size_t> adjacency_start;
+    vector<handle_t> adjacency;
+    bool finalized = false;
+
+    /// Make a handle of this graph for a rank and orientation
+    inline handle_t rank_handle(size_t rank, bool is_reverse) const;
+};
+
+}
+
+#endif
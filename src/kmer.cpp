@@ -1,5 +1,12 @@
 #include "kmer.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+
 namespace vg {
 
 void for_each_kmer(const HandleGraph& graph, size_t k,
@@ -170,6 +177,122 @@ void for_each_kmer(const HandleGraph& graph, size_t k,
         }, true);
 }
 
+/// The 2-bit code of a base, or 4 if it isn't one of ACGT
+static inline uint64_t packed_base_code(char base) {
+    switch (base) {
+        case 'A': case 'a': return 0;
+        case 'C': case 'c': return 1;
+        case 'G': case 'g': return 2;
+        case 'T': case 't': return 3;
+        default: return 4;
+    }
+}
+
+string packed_kmer_sequence(uint64_t bases, size_t k) {
+    string seq(k, 'N');
+    for (size_t i = 0; i < k; i++) {
+        seq[k - i - 1] = "ACGT"[bases & 3];
+        bases >>= 2;
+    }
+    return seq;
+}
+
+pos_t packed_kmer_position(const HandleGraph& graph, const packed_kmer_t& kmer) {
+    return make_pos_t(graph.get_id(kmer.handle), graph.get_is_reverse(kmer.handle), kmer.offset);
+}
+
+void for_each_packed_kmer(const HandleGraph& graph, size_t k,
+                          const function<void(const vector<packed_kmer_t>&)>& lambda,
+                          size_t batch_size) {
+    if (k == 0 || k > 32) {
+        cerr << "error: [for_each_packed_kmer()] kmers must be between 1 and 32 bases long, not " << k << endl;
+        exit(1);
+    }
+
+    // each thread fills its own batch
+    vector<vector<packed_kmer_t>> batches(omp_get_max_threads());
+    auto emit = [&](vector<packed_kmer_t>& batch, uint64_t bases, const handle_t& handle, size_t offset) {
+        batch.push_back({bases, handle, (uint32_t) offset});
+        if (batch.size() >= batch_size) {
+            lambda(batch);
+            batch.clear();
+        }
+    };
+
+    graph.for_each_handle([&](const handle_t& h) {
+        auto& batch = batches[omp_get_thread_num()];
+        for (bool is_reverse : {false, true}) {
+            handle_t handle = is_reverse ? graph.flip(h) : h;
+            string seq = graph.get_sequence(handle);
+
+            // kmers inside the node, with a rolling key
+            uint64_t mask = k == 32 ? numeric_limits<uint64_t>::max() : (uint64_t(1) << (2 * k)) - 1;
+            uint64_t bases = 0;
+            // how many bases we have had since the last one that isn't ACGT
+            size_t valid_run = 0;
+            for (size_t i = 0; i < seq.size(); i++) {
+                uint64_t code = packed_base_code(seq[i]);
+                if (code > 3) {
+                    valid_run = 0;
+                    bases = 0;
+                    continue;
+                }
+                bases = ((bases << 2) | code) & mask;
+                valid_run++;
+                if (valid_run >= k) {
+                    emit(batch, bases, handle, i + 1 - k);
+                }
+            }
+
+            // the last up to k - 1 bases start kmers that run into the next
+            // nodes; valid_run and bases now describe the end of the node
+            size_t tail_length = min(min(valid_run, seq.size()), k - 1);
+            if (tail_length == 0) {
+                continue;
+            }
+            uint64_t tail = bases;
+
+            // Walk out every extension of up to k - 1 bases. When the
+            // extension is e bases long, the kmer starting k - e bases from
+            // the end of the node is complete.
+            function<void(const handle_t&, uint64_t, size_t)> extend = [&](const handle_t& next, uint64_t extension,
+                                                                           size_t extension_length) {
+                string next_seq = graph.get_sequence(next);
+                for (char base : next_seq) {
+                    uint64_t code = packed_base_code(base);
+                    if (code > 3) {
+                        // every longer extension goes through this base
+                        return;
+                    }
+                    extension = (extension << 2) | code;
+                    extension_length++;
+                    size_t from_end = k - extension_length;
+                    if (from_end <= tail_length) {
+                        uint64_t kmer = ((tail & ((uint64_t(1) << (2 * from_end)) - 1)) << (2 * extension_length))
+                            | extension;
+                        emit(batch, kmer, handle, seq.size() - from_end);
+                    }
+                    if (extension_length == k - 1) {
+                        return;
+                    }
+                }
+                graph.follow_edges(next, false, [&](const handle_t& after) {
+                    extend(after, extension, extension_length);
+                });
+            };
+            graph.follow_edges(handle, false, [&](const handle_t& next) {
+                extend(next, 0, 0);
+            });
+        }
+    }, true);
+
+    for (auto& batch : batches) {
+        if (!batch.empty()) {
+            lambda(batch);
+        }
+    }
+}
+
 ostream& operator<<(ostream& out, const kmer_t& kmer) {
     out << kmer.seq << "\t"
         << id(kmer.begin) << ":" << (is_rev(kmer.begin) ? "-":"") << offset(kmer.begin) << "\t";
@@ -219,62 +342,234 @@ gcsa::byte_type encode_chars(const vector<char>& chars, const gcsa::Alphabet& al
     return val;
 }
 
-void write_gcsa_kmers(const HandleGraph& graph, int kmer_size, ostream& out, size_t& size_limit, id_t head_id, id_t tail_id) {
+/// How many leading characters of a kmer choose its partition
+const size_t GCSA_KMER_PREFIX_LENGTH = 2;
+/// Each prefix character is one of ACGT or something else
+const size_t GCSA_KMER_PARTITIONS = 25;
+
+/// Get the partition of a kmer from the first characters of its sequence
+static size_t kmer_partition(const string& seq) {
+    size_t partition = 0;
+    for (size_t i = 0; i < GCSA_KMER_PREFIX_LENGTH; i++) {
+        size_t code = 4;
+        if (i < seq.size()) {
+            switch (seq[i]) {
+                case 'A': code = 0; break;
+                case 'C': code = 1; break;
+                case 'G': code = 2; break;
+                case 'T': code = 3; break;
+            }
+        }
+        partition = partition * 5 + code;
+    }
+    return partition;
+}
+
+static bool gcsa_kmer_less(const gcsa::KMer& a, const gcsa::KMer& b) {
+    return a.key < b.key || (a.key == b.key && (a.from < b.from || (a.from == b.from && a.to < b.to)));
+}
+
+static bool gcsa_kmer_equal(const gcsa::KMer& a, const gcsa::KMer& b) {
+    return a.key == b.key && a.from == b.from && a.to == b.to;
+}
+
+/// One thread's kmers on their way to disk. The thread buffers its kmers by
+/// partition and appends full buffers to its own temp file, so threads never
+/// wait on each other while generating kmers.
+struct GCSAKmerSpill {
+    string filename;
+    ofstream out;
+    vector<vector<gcsa::KMer>> buffers;
+    /// The partition, starting kmer, and kmer count of each block in the file
+    vector<tuple<size_t, size_t, size_t>> blocks;
+    size_t kmers_written = 0;
+};
+
+void write_gcsa_kmers(const HandleGraph& graph, int kmer_size, ostream& out, size_t& size_limit, id_t head_id, id_t tail_id,
+                      size_t memory_limit) {
 
     // We need an alphabet to parse the internal string format
     const gcsa::Alphabet alpha;
-    // Each thread is going to make its own KMers, then we'll concatenate these all together at the end.
-    vector<vector<gcsa::KMer> > thread_outputs;
+    // Each thread spills its kmers to its own file.
+    vector<GCSAKmerSpill> spills;
 #pragma omp parallel
     {
 #pragma omp single
         {
-            // Set up our write buffers at the given parallelism we expect
-            thread_outputs.resize(omp_get_num_threads());
+            // Set up our spill files at the given parallelism we expect
+            spills.resize(omp_get_num_threads());
         }
     }
-    // This handles the buffered writing for each thread
-    size_t buffer_limit = 1e5; // max 100k kmers per buffer
-    size_t total_bytes = 0;
-    auto handle_kmers = [&](vector<gcsa::KMer>& kmers, bool more) {
-        if (!more || kmers.size() > buffer_limit) {
-            size_t bytes_required = kmers.size() * sizeof(gcsa::KMer) + sizeof(gcsa::GraphFileHeader);
-#pragma omp critical (gcsa_kmer_out)
-            {
-                if (total_bytes + bytes_required > size_limit) {
-                    cerr << "error: [write_gcsa_kmers()] size limit exceeded" << endl;
-                    exit(EXIT_FAILURE);
+
+    // We can't throw out of the parallel sections, so the first error is kept
+    // here, the threads skip their remaining work, and we throw once they are
+    // done.
+    string error;
+    atomic<bool> failed(false);
+    auto fail = [&](const string& message) {
+#pragma omp critical (gcsa_kmer_error)
+        {
+            if (!failed) {
+                error = message;
+                failed = true;
+            }
+        }
+    };
+    auto throw_if_failed = [&]() {
+        if (failed) {
+            for (auto& spill : spills) {
+                spill.out.close();
+                if (!spill.filename.empty()) {
+                    temp_file::remove(spill.filename);
                 }
-                gcsa::writeBinary(out, kmers, kmer_size);
-                total_bytes += bytes_required;
             }
-            kmers.clear();
+            throw runtime_error("[write_gcsa_kmers()] " + error);
         }
     };
+
+    // temp_file isn't thread safe, so make the files here.
+    for (auto& spill : spills) {
+        spill.filename = temp_file::create("vg-kmers-part-");
+        spill.out.open(spill.filename, ios::binary);
+        if (!spill.out) {
+            fail("could not write temp file " + spill.filename);
+            break;
+        }
+        spill.buffers.resize(GCSA_KMER_PARTITIONS);
+    }
+    throw_if_failed();
+
+    // All the buffers together, and then the kmers being deduplicated by all
+    // the threads together, are held to the memory limit.
+    size_t buffer_limit = max<size_t>(memory_limit / (spills.size() * GCSA_KMER_PARTITIONS * sizeof(gcsa::KMer)), 1024);
+    size_t dedup_limit = max<size_t>(memory_limit / (spills.size() * sizeof(gcsa::KMer)), 1024);
+
+    // The spilled kmers are no bigger than the undeduplicated kmer file we
+    // used to write, so they and the kmer file are each held to the limit.
+    auto check_size_limit = [&](size_t bytes, const string& what) {
+        if (bytes > size_limit) {
+            fail("size limit of " + to_string(size_limit) + " bytes exceeded; " + what + " need at least "
+                 + to_string(bytes) + " bytes of disk space. "
+                 + "Raise the limit or prune complex regions of the graph with `vg prune`.");
+        }
+    };
+
+    atomic<size_t> spilled_bytes(0);
+    auto flush_buffer = [&](GCSAKmerSpill& spill, size_t partition) {
+        auto& buffer = spill.buffers[partition];
+        if (buffer.empty() || failed) {
+            buffer.clear();
+            return;
+        }
+        spill.out.write((const char*) buffer.data(), buffer.size() * sizeof(gcsa::KMer));
+        if (!spill.out) {
+            fail("could not write temp file " + spill.filename);
+            return;
+        }
+        spill.blocks.emplace_back(partition, spill.kmers_written, buffer.size());
+        spill.kmers_written += buffer.size();
+        check_size_limit(spilled_bytes += buffer.size() * sizeof(gcsa::KMer), "the spilled kmers");
+        buffer.clear();
+    };
+
     // Here we convert our kmer_t to gcsa::KMer
-    auto convert_kmer = [&thread_outputs, &alpha, &head_id, &tail_id, &handle_kmers](const kmer_t& kmer) {
-        // Convert this KmerPosition to several gcsa::KMers, and save them in thread_outputs
-        vector<gcsa::KMer>& thread_output = thread_outputs[omp_get_thread_num()];
-        kmer_to_gcsa_kmers(kmer, alpha, [&thread_output](const gcsa::KMer& k) { thread_output.push_back(k); });
-        // Handle kmer buffered writes, indicating we're not yet done
-        handle_kmers(thread_output, true);
+    auto convert_kmer = [&](const kmer_t& kmer) {
+        if (failed) {
+            return;
+        }
+        // Convert this KmerPosition to several gcsa::KMers, and save them in this thread's buffer for their partition
+        GCSAKmerSpill& spill = spills[omp_get_thread_num()];
+        size_t partition = kmer_partition(kmer.seq);
+        auto& buffer = spill.buffers[partition];
+        kmer_to_gcsa_kmers(kmer, alpha, [&buffer](const gcsa::KMer& k) { buffer.push_back(k); });
+        if (buffer.size() >= buffer_limit) {
+            flush_buffer(spill, partition);
+        }
     };
     // Run on each KmerPosition. This populates start_end_id, if it was 0, before calling convert_kmer.
     for_each_kmer(graph, kmer_size, convert_kmer, head_id, tail_id);
-    for(auto& thread_output : thread_outputs) {
+    for (auto& spill : spills) {
         // Flush our buffers
-        handle_kmers(thread_output, false);
+        for (size_t partition = 0; partition < GCSA_KMER_PARTITIONS; partition++) {
+            flush_buffer(spill, partition);
+        }
+        spill.buffers.clear();
+        spill.out.close();
+    }
+    throw_if_failed();
+
+    // Now deduplicate each partition and write it out. Partitions that fit in
+    // a thread's share of memory are deduplicated completely; bigger ones are
+    // deduplicated a piece at a time, and GCSA2 merges what's left.
+    size_t total_bytes = 0;
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t partition = 0; partition < GCSA_KMER_PARTITIONS; partition++) {
+        vector<gcsa::KMer> kmers;
+        auto write_kmers = [&]() {
+            std::sort(kmers.begin(), kmers.end(), gcsa_kmer_less);
+            kmers.erase(std::unique(kmers.begin(), kmers.end(), gcsa_kmer_equal), kmers.end());
+            size_t bytes_required = kmers.size() * sizeof(gcsa::KMer) + sizeof(gcsa::GraphFileHeader);
+#pragma omp critical (gcsa_kmer_out)
+            {
+                total_bytes += bytes_required;
+                check_size_limit(total_bytes, "the kmers");
+                if (!failed) {
+                    gcsa::writeBinary(out, kmers, kmer_size);
+                }
+            }
+            kmers.clear();
+        };
+        for (auto& spill : spills) {
+            if (failed) {
+                break;
+            }
+            ifstream in(spill.filename, ios::binary);
+            if (!in) {
+                fail("could not read temp file " + spill.filename);
+                break;
+            }
+            for (auto& block : spill.blocks) {
+                if (get<0>(block) != partition) {
+                    continue;
+                }
+                size_t count = get<2>(block);
+                if (!kmers.empty() && kmers.size() + count > dedup_limit) {
+                    write_kmers();
+                }
+                size_t start = kmers.size();
+                kmers.resize(start + count);
+                if (!in.seekg(get<1>(block) * sizeof(gcsa::KMer))
+                    || !in.read((char*) (kmers.data() + start), count * sizeof(gcsa::KMer))) {
+                    fail("could not read " + to_string(count) + " kmers from temp file " + spill.filename);
+                    break;
+                }
+            }
+        }
+        if (!kmers.empty() && !failed) {
+            write_kmers();
+        }
+    }
+    throw_if_failed();
+
+    for (auto& spill : spills) {
+        temp_file::remove(spill.filename);
     }
     size_limit = total_bytes;
 }
 
 string write_gcsa_kmers_to_tmpfile(const HandleGraph& graph, int kmer_size, size_t& size_limit, id_t head_id, id_t tail_id,
-                                   const string& base_file_name) {
+                                   const string& base_file_name, size_t memory_limit) {
     // open a temporary file for the kmers
     string tmpfile = temp_file::create(base_file_name);
     ofstream out(tmpfile);
     // write the kmers to the temporary file
-    write_gcsa_kmers(graph, kmer_size, out, size_limit, head_id, tail_id);
+    try {
+        write_gcsa_kmers(graph, kmer_size, out, size_limit, head_id, tail_id, memory_limit);
+    } catch (...) {
+        out.close();
+        temp_file::remove(tmpfile);
+        throw;
+    }
     out.close();
     return tmpfile;
 }
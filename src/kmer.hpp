@@ -45,6 +45,30 @@ void for_each_kmer(const HandleGraph& graph, size_t k,
                    const function<void(const kmer_t&)>& lambda,
                    id_t head_id = 0, id_t tail_id = 0);
 
+/// A kmer of at most 32 bases, all ACGT, packed 2 bits per base with the last
+/// base in the lowest bits, and the handle and offset where it starts.
+struct packed_kmer_t {
+    uint64_t bases;
+    handle_t handle;
+    uint32_t offset;
+};
+
+/// Iterate over all the kmers of length k <= 32 that contain only ACGT, on
+/// both strands of the graph, with one kmer per walk spelling it out. Each
+/// thread collects its kmers in a batch of up to batch_size, and runs lambda
+/// on the batch when it fills up, so lambda may be called from many threads.
+/// Unlike for_each_kmer(), no context is collected and nothing is allocated
+/// per kmer.
+void for_each_packed_kmer(const HandleGraph& graph, size_t k,
+                          const function<void(const vector<packed_kmer_t>&)>& lambda,
+                          size_t batch_size = 1024);
+
+/// Unpack the sequence of a packed kmer of length k
+string packed_kmer_sequence(uint64_t bases, size_t k);
+
+/// Get the position where a packed kmer starts
+pos_t packed_kmer_position(const HandleGraph& graph, const packed_kmer_t& kmer);
+
 /// Print a kmer_t to a stream.
 ostream& operator<<(ostream& out, const kmer_t& kmer);
 
@@ -56,15 +80,22 @@ gcsa::byte_type encode_chars(const vector<char>& chars, const gcsa::Alphabet& al
 
 /**
  * Write GCSA2 formatted binary KMers to the given ostream.
- * size_limit is the maximum size of the kmer file in bytes. When the function
- * returns, size_limit is the size of the kmer file in bytes.
+ * The kmers are first spilled to temp files partitioned by their first
+ * characters, and then each partition is deduplicated and written out.
+ * size_limit is the maximum size of the kmer file in bytes, and separately of
+ * the spilled kmers. When the function returns, size_limit is the size of the
+ * kmer file in bytes. memory_limit is roughly how many bytes of kmers are held
+ * in memory at once. Throws a runtime_error if a limit is exceeded or the temp
+ * files can't be used.
  */
-void write_gcsa_kmers(const HandleGraph& graph, int kmer_size, ostream& out, size_t& size_limit, id_t head_id, id_t tail_id);
+void write_gcsa_kmers(const HandleGraph& graph, int kmer_size, ostream& out, size_t& size_limit, id_t head_id, id_t tail_id,
+                      size_t memory_limit = 1024 * 1024 * 1024);
 
 /// Open a tempfile and write the kmers to it. The calling context should remove it
 /// with temp_file::remove().
 string write_gcsa_kmers_to_tmpfile(const HandleGraph& graph, int kmer_size, size_t& size_limit, id_t head_id, id_t tail_id,
-                                   const string& base_file_name = "vg-kmers-tmp-");
+                                   const string& base_file_name = "vg-kmers-tmp-",
+                                   size_t memory_limit = 1024 * 1024 * 1024);
 
 }
 
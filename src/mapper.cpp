@@ -81,6 +81,10 @@ BaseMapper::find_mems_simple(string::const_iterator seq_begin,
                              int min_mem_length,
                              int reseed_length) {
     
+    if (minimizer_index) {
+        return find_minimizer_mems(seq_begin, seq_end);
+    }
+    
     if (!gcsa) {
         cerr << "error:[vg::Mapper] a GCSA2 index is required to query MEMs" << endl;
         exit(1);
@@ -271,6 +275,64 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
                                                      bool include_parent_in_sub_mem_count,
                                                      bool record_max_lcp,
                                                      int reseed_below) {
+    
+    if (!mem_cache) {
+        return find_mems_deep_uncached(seq_begin, seq_end, longest_lcp, fraction_filtered, max_mem_length,
+                                       min_mem_length, reseed_length, use_lcp_reseed_heuristic,
+                                       use_diff_based_fast_reseed, include_parent_in_sub_mem_count,
+                                       record_max_lcp, reseed_below);
+    }
+    
+    // the same sequence can be searched with different parameters, so they're part of the key
+    stringstream key_stream;
+    key_stream << max_mem_length << ':' << min_mem_length << ':' << reseed_length << ':'
+               << use_lcp_reseed_heuristic << use_diff_based_fast_reseed << include_parent_in_sub_mem_count
+               << record_max_lcp << ':' << reseed_below << ':';
+    string key = key_stream.str();
+    key.append(seq_begin, seq_end);
+    
+    shared_ptr<const CachedMEMs> cached = mem_cache->retrieve(key);
+    if (!cached) {
+        CachedMEMs found;
+        found.mems = find_mems_deep_uncached(seq_begin, seq_end, found.longest_lcp, found.fraction_filtered,
+                                             max_mem_length, min_mem_length, reseed_length, use_lcp_reseed_heuristic,
+                                             use_diff_based_fast_reseed, include_parent_in_sub_mem_count,
+                                             record_max_lcp, reseed_below);
+        // the MEMs we return can point into this read, so only the cached copy needs offsets
+        longest_lcp = found.longest_lcp;
+        fraction_filtered = found.fraction_filtered;
+        vector<MaximalExactMatch> mems = found.mems;
+        for (auto& mem : found.mems) {
+            found.intervals.emplace_back(mem.begin - seq_begin, mem.end - seq_begin);
+            mem.begin = mem.end = string::const_iterator();
+        }
+        mem_cache->put(key, std::move(found));
+        return mems;
+    }
+    
+    // point the cached MEMs into this read
+    longest_lcp = cached->longest_lcp;
+    fraction_filtered = cached->fraction_filtered;
+    vector<MaximalExactMatch> mems = cached->mems;
+    for (size_t i = 0; i < mems.size(); i++) {
+        mems[i].begin = seq_begin + cached->intervals[i].first;
+        mems[i].end = seq_begin + cached->intervals[i].second;
+    }
+    return mems;
+}
+
+vector<MaximalExactMatch> BaseMapper::find_mems_deep_uncached(string::const_iterator seq_begin,
+                                                              string::const_iterator seq_end,
+                                                              double& longest_lcp,
+                                                              double& fraction_filtered,
+                                                              int max_mem_length,
+                                                              int min_mem_length,
+                                                              int reseed_length,
+                                                              bool use_lcp_reseed_heuristic,
+                                                              bool use_diff_based_fast_reseed,
+                                                              bool include_parent_in_sub_mem_count,
+                                                              bool record_max_lcp,
+                                                              int reseed_below) {
 #ifdef debug_mapper
 #pragma omp critical
     {
@@ -283,6 +345,13 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
     }
 #endif
 
+    if (minimizer_index) {
+        // minimizer seeds have no LCP or filtering statistics to report
+        longest_lcp = 0.0;
+        fraction_filtered = 0.0;
+        return find_minimizer_mems(seq_begin, seq_end);
+    }
+
     if (!gcsa) {
         cerr << "error:[vg::Mapper] a GCSA2 index is required to query MEMs" << endl;
         exit(1);
@@ -292,6 +361,7 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
         cerr << "error:[vg::Mapper] minimimum reseed length for MEMs cannot be less than minimum MEM length" << endl;
         exit(1);
     }
+    StageTimer timer(STAGE_FIND_MEMS);
     vector<MaximalExactMatch> mems;
     
     gcsa::range_type full_range = gcsa::range_type(0, gcsa->size() - 1);
@@ -648,6 +718,72 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
         precollapse_order_length_runs(seq_begin, mems);
     }
 
+    timer.add_candidates(mems.size());
+    return mems;
+}
+
+vector<MaximalExactMatch> BaseMapper::find_minimizer_mems(string::const_iterator seq_begin,
+                                                          string::const_iterator seq_end) {
+    
+    StageTimer timer(STAGE_FIND_MEMS);
+    vector<MaximalExactMatch> mems;
+    size_t k = minimizer_index->k();
+    
+    // the hits of the last minimizer added to the last MEM
+    MinimizerIndex::Hits last_hits(nullptr, nullptr);
+    size_t last_offset = 0;
+    
+    for (const MinimizerIndex::Minimizer& minimizer : minimizer_index->minimizers(seq_begin, seq_end)) {
+        MinimizerIndex::Hits hits = minimizer_index->find(minimizer.key);
+        if (hits.empty()) {
+            last_hits = hits;
+            continue;
+        }
+        
+        // if this minimizer overlaps the last one and all of its hits are the
+        // last one's hits shifted along the same nodes, it's part of the same
+        // exact match
+        if (!last_hits.empty() && minimizer.offset < last_offset + k && hits.size() == last_hits.size()) {
+            size_t shift = minimizer.offset - last_offset;
+            bool lined_up = true;
+            for (size_t i = 0; i < hits.size() && lined_up; i++) {
+                const pos_t& last_hit = last_hits[i];
+                lined_up = (id(hits[i]) == id(last_hit) && is_rev(hits[i]) == is_rev(last_hit)
+                            && offset(hits[i]) == offset(last_hit) + shift);
+            }
+            if (lined_up) {
+                mems.back().end = seq_begin + minimizer.offset + k;
+                last_hits = hits;
+                last_offset = minimizer.offset;
+                continue;
+            }
+        }
+        
+        mems.emplace_back(seq_begin + minimizer.offset, seq_begin + minimizer.offset + k,
+                          gcsa::range_type(0, 0), hits.size());
+        MaximalExactMatch& mem = mems.back();
+        mem.primary = true;
+        // like locating in the GCSA2, leave the hits out if there are too many
+        if (!hit_max || hits.size() <= (size_t) hit_max) {
+            mem.nodes.reserve(hits.size());
+            for (const pos_t& hit : hits) {
+                mem.nodes.push_back(gcsa::Node::encode(id(hit), offset(hit), is_rev(hit)));
+            }
+        }
+        last_hits = hits;
+        last_offset = minimizer.offset;
+    }
+    
+#ifdef debug_mapper
+#pragma omp critical
+    {
+        for (auto& mem : mems) {
+            cerr << "minimizer MEM " << mem.sequence() << " has " << mem.match_count << " hits" << endl;
+        }
+    }
+#endif
+    
+    timer.add_candidates(mems.size());
     return mems;
 }
 
@@ -1283,6 +1419,11 @@ void BaseMapper::precollapse_order_length_runs(string::const_iterator seq_begin,
 void BaseMapper::rescue_high_count_order_length_mems(vector<MaximalExactMatch>& mems,
                                                      size_t max_rescue_hit_count) {
     
+    if (!gcsa) {
+        // minimizer MEMs are never capped at the GCSA2 order, so there's nothing to rescue
+        return;
+    }
+    
     vector<pair<size_t, size_t>> unfilled_mem_ranges;
     
     // identify the ranges of MEMs that are unfilled
@@ -1557,13 +1698,51 @@ set<pos_t> BaseMapper::positions_bp_from(pos_t pos, int distance, bool rev) {
 }
     
 char BaseMapper::pos_char(pos_t pos) {
+    if (node_cache) {
+        return xg_cached_pos_char(pos, xindex, *node_cache);
+    }
     return xg_pos_char(pos, xindex);
 }
 
 map<pos_t, char> BaseMapper::next_pos_chars(pos_t pos) {
+    if (node_cache) {
+        return xg_cached_next_pos_chars(pos, xindex, *node_cache);
+    }
     return xg_next_pos_chars(pos, xindex);
 }
 
+void BaseMapper::set_cache_size(int new_cache_size) {
+    if (new_cache_size > 0) {
+        node_cache = make_shared<NodeCache>(new_cache_size);
+    } else {
+        node_cache.reset();
+    }
+}
+
+void BaseMapper::set_node_cache(shared_ptr<NodeCache> new_node_cache) {
+    node_cache = new_node_cache;
+}
+
+shared_ptr<NodeCache> BaseMapper::get_node_cache() const {
+    return node_cache;
+}
+
+void BaseMapper::set_mem_cache_size(int new_cache_size) {
+    if (new_cache_size > 0) {
+        mem_cache = make_shared<MEMCache>(new_cache_size);
+    } else {
+        mem_cache.reset();
+    }
+}
+
+void BaseMapper::set_mem_cache(shared_ptr<MEMCache> new_mem_cache) {
+    mem_cache = new_mem_cache;
+}
+
+shared_ptr<MEMCache> BaseMapper::get_mem_cache() const {
+    return mem_cache;
+}
+
 void BaseMapper::set_alignment_threads(int new_thread_count) {
     alignment_threads = new_thread_count;
 }
@@ -1611,6 +1790,18 @@ void BaseMapper::init_aligner(int8_t match, int8_t mismatch, int8_t gap_open, in
     qual_adj_aligner = new QualAdjAligner(match, mismatch, gap_open, gap_extend, full_length_bonus,
                                           max_score, 255, gc_content);
     regular_aligner = new Aligner(match, mismatch, gap_open, gap_extend, full_length_bonus);
+    set_xdrop_threshold(xdrop_threshold);
+}
+
+void BaseMapper::set_xdrop_threshold(int32_t xdrop_threshold) {
+    this->xdrop_threshold = xdrop_threshold;
+    if (regular_aligner) {
+        regular_aligner->xdrop_threshold = xdrop_threshold;
+    }
+    if (qual_adj_aligner) {
+        // the quality adjusted aligner's scores are scaled up
+        qual_adj_aligner->xdrop_threshold = xdrop_threshold * qual_adj_aligner->scale_factor;
+    }
 }
 
 void BaseMapper::load_scoring_matrix(std::ifstream& matrix_stream){
@@ -1867,6 +2058,7 @@ Alignment Mapper::align_to_graph(const Alignment& aln,
         // we've got an id-sortable graph and we can directly align with gssw
         aligned = aln;
         if (banded_global) {
+            StageTimer timer(STAGE_BANDED_GLOBAL);
             size_t max_span = aln.sequence().size();
             size_t band_padding_override = 0;
             bool permissive_banding = (band_padding_override == 0);
@@ -2020,6 +2212,7 @@ pair<bool, bool> Mapper::pair_rescue(Alignment& mate1, Alignment& mate2,
     bool rescued1 = false;
     bool rescued2 = false;
     if (!frag_stats.fragment_size) return make_pair(false, false);
+    StageTimer timer(STAGE_PAIR_RESCUE);
     double hang_threshold = pair_rescue_hang_threshold;
     double retry_threshold = pair_rescue_retry_threshold;
     double min_threshold = 0.5;
@@ -2131,6 +2324,7 @@ pair<bool, bool> Mapper::pair_rescue(Alignment& mate1, Alignment& mate2,
     }
     // if the new alignment is better
     // set the old alignment to it
+    timer.add_candidates(rescued1 + rescued2);
     return make_pair(rescued1, rescued2);
 }
 
@@ -2180,6 +2374,35 @@ bool Mapper::pair_consistent(Alignment& aln1,
                              Alignment& aln2,
                              double pval) {
     if (!(aln1.score() && aln2.score())) return false;
+    // is a pair with these orientations and this distance between them, measured along a path or walk in
+    // which the first read is forward if fwd1 is set, a pair we would expect?
+    auto pos_consistent = [&](int64_t len, bool fwd1, bool fwd2) {
+        if (frag_stats.fragment_size) {
+            bool orientation_ok = frag_stats.cached_fragment_orientation_same && fwd1 == fwd2 || fwd1 != fwd2;
+            bool direction_ok = frag_stats.cached_fragment_direction && (!fwd1 && len >= 0 || fwd1 && len <= 0)
+                || (fwd1 && len >= 0 || !fwd1 && len <= 0);
+            bool length_ok = frag_stats.fragment_length_pval(abs(len)) > pval;//|| pval == 0 && abs(len) < frag_stats.fragment_size;
+            return orientation_ok && direction_ok && length_ok;
+        } else {
+            return abs(len) < frag_stats.fragment_max;
+        }
+    };
+    if (distance_index && aln1.path().mapping_size() && aln2.path().mapping_size()) {
+        pos_t pos1 = make_pos_t(aln1.path().mapping(0).position());
+        pos_t pos2 = make_pos_t(aln2.path().mapping(0).position());
+        if (distance_index->has_node(id(pos1)) && distance_index->has_node(id(pos2))) {
+            // use the minimum distance in the graph, measured along a walk in the first read's orientation,
+            // which the second read either follows or runs against
+            int64_t along = distance_index->oriented_distance(pos1, pos2);
+            int64_t against = distance_index->oriented_distance(pos1, reverse(pos2, xindex->node_length(id(pos2))));
+            if (along == numeric_limits<int64_t>::max() && against == numeric_limits<int64_t>::max()) {
+                return false;
+            }
+            bool follows = against == numeric_limits<int64_t>::max()
+                || along != numeric_limits<int64_t>::max() && abs(along) <= abs(against);
+            return pos_consistent(follows ? along : against, true, follows);
+        }
+    }
     bool length_ok = false;
     if (xindex->path_count == 0) {
         // use the approximate distance
@@ -2205,23 +2428,6 @@ bool Mapper::pair_consistent(Alignment& aln1,
         annotate_with_initial_path_positions(aln2);
         map<string, vector<pair<size_t, bool> > > offsets1 = alignment_refpos_to_path_offsets(aln1);
         map<string, vector<pair<size_t, bool> > > offsets2 = alignment_refpos_to_path_offsets(aln2);
-        auto pos_consistent =
-            [&](const pair<size_t, bool>& p1, const pair<size_t, bool>& p2) {
-            int64_t pos1 = p1.first;
-            int64_t pos2 = p2.first;
-            bool fwd1 = p1.second;
-            bool fwd2 = p2.second;
-            int64_t len = pos2 - pos1;
-            if (frag_stats.fragment_size) {
-                bool orientation_ok = frag_stats.cached_fragment_orientation_same && fwd1 == fwd2 || fwd1 != fwd2;
-                bool direction_ok = frag_stats.cached_fragment_direction && (!fwd1 && len >= 0 || fwd1 && len <= 0)
-                    || (fwd1 && len >= 0 || !fwd1 && len <= 0);
-                bool length_ok = frag_stats.fragment_length_pval(abs(len)) > pval;//|| pval == 0 && abs(len) < frag_stats.fragment_size;
-                return orientation_ok && direction_ok && length_ok;
-            } else {
-                return abs(len) < frag_stats.fragment_max;
-            }
-        };
         for (auto& path : offsets1) {
             // see if the other alignment has it
             auto f = offsets2.find(path.first);
@@ -2232,7 +2438,9 @@ bool Mapper::pair_consistent(Alignment& aln1,
                 // TODO linearize this as it could get bad if we have lots of paths!
                 for (auto& pos1 : pos1s) {
                     for (auto& pos2 : pos2s) {
-                        if (pos_consistent(pos1, pos2)) return true;
+                        if (pos_consistent((int64_t) pos2.first - (int64_t) pos1.first, pos1.second, pos2.second)) {
+                            return true;
+                        }
                     }
                 }
             }
@@ -2250,6 +2458,11 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
     bool retrying) {
 
     chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
+    // Only copied if we are annotating reads with what they cost
+    MappingStageCounts stage_counts_before;
+    if (annotate_stage_stats && MappingStageStats::is_enabled()) {
+        stage_counts_before = MappingStageStats::local();
+    }
 
     Alignment read1;
     read1.set_name(first_mate.name());
@@ -2319,7 +2532,8 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
     double mem_read_ratio1 = min(1.0, (double)total_mem_length1 / (double)read1.sequence().size());
     double mem_read_ratio2 = min(1.0, (double)total_mem_length2 / (double)read2.sequence().size());
 
-    int basis_length = min((int)read1.sequence().size(), (int)gcsa->order());
+    // minimizer MEMs aren't capped at an order, so they can span the whole read
+    int basis_length = gcsa ? min((int)read1.sequence().size(), (int)gcsa->order()) : (int)read1.sequence().size();
     double max_possible_mq = max_possible_mapping_quality(basis_length);
 
     int mem_max_length1 = 0;
@@ -2435,6 +2649,7 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
         }
 #endif
     
+        StageTimer timer(STAGE_CLUSTER);
         MEMChainModel chainer({ read1.sequence().size(), read2.sequence().size() },
                               { mems1, mems2 },
                               [&](pos_t n) -> int64_t {
@@ -2446,6 +2661,7 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
                               transition_weight,
                               band_width);
         clusters = chainer.traceback(total_multimaps, false, debug);
+        timer.add_candidates(clusters.size());
     }
 
     auto show_clusters = [&](void) {
@@ -2937,6 +3153,13 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
     results.first.front().set_time_used(used_time);
     results.second.front().set_time_used(used_time);
 
+    if (annotate_stage_stats && MappingStageStats::is_enabled()) {
+        // The stages for the pair go on both reads
+        MappingStageCounts stage_counts = MappingStageStats::local() - stage_counts_before;
+        MappingStageStats::annotate(&results.first.front(), stage_counts);
+        MappingStageStats::annotate(&results.second.front(), stage_counts);
+    }
+
     return results;
 
 }
@@ -3086,7 +3309,8 @@ Mapper::align_mem_multi(const Alignment& aln,
     int total_mem_length = 0;
     for (auto& mem : mems) total_mem_length += mem.length(); // * mem.nodes.size();
     double mem_read_ratio = min(1.0, (double)total_mem_length / (double)aln.sequence().size());
-    int basis_length = min((int)aln.sequence().size(), (int)gcsa->order());
+    // minimizer MEMs aren't capped at an order, so they can span the whole read
+    int basis_length = gcsa ? min((int)aln.sequence().size(), (int)gcsa->order()) : (int)aln.sequence().size();
     double max_possible_mq = max_possible_mapping_quality(basis_length);
 
     // Estimate the maximum mapping quality we can get if the alignments based on the good MEMs are the best ones.
@@ -3134,7 +3358,29 @@ Mapper::align_mem_multi(const Alignment& aln,
 
     // establish the chains
     vector<vector<MaximalExactMatch> > clusters;
-    if (total_multimaps) {
+    if (total_multimaps && use_sparse_chaining) {
+        StageTimer timer(STAGE_CLUSTER);
+        vector<SparseChainClusterer::cluster_t> hit_clusters;
+        if (adjust_alignments_for_base_quality && !aln.quality().empty()) {
+            SparseChainClusterer chainer(aln, mems, *get_qual_adj_aligner(), xindex);
+            hit_clusters = chainer.clusters(aln, max_mapping_quality, log_likelihood_approx_factor);
+        }
+        else {
+            SparseChainClusterer chainer(aln, mems, *get_regular_aligner(), xindex);
+            hit_clusters = chainer.clusters(aln, max_mapping_quality, log_likelihood_approx_factor);
+        }
+        // give each hit its own copy of its MEM, like the MEMChainModel does
+        for (size_t i = 0; i < hit_clusters.size() && i < (size_t) total_multimaps; i++) {
+            clusters.emplace_back();
+            for (auto& hit : hit_clusters[i]) {
+                clusters.back().push_back(*hit.first);
+                clusters.back().back().nodes.assign(1, gcsa::Node::encode(id(hit.second), offset(hit.second), is_rev(hit.second)));
+            }
+        }
+        timer.add_candidates(clusters.size());
+    }
+    else if (total_multimaps) {
+        StageTimer timer(STAGE_CLUSTER);
         MEMChainModel chainer({ aln.sequence().size() }, { mems },
                               [&](pos_t n) {
                                   return approx_position(n);
@@ -3145,6 +3391,7 @@ Mapper::align_mem_multi(const Alignment& aln,
                               transition_weight,
                               aln.sequence().size());
         clusters = chainer.traceback(total_multimaps, false, debug);
+        timer.add_candidates(clusters.size());
     }
     
     /*
@@ -3377,6 +3624,8 @@ double Mapper::compute_uniqueness(const Alignment& aln, const vector<MaximalExac
 }
 
 Alignment Mapper::align_cluster(const Alignment& aln, const vector<MaximalExactMatch>& mems, bool traceback) {
+    StageTimer timer(STAGE_ALIGN_CLUSTER);
+    timer.add_candidates(mems.size());
     // check if we can just fill out the alignment with exact matches
     /*
     if (cluster_coverage(mems) == aln.sequence().size()) {
@@ -3774,6 +4023,9 @@ set<MaximalExactMatch*> Mapper::resolve_paired_mems(vector<MaximalExactMatch>& m
 int64_t Mapper::get_node_length(int64_t node_id) {
     // Grab the node sequence only from the XG index and get its size.
     // Make sure to use the cache
+    if (node_cache) {
+        return xg_cached_node_length(node_id, xindex, *node_cache);
+    }
     return xg_node_length(node_id, xindex);
 }
 
@@ -3889,6 +4141,7 @@ vector<Alignment> Mapper::align_banded(const Alignment& read, int kmer_size, int
 #endif
 
     chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
+    StageTimer timer(STAGE_LONG_READ_BANDS);
 
     // scan across the read choosing bands
     // these bands are hard coded to overlap by 50%
@@ -3907,6 +4160,7 @@ vector<Alignment> Mapper::align_banded(const Alignment& read, int kmer_size, int
     // function can be used to enable direct detection of SVs and other large scale variations.
     vector<pair<int, int>> to_strip;
     vector<Alignment> bands = make_bands(read, band_width, band_overlap, to_strip);
+    timer.add_candidates(bands.size());
     vector<vector<Alignment>> multi_alns;
     multi_alns.resize(bands.size());
 
@@ -4039,6 +4293,8 @@ bool Mapper::adjacent_positions(const Position& pos1, const Position& pos2) {
 
 void Mapper::compute_mapping_qualities(vector<Alignment>& alns, double cluster_mq, double mq_estimate, double mq_cap) {
     if (alns.empty()) return;
+    StageTimer timer(STAGE_MAPPING_QUALITY);
+    timer.add_candidates(alns.size());
     double max_mq = min(mq_cap, (double)max_mapping_quality);
     BaseAligner* aligner = get_aligner();
     int sub_overlaps = sub_overlaps_of_first_aln(alns, mq_overlap);
@@ -4056,6 +4312,8 @@ void Mapper::compute_mapping_qualities(vector<Alignment>& alns, double cluster_m
     
 void Mapper::compute_mapping_qualities(pair<vector<Alignment>, vector<Alignment>>& pair_alns, double cluster_mq, double mq_estimate1, double mq_estimate2, double mq_cap1, double mq_cap2) {
     if (pair_alns.first.empty() || pair_alns.second.empty()) return;
+    StageTimer timer(STAGE_MAPPING_QUALITY);
+    timer.add_candidates(pair_alns.first.size());
     double max_mq1 = min(mq_cap1, (double)max_mapping_quality);
     double max_mq2 = min(mq_cap2, (double)max_mapping_quality);
     BaseAligner* aligner = get_aligner();
@@ -4159,6 +4417,13 @@ vector<Alignment> Mapper::align_multi(const Alignment& aln, int kmer_size, int s
     clean_aln.set_sequence(aln.sequence());
     clean_aln.set_quality(aln.quality());
     clean_aln.clear_refpos();
+    if (annotate_stage_stats && MappingStageStats::is_enabled()) {
+        // Record what this read costs us
+        MappingStageCounts before = MappingStageStats::local();
+        vector<Alignment> alignments = align_multi_internal(true, clean_aln, kmer_size, stride, max_mem_length, band_width, band_overlap, cluster_mq, max_multimaps, extra_multimaps, nullptr);
+        MappingStageStats::annotate(&alignments.front(), MappingStageStats::local() - before);
+        return alignments;
+    }
     return align_multi_internal(true, clean_aln, kmer_size, stride, max_mem_length, band_width, band_overlap, cluster_mq, max_multimaps, extra_multimaps, nullptr);
 }
     
@@ -4293,6 +4558,13 @@ set<pos_t> gcsa_nodes_to_positions(const vector<gcsa::node_type>& nodes) {
 
 
 int64_t Mapper::graph_distance(pos_t pos1, pos_t pos2, int64_t maximum) {
+    if (distance_index && distance_index->has_node(id(pos1)) && distance_index->has_node(id(pos2))) {
+        int64_t distance = distance_index->min_distance(pos1, pos2);
+        return distance <= maximum ? distance : numeric_limits<int64_t>::max();
+    }
+    if (node_cache) {
+        return xg_cached_distance(pos1, pos2, maximum, xindex, *node_cache);
+    }
     return xg_distance(pos1, pos2, maximum, xindex);
 }
 
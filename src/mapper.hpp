@@ -16,12 +16,15 @@
 #include "path.hpp"
 #include "position.hpp"
 #include "xg_position.hpp"
+#include "cached_position.hpp"
+#include "stage_stats.hpp"
 #include "lru_cache.h"
 #include "json2pb.h"
 #include "entropy.hpp"
 #include "gssw_aligner.hpp"
 #include "mem.hpp"
 #include "cluster.hpp"
+#include "minimizer_index.hpp"
 #include "graph.hpp"
 #include "translator.hpp"
 // TODO: pull out ScoreProvider into its own file
@@ -37,6 +40,20 @@ using namespace std;
     
 enum MappingQualityMethod { Approx, Exact, Adaptive, None };
 
+/// The MEMs found for a read sequence, kept so that reads with the same
+/// sequence can skip finding them again. The MEMs' read iterators don't point
+/// anywhere; their intervals are kept as offsets instead.
+struct CachedMEMs {
+    vector<MaximalExactMatch> mems;
+    vector<pair<size_t, size_t>> intervals;
+    double longest_lcp = 0.0;
+    double fraction_filtered = 0.0;
+};
+
+/// Cache of MEMs by read sequence and MEM-finding parameters, which may be
+/// shared by mappers with the same settings running in different threads.
+typedef ClockCache<string, CachedMEMs> MEMCache;
+
 class Mapper;
 
 // for banded long read alignment resolution
@@ -164,6 +181,11 @@ public:
     void set_alignment_scores(int8_t match, int8_t mismatch, int8_t gap_open, int8_t gap_extend, int8_t full_length_bonus,
         double haplotype_consistency_exponent = 1);
     
+    /// Make single local and pinned alignments with X-drop pruning, abandoning DP cells that score
+    /// this far below the best earlier on their path (in unscaled score units), or with the full DP
+    /// if 0. Survives recreating the aligners.
+    void set_xdrop_threshold(int32_t xdrop_threshold);
+    
     // TODO: setting alignment threads could mess up the internal memory for how many threads to reset to
     void set_fragment_length_distr_params(size_t maximum_sample_size = 1000, size_t reestimation_frequency = 1000,
                                           double robust_estimation_fraction = 0.95);
@@ -172,8 +194,29 @@ public:
     /// are per thread. Note that this resets aligner scores to their default values!
     void set_alignment_threads(int new_thread_count);
     
+    /// Give this mapper its own cache of decoded nodes, holding up to the
+    /// given number of nodes, or turn off caching if the size is 0.
     void set_cache_size(int new_cache_size);
     
+    /// Use the given cache of decoded nodes, which may be shared with other
+    /// mappers running in other threads on the same XG, or no cache if null.
+    void set_node_cache(shared_ptr<NodeCache> new_node_cache);
+    
+    /// Get the cache of decoded nodes in use, or null if there isn't one.
+    shared_ptr<NodeCache> get_node_cache() const;
+    
+    /// Give this mapper its own cache of the MEMs found for read sequences,
+    /// holding up to the given number of sequences, or turn off caching if the
+    /// size is 0.
+    void set_mem_cache_size(int new_cache_size);
+    
+    /// Use the given cache of MEMs, which may be shared with other mappers
+    /// with the same MEM-finding settings, or no cache if null.
+    void set_mem_cache(shared_ptr<MEMCache> new_mem_cache);
+    
+    /// Get the cache of MEMs in use, or null if there isn't one.
+    shared_ptr<MEMCache> get_mem_cache() const;
+    
     /// Returns true if fragment length distribution has been fixed
     bool has_fixed_fragment_length_distr();
     
@@ -188,6 +231,7 @@ public:
     // Minimally-more-frequent sub-MEMs are MEMs contained in an SMEM that have occurrences outside of the SMEM.
     // SMEMs and sub-MEMs will be automatically filled with the nodes they contain, which the occurrences of the sub-MEMs
     // that are inside SMEM hits filtered out. (filling sub-MEMs currently requires an XG index)
+    // If there is a MEM cache, reads with a sequence already seen get a copy of the MEMs found for it.
     
     vector<MaximalExactMatch>
     find_mems_deep(string::const_iterator seq_begin,
@@ -203,6 +247,14 @@ public:
                    bool record_max_lcp = false,
                    int reseed_below_count = 0);
     
+    /// Use the minimizer index to find exact matches of the read's
+    /// minimizers, merging runs of overlapping minimizers whose hits all line
+    /// up into longer matches. The matches are in order along the read and
+    /// have their hits filled in, but don't have GCSA2 ranges.
+    vector<MaximalExactMatch>
+    find_minimizer_mems(string::const_iterator seq_begin,
+                        string::const_iterator seq_end);
+    
     // Use the GCSA2 index to find super-maximal exact matches.
     vector<MaximalExactMatch>
     find_mems_simple(string::const_iterator seq_begin,
@@ -241,6 +293,8 @@ public:
     int max_sub_mem_recursion_depth = 2;
     int unpaired_penalty = 17;
     bool precollapse_order_length_hits = true;
+    bool use_sparse_chaining = false; // cluster MEM hits with the SparseChainClusterer (single reads only in Mapper)
+    double log_likelihood_approx_factor = 1.0; // keep clusters scoring within this many mapping quality score differences of the best
     
     // Remove any bonuses used by the aligners from the final reported scores.
     // Does NOT (yet) remove the haplotype consistency bonus.
@@ -254,7 +308,35 @@ public:
     /// Set to enable debugging messages to cerr from the mapper, so a user can understand why a read maps the way it does.
     bool debug = false;
     
+    /// Set to annotate each mapped read with the time and candidates spent in
+    /// each stage of mapping. Only does anything if MappingStageStats
+    /// recording is enabled. Work done by other threads, as in banded
+    /// alignment with multiple alignment threads, is not included.
+    bool annotate_stage_stats = false;
+    
+    // Minimum distance index over the snarls of the graph, if any, used in
+    // place of searching the graph or its paths for distances
+    const DistanceIndex* distance_index = nullptr;
+    
+    // Minimizer index, if any, used to find seeds instead of the GCSA2
+    const MinimizerIndex* minimizer_index = nullptr;
+    
 protected:
+    /// Find MEMs as in find_mems_deep(), without consulting the MEM cache
+    vector<MaximalExactMatch>
+    find_mems_deep_uncached(string::const_iterator seq_begin,
+                            string::const_iterator seq_end,
+                            double& lcp_avg,
+                            double& fraction_filtered,
+                            int max_mem_length,
+                            int min_mem_length,
+                            int reseed_length,
+                            bool use_lcp_reseed_heuristic,
+                            bool use_diff_based_fast_reseed,
+                            bool include_parent_in_sub_mem_count,
+                            bool record_max_lcp,
+                            int reseed_below_count);
+    
     /// Locate the sub-MEMs contained in the last MEM of the mems vector that have ending positions
     /// before the end the next SMEM, label each of the sub-MEMs with the indices of all of the SMEMs
     /// that contain it
@@ -327,6 +409,12 @@ protected:
     // xg index
     xg::XG* xindex = nullptr;
     
+    // Decoded nodes from the xg index, possibly shared with other mappers
+    shared_ptr<NodeCache> node_cache;
+    
+    // MEMs already found for read sequences, possibly shared with other mappers
+    shared_ptr<MEMCache> mem_cache;
+    
     // GCSA index and its LCP array
     gcsa::GCSA* gcsa = nullptr;
     gcsa::LCPArray* lcp = nullptr;
@@ -359,6 +447,9 @@ private:
     // GSSW aligners
     QualAdjAligner* qual_adj_aligner = nullptr;
     Aligner* regular_aligner = nullptr;    
+    
+    // X-drop threshold for the aligners, 0 if off
+    int32_t xdrop_threshold = 0;
 
 };
 
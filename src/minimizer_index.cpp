@@ -0,0 +1,438 @@
+#include "minimizer_index.hpp"
+#include "position.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+
+#include <omp.h>
+
+//#define debug_minimizer_index
+
+namespace vg {
+
+using namespace std;
+
+/// Magic number at the start of a serialized minimizer index
+static const char MINIMIZER_INDEX_MAGIC[4] = {'M', 'I', 'N', '!'};
+
+/// Version of the serialized format we write
+static const uint32_t MINIMIZER_INDEX_VERSION = 2;
+
+const size_t MinimizerIndex::MAX_K;
+const size_t MinimizerIndex::DEFAULT_MAX_WALK_BASES;
+const uint64_t MinimizerIndex::NO_KEY;
+
+/// 2-bit codes of the bases, or 4 for anything else
+static inline uint64_t base_code(char base) {
+    switch (base) {
+    case 'A': case 'a': return 0;
+    case 'C': case 'c': return 1;
+    case 'G': case 'g': return 2;
+    case 'T': case 't': return 3;
+    default: return 4;
+    }
+}
+
+inline uint64_t MinimizerIndex::kmer_hash(uint64_t key) {
+    // Thomas Wang's 64-bit integer hash
+    key = (~key) + (key << 21);
+    key = key ^ (key >> 24);
+    key = (key + (key << 3)) + (key << 8);
+    key = key ^ (key >> 14);
+    key = (key + (key << 2)) + (key << 4);
+    key = key ^ (key >> 28);
+    key = key + (key << 31);
+    return key;
+}
+
+MinimizerIndex::MinimizerIndex(size_t k, size_t w) : kmer_size(k), window_size(w) {
+    if (k == 0 || k > MAX_K) {
+        throw runtime_error("[vg::MinimizerIndex] k-mer size must be between 1 and " + to_string(MAX_K));
+    }
+    if (w == 0) {
+        throw runtime_error("[vg::MinimizerIndex] window size must be at least 1");
+    }
+}
+
+/// The state of one base along a walk through the graph while indexing
+/// minimizers. Bases are indexed by their depth along the walk, and so are the
+/// k-mers that start at them and the windows that end at them.
+struct MinimizerWalkBase {
+    /// Where the base is in the graph
+    pos_t pos;
+    /// Rolling key of the bases that end here
+    uint64_t key;
+    /// Number of consecutive ACGT bases that end here
+    size_t run;
+    /// Key and hash of the k-mer that starts here, or NO_KEY
+    uint64_t kmer_key;
+    uint64_t kmer_hash;
+    /// Depth of the leftmost minimizer of the window that ends here, or -1 if
+    /// the window has no encodable k-mers
+    int64_t min_start;
+    /// Depth of the last minimizer reported along the walk up to here
+    int64_t reported;
+};
+
+/// Number of hits from one node's windows to collect before deduplicating them
+static const size_t MAX_WALK_HITS = 1 << 16;
+
+// The windows come from walks of k + w - 1 bases, and we need the position of
+// every k-mer in a window, while for_each_kmer() and for_each_packed_kmer()
+// only report each k-mer by itself. So we follow the walks here, sharing the
+// rolling keys and window minima along each walk's common prefix, and hold
+// them to a budget of bases like the GCSA2 k-mer size limits.
+MinimizerIndex::MinimizerIndex(const HandleGraph& graph, size_t k, size_t w, size_t max_walk_bases) :
+    MinimizerIndex(k, w) {
+
+    size_t window_length = kmer_size + window_size - 1;
+    uint64_t mask = (uint64_t(1) << (2 * kmer_size)) - 1;
+
+    // the minimizers found by each thread, without the repeats from
+    // overlapping windows
+    vector<vector<pair<uint64_t, pos_t>>> thread_hits(omp_get_max_threads());
+
+    // We can't throw out of the parallel loop, so the first error is kept
+    // here, the threads skip their remaining nodes, and we throw once they
+    // are done.
+    string error;
+    atomic<bool> failed(false);
+
+    graph.for_each_handle([&](const handle_t& node) {
+        if (failed) {
+            return;
+        }
+        
+        // branching walks share windows, so the hits from this node's windows
+        // are deduplicated before they join the thread's hits
+        vector<pair<uint64_t, pos_t>> node_hits;
+        vector<MinimizerWalkBase> walk;
+        auto dedup_hits = [&]() {
+            sort(node_hits.begin(), node_hits.end());
+            node_hits.erase(unique(node_hits.begin(), node_hits.end()), node_hits.end());
+        };
+
+        // add the next base of the walk, rolling its k-mer key and the
+        // minimum of the window that ends with it
+        auto add_base = [&](size_t depth, char base, const pos_t& pos) {
+            MinimizerWalkBase& here = walk[depth];
+            const MinimizerWalkBase* prev = depth ? &walk[depth - 1] : nullptr;
+            here.pos = pos;
+            here.min_start = -1;
+            here.reported = prev ? prev->reported : -1;
+            uint64_t code = base_code(base);
+            if (code > 3) {
+                here.key = 0;
+                here.run = 0;
+            } else {
+                here.key = (((prev ? prev->key : 0) << 2) | code) & mask;
+                here.run = (prev ? prev->run : 0) + 1;
+            }
+            if (depth + 1 < kmer_size) {
+                return;
+            }
+
+            // a k-mer ends here
+            size_t kmer_start = depth + 1 - kmer_size;
+            MinimizerWalkBase& kmer = walk[kmer_start];
+            kmer.kmer_key = here.run >= kmer_size ? here.key : NO_KEY;
+            kmer.kmer_hash = kmer_hash(kmer.kmer_key);
+            if (depth + 1 < window_length) {
+                return;
+            }
+
+            // and so does a window, which only needs a rescan if the last
+            // window's minimizer left it or the new k-mer ties or beats it
+            size_t window_start = depth + 1 - window_length;
+            if (depth >= window_length && prev->min_start >= (int64_t) window_start
+                && (kmer.kmer_key == NO_KEY || kmer.kmer_hash > walk[prev->min_start].kmer_hash)) {
+                here.min_start = prev->min_start;
+                return;
+            }
+            for (size_t i = window_start; i <= kmer_start; i++) {
+                if (walk[i].kmer_key != NO_KEY
+                    && (here.min_start == -1 || walk[i].kmer_hash < walk[here.min_start].kmer_hash)) {
+                    here.min_start = i;
+                }
+            }
+            if (here.min_start == -1) {
+                return;
+            }
+            // report the ties that earlier windows along the walk haven't
+            for (size_t i = max<int64_t>(here.min_start, here.reported + 1); i <= kmer_start; i++) {
+                if (walk[i].kmer_key != NO_KEY && walk[i].kmer_hash == walk[here.min_start].kmer_hash) {
+                    node_hits.emplace_back(walk[i].kmer_key, walk[i].pos);
+                    here.reported = i;
+                }
+            }
+            if (node_hits.size() >= MAX_WALK_HITS) {
+                dedup_hits();
+            }
+        };
+
+        for (const handle_t& start : {node, graph.flip(node)}) {
+            // follow every walk far enough to finish the windows that start
+            // on this strand of the node
+            size_t max_depth = graph.get_length(start) + window_length - 1;
+            walk.resize(max_depth);
+            size_t walk_bases = 0;
+
+            // the handles to extend the walks into, with the depth of their
+            // first base; the walk up to that depth stays in place until all
+            // the walks through the handle are done
+            vector<pair<handle_t, size_t>> stack{make_pair(start, 0)};
+            while (!stack.empty()) {
+                handle_t handle = stack.back().first;
+                size_t depth = stack.back().second;
+                stack.pop_back();
+
+                string seq = graph.get_sequence(handle);
+                id_t node_id = graph.get_id(handle);
+                bool node_is_rev = graph.get_is_reverse(handle);
+                size_t end_depth = min(max_depth, depth + seq.size());
+                walk_bases += end_depth - depth;
+                if (walk_bases > max_walk_bases) {
+#pragma omp critical (minimizer_index_error)
+                    {
+                        if (!failed) {
+                            error = "walks from node " + to_string(graph.get_id(node)) + " cover more than "
+                                + to_string(max_walk_bases) + " bases. Prune complex regions of the graph with "
+                                + "`vg prune` or raise the limit.";
+                            failed = true;
+                        }
+                    }
+                    return;
+                }
+                for (size_t i = 0; depth < end_depth; i++, depth++) {
+                    add_base(depth, seq[i], make_pos_t(node_id, node_is_rev, i));
+                }
+                if (depth < max_depth) {
+                    graph.follow_edges(handle, false, [&](const handle_t& next) {
+                        stack.emplace_back(next, depth);
+                    });
+                }
+            }
+        }
+        
+        dedup_hits();
+        auto& found = thread_hits[omp_get_thread_num()];
+        found.insert(found.end(), node_hits.begin(), node_hits.end());
+    }, true);
+
+    if (failed) {
+        throw runtime_error("[vg::MinimizerIndex] " + error);
+    }
+
+    // windows starting on different nodes can still share minimizers
+    vector<pair<uint64_t, pos_t>> all_hits;
+    for (auto& found : thread_hits) {
+        all_hits.insert(all_hits.end(), found.begin(), found.end());
+        vector<pair<uint64_t, pos_t>>().swap(found);
+    }
+    sort(all_hits.begin(), all_hits.end());
+    all_hits.erase(unique(all_hits.begin(), all_hits.end()), all_hits.end());
+
+    // lay the hits out by key
+    hits.reserve(all_hits.size());
+    for (auto& hit : all_hits) {
+        if (keys.empty() || keys.back() != hit.first) {
+            if (!keys.empty()) {
+                hit_start.push_back(hits.size());
+            }
+            keys.push_back(hit.first);
+        }
+        hits.push_back(hit.second);
+    }
+    if (!keys.empty()) {
+        hit_start.push_back(hits.size());
+    }
+
+#ifdef debug_minimizer_index
+    cerr << "indexed " << hits.size() << " hits of " << keys.size() << " minimizers" << endl;
+#endif
+}
+
+uint64_t MinimizerIndex::encode(string::const_iterator begin) const {
+    uint64_t key = 0;
+    for (size_t i = 0; i < kmer_size; i++) {
+        uint64_t code = base_code(*(begin + i));
+        if (code > 3) {
+            return NO_KEY;
+        }
+        key = (key << 2) | code;
+    }
+    return key;
+}
+
+vector<MinimizerIndex::Minimizer> MinimizerIndex::minimizers(string::const_iterator begin,
+                                                             string::const_iterator end) const {
+    vector<Minimizer> result;
+    if (end - begin < (ptrdiff_t) kmer_size) {
+        return result;
+    }
+
+    // encode every k-mer with a rolling key, remembering where the last
+    // unencodable character was
+    size_t kmer_count = end - begin - kmer_size + 1;
+    vector<uint64_t> keys(kmer_count, NO_KEY);
+    vector<uint64_t> hashes(kmer_count);
+    uint64_t mask = (uint64_t(1) << (2 * kmer_size)) - 1;
+    uint64_t key = 0;
+    size_t valid_run = 0;
+    for (size_t i = 0; i < (size_t) (end - begin); i++) {
+        uint64_t code = base_code(*(begin + i));
+        if (code > 3) {
+            valid_run = 0;
+            key = 0;
+            continue;
+        }
+        key = ((key << 2) | code) & mask;
+        valid_run++;
+        if (valid_run >= kmer_size) {
+            keys[i + 1 - kmer_size] = key;
+            hashes[i + 1 - kmer_size] = kmer_hash(key);
+        }
+    }
+
+    size_t window_count = kmer_count >= window_size ? kmer_count - window_size + 1 : 1;
+    size_t window_length = min(window_size, kmer_count);
+    for (size_t window = 0; window < window_count; window++) {
+        bool found = false;
+        uint64_t min_hash = 0;
+        for (size_t i = window; i < window + window_length; i++) {
+            if (keys[i] != NO_KEY && (!found || hashes[i] < min_hash)) {
+                min_hash = hashes[i];
+                found = true;
+            }
+        }
+        if (!found) {
+            continue;
+        }
+        for (size_t i = window; i < window + window_length; i++) {
+            // keep the ties, and don't report the same k-mer for each window
+            // it minimizes
+            if (keys[i] != NO_KEY && hashes[i] == min_hash && (result.empty() || result.back().offset < i)) {
+                result.push_back(Minimizer{keys[i], i});
+            }
+        }
+    }
+
+    // ties can put the minimizers of consecutive windows out of order
+    sort(result.begin(), result.end(), [](const Minimizer& a, const Minimizer& b) {
+        return a.offset < b.offset;
+    });
+    result.erase(unique(result.begin(), result.end(), [](const Minimizer& a, const Minimizer& b) {
+        return a.offset == b.offset;
+    }), result.end());
+
+    return result;
+}
+
+MinimizerIndex::Hits::Hits(const pos_t* first, const pos_t* last) : first(first), last(last) {
+    // nothing to do
+}
+
+const pos_t* MinimizerIndex::Hits::begin() const {
+    return first;
+}
+
+const pos_t* MinimizerIndex::Hits::end() const {
+    return last;
+}
+
+size_t MinimizerIndex::Hits::size() const {
+    return last - first;
+}
+
+bool MinimizerIndex::Hits::empty() const {
+    return first == last;
+}
+
+const pos_t& MinimizerIndex::Hits::operator[](size_t i) const {
+    return first[i];
+}
+
+MinimizerIndex::Hits MinimizerIndex::find(uint64_t key) const {
+    auto found = lower_bound(keys.begin(), keys.end(), key);
+    if (found == keys.end() || *found != key) {
+        return Hits(nullptr, nullptr);
+    }
+    size_t i = found - keys.begin();
+    return Hits(hits.data() + hit_start[i], hits.data() + hit_start[i + 1]);
+}
+
+size_t MinimizerIndex::k() const {
+    return kmer_size;
+}
+
+size_t MinimizerIndex::w() const {
+    return window_size;
+}
+
+size_t MinimizerIndex::size() const {
+    return keys.size();
+}
+
+size_t MinimizerIndex::hit_count() const {
+    return hits.size();
+}
+
+void MinimizerIndex::save(ostream& out) const {
+    out.write(MINIMIZER_INDEX_MAGIC, sizeof(MINIMIZER_INDEX_MAGIC));
+    out.write((const char*) &MINIMIZER_INDEX_VERSION, sizeof(MINIMIZER_INDEX_VERSION));
+
+    uint64_t header[4] = {kmer_size, window_size, keys.size(), hits.size()};
+    out.write((const char*) header, sizeof(header));
+    out.write((const char*) keys.data(), keys.size() * sizeof(uint64_t));
+    out.write((const char*) hit_start.data(), hit_start.size() * sizeof(uint64_t));
+    for (auto& pos : hits) {
+        int64_t hit[3] = {id(pos), is_rev(pos), (int64_t) offset(pos)};
+        out.write((const char*) hit, sizeof(hit));
+    }
+
+    if (!out) {
+        throw runtime_error("[vg::MinimizerIndex] could not write index");
+    }
+}
+
+void MinimizerIndex::load(istream& in) {
+    char magic[sizeof(MINIMIZER_INDEX_MAGIC)];
+    uint32_t version = 0;
+    in.read(magic, sizeof(magic));
+    in.read((char*) &version, sizeof(version));
+    if (!in || !equal(magic, magic + sizeof(magic), MINIMIZER_INDEX_MAGIC)) {
+        throw runtime_error("[vg::MinimizerIndex] data is not a minimizer index");
+    }
+    if (version != MINIMIZER_INDEX_VERSION) {
+        throw runtime_error("[vg::MinimizerIndex] unsupported minimizer index version " + to_string(version));
+    }
+
+    uint64_t header[4];
+    in.read((char*) header, sizeof(header));
+    if (!in || header[0] == 0 || header[0] > MAX_K || header[1] == 0) {
+        throw runtime_error("[vg::MinimizerIndex] corrupt minimizer index header");
+    }
+    kmer_size = header[0];
+    window_size = header[1];
+
+    keys.resize(header[2]);
+    hit_start.resize(header[2] + 1);
+    hits.resize(header[3]);
+    in.read((char*) keys.data(), keys.size() * sizeof(uint64_t));
+    in.read((char*) hit_start.data(), hit_start.size() * sizeof(uint64_t));
+    for (auto& pos : hits) {
+        int64_t hit[3];
+        in.read((char*) hit, sizeof(hit));
+        pos = make_pos_t(hit[0], hit[1], hit[2]);
+    }
+    if (!in) {
+        throw runtime_error("[vg::MinimizerIndex] truncated minimizer index");
+    }
+    if (hit_start.front() != 0 || hit_start.back() != hits.size()
+        || !is_sorted(hit_start.begin(), hit_start.end()) || !is_sorted(keys.begin(), keys.end())) {
+        throw runtime_error("[vg::MinimizerIndex] corrupt minimizer index");
+    }
+}
+
+}
@@ -0,0 +1,124 @@
+#ifndef VG_MINIMIZER_INDEX_HPP_INCLUDED
+#define VG_MINIMIZER_INDEX_HPP_INCLUDED
+
+/** \file
+ *
+ * Provides an index of the (w, k)-minimizers of a graph, which can be used in
+ * place of the GCSA2 to find seeds for reads.
+ *
+ * A k-mer is a minimizer if it has the smallest hash among the k-mers of a
+ * window of w consecutive k-mers. Every window of k + w - 1 bases along a walk
+ * through the graph contributes its minimizers, and the index maps each
+ * minimizer to the graph positions where it starts. Finding the minimizers of
+ * a read then gives exact matches of length k at a small fraction of the cost
+ * of backward searching every suffix of the read.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <limits>
+
+#include "handle.hpp"
+#include "types.hpp"
+
+namespace vg {
+
+using namespace std;
+
+class MinimizerIndex {
+public:
+
+    /// A minimizer of a sequence, as an encoded k-mer and the offset it
+    /// starts at in the sequence
+    struct Minimizer {
+        uint64_t key;
+        size_t offset;
+    };
+
+    /// Longest k-mers that fit in a key
+    static const size_t MAX_K = 31;
+
+    /// Default for the most bases to follow along the walks from each strand
+    /// of each node while indexing
+    static const size_t DEFAULT_MAX_WALK_BASES = 1 << 20;
+
+    /// The graph positions where a minimizer starts, in sorted order. Points
+    /// into the index, so it is only valid while the index is unchanged.
+    class Hits {
+    public:
+        Hits(const pos_t* first, const pos_t* last);
+        const pos_t* begin() const;
+        const pos_t* end() const;
+        size_t size() const;
+        bool empty() const;
+        const pos_t& operator[](size_t i) const;
+    private:
+        const pos_t* first;
+        const pos_t* last;
+    };
+
+    /// Make an empty index with the given parameters, to load into or add to.
+    MinimizerIndex(size_t k = 15, size_t w = 11);
+
+    /// Index the minimizers of all the walks through a graph. Both strands are
+    /// indexed. Each window is found by following every walk of k + w - 1
+    /// bases from each strand of each node, and the number of walks grows
+    /// exponentially with the number of variants close together, so if the
+    /// walks from any one strand of a node take more than max_walk_bases
+    /// bases, this throws a runtime_error instead. Complex regions should then
+    /// be pruned, as they are for GCSA2 indexing.
+    MinimizerIndex(const HandleGraph& graph, size_t k = 15, size_t w = 11,
+                   size_t max_walk_bases = DEFAULT_MAX_WALK_BASES);
+
+    /// Save the index to a stream
+    void save(ostream& out) const;
+
+    /// Load an index from a stream, replacing the current contents. Throws
+    /// if the data is not a minimizer index.
+    void load(istream& in);
+
+    /// Get the minimizers of a sequence, in order of offset. If several k-mers
+    /// are tied for the smallest hash in a window they are all minimizers.
+    /// K-mers with characters other than ACGT are never minimizers. A sequence
+    /// shorter than a window is treated as one window.
+    vector<Minimizer> minimizers(string::const_iterator begin, string::const_iterator end) const;
+
+    /// Get the graph positions where a minimizer starts, in sorted order.
+    Hits find(uint64_t key) const;
+
+    /// Encode a k-mer as a key, or return NO_KEY if it has characters other
+    /// than ACGT
+    uint64_t encode(string::const_iterator begin) const;
+
+    /// The key of k-mers that can't be encoded
+    static const uint64_t NO_KEY = numeric_limits<uint64_t>::max();
+
+    size_t k() const;
+    size_t w() const;
+    /// Number of distinct minimizers in the index
+    size_t size() const;
+    /// Total number of graph positions over all the minimizers
+    size_t hit_count() const;
+
+private:
+
+    size_t kmer_size;
+    size_t window_size;
+
+    /// The distinct minimizers in sorted order. The hits of keys[i] are
+    /// hits[hit_start[i] .. hit_start[i + 1]], so hit_start has one more entry
+    /// than keys.
+    vector<uint64_t> keys;
+    vector<uint64_t> hit_start{0};
+    vector<pos_t> hits;
+
+    /// Invertible hash used to order k-mers, so that minimizers aren't biased
+    /// towards k-mers that are lexicographically small
+    static inline uint64_t kmer_hash(uint64_t key);
+};
+
+}
+
+#endif
@@ -2635,14 +2635,21 @@ namespace vg {
         cerr << "transferred over read information" << endl;
 #endif
         
+        // pack the read once to score all of the exact match nodes along it, if
+        // the aligner needs its qualities to score them
+        unique_ptr<PackedRead> packed_read = aligner->pack_read(alignment);
+        
         // add a subpath for each of the exact match nodes
         if (score_anchors_as_matches) {
             for (int64_t j = 0; j < path_nodes.size(); j++) {
                 PathNode& path_node = path_nodes[j];
                 Subpath* subpath = multipath_aln_out.add_subpath();
                 *subpath->mutable_path() = path_node.path;
-                int32_t match_score = aligner->score_exact_match(path_node.begin, path_node.end,
-                                                                 alignment.quality().begin() + (path_node.begin - alignment.sequence().begin()));
+                int32_t match_score = packed_read ?
+                    aligner->score_exact_match(*packed_read, path_node.begin - alignment.sequence().begin(),
+                                               path_node.end - path_node.begin) :
+                    aligner->score_exact_match(path_node.begin, path_node.end,
+                                               alignment.quality().begin() + (path_node.begin - alignment.sequence().begin()));
                 
                 subpath->set_score(match_score + aligner->full_length_bonus *
                                    ((path_node.begin == alignment.sequence().begin()) +
@@ -2655,7 +2662,8 @@ namespace vg {
                 Subpath* subpath = multipath_aln_out.add_subpath();
                 *subpath->mutable_path() = path_node.path;
                 
-                subpath->set_score(aligner->score_partial_alignment(alignment, align_graph, path_node.path, path_node.begin));
+                subpath->set_score(aligner->score_partial_alignment(alignment, align_graph, path_node.path, path_node.begin,
+                                                                    packed_read.get()));
             }
         }
         
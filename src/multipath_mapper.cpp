@@ -13,6 +13,8 @@
 #include "multipath_alignment_graph.hpp"
 
 #include "algorithms/topological_sort.hpp"
+#include "algorithms/split_strands.hpp"
+#include "algorithms/is_directed_acyclic.hpp"
 #include "annotation.hpp"
 
 namespace vg {
@@ -35,6 +37,15 @@ namespace vg {
     void MultipathMapper::multipath_map(const Alignment& alignment,
                                         vector<MultipathAlignment>& multipath_alns_out,
                                         size_t max_alt_mappings) {
+        if (annotate_stage_stats && MappingStageStats::is_enabled()) {
+            // Record what this read costs us
+            MappingStageCounts before = MappingStageStats::local();
+            multipath_map_internal(alignment, mapping_quality_method, multipath_alns_out, max_alt_mappings);
+            if (!multipath_alns_out.empty()) {
+                MappingStageStats::annotate(&multipath_alns_out.front(), MappingStageStats::local() - before);
+            }
+            return;
+        }
         multipath_map_internal(alignment, mapping_quality_method, multipath_alns_out, max_alt_mappings);
     }
     
@@ -70,18 +81,7 @@ namespace vg {
         OrientedDistanceClusterer::paths_of_node_memo_t paths_of_node_memo;
         OrientedDistanceClusterer::oriented_occurences_memo_t oriented_occurences_memo;
         OrientedDistanceClusterer::handle_memo_t handle_memo;
-        // TODO: Making OrientedDistanceClusterers is the only place we actually
-        // need to distinguish between regular_aligner and qual_adj_aligner
-        if (adjust_alignments_for_base_quality) {
-            OrientedDistanceClusterer clusterer(alignment, mems, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error,
-                                                min_clustering_mem_length, unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
-            clusters = clusterer.clusters(alignment, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-        }
-        else {
-            OrientedDistanceClusterer clusterer(alignment, mems, *get_regular_aligner(), xindex, max_expected_dist_approx_error,
-                                                min_clustering_mem_length, unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
-            clusters = clusterer.clusters(alignment, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-        }
+        clusters = get_clusters(alignment, mems, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
         
         
 #ifdef debug_multipath_mapper
@@ -137,6 +137,43 @@ namespace vg {
         }
     }
     
+    vector<memcluster_t> MultipathMapper::get_clusters(const Alignment& alignment, const vector<MaximalExactMatch>& mems,
+                                                       OrientedDistanceClusterer::paths_of_node_memo_t* paths_of_node_memo,
+                                                       OrientedDistanceClusterer::oriented_occurences_memo_t* oriented_occurences_memo,
+                                                       OrientedDistanceClusterer::handle_memo_t* handle_memo) {
+        
+        StageTimer timer(STAGE_CLUSTER);
+        vector<memcluster_t> clusters;
+        // TODO: Making OrientedDistanceClusterers is the only place we actually
+        // need to distinguish between regular_aligner and qual_adj_aligner
+        if (use_sparse_chaining) {
+            if (adjust_alignments_for_base_quality) {
+                SparseChainClusterer clusterer(alignment, mems, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error,
+                                               min_clustering_mem_length);
+                clusters = clusterer.clusters(alignment, max_mapping_quality, log_likelihood_approx_factor);
+            }
+            else {
+                SparseChainClusterer clusterer(alignment, mems, *get_regular_aligner(), xindex, max_expected_dist_approx_error,
+                                               min_clustering_mem_length);
+                clusters = clusterer.clusters(alignment, max_mapping_quality, log_likelihood_approx_factor);
+            }
+        }
+        else if (adjust_alignments_for_base_quality) {
+            OrientedDistanceClusterer clusterer(alignment, mems, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error,
+                                                min_clustering_mem_length, unstranded_clustering, paths_of_node_memo, oriented_occurences_memo, handle_memo,
+                                                distance_index);
+            clusters = clusterer.clusters(alignment, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
+        }
+        else {
+            OrientedDistanceClusterer clusterer(alignment, mems, *get_regular_aligner(), xindex, max_expected_dist_approx_error,
+                                                min_clustering_mem_length, unstranded_clustering, paths_of_node_memo, oriented_occurences_memo, handle_memo,
+                                                distance_index);
+            clusters = clusterer.clusters(alignment, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
+        }
+        timer.add_candidates(clusters.size());
+        return clusters;
+    }
+    
     void MultipathMapper::align_to_cluster_graphs(const Alignment& alignment,
                                                   MappingQualityMethod mapq_method,
                                                   vector<clustergraph_t>& cluster_graphs,
@@ -173,7 +210,7 @@ namespace vg {
             }
             
 #ifdef debug_multipath_mapper_alignment
-            cerr << "performing alignment to subgraph " << pb2json(get<0>(cluster_graph)->graph) << endl;
+            cerr << "performing alignment to subgraph with " << get<0>(cluster_graph)->node_size() << " nodes" << endl;
 #endif
             
             multipath_alns_out.emplace_back();
@@ -325,6 +362,8 @@ namespace vg {
     bool MultipathMapper::attempt_rescue(const MultipathAlignment& multipath_aln, const Alignment& other_aln,
                                          bool rescue_forward, MultipathAlignment& rescue_multipath_aln) {
         
+        StageTimer timer(STAGE_PAIR_RESCUE);
+        
 #ifdef debug_multipath_mapper
         cerr << "attemping pair rescue in " << (rescue_forward ? "forward" : "backward") << " direction from " << pb2json(multipath_aln) << endl;
 #endif
@@ -418,6 +457,7 @@ namespace vg {
             return false;
         }
         
+        timer.add_candidates(1);
         return true;
     }
     
@@ -589,6 +629,14 @@ namespace vg {
 #ifdef debug_multipath_mapper
         cerr << "measuring left-to-" << (full_fragment ? "right" : "left") << " end distance between " << pos_1 << " and " << pos_2 << endl;
 #endif
+        if (distance_index && distance_index->has_node(id(pos_1)) && distance_index->has_node(id(pos_2))) {
+            int64_t distance = distance_index->oriented_distance(pos_1, pos_2);
+            if (forward_strand && is_rev(pos_1) && distance != numeric_limits<int64_t>::max()) {
+                // measure along the forward strand of the first position's node
+                distance = -distance;
+            }
+            return distance;
+        }
         return xindex->closest_shared_path_oriented_distance(id(pos_1), offset(pos_1), is_rev(pos_1),
                                                              id(pos_2), offset(pos_2), is_rev(pos_2),
                                                              forward_strand);
@@ -1143,6 +1191,21 @@ namespace vg {
         // empty the output vector (just for safety)
         multipath_aln_pairs_out.clear();
         
+        // If we are annotating reads with what they cost, we put the stages
+        // for the pair on both reads of the best pair.
+        bool annotating = annotate_stage_stats && MappingStageStats::is_enabled();
+        MappingStageCounts stage_counts_before;
+        if (annotating) {
+            stage_counts_before = MappingStageStats::local();
+        }
+        auto annotate_stages = [&]() {
+            if (annotating && !multipath_aln_pairs_out.empty()) {
+                MappingStageCounts stage_counts = MappingStageStats::local() - stage_counts_before;
+                MappingStageStats::annotate(&multipath_aln_pairs_out.front().first, stage_counts);
+                MappingStageStats::annotate(&multipath_aln_pairs_out.front().second, stage_counts);
+            }
+        };
+        
         if (!fragment_length_distr.is_finalized()) {
             // we have not estimated a fragment length distribution yet, so we revert to single ended mode and look
             // for unambiguous pairings
@@ -1152,6 +1215,7 @@ namespace vg {
 #endif
             
             attempt_unpaired_multipath_map_of_pair(alignment1, alignment2, multipath_aln_pairs_out, ambiguous_pair_buffer);
+            annotate_stages();
             
             return;
         }
@@ -1240,16 +1304,7 @@ namespace vg {
                 }
                 
                 // do the clustering
-                if (adjust_alignments_for_base_quality) {
-                    OrientedDistanceClusterer clusterer2(alignment2, mems2, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                         unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
-                    clusters2 = clusterer2.clusters(alignment2, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-                }
-                else {
-                    OrientedDistanceClusterer clusterer2(alignment2, mems2, *get_regular_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                         unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
-                    clusters2 = clusterer2.clusters(alignment2, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-                }
+                clusters2 = get_clusters(alignment2, mems2, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
                 
                 cluster_graphs2 = query_cluster_graphs(alignment2, mems2, clusters2);
             }
@@ -1269,16 +1324,7 @@ namespace vg {
                 }
                 
                 // do the clustering
-                if (adjust_alignments_for_base_quality) {
-                    OrientedDistanceClusterer clusterer1(alignment1, mems1, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                         unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
-                    clusters1 = clusterer1.clusters(alignment1, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-                }
-                else {
-                    OrientedDistanceClusterer clusterer1(alignment1, mems1, *get_regular_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                         unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
-                    clusters1 = clusterer1.clusters(alignment1, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-                }
+                clusters1 = get_clusters(alignment1, mems1, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
                 
                 cluster_graphs1 = query_cluster_graphs(alignment1, mems1, clusters1);
             }
@@ -1302,22 +1348,8 @@ namespace vg {
             }
             
             // do the clustering
-            if (adjust_alignments_for_base_quality) {
-                OrientedDistanceClusterer clusterer1(alignment1, mems1, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                     unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
-                clusters1 = clusterer1.clusters(alignment1, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-                OrientedDistanceClusterer clusterer2(alignment2, mems2, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                     unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
-                clusters2 = clusterer2.clusters(alignment2, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-            }
-            else {
-                OrientedDistanceClusterer clusterer1(alignment1, mems1, *get_regular_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                     unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
-                clusters1 = clusterer1.clusters(alignment1, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-                OrientedDistanceClusterer clusterer2(alignment2, mems2, *get_regular_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                     unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
-                clusters2 = clusterer2.clusters(alignment2, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-            }
+            clusters1 = get_clusters(alignment1, mems1, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
+            clusters2 = get_clusters(alignment2, mems2, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
             
             // extract graphs around the clusters and get the assignments of MEMs to these graphs
             cluster_graphs1 = query_cluster_graphs(alignment1, mems1, clusters1);
@@ -1393,13 +1425,18 @@ namespace vg {
             }
             
             // Compute the pairs of cluster graphs and their approximate distances from each other
-            cluster_pairs = OrientedDistanceClusterer::pair_clusters(alignment1, alignment2,
-                                                                     cluster_mems_1, cluster_mems_2,
-                                                                     alt_anchors_1, alt_anchors_2,
-                                                                     xindex,
-                                                                     min_separation, max_separation,
-                                                                     unstranded_clustering,
-                                                                     &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
+            {
+                StageTimer timer(STAGE_CLUSTER);
+                cluster_pairs = OrientedDistanceClusterer::pair_clusters(alignment1, alignment2,
+                                                                         cluster_mems_1, cluster_mems_2,
+                                                                         alt_anchors_1, alt_anchors_2,
+                                                                         xindex,
+                                                                         min_separation, max_separation,
+                                                                         unstranded_clustering,
+                                                                         &paths_of_node_memo, &oriented_occurences_memo, &handle_memo,
+                                                                         distance_index);
+                timer.add_candidates(cluster_pairs.size());
+            }
 #ifdef debug_multipath_mapper
             cerr << "obtained cluster pairs:" << endl;
             for (int i = 0; i < cluster_pairs.size(); i++) {
@@ -1522,7 +1559,9 @@ namespace vg {
             set_annotation(&multipath_aln_pair.second, "fragment_length_distribution", distribution);
         }
         
-        // clean up the VG objects on the heap
+        annotate_stages();
+        
+        // clean up the cluster graphs on the heap
         for (auto cluster_graph : cluster_graphs1) {
             delete get<0>(cluster_graph);
         }
@@ -1672,16 +1711,7 @@ namespace vg {
 #endif
             
             // get the clusters for the non repeat
-            if (adjust_alignments_for_base_quality) {
-                OrientedDistanceClusterer clusterer1(alignment1, mems1, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                     unstranded_clustering, paths_of_node_memo, oriented_occurences_memo, handle_memo);
-                clusters1 = clusterer1.clusters(alignment1, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-            }
-            else {
-                OrientedDistanceClusterer clusterer1(alignment1, mems1, *get_regular_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                     unstranded_clustering, paths_of_node_memo, oriented_occurences_memo, handle_memo);
-                clusters1 = clusterer1.clusters(alignment1, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-            }
+            clusters1 = get_clusters(alignment1, mems1, paths_of_node_memo, oriented_occurences_memo, handle_memo);
             
             // extract the graphs around the clusters
             cluster_graphs1 = query_cluster_graphs(alignment1, mems1, clusters1);
@@ -1716,16 +1746,7 @@ namespace vg {
 #endif
             
             // get the clusters for the non repeat
-            if (adjust_alignments_for_base_quality) {
-                OrientedDistanceClusterer clusterer2(alignment2, mems2, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                     unstranded_clustering, paths_of_node_memo, oriented_occurences_memo, handle_memo);
-                clusters2 = clusterer2.clusters(alignment2, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-            }
-            else {
-                OrientedDistanceClusterer clusterer2(alignment2, mems2, *get_regular_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                     unstranded_clustering, paths_of_node_memo, oriented_occurences_memo, handle_memo);
-                clusters2 = clusterer2.clusters(alignment2, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-            }
+            clusters2 = get_clusters(alignment2, mems2, paths_of_node_memo, oriented_occurences_memo, handle_memo);
             
             // extract the graphs around the clusters
             cluster_graphs2 = query_cluster_graphs(alignment2, mems2, clusters2);
@@ -1936,6 +1957,11 @@ namespace vg {
         // TODO: some cluster pairs will produce redundant subgraph pairs.
         // We'll end up with redundant pairs being output.
         
+        // a cluster graph can be in many pairs, but its alignment doesn't depend on its mate's,
+        // so we remember the alignment to each cluster graph of each read
+        unordered_map<size_t, MultipathAlignment> cluster_multipath_alns1;
+        unordered_map<size_t, MultipathAlignment> cluster_multipath_alns2;
+        
         // align to each cluster pair
         multipath_aln_pairs_out.reserve(min(num_mappings_to_compute, cluster_pairs.size()));
         size_t num_mappings = 0;
@@ -1956,21 +1982,29 @@ namespace vg {
                 break;
             }
             
-            VG* vg1 = get<0>(cluster_graphs1[cluster_pair.first.first]);
-            VG* vg2 = get<0>(cluster_graphs2[cluster_pair.first.second]);
+            HandleSubgraph* graph1 = get<0>(cluster_graphs1[cluster_pair.first.first]);
+            HandleSubgraph* graph2 = get<0>(cluster_graphs2[cluster_pair.first.second]);
             
             memcluster_t& graph_mems1 = get<1>(cluster_graphs1[cluster_pair.first.first]);
             memcluster_t& graph_mems2 = get<1>(cluster_graphs2[cluster_pair.first.second]);
             
 #ifdef debug_multipath_mapper
             cerr << "doing pair " << cluster_pair.first.first << " " << cluster_pair.first.second << endl;
-            cerr << "performing alignments to subgraphs " << pb2json(vg1->graph) << " and " << pb2json(vg2->graph) << endl;
+            cerr << "performing alignments to subgraphs with " << graph1->node_size() << " and " << graph2->node_size() << " nodes" << endl;
 #endif
             
-            // Do the two alignments
-            multipath_aln_pairs_out.emplace_back();
-            multipath_align(alignment1, vg1, graph_mems1, multipath_aln_pairs_out.back().first);
-            multipath_align(alignment2, vg2, graph_mems2, multipath_aln_pairs_out.back().second);
+            // Do the two alignments, or copy them if we already aligned to these cluster graphs in another pair
+            auto cluster_aln1 = cluster_multipath_alns1.find(cluster_pair.first.first);
+            if (cluster_aln1 == cluster_multipath_alns1.end()) {
+                cluster_aln1 = cluster_multipath_alns1.emplace(cluster_pair.first.first, MultipathAlignment()).first;
+                multipath_align(alignment1, graph1, graph_mems1, cluster_aln1->second);
+            }
+            auto cluster_aln2 = cluster_multipath_alns2.find(cluster_pair.first.second);
+            if (cluster_aln2 == cluster_multipath_alns2.end()) {
+                cluster_aln2 = cluster_multipath_alns2.emplace(cluster_pair.first.second, MultipathAlignment()).first;
+                multipath_align(alignment2, graph2, graph_mems2, cluster_aln2->second);
+            }
+            multipath_aln_pairs_out.emplace_back(cluster_aln1->second, cluster_aln2->second);
             
             num_mappings++;
         }
@@ -2017,6 +2051,8 @@ namespace vg {
                                                const vector<MaximalExactMatch>& mems,
                                                const vector<memcluster_t>& clusters) -> vector<clustergraph_t> {
         
+        StageTimer timer(STAGE_CLUSTER_GRAPHS);
+        
         // Figure out the aligner to use
         BaseAligner* aligner = get_aligner();
         
@@ -2028,7 +2064,7 @@ namespace vg {
         unordered_map<id_t, size_t> node_id_to_cluster;
         
         // to hold the clusters as they are (possibly) merged
-        unordered_map<size_t, VG*> cluster_graphs;
+        unordered_map<size_t, HandleSubgraph*> cluster_graphs;
         
         // to keep track of which clusters have been merged
         UnionFind union_find(clusters.size());
@@ -2066,11 +2102,10 @@ namespace vg {
             
             // extract the subgraph within the search distance
             
-            VG* cluster_graph = new VG();
-            Graph& graph = cluster_graph->graph;
+            HandleSubgraph* cluster_graph = new HandleSubgraph(xindex);
             
-            // extract the protobuf Graph in place in the VG
-            algorithms::extract_containing_graph(xindex, graph, positions, forward_max_dist,
+            // extract the node IDs and edges into the subgraph, without copying any sequence
+            algorithms::extract_containing_graph(xindex, *cluster_graph, positions, forward_max_dist,
                                                  backward_max_dist);
                                                  
             // check if this subgraph overlaps with any previous subgraph (indicates a probable clustering failure where
@@ -2078,15 +2113,15 @@ namespace vg {
             unordered_set<size_t> overlapping_graphs;
             
             if (!suppress_cluster_merging) {
-                for (size_t j = 0; j < graph.node_size(); j++) {
-                    id_t node_id = graph.node(j).id();
+                cluster_graph->for_each_handle([&](const handle_t& handle) {
+                    id_t node_id = cluster_graph->get_id(handle);
                     if (node_id_to_cluster.count(node_id)) {
                         overlapping_graphs.insert(node_id_to_cluster[node_id]);
                     }
                     else {
                         node_id_to_cluster[node_id] = i;
                     }
-                }
+                });
             }
             
             if (overlapping_graphs.empty()) {
@@ -2096,10 +2131,6 @@ namespace vg {
                 cerr << "cluster graph does not overlap with any other cluster graphs, adding as cluster " << i << endl;
 #endif
                 cluster_graphs[i] = cluster_graph;
-                
-                // now that we know we're going to save the graph, manually trigger the index building since
-                // we circumvented the constructors
-                cluster_graph->build_indexes();
             }
             else {
                 // this graph overlaps at least one other graph, so we merge them into one
@@ -2121,7 +2152,7 @@ namespace vg {
                 cerr << "merging as cluster " << remaining_idx << endl;
 #endif
                 
-                VG* merging_graph;
+                HandleSubgraph* merging_graph;
                 if (remaining_idx == i) {
                     // the new graph was chosen to remain, so add it to the record
                     cluster_graphs[i] = cluster_graph;
@@ -2130,24 +2161,24 @@ namespace vg {
                 else {
                     // the new graph will be merged into an existing graph
                     merging_graph = cluster_graphs[remaining_idx];
-                    merging_graph->extend(graph);
+                    merging_graph->extend(*cluster_graph);
                     delete cluster_graph;
                 }
                 
                 // merge any other chained graphs into the remaining graph
                 for (size_t j : overlapping_graphs) {
                     if (j != remaining_idx) {
-                        VG* removing_graph = cluster_graphs[j];
-                        merging_graph->extend(removing_graph->graph);
+                        HandleSubgraph* removing_graph = cluster_graphs[j];
+                        merging_graph->extend(*removing_graph);
                         delete removing_graph;
                         cluster_graphs.erase(j);
                     }
                 }
+                merging_graph->finalize();
                 
-                Graph& merged_graph = merging_graph->graph;
-                for (size_t j = 0; j < merged_graph.node_size(); j++) {
-                    node_id_to_cluster[merged_graph.node(j).id()] = remaining_idx;
-                }
+                merging_graph->for_each_handle([&](const handle_t& handle) {
+                    node_id_to_cluster[merging_graph->get_id(handle)] = remaining_idx;
+                });
             }
         }
         
@@ -2159,7 +2190,7 @@ namespace vg {
         unordered_map<size_t, vector<size_t>> multicomponent_splits;
         
         size_t max_graph_idx = 0;
-        for (const pair<size_t, VG*> cluster_graph : cluster_graphs) {
+        for (const pair<size_t, HandleSubgraph*> cluster_graph : cluster_graphs) {
             vector<unordered_set<id_t>> connected_components = algorithms::weakly_connected_components(cluster_graph.second);
             if (connected_components.size() > 1) {
                 multicomponent_graphs.emplace_back(cluster_graph.first, std::move(connected_components));
@@ -2183,42 +2214,52 @@ namespace vg {
 #endif
             
             for (size_t i = 0; i < multicomponent_graph.second.size(); i++) {
-                cluster_graphs[max_graph_idx + i] = new VG();
+                cluster_graphs[max_graph_idx + i] = new HandleSubgraph(xindex);
             }
             
-            Graph& joined_graph = cluster_graphs[multicomponent_graph.first]->graph;
+            HandleSubgraph* joined_graph = cluster_graphs[multicomponent_graph.first];
             
             // divvy up the nodes
-            for (size_t i = 0; i < joined_graph.node_size(); i++) {
-                const Node& node = joined_graph.node(i);
+            vector<size_t> component_of_node(joined_graph->node_size());
+            joined_graph->for_each_handle([&](const handle_t& handle) {
+                id_t node_id = joined_graph->get_id(handle);
                 for (size_t j = 0; j < multicomponent_graph.second.size(); j++) {
-                    if (multicomponent_graph.second[j].count(node.id())) {
-                        cluster_graphs[max_graph_idx + j]->add_node(node);
+                    if (multicomponent_graph.second[j].count(node_id)) {
+                        cluster_graphs[max_graph_idx + j]->add_node(node_id);
                         // if we're suppressing cluster merging, we don't maintain this index
                         if (!suppress_cluster_merging) {
-                            node_id_to_cluster[node.id()] = max_graph_idx + j;
+                            node_id_to_cluster[node_id] = max_graph_idx + j;
                         }
+                        component_of_node[joined_graph->get_rank(handle)] = j;
                         break;
                     }
                 }
-            }
+            });
             
-            // divvy up the edges
-            for (size_t i = 0; i < joined_graph.edge_size(); i++) {
-                const Edge& edge = joined_graph.edge(i);
-                for (size_t j = 0; j < multicomponent_graph.second.size(); j++) {
-                    if (multicomponent_graph.second[j].count(edge.from())) {
-                        cluster_graphs[max_graph_idx + j]->add_edge(edge);
-                        break;
-                    }
+            // divvy up the edges, which we see from both ends
+            joined_graph->for_each_handle([&](const handle_t& handle) {
+                HandleSubgraph* component = cluster_graphs[max_graph_idx + component_of_node[joined_graph->get_rank(handle)]];
+                for (bool go_left : {false, true}) {
+                    joined_graph->follow_edges(handle, go_left, [&](const handle_t& next) {
+                        handle_t left = go_left ? next : handle;
+                        handle_t right = go_left ? handle : next;
+                        component->add_edge(joined_graph->get_underlying_handle(left),
+                                            joined_graph->get_underlying_handle(right));
+                    });
                 }
+            });
+            
+            for (size_t i = 0; i < multicomponent_graph.second.size(); i++) {
+                cluster_graphs[max_graph_idx + i]->finalize();
             }
             
 #ifdef debug_multipath_mapper
             cerr << "split graphs:" << endl;
             for (size_t i = 0; i < multicomponent_graph.second.size(); i++) {
                 cerr << "component " << max_graph_idx + i << ":" << endl;
-                cerr << pb2json(cluster_graphs[max_graph_idx + i]->graph) << endl;
+                cluster_graphs[max_graph_idx + i]->for_each_handle([&](const handle_t& handle) {
+                    cerr << "\t" << cluster_graphs[max_graph_idx + i]->get_id(handle) << endl;
+                });
             }
 #endif
             
@@ -2272,10 +2313,10 @@ namespace vg {
             
             unordered_map<id_t, vector<size_t>> node_id_to_cluster_idxs;
             for (size_t i = 0; i < cluster_graphs_out.size(); i++) {
-                Graph& graph = get<0>(cluster_graphs_out[i])->graph;
-                for (size_t j = 0; j < graph.node_size(); j++) {
-                    node_id_to_cluster_idxs[graph.node(j).id()].push_back(i);
-                }
+                const HandleSubgraph* graph = get<0>(cluster_graphs_out[i]);
+                graph->for_each_handle([&](const handle_t& handle) {
+                    node_id_to_cluster_idxs[graph->get_id(handle)].push_back(i);
+                });
             }
             
             for (const MaximalExactMatch& mem : mems) {
@@ -2314,7 +2355,7 @@ namespace vg {
             
         // find the node ID range for the cluster graphs to help set up a stable, system-independent ordering
         // note: technically this is not quite a total ordering, but it should be close to one
-        unordered_map<VG*, pair<id_t, id_t>> node_range;
+        unordered_map<HandleSubgraph*, pair<id_t, id_t>> node_range;
         node_range.reserve(cluster_graphs_out.size());
         for (const auto& cluster_graph : cluster_graphs_out) {
             node_range[get<0>(cluster_graph)] = make_pair(get<0>(cluster_graph)->min_node_id(),
@@ -2330,15 +2371,19 @@ namespace vg {
                                  wang_hash<pair<id_t, id_t>>()(node_range[get<0>(cluster_graph_1)]) < wang_hash<pair<id_t, id_t>>()(node_range[get<0>(cluster_graph_2)])));
                     });
         
+        timer.add_candidates(cluster_graphs_out.size());
         return move(cluster_graphs_out);
         
         
     }
     
-    void MultipathMapper::multipath_align(const Alignment& alignment, VG* vg,
+    void MultipathMapper::multipath_align(const Alignment& alignment, const HandleSubgraph* graph,
                                           memcluster_t& graph_mems,
                                           MultipathAlignment& multipath_aln_out) const {
 
+        StageTimer timer(STAGE_MULTIPATH_ALIGN);
+        timer.add_candidates(graph_mems.size());
+
 #ifdef debug_multipath_mapper_alignment
         cerr << "constructing alignment graph" << endl;
 #endif
@@ -2350,7 +2395,7 @@ namespace vg {
         unordered_map<id_t, pair<id_t, bool> > node_trans;
         
         // check if we can get away with using only one strand of the graph
-        bool use_single_stranded = vg->is_single_stranded();
+        bool use_single_stranded = algorithms::is_single_stranded(graph);
         bool mem_strand = false;
         if (use_single_stranded) {
             mem_strand = is_rev(graph_mems[0].second);
@@ -2362,21 +2407,21 @@ namespace vg {
             }
         }
         
-        // make the graph we need to align to
-        // TODO: can I do this without the copy constructor for the forward strand?
+        // make the graph we need to align to, straight from the cluster graph, so that only now that we're
+        // actually aligning to this cluster do we copy its sequences
 #ifdef debug_multipath_mapper_alignment
         cerr << "use_single_stranded: " << use_single_stranded << " mem_strand: " << mem_strand << endl;
 #endif
-        VG align_graph = use_single_stranded ? (mem_strand ? vg->reverse_complement_graph(node_trans) : *vg) : vg->split_strands(node_trans);
-        
-        // if we are using only the forward strand of the current graph, a make trivial node translation so
-        // the later code's expectations are met
-        if (use_single_stranded && !mem_strand) {
-            vg->identity_translation(node_trans);
+        VG align_graph;
+        if (use_single_stranded) {
+            node_trans = algorithms::extract_strand(graph, &align_graph, mem_strand);
+        }
+        else {
+            node_trans = algorithms::split_strands(graph, &align_graph);
         }
         
         // if necessary, convert from cyclic to acylic
-        if (!vg->is_directed_acyclic()) {
+        if (!algorithms::is_directed_acyclic(graph)) {
             unordered_map<id_t, pair<id_t, bool> > dagify_trans;
             align_graph = align_graph.dagify(target_length, // high enough that num SCCs is never a limiting factor
                                              dagify_trans,
@@ -2555,6 +2600,8 @@ namespace vg {
         if (multipath_alns.empty()) {
             return;
         }
+        StageTimer timer(STAGE_MAPPING_QUALITY);
+        timer.add_candidates(multipath_alns.size());
         
         // only do the population MAPQ if it might disambiguate two paths (since it's not
         // as cheap as just using the score)
@@ -2721,6 +2768,9 @@ namespace vg {
         cerr << "Sorting and computing mapping qualities for paired reads" << endl;
 #endif
         
+        StageTimer timer(STAGE_MAPPING_QUALITY);
+        timer.add_candidates(multipath_aln_pairs.size());
+        
         assert(multipath_aln_pairs.size() == cluster_pairs.size());
         
         if (multipath_aln_pairs.empty()) {
@@ -20,6 +20,7 @@
 #include "edit.hpp"
 #include "snarls.hpp"
 #include "haplotypes.hpp"
+#include "handle_subgraph.hpp"
 
 #include "algorithms/extract_containing_graph.hpp"
 #include "algorithms/extract_connecting_graph.hpp"
@@ -87,7 +88,6 @@ namespace vg {
         double mem_coverage_min_ratio = 0.5;
         double max_suboptimal_path_score_ratio = 2.0;
         size_t num_mapping_attempts = 48;
-        double log_likelihood_approx_factor = 1.0;
         size_t min_clustering_mem_length = 0;
         size_t max_p_value_memo_size = 500;
         double pseudo_length_multiplier = 1.65;
@@ -118,10 +118,10 @@ namespace vg {
         using memcluster_t = vector<pair<const MaximalExactMatch*, pos_t>>;
         
         /// This represents a graph for a cluster, and holds a pointer to the
-        /// actual extracted graph, a list of assigned MEMs, and the number of
-        /// bases of read coverage that that MEM cluster provides (which serves
-        /// as a priority).
-        using clustergraph_t = tuple<VG*, memcluster_t, size_t>;
+        /// actual extracted graph (a lightweight subgraph of the XG), a list
+        /// of assigned MEMs, and the number of bases of read coverage that
+        /// that MEM cluster provides (which serves as a priority).
+        using clustergraph_t = tuple<HandleSubgraph*, memcluster_t, size_t>;
         
     protected:
         
@@ -204,13 +204,21 @@ namespace vg {
                                     vector<pair<MultipathAlignment, MultipathAlignment>>& rescued_multipath_aln_pairs,
                                     vector<pair<pair<size_t, size_t>, int64_t>>& rescued_cluster_pairs) const;
         
+        /// Cluster the MEMs of a read with an OrientedDistanceClusterer, using
+        /// the aligner that matches our base quality setting and the given
+        /// memos, if any.
+        vector<memcluster_t> get_clusters(const Alignment& alignment, const vector<MaximalExactMatch>& mems,
+                                          OrientedDistanceClusterer::paths_of_node_memo_t* paths_of_node_memo = nullptr,
+                                          OrientedDistanceClusterer::oriented_occurences_memo_t* oriented_occurences_memo = nullptr,
+                                          OrientedDistanceClusterer::handle_memo_t* handle_memo = nullptr);
+        
         /// Extracts a subgraph around each cluster of MEMs that encompasses any
         /// graph position reachable (according to the Mapper's aligner) with
         /// local alignment anchored at the MEMs. If any subgraphs overlap, they
         /// are merged into one subgraph. Returns a vector of all the merged
         /// cluster subgraphs, their MEMs assigned from the mems vector
         /// according to the MEMs' hits, and their read coverages in bp. The
-        /// caller must delete the VG objects produced!
+        /// caller must delete the subgraphs produced!
         vector<clustergraph_t> query_cluster_graphs(const Alignment& alignment,
                                                     const vector<MaximalExactMatch>& mems,
                                                     const vector<memcluster_t>& clusters);
@@ -228,7 +236,7 @@ namespace vg {
         
         /// Make a multipath alignment of the read against the indicated graph and add it to
         /// the list of multimappings.
-        void multipath_align(const Alignment& alignment, VG* vg,
+        void multipath_align(const Alignment& alignment, const HandleSubgraph* graph,
                              memcluster_t& graph_mems,
                              MultipathAlignment& multipath_aln_out) const;
         
@@ -513,7 +513,7 @@ char Sampler::pos_char(pos_t pos) {
 }
 
 map<pos_t, char> Sampler::next_pos_chars(pos_t pos) {
-    return xg_cached_next_pos_chars(pos, xgidx, node_cache, edge_cache);
+    return xg_cached_next_pos_chars(pos, xgidx, node_cache);
 }
 
 bool Sampler::is_valid(const Alignment& aln) {
@@ -562,7 +562,6 @@ NGSSimulator::NGSSimulator(xg::XG& xg_index,
                            size_t seed) :
       xg_index(xg_index)
     , node_cache(100)
-    , edge_cache(100)
     , sub_poly_rate(substition_polymorphism_rate)
     , indel_poly_rate(indel_polymorphism_rate)
     , indel_error_prop(indel_error_proportion)
@@ -935,8 +934,7 @@ bool NGSSimulator::advance_on_graph(pos_t& pos, char& graph_char) {
     // choose a next position at random
     map<pos_t, char> next_pos_chars = xg_cached_next_pos_chars(pos,
                                                                &xg_index,
-                                                               node_cache,
-                                                               edge_cache);
+                                                               node_cache);
     if (next_pos_chars.empty()) {
         return true;
     }
@@ -41,7 +41,6 @@ public:
     // We need this so we don't re-load the node for every character we visit in
     // it.
     LRUCache<id_t, Node> node_cache;
-    LRUCache<id_t, vector<Edge> > edge_cache;
     mt19937 rng;
     int64_t nonce;
     // If set, only sample positions/start reads on the forward strands of their
@@ -59,7 +58,6 @@ public:
             const vector<string>& source_paths = {})
         : xgidx(x),
           node_cache(100),
-          edge_cache(100),
           forward_only(forward_only),
           no_Ns(!allow_Ns),
           nonce(0),
@@ -268,7 +266,6 @@ private:
     xg::XG& xg_index;
     
     LRUCache<id_t, Node> node_cache;
-    LRUCache<id_t, vector<Edge> > edge_cache;
     
     default_random_engine prng;
     discrete_distribution<> path_sampler;
@@ -0,0 +1,168 @@
+#include "score_kernels.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCORE_KERNELS_SIMD
+#endif
+
+namespace vg {
+
+using namespace std;
+
+PackedRead::PackedRead(const string& sequence, const string& quality) :
+    length(sequence.size()), bases(sequence.size() / 32 + 2, 0), ns(sequence.size() / 64 + 2, 0),
+    qualities(quality) {
+
+    if (!quality.empty() && quality.size() != sequence.size()) {
+        throw runtime_error("[vg::PackedRead] base qualities do not match the length of the sequence");
+    }
+
+    for (size_t i = 0; i < length; i++) {
+        uint64_t code;
+        switch (sequence[i]) {
+            case 'A': case 'a': code = 0; break;
+            case 'C': case 'c': code = 1; break;
+            case 'G': case 'g': code = 2; break;
+            case 'T': case 't': code = 3; break;
+            default:
+                ns[i / 64] |= uint64_t(1) << (i % 64);
+                continue;
+        }
+        bases[i / 32] |= code << (2 * (i % 32));
+    }
+}
+
+size_t PackedRead::size() const {
+    return length;
+}
+
+bool PackedRead::has_quality() const {
+    return !qualities.empty();
+}
+
+uint8_t PackedRead::code(size_t i) const {
+    if ((ns[i / 64] >> (i % 64)) & 1) {
+        return 4;
+    }
+    return (bases[i / 32] >> (2 * (i % 32))) & 3;
+}
+
+uint8_t PackedRead::quality(size_t i) const {
+    return qualities[i];
+}
+
+uint64_t PackedRead::bases_at(size_t i) const {
+    size_t shift = 2 * (i % 32);
+    uint64_t window = bases[i / 32] >> shift;
+    if (shift) {
+        window |= bases[i / 32 + 1] << (64 - shift);
+    }
+    return window;
+}
+
+uint64_t PackedRead::ns_at(size_t i) const {
+    size_t shift = i % 64;
+    uint64_t window = ns[i / 64] >> shift;
+    if (shift) {
+        window |= ns[i / 64 + 1] << (64 - shift);
+    }
+    return window;
+}
+
+const uint8_t* PackedRead::quality_data() const {
+    return (const uint8_t*) qualities.data();
+}
+
+/// The instruction sets that exact matches can be scored with
+enum ScoreKernelLevel {ScoreKernelScalar, ScoreKernelAVX2};
+
+static ScoreKernelLevel detect_score_kernel_level() {
+#ifdef SCORE_KERNELS_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return ScoreKernelAVX2;
+    }
+#endif
+    return ScoreKernelScalar;
+}
+
+static const ScoreKernelLevel supported_score_kernel_level = detect_score_kernel_level();
+static ScoreKernelLevel score_kernel_level = supported_score_kernel_level;
+
+void set_score_kernel_simd(bool allowed) {
+    score_kernel_level = allowed ? supported_score_kernel_level : ScoreKernelScalar;
+}
+
+const char* score_kernel_simd_name() {
+    return score_kernel_level == ScoreKernelAVX2 ? "avx2" : "scalar";
+}
+
+static int32_t score_exact_match_by_quality_scalar(const PackedRead& read, size_t begin, size_t end,
+                                                   const int32_t* scores_by_quality, uint8_t max_quality) {
+    const uint8_t* quality = read.quality_data();
+    int32_t score = 0;
+    for (size_t i = begin; i < end; i++) {
+        score += scores_by_quality[5 * min(quality[i], max_quality) + read.code(i)];
+    }
+    return score;
+}
+
+#ifdef SCORE_KERNELS_SIMD
+
+__attribute__((target("avx2")))
+static int32_t score_exact_match_by_quality_avx2(const PackedRead& read, size_t begin, size_t end,
+                                                 const int32_t* scores_by_quality, uint8_t max_quality) {
+    const uint8_t* quality = read.quality_data();
+
+    // lane j of a block of 8 bases takes its code from bits 2j and its N flag from bit j
+    const __m256i code_shifts = _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14);
+    const __m256i n_shifts = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i low_bits = _mm256_set1_epi32(3);
+    const __m256i low_bit = _mm256_set1_epi32(1);
+    const __m128i quality_cap = _mm_set1_epi8((char) max_quality);
+
+    __m256i total = _mm256_setzero_si256();
+    size_t i = begin;
+    for (; i + 32 <= end; i += 32) {
+        uint64_t codes = read.bases_at(i);
+        uint64_t ns = read.ns_at(i);
+        for (size_t j = 0; j < 32; j += 8, codes >>= 16, ns >>= 8) {
+            __m256i code = _mm256_and_si256(_mm256_srlv_epi32(_mm256_set1_epi32((int32_t) (codes & 0xFFFF)),
+                                                              code_shifts), low_bits);
+            __m256i n = _mm256_and_si256(_mm256_srlv_epi32(_mm256_set1_epi32((int32_t) (ns & 0xFF)),
+                                                           n_shifts), low_bit);
+            // Ns are packed as code 0, so setting bit 2 makes them code 4
+            code = _mm256_or_si256(code, _mm256_slli_epi32(n, 2));
+
+            __m128i qual_bytes = _mm_min_epu8(_mm_loadl_epi64((const __m128i*) (quality + i + j)), quality_cap);
+            __m256i qual = _mm256_cvtepu8_epi32(qual_bytes);
+            // 5 * q + c
+            __m256i index = _mm256_add_epi32(_mm256_add_epi32(_mm256_slli_epi32(qual, 2), qual), code);
+            total = _mm256_add_epi32(total, _mm256_i32gather_epi32(scores_by_quality, index, 4));
+        }
+    }
+
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+    sum = _mm_hadd_epi32(sum, sum);
+    sum = _mm_hadd_epi32(sum, sum);
+
+    return _mm_cvtsi128_si32(sum) + score_exact_match_by_quality_scalar(read, i, end, scores_by_quality,
+                                                                        max_quality);
+}
+
+#endif
+
+int32_t score_exact_match_by_quality(const PackedRead& read, size_t begin, size_t end,
+                                     const int32_t* scores_by_quality, uint8_t max_quality) {
+#ifdef SCORE_KERNELS_SIMD
+    if (score_kernel_level == ScoreKernelAVX2) {
+        return score_exact_match_by_quality_avx2(read, begin, end, scores_by_quality, max_quality);
+    }
+#endif
+    return score_exact_match_by_quality_scalar(read, begin, end, scores_by_quality, max_quality);
+}
+
+}
@@ -0,0 +1,84 @@
+#ifndef VG_SCORE_KERNELS_HPP_INCLUDED
+#define VG_SCORE_KERNELS_HPP_INCLUDED
+
+/** \file
+ *
+ * Kernels for scoring runs of exact matches against a read in bulk.
+ *
+ * A read is packed once into a PackedRead, 2 bits per base with a separate
+ * mask for Ns, and then every exact match along it (each MEM, each anchor of a
+ * multipath alignment, each match edit of a rescored path) can be scored from
+ * the packed bases and qualities without going back through the character
+ * tables one base at a time. On CPUs with AVX2, quality adjusted scores are
+ * looked up 8 bases at a time with gathers.
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A read sequence packed 2 bits per base, with its base qualities.
+ */
+class PackedRead {
+public:
+
+    /// Pack a read. The quality string is either empty or as long as the
+    /// sequence. Any base other than ACGT is treated as an N.
+    explicit PackedRead(const string& sequence, const string& quality = "");
+
+    /// Number of bases in the read
+    size_t size() const;
+
+    /// True if the read came with base qualities
+    bool has_quality() const;
+
+    /// The code of a base: 0-3 for ACGT, 4 for N, matching gssw's nt_table
+    uint8_t code(size_t i) const;
+
+    /// The quality of a base
+    uint8_t quality(size_t i) const;
+
+    /// The 2-bit codes of the 32 bases starting at i, with the first base in
+    /// the low bits. Ns have code 0 here, and bases past the end are 0.
+    uint64_t bases_at(size_t i) const;
+
+    /// The N flags of the 64 bases starting at i, with the first base in the
+    /// low bit
+    uint64_t ns_at(size_t i) const;
+
+    /// The raw base qualities
+    const uint8_t* quality_data() const;
+
+private:
+
+    size_t length;
+    /// 32 bases per word, plus one padding word so windows can straddle words
+    vector<uint64_t> bases;
+    /// 64 N flags per word, plus one padding word
+    vector<uint64_t> ns;
+    string qualities;
+};
+
+/// Allow or forbid scoring with vector instructions. They are allowed by
+/// default, and only used on CPUs with AVX2.
+void set_score_kernel_simd(bool allowed);
+
+/// Name of the instruction set exact matches are currently scored with:
+/// "avx2" or "scalar"
+const char* score_kernel_simd_name();
+
+/// Sum the quality adjusted scores of the bases of the read in [begin, end),
+/// as if each matched exactly. The score of base code c at quality q is
+/// scores_by_quality[5 * q + c]. Qualities above max_quality are scored as
+/// max_quality. The read must have qualities.
+int32_t score_exact_match_by_quality(const PackedRead& read, size_t begin, size_t end,
+                                     const int32_t* scores_by_quality, uint8_t max_quality);
+
+}
+
+#endif
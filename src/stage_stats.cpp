@@ -0,0 +1,101 @@
+#include "stage_stats.hpp"
+
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vg {
+
+using namespace std;
+
+bool MappingStageStats::enabled = false;
+
+/// Counters of every thread that has recorded anything. They are kept alive
+/// here after their threads exit, so they can still be added up.
+static vector<shared_ptr<MappingStageCounts>> all_thread_counts;
+static mutex all_thread_counts_mutex;
+
+const char* mapping_stage_name(MappingStage stage) {
+    switch (stage) {
+    case STAGE_FIND_MEMS:
+        return "find_mems";
+    case STAGE_CLUSTER:
+        return "cluster";
+    case STAGE_CLUSTER_GRAPHS:
+        return "cluster_graphs";
+    case STAGE_ALIGN_CLUSTER:
+        return "align_cluster";
+    case STAGE_BANDED_GLOBAL:
+        return "banded_global";
+    case STAGE_LONG_READ_BANDS:
+        return "long_read_bands";
+    case STAGE_MULTIPATH_ALIGN:
+        return "multipath_align";
+    case STAGE_PAIR_RESCUE:
+        return "pair_rescue";
+    case STAGE_MAPPING_QUALITY:
+        return "mapping_quality";
+    default:
+        return "unknown";
+    }
+}
+
+MappingStageCounts& MappingStageCounts::operator+=(const MappingStageCounts& other) {
+    for (size_t i = 0; i < MAPPING_STAGE_COUNT; i++) {
+        nanoseconds[i] += other.nanoseconds[i];
+        calls[i] += other.calls[i];
+        candidates[i] += other.candidates[i];
+    }
+    return *this;
+}
+
+MappingStageCounts MappingStageCounts::operator-(const MappingStageCounts& other) const {
+    MappingStageCounts difference;
+    for (size_t i = 0; i < MAPPING_STAGE_COUNT; i++) {
+        difference.nanoseconds[i] = nanoseconds[i] - other.nanoseconds[i];
+        difference.calls[i] = calls[i] - other.calls[i];
+        difference.candidates[i] = candidates[i] - other.candidates[i];
+    }
+    return difference;
+}
+
+void MappingStageStats::set_enabled(bool enabled) {
+    MappingStageStats::enabled = enabled;
+}
+
+MappingStageCounts& MappingStageStats::local() {
+    // Register this thread's counters the first time it asks for them
+    thread_local shared_ptr<MappingStageCounts> counts;
+    if (!counts) {
+        counts = make_shared<MappingStageCounts>();
+        lock_guard<mutex> guard(all_thread_counts_mutex);
+        all_thread_counts.push_back(counts);
+    }
+    return *counts;
+}
+
+MappingStageCounts MappingStageStats::total() {
+    MappingStageCounts sum;
+    lock_guard<mutex> guard(all_thread_counts_mutex);
+    for (auto& counts : all_thread_counts) {
+        sum += *counts;
+    }
+    return sum;
+}
+
+void MappingStageStats::report(ostream& out, const MappingStageCounts& counts) {
+    auto old_flags = out.flags();
+    auto old_precision = out.precision();
+    out << "stage\tseconds\tcalls\tcandidates" << endl;
+    for (size_t i = 0; i < MAPPING_STAGE_COUNT; i++) {
+        out << mapping_stage_name((MappingStage) i) << "\t"
+            << fixed << setprecision(3) << (double) counts.nanoseconds[i] / 1e9 << "\t"
+            << counts.calls[i] << "\t"
+            << counts.candidates[i] << endl;
+    }
+    out.flags(old_flags);
+    out.precision(old_precision);
+}
+
+}
@@ -0,0 +1,160 @@
+#ifndef VG_STAGE_STATS_HPP_INCLUDED
+#define VG_STAGE_STATS_HPP_INCLUDED
+
+/** \file
+ *
+ * Lightweight instrumentation for the stages of read mapping. Each thread
+ * keeps its own counters of wall time, calls and candidates per stage, so
+ * recording never takes a lock. The counters of all threads can be added up
+ * at the end of a run, or the counters of one thread compared before and after
+ * mapping a read to see what that read cost.
+ *
+ * Recording is off until turned on with MappingStageStats::set_enabled(), and
+ * a disabled StageTimer costs one branch.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "annotation.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/// The stages of read mapping that we keep track of. Stages can nest; for
+/// instance a banded global alignment done during pair rescue counts toward
+/// both stages.
+enum MappingStage {
+    /// Finding MEMs in the GCSA
+    STAGE_FIND_MEMS = 0,
+    /// Chaining or clustering MEMs into candidate placements
+    STAGE_CLUSTER,
+    /// Extracting subgraphs around clusters (multipath mapping)
+    STAGE_CLUSTER_GRAPHS,
+    /// Aligning a read to the subgraph of a MEM cluster
+    STAGE_ALIGN_CLUSTER,
+    /// Aligning a read with the banded global aligner
+    STAGE_BANDED_GLOBAL,
+    /// Splitting a long read into bands and chaining the band alignments
+    STAGE_LONG_READ_BANDS,
+    /// Making multipath alignments to cluster subgraphs
+    STAGE_MULTIPATH_ALIGN,
+    /// Looking for a missing mate near its partner
+    STAGE_PAIR_RESCUE,
+    /// Computing mapping qualities
+    STAGE_MAPPING_QUALITY,
+    /// Not a stage; the number of stages
+    MAPPING_STAGE_COUNT
+};
+
+/// Get a short name for a mapping stage, for reports and annotations
+const char* mapping_stage_name(MappingStage stage);
+
+/// Counters for all the stages
+struct MappingStageCounts {
+    /// Wall time spent, in nanoseconds
+    uint64_t nanoseconds[MAPPING_STAGE_COUNT] = {};
+    /// Number of times each stage was entered
+    uint64_t calls[MAPPING_STAGE_COUNT] = {};
+    /// Number of candidates each stage produced or considered (MEMs found,
+    /// clusters made, alignments made, mates rescued...)
+    uint64_t candidates[MAPPING_STAGE_COUNT] = {};
+
+    MappingStageCounts& operator+=(const MappingStageCounts& other);
+    MappingStageCounts operator-(const MappingStageCounts& other) const;
+};
+
+class MappingStageStats {
+public:
+
+    /// Turn recording on or off in all threads. Should not be called while
+    /// anything is being mapped.
+    static void set_enabled(bool enabled);
+
+    /// Return true if recording is on
+    inline static bool is_enabled();
+
+    /// Get the counters for the calling thread
+    static MappingStageCounts& local();
+
+    /// Add up the counters of all the threads that have recorded anything.
+    /// Should be called when no mapping is going on.
+    static MappingStageCounts total();
+
+    /// Write a table of the given counters, one line per stage
+    static void report(ostream& out, const MappingStageCounts& counts);
+
+    /// Annotate an alignment with the time, in microseconds, and candidates
+    /// for each stage that was used, from the given counters.
+    template<typename Annotated>
+    static void annotate(Annotated* annotated, const MappingStageCounts& counts);
+
+private:
+
+    static bool enabled;
+};
+
+/// Times a stage from construction until destruction, if recording is on.
+class StageTimer {
+public:
+    /// Start timing the given stage
+    inline StageTimer(MappingStage stage);
+
+    /// Stop timing and record the time
+    inline ~StageTimer();
+
+    /// Count some candidates toward the stage
+    inline void add_candidates(size_t count);
+
+private:
+    MappingStage stage;
+    bool running;
+    chrono::steady_clock::time_point start;
+};
+
+////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////
+
+inline bool MappingStageStats::is_enabled() {
+    return enabled;
+}
+
+template<typename Annotated>
+void MappingStageStats::annotate(Annotated* annotated, const MappingStageCounts& counts) {
+    for (size_t i = 0; i < MAPPING_STAGE_COUNT; i++) {
+        if (counts.calls[i] == 0) {
+            continue;
+        }
+        string name = mapping_stage_name((MappingStage) i);
+        set_annotation(annotated, "stage_" + name + "_us", (double) counts.nanoseconds[i] / 1000.0);
+        set_annotation(annotated, "stage_" + name + "_candidates", (double) counts.candidates[i]);
+    }
+}
+
+inline StageTimer::StageTimer(MappingStage stage) : stage(stage), running(MappingStageStats::is_enabled()) {
+    if (running) {
+        start = chrono::steady_clock::now();
+    }
+}
+
+inline StageTimer::~StageTimer() {
+    if (running) {
+        auto& counts = MappingStageStats::local();
+        counts.nanoseconds[stage] += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        counts.calls[stage]++;
+    }
+}
+
+inline void StageTimer::add_candidates(size_t count) {
+    if (running) {
+        MappingStageStats::local().candidates[stage] += count;
+    }
+}
+
+}
+
+#endif
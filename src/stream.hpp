@@ -3,20 +3,33 @@
 
 // de/serialization of protobuf objects from/to a length-prefixed, gzipped binary stream
 // from http://www.mail-archive.com/protobuf@googlegroups.com/msg03417.html
+//
+// Data is written as BGZF blocks, with each group of messages starting a new
+// block, so readers can seek to a group by its virtual offset. Older files,
+// which are ordinary multi-member gzip, can still be read.
 
 #include <cassert>
 #include <iostream>
 #include <istream>
 #include <fstream>
+#include <sstream>
 #include <functional>
 #include <vector>
 #include <list>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <omp.h>
 #include "google/protobuf/stubs/common.h"
 #include "google/protobuf/io/zero_copy_stream.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
 #include "google/protobuf/io/gzip_stream.h"
 #include "google/protobuf/io/coded_stream.h"
 
+#include "blocked_gzip_output_stream.hpp"
+#include "blocked_gzip_input_stream.hpp"
+
 namespace stream {
 
 /// Protobuf will refuse to read messages longer than this size.
@@ -40,9 +53,8 @@ bool write(std::ostream& out, uint64_t element_count, uint64_t chunk_elements,
     // How many elements have we serialized so far
     size_t serialized = 0;
     
-    ::google::protobuf::io::OstreamOutputStream raw_out(&out);
-    ::google::protobuf::io::GzipOutputStream gzip_out(&raw_out);
-    ::google::protobuf::io::CodedOutputStream coded_out(&gzip_out);
+    BlockedGzipOutputStream bgzip_out(out);
+    ::google::protobuf::io::CodedOutputStream coded_out(&bgzip_out);
 
     auto handle = [](bool ok) {
         if (!ok) throw std::runtime_error("stream::write: I/O error writing protobuf");
@@ -106,10 +118,18 @@ bool write(std::ostream& out, uint64_t element_count, uint64_t chunk_elements,
 template <typename T>
 bool write(std::ostream& out, uint64_t count, const std::function<T(uint64_t)>& lambda) {
 
+    if (count == 0) {
+        // Still emit an empty block, so the output is a valid gzip file
+        BlockedGzipOutputStream bgzip_out(out);
+        if (!bgzip_out.EndFile()) {
+            throw std::runtime_error("stream::write: I/O error writing protobuf");
+        }
+        return true;
+    }
+
     // Make all our streams on the stack, in case of error.
-    ::google::protobuf::io::OstreamOutputStream raw_out(&out);
-    ::google::protobuf::io::GzipOutputStream gzip_out(&raw_out);
-    ::google::protobuf::io::CodedOutputStream coded_out(&gzip_out);
+    BlockedGzipOutputStream bgzip_out(out);
+    ::google::protobuf::io::CodedOutputStream coded_out(&bgzip_out);
 
     auto handle = [](bool ok) {
         if (!ok) {
@@ -152,18 +172,36 @@ bool write_buffered(std::ostream& out, std::vector<T>& buffer, uint64_t buffer_l
     return wrote;
 }
 
+/// Serialize and compress a group of objects into a string, in the same
+/// format as write(), so that it can be written out later without holding
+/// any lock. Strings made this way can be concatenated into a valid stream.
+/// Returns an empty string if there are no objects.
+template <typename T>
+std::string write_to_string(const std::vector<T>& objects) {
+    if (objects.empty()) {
+        return std::string();
+    }
+    std::stringstream out;
+    std::function<T(uint64_t)> lambda = [&objects](uint64_t n) { return objects.at(n); };
+    write(out, objects.size(), lambda);
+    return out.str();
+}
+
 // deserialize the input stream into the objects
 // skips over groups of objects with count 0
-// takes a callback function to be called on the objects, and another to be called per object group.
+// takes a callback function to be called on the objects, along with the
+// virtual offset of the group each is in (or -1 if the group can't be sought
+// to), and another to be called per object group.
 
 template <typename T>
-void for_each(std::istream& in,
-              const std::function<void(T&)>& lambda,
-              const std::function<void(uint64_t)>& handle_count) {
+void for_each_with_group_offsets(std::istream& in,
+                                 const std::function<void(int64_t, T&)>& lambda,
+                                 const std::function<void(uint64_t)>& handle_count) {
 
-    ::google::protobuf::io::IstreamInputStream raw_in(&in);
-    ::google::protobuf::io::GzipInputStream gzip_in(&raw_in);
-    ::google::protobuf::io::CodedInputStream coded_in(&gzip_in);
+    BlockedGzipInputStream bgzip_in(in);
+    // Where does the group we are reading start?
+    int64_t group_offset = bgzip_in.Tell();
+    ::google::protobuf::io::CodedInputStream coded_in(&bgzip_in);
 
     auto handle = [](bool ok) {
         if (!ok) {
@@ -185,7 +223,7 @@ void for_each(std::istream& in,
             // bytes-ever-read counter, because it thinks it's reading a single
             // message.
             coded_in.~CodedInputStream();
-            new (&coded_in) ::google::protobuf::io::CodedInputStream(&gzip_in);
+            new (&coded_in) ::google::protobuf::io::CodedInputStream(&bgzip_in);
             // Alot space for size, and for reading next chunk's length
             coded_in.SetTotalBytesLimit(MAX_PROTOBUF_SIZE * 2, MAX_PROTOBUF_SIZE * 2);
             
@@ -201,13 +239,34 @@ void for_each(std::istream& in,
                 handle(coded_in.ReadString(&s, msgSize));
                 T object;
                 handle(object.ParseFromString(s));
-                lambda(object);
+                lambda(group_offset, object);
             }
         }
+        
+        // Give back anything the CodedInputStream buffered so we can see where
+        // the next group starts.
+        coded_in.~CodedInputStream();
+        group_offset = bgzip_in.Tell();
+        new (&coded_in) ::google::protobuf::io::CodedInputStream(&bgzip_in);
     }
 }
-    
-    
+
+template <typename T>
+void for_each_with_group_offsets(std::istream& in,
+                                 const std::function<void(int64_t, T&)>& lambda) {
+    std::function<void(uint64_t)> noop = [](uint64_t) { };
+    for_each_with_group_offsets(in, lambda, noop);
+}
+
+template <typename T>
+void for_each(std::istream& in,
+              const std::function<void(T&)>& lambda,
+              const std::function<void(uint64_t)>& handle_count) {
+    std::function<void(int64_t, T&)> ignore_offset = [&lambda](int64_t, T& object) {
+        lambda(object);
+    };
+    for_each_with_group_offsets(in, ignore_offset, handle_count);
+}
 
 template <typename T>
 void for_each(std::istream& in,
@@ -218,153 +277,373 @@ void for_each(std::istream& in,
 
 // Parallelized versions of for_each
 
+/// Default limit on the bytes of serialized messages that the parallel
+/// readers will hold in memory while they wait for worker threads.
+const size_t PARALLEL_READ_MEMORY_BUDGET = 1024 * 1024 * 1024;
+
+/// How much compressed data each parallel decompression task handles
+const size_t PARALLEL_READ_CHUNK_SIZE = 1024 * 1024;
+
+/// A serialized message found by a MessageFramer. The message bytes live in a
+/// shared buffer, which the message keeps alive.
+struct FramedMessage {
+    const char* data;
+    size_t length;
+    std::shared_ptr<const std::string> owner;
+};
+
+/**
+ * Splits decompressed stream data into serialized messages, following the
+ * group count and message length prefixes that stream::write produces. Data
+ * can be fed in arbitrary pieces, and messages that lie entirely within one
+ * piece are not copied.
+ */
+class MessageFramer {
+public:
+    
+    /// Frame the next piece of data, appending any messages completed to
+    /// framed and calling handle_count on each group count read.
+    void feed(const std::shared_ptr<const std::string>& piece,
+              std::vector<FramedMessage>& framed,
+              const std::function<void(uint64_t)>& handle_count) {
+        
+        const char* cursor = piece->data();
+        const char* end = cursor + piece->size();
+        
+        while (cursor < end) {
+            if (state == BODY) {
+                size_t available = end - cursor;
+                if (partial == nullptr && available >= message_size) {
+                    // The whole message is here
+                    framed.push_back(FramedMessage{cursor, message_size, piece});
+                    cursor += message_size;
+                    finish_message();
+                } else {
+                    // The message spans pieces, so we have to copy it
+                    if (partial == nullptr) {
+                        partial = std::make_shared<std::string>();
+                        partial->reserve(message_size);
+                    }
+                    size_t wanted = std::min(available, message_size - partial->size());
+                    partial->append(cursor, wanted);
+                    cursor += wanted;
+                    if (partial->size() == message_size) {
+                        framed.push_back(FramedMessage{partial->data(), message_size, partial});
+                        partial.reset();
+                        finish_message();
+                    }
+                }
+            } else {
+                // Decode a varint a byte at a time, so it can span pieces
+                unsigned char byte = *cursor;
+                ++cursor;
+                if (shift >= 64) {
+                    throw std::runtime_error("[stream::for_each] obsolete, invalid, or corrupt protobuf input");
+                }
+                varint |= (uint64_t) (byte & 0x7f) << shift;
+                shift += 7;
+                if (byte & 0x80) {
+                    // More bytes to come
+                    continue;
+                }
+                
+                uint64_t value = varint;
+                varint = 0;
+                shift = 0;
+                
+                if (state == COUNT) {
+                    handle_count(value);
+                    group_remaining = value;
+                    state = group_remaining ? SIZE : COUNT;
+                } else {
+                    if (value > MAX_PROTOBUF_SIZE) {
+                        throw std::runtime_error("[stream::for_each] protobuf message of " +
+                            std::to_string(value) + " bytes is too long");
+                    }
+                    message_size = value;
+                    if (message_size) {
+                        state = BODY;
+                    } else {
+                        // Empty messages are skipped
+                        finish_message();
+                    }
+                }
+            }
+        }
+    }
+    
+    /// Throw if the data ended partway through a group.
+    void finish() {
+        if (state != COUNT || shift != 0) {
+            throw std::runtime_error("[stream::for_each] obsolete, invalid, or corrupt protobuf input");
+        }
+    }
+    
+private:
+    
+    /// Note that a message has been read.
+    inline void finish_message() {
+        group_remaining--;
+        state = group_remaining ? SIZE : COUNT;
+    }
+    
+    /// What are we reading next?
+    enum {COUNT, SIZE, BODY} state = COUNT;
+    
+    /// Value of the varint being decoded
+    uint64_t varint = 0;
+    /// Bits of the varint decoded so far
+    int shift = 0;
+    
+    /// Messages left to read in the current group
+    uint64_t group_remaining = 0;
+    /// Length of the message being read
+    size_t message_size = 0;
+    /// Copy of the part of the message being read that we have seen, if it
+    /// spans pieces
+    std::shared_ptr<std::string> partial;
+};
+
+/// A run of BGZF blocks, being decompressed by whichever thread gets to it
+/// first.
+struct DecompressionChunk {
+    /// The compressed blocks
+    std::string compressed;
+    /// The decompressed data
+    std::shared_ptr<const std::string> data;
+    /// Set when a thread takes on the decompression
+    bool claimed = false;
+    /// Set when data is filled in
+    bool ready = false;
+    /// Protects claimed, ready and data
+    std::mutex mutex;
+    /// Signalled when ready is set
+    std::condition_variable ready_cv;
+    
+    /// Decompress the chunk, unless another thread already has. Returns true
+    /// if this thread did the work.
+    bool decompress() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (claimed) {
+                return false;
+            }
+            claimed = true;
+        }
+        
+        std::shared_ptr<std::string> decompressed = std::make_shared<std::string>();
+        BlockedGzipInputStream::InflateBlocks(compressed, *decompressed);
+        std::string().swap(compressed);
+        
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            data = decompressed;
+            ready = true;
+        }
+        ready_cv.notify_all();
+        return true;
+    }
+    
+    /// Get the decompressed data, decompressing it here or sleeping until
+    /// another thread finishes it if necessary.
+    std::shared_ptr<const std::string> wait() {
+        if (!decompress()) {
+            // Someone else is working on it, and will wake us when it's done.
+            std::unique_lock<std::mutex> lock(mutex);
+            ready_cv.wait(lock, [&]() { return ready; });
+        }
+        return data;
+    }
+};
+
+/**
+ * Reads the serialized messages of a stream in order. Used inside an OpenMP
+ * parallel region, it keeps runs of BGZF blocks ahead of the reader
+ * decompressing in tasks, and the reader only splits the decompressed data
+ * into messages, without copying them. Data that isn't BGZF is decompressed
+ * on the reading thread.
+ */
+class MessageReader {
+public:
+    
+    /// Read from the given stream, calling handle_count on each group count
+    /// read. Decompression only runs ahead while read_ahead returns true.
+    MessageReader(std::istream& in,
+                  const std::function<void(uint64_t)>& handle_count = [](uint64_t) {},
+                  const std::function<bool(void)>& read_ahead = []() { return true; }) :
+                  bgzip_in(in), handle_count(handle_count), read_ahead(read_ahead) {
+        // nothing to do
+    }
+    
+    /// Get the next message, or return false at the end of the stream. Throws
+    /// if the stream ends partway through a group.
+    bool next(FramedMessage& message) {
+        while (next_framed == framed.size()) {
+            framed.clear();
+            next_framed = 0;
+            std::shared_ptr<const std::string> piece = next_piece();
+            if (!piece) {
+                framer.finish();
+                return false;
+            }
+            framer.feed(piece, framed, handle_count);
+        }
+        message = std::move(framed[next_framed++]);
+        return true;
+    }
+    
+private:
+    
+    /// Get the next piece of decompressed data, in order, or null at the end.
+    std::shared_ptr<const std::string> next_piece() {
+        // Keep decompression running ahead of us, if the data is BGZF, with a
+        // couple of decompression tasks per thread
+        while (chunks.size() < 2 * (size_t) omp_get_num_threads() && read_ahead()) {
+            std::shared_ptr<DecompressionChunk> chunk = std::make_shared<DecompressionChunk>();
+            if (!bgzip_in.ReadRawBlocks(chunk->compressed, PARALLEL_READ_CHUNK_SIZE)) {
+                break;
+            }
+            chunks.push_back(chunk);
+#pragma omp task firstprivate(chunk)
+            chunk->decompress();
+        }
+        
+        if (!chunks.empty()) {
+            std::shared_ptr<const std::string> piece = chunks.front()->wait();
+            chunks.pop_front();
+            return piece;
+        }
+        
+        // There are no BGZF blocks to hand out, so we are either at the end or
+        // need to decompress here.
+        const void* data;
+        int size;
+        if (!bgzip_in.Next(&data, &size)) {
+            return nullptr;
+        }
+        return std::make_shared<std::string>((const char*) data, size);
+    }
+    
+    BlockedGzipInputStream bgzip_in;
+    MessageFramer framer;
+    std::function<void(uint64_t)> handle_count;
+    std::function<bool(void)> read_ahead;
+    /// Runs of blocks being decompressed, in file order
+    std::deque<std::shared_ptr<DecompressionChunk>> chunks;
+    /// Messages framed but not handed out yet
+    std::vector<FramedMessage> framed;
+    size_t next_framed = 0;
+};
+
 // First, an internal implementation underlying several variants below.
 // lambda2 is invoked on interleaved pairs of elements from the stream. The
 // elements of each pair are in order, but the overall order in which lambda2
 // is invoked on pairs is undefined (concurrent). lambda1 is invoked on an odd
 // last element of the stream, if any.
+//
+// Reading is a pipeline: a MessageReader decompresses runs of BGZF blocks in
+// tasks ahead of the reader and splits them into messages in order, and batches
+// of messages are parsed in tasks. Once memory_budget bytes of messages are
+// waiting for workers, the reader stops decompressing ahead and parses batches
+// itself.
 template <typename T>
 void for_each_parallel_impl(std::istream& in,
                             const std::function<void(T&,T&)>& lambda2,
                             const std::function<void(T&)>& lambda1,
                             const std::function<void(uint64_t)>& handle_count,
-                            const std::function<bool(void)>& single_threaded_until_true) {
-
-    // objects will be handed off to worker threads in batches of this many
-    const uint64_t batch_size = 256;
-    static_assert(batch_size % 2 == 0, "stream::for_each_parallel::batch_size must be even");
-    // max # of such batches to be holding in memory
-    uint64_t max_batches_outstanding = 256;
-    // max # we will ever increase the batch buffer to
-    const uint64_t max_max_batches_outstanding = 1 << 13; // 8192
-    // number of batches currently being processed
-    uint64_t batches_outstanding = 0;
+                            const std::function<bool(void)>& single_threaded_until_true,
+                            size_t memory_budget = PARALLEL_READ_MEMORY_BUDGET) {
+
+    // bytes of messages currently waiting in batches or being processed
+    size_t bytes_outstanding = 0;
 
     // this loop handles a chunked file with many pieces
     // such as we might write in a multithreaded process
-    #pragma omp parallel default(none) shared(in, lambda1, lambda2, handle_count, batches_outstanding, max_batches_outstanding, single_threaded_until_true)
+    #pragma omp parallel default(none) shared(in, lambda1, lambda2, handle_count, bytes_outstanding, memory_budget, single_threaded_until_true)
     #pragma omp single
     {
+        // objects will be handed off to worker threads in batches of this many
+        const size_t batch_size = 256;
+        static_assert(batch_size % 2 == 0, "stream::for_each_parallel::batch_size must be even");
+    
         auto handle = [](bool retval) -> void {
             if (!retval) throw std::runtime_error("obsolete, invalid, or corrupt protobuf input");
         };
-
-        ::google::protobuf::io::IstreamInputStream raw_in(&in);
-        ::google::protobuf::io::GzipInputStream gzip_in(&raw_in);
-        ::google::protobuf::io::CodedInputStream coded_in(&gzip_in);
-
-        std::vector<std::string> *batch = nullptr;
         
-        // process chunks prefixed by message count
-        uint64_t count;
-        while (coded_in.ReadVarint64((::google::protobuf::uint64*) &count)) {
-            handle_count(count);
-            for (uint64_t i = 0; i < count; ++i) {
-                if (!batch) {
-                     batch = new std::vector<std::string>();
-                     batch->reserve(batch_size);
-                }
-                
-                // Reconstruct the CodedInputStream in place to reset its maximum-
-                // bytes-ever-read counter, because it thinks it's reading a single
-                // message.
-                coded_in.~CodedInputStream();
-                new (&coded_in) ::google::protobuf::io::CodedInputStream(&gzip_in);
-                // Allot space for size, and for reading next chunk's length
-                coded_in.SetTotalBytesLimit(MAX_PROTOBUF_SIZE * 2, MAX_PROTOBUF_SIZE * 2);
-                
-                uint32_t msgSize = 0;
-                // the messages are prefixed by their size
-                handle(coded_in.ReadVarint32(&msgSize));
-                
-                if (msgSize > MAX_PROTOBUF_SIZE) {
-                    throw std::runtime_error("[stream::for_each] protobuf message of " +
-                        std::to_string(msgSize) + " bytes is too long");
+        // Parse the messages in a batch and invoke the lambdas on them, then
+        // dispose of the batch.
+        auto process_batch = [&](std::vector<FramedMessage>* batch) {
+            {
+                T obj1, obj2;
+                size_t i = 0;
+                for (; i + 1 < batch->size(); i += 2) {
+                    // parse protobuf objects and invoke lambda on the pair
+                    handle(obj1.ParseFromArray(batch->at(i).data, batch->at(i).length));
+                    handle(obj2.ParseFromArray(batch->at(i+1).data, batch->at(i+1).length));
+                    lambda2(obj1, obj2);
                 }
-                
-                if (msgSize) {
-                    // pick off the message (serialized protobuf object)
-                    std::string s;
-                    handle(coded_in.ReadString(&s, msgSize));
-                    batch->push_back(std::move(s));
+                if (i < batch->size()) {
+                    // odd last object
+                    handle(obj1.ParseFromArray(batch->at(i).data, batch->at(i).length));
+                    lambda1(obj1);
                 }
+            } // scope obj1 & obj2
+            delete batch;
+        };
 
-                if (batch->size() == batch_size) {
-                    // time to enqueue this batch for processing. first, block if
-                    // we've hit max_batches_outstanding.
-                    uint64_t b;
-#pragma omp atomic capture
-                    b = ++batches_outstanding;
-                    
-                    bool do_single_threaded = !single_threaded_until_true();
-                    if (b >= max_batches_outstanding || do_single_threaded) {
-                        
-                        // process this batch in the current thread
-                        {
-                            T obj1, obj2;
-                            for (int i = 0; i<batch_size; i+=2) {
-                                // parse protobuf objects and invoke lambda on the pair
-                                handle(obj1.ParseFromString(batch->at(i)));
-                                handle(obj2.ParseFromString(batch->at(i+1)));
-                                lambda2(obj1,obj2);
-                            }
-                        } // scope obj1 & obj2
-                        delete batch;
+        // Don't read ahead while the workers are swamped
+        MessageReader reader(in, handle_count, [&]() {
+            size_t b;
+#pragma omp atomic read
+            b = bytes_outstanding;
+            return b < memory_budget;
+        });
+        
+        std::vector<FramedMessage>* batch = nullptr;
+        size_t batch_bytes = 0;
+        
+        FramedMessage message;
+        while (reader.next(message)) {
+            if (!batch) {
+                 batch = new std::vector<FramedMessage>();
+                 batch->reserve(batch_size);
+                 batch_bytes = 0;
+            }
+            batch_bytes += message.length;
+            batch->push_back(std::move(message));
+            
+            if (batch->size() == batch_size) {
+                // time to enqueue this batch for processing. first, check
+                // if we've hit our memory budget.
+                size_t b;
 #pragma omp atomic capture
-                        b = --batches_outstanding;
-                        
-                        if (4 * b / 3 < max_batches_outstanding
-                            && max_batches_outstanding < max_max_batches_outstanding
-                            && !do_single_threaded) {
-                            // we went through at least 1/4 of the batch buffer while we were doing this thread's batch
-                            // this looks risky, since we want the batch buffer to stay populated the entire time we're
-                            // occupying this thread on compute, so let's increase the batch buffer size
-                            // (skip this adjustment if you're in single-threaded mode and thus expect the buffer to be
-                            // empty)
-                            max_batches_outstanding *= 2;
-                        }
-                    }
-                    else {
-                        // spawn a task in another thread to process this batch
-#pragma omp task default(none) firstprivate(batch) shared(batches_outstanding, lambda2, handle, single_threaded_until_true)
-                        {
-                            {
-                                T obj1, obj2;
-                                for (int i = 0; i<batch_size; i+=2) {
-                                    // parse protobuf objects and invoke lambda on the pair
-                                    handle(obj1.ParseFromString(batch->at(i)));
-                                    handle(obj2.ParseFromString(batch->at(i+1)));
-                                    lambda2(obj1,obj2);
-                                }
-                            } // scope obj1 & obj2
-                            delete batch;
+                b = bytes_outstanding += batch_bytes;
+                
+                bool do_single_threaded = !single_threaded_until_true();
+                if (b >= memory_budget || do_single_threaded) {
+                    // process this batch in the current thread
+                    process_batch(batch);
+#pragma omp atomic update
+                    bytes_outstanding -= batch_bytes;
+                }
+                else {
+                    // spawn a task in another thread to process this batch
+#pragma omp task firstprivate(batch, batch_bytes) shared(bytes_outstanding, process_batch)
+                    {
+                        process_batch(batch);
 #pragma omp atomic update
-                            batches_outstanding--;
-                        }
+                        bytes_outstanding -= batch_bytes;
                     }
-
-                    batch = nullptr;
                 }
+
+                batch = nullptr;
             }
         }
 
         #pragma omp taskwait
         // process final batch
         if (batch) {
-            {
-                T obj1, obj2;
-                int i = 0;
-                for (; i < batch->size()-1; i+=2) {
-                    handle(obj1.ParseFromString(batch->at(i)));
-                    handle(obj2.ParseFromString(batch->at(i+1)));
-                    lambda2(obj1, obj2);
-                }
-                if (i == batch->size()-1) { // odd last object
-                    handle(obj1.ParseFromString(batch->at(i)));
-                    lambda1(obj1);
-                }
-            } // scope obj1 & obj2
-            delete batch;
+            process_batch(batch);
         }
     }
 }
@@ -421,9 +700,9 @@ public:
         where(0),
         chunk_count(0),
         chunk_idx(0),
-        raw_in(&in),
-        gzip_in(&raw_in),
-        coded_in(&gzip_in)
+        group_offset(-1),
+        bgzip_in(in),
+        coded_in(&bgzip_in)
     {
         get_next();
     }
@@ -435,8 +714,7 @@ public:
 //        where = other.where;
 //        chunk_count = other.chunk_count;
 //        chunk_idx = other.chunk_idx;
-//        raw_in = other.raw_in;
-//        gzip_in = other.gzip_in;
+//        bgzip_in = other.bgzip_in;
 //        coded_in = other.coded_in;
 //    }
 
@@ -448,6 +726,11 @@ public:
     void get_next() {
         if (chunk_count == chunk_idx) {
             chunk_idx = 0;
+            // Make the CodedInputStream give back what it buffered, so we can
+            // see where the new group starts.
+            coded_in.~CodedInputStream();
+            group_offset = bgzip_in.Tell();
+            new (&coded_in) ::google::protobuf::io::CodedInputStream(&bgzip_in);
             if (!coded_in.ReadVarint64((::google::protobuf::uint64*) &chunk_count)) {
                 // This is the end of the input stream, switch to state that
                 // will match the end constructor
@@ -463,7 +746,7 @@ public:
         // bytes-ever-read counter, because it thinks it's reading a single
         // message.
         coded_in.~CodedInputStream();
-        new (&coded_in) ::google::protobuf::io::CodedInputStream(&gzip_in);
+        new (&coded_in) ::google::protobuf::io::CodedInputStream(&bgzip_in);
         // Alot space for size, and for reading next chunk's length
         coded_in.SetTotalBytesLimit(MAX_PROTOBUF_SIZE * 2, MAX_PROTOBUF_SIZE * 2);
         
@@ -498,6 +781,36 @@ public:
         return value;
     }
     
+    /// Move the current item out of the iterator, instead of copying it. The
+    /// iterator must be advanced with get_next() before being dereferenced
+    /// again.
+    inline T take() {
+        return std::move(value);
+    }
+    
+    /// Get the virtual offset of the group containing the current item, or -1
+    /// if it can't be sought to.
+    inline int64_t tell_group() {
+        return group_offset;
+    }
+    
+    /// Go to the group at the given virtual offset, and load its first item.
+    /// Returns false if the stream can't seek.
+    bool seek_group(int64_t virtual_offset) {
+        coded_in.~CodedInputStream();
+        bool sought = bgzip_in.Seek(virtual_offset);
+        new (&coded_in) ::google::protobuf::io::CodedInputStream(&bgzip_in);
+        if (!sought) {
+            return false;
+        }
+        
+        // Start reading a new group
+        chunk_count = 0;
+        chunk_idx = 0;
+        get_next();
+        return true;
+    }
+    
 private:
     
     T value;
@@ -508,8 +821,10 @@ private:
     uint64_t chunk_count;
     uint64_t chunk_idx;
     
-    ::google::protobuf::io::IstreamInputStream raw_in;
-    ::google::protobuf::io::GzipInputStream gzip_in;
+    // Virtual offset of the current group
+    int64_t group_offset;
+    
+    BlockedGzipInputStream bgzip_in;
     ::google::protobuf::io::CodedInputStream coded_in;
     
     void handle(bool ok) {
@@ -16,6 +16,8 @@
 
 #include "../vg.hpp"
 #include "../xg.hpp"
+#include "../gssw_aligner.hpp"
+#include "../score_kernels.hpp"
 #include "../algorithms/extract_connecting_graph.hpp"
 #include "../algorithms/topological_sort.hpp"
 #include "../algorithms/weakly_connected_components.hpp"
@@ -167,6 +169,62 @@ int main_benchmark(int argc, char** argv) {
     
     }));
     
+    // Make a read with qualities, and a lot of overlapping MEM-like intervals along it to score
+    string read_sequence;
+    string read_quality;
+    for (size_t i = 0; i < 150; i++) {
+        bits = bits ^ (bits << 13) ^ i;
+        read_sequence.push_back("ACGTACGTACGTACGN"[bits % 16]);
+        read_quality.push_back((char) (bits % 41));
+    }
+    vector<pair<size_t, size_t>> intervals;
+    for (size_t i = 0; i + 20 <= read_sequence.size(); i += 5) {
+        intervals.emplace_back(i, 20 + (i % 60));
+        if (intervals.back().first + intervals.back().second > read_sequence.size()) {
+            intervals.back().second = read_sequence.size() - intervals.back().first;
+        }
+    }
+    QualAdjAligner qual_adj_aligner;
+    
+    // Work out the right total up front, so each benchmark can check its own
+    // total whatever order they run in
+    int32_t expected_total = 0;
+    for (auto& interval : intervals) {
+        auto seq_begin = read_sequence.begin() + interval.first;
+        expected_total += qual_adj_aligner.score_exact_match(seq_begin, seq_begin + interval.second,
+                                                             read_quality.begin() + interval.first);
+    }
+    expected_total *= 10;
+    
+    results.push_back(run_benchmark("QualAdjAligner::score_exact_match on strings", 1000, [&]() {
+        int32_t loop_total = 0;
+        for (size_t rep = 0; rep < 10; rep++) {
+            for (auto& interval : intervals) {
+                auto seq_begin = read_sequence.begin() + interval.first;
+                loop_total += qual_adj_aligner.score_exact_match(seq_begin, seq_begin + interval.second,
+                                                                 read_quality.begin() + interval.first);
+            }
+        }
+        assert(loop_total == expected_total);
+    }));
+    
+    for (bool simd : {true, false}) {
+        set_score_kernel_simd(simd);
+        results.push_back(run_benchmark(string("QualAdjAligner::score_exact_match on packed reads (")
+                                        + score_kernel_simd_name() + ")", 1000, [&]() {
+            int32_t packed_total = 0;
+            for (size_t rep = 0; rep < 10; rep++) {
+                // packing is part of the cost
+                PackedRead packed_read(read_sequence, read_quality);
+                for (auto& interval : intervals) {
+                    packed_total += qual_adj_aligner.score_exact_match(packed_read, interval.first, interval.second);
+                }
+            }
+            assert(packed_total == expected_total);
+        }));
+    }
+    set_score_kernel_simd(true);
+    
     // Do the control against itself
     results.push_back(run_benchmark("control", 1000, benchmark_control));
 
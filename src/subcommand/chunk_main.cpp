@@ -16,6 +16,7 @@
 #include "../stream.hpp"
 #include "../utility.hpp"
 #include "../chunker.hpp"
+#include "../gam_index.hpp"
 #include "../region.hpp"
 #include "../haplotype_extracter.hpp"
 
@@ -40,6 +41,7 @@ void help_chunk(char** argv) {
          << "    -x, --xg-name FILE       use this xg index to chunk subgraphs" << endl
          << "    -G, --gbwt-name FILE     use this GBWT haplotype index for haplotype extraction" << endl
          << "    -a, --gam-index FILE     chunk this gam index (made with vg index -a) instead of the graph" << endl
+         << "                             (or a sorted gam with a FILE.gai index made with vg gamsort -i)" << endl
          << "    -g, --gam-and-graph      when used in combination with -a, both gam and graph will be chunked" << endl 
          << "path chunking:" << endl
          << "    -p, --path TARGET        write the chunk in the specified (0-based inclusive)\n"
@@ -309,8 +311,17 @@ int main_chunk(int argc, char** argv) {
 
     // This holds the RocksDB index that has all our reads, indexed by the nodes they visit.
     Index gam_index; 
+    // Or this holds the index for a sorted GAM, if we have one of those.
+    unique_ptr<GAMIndex> sorted_gam_index;
     if (chunk_gam) {
-        gam_index.open_read_only(gam_file);
+        ifstream sorted_gam_index_stream(gam_file + ".gai");
+        if (sorted_gam_index_stream) {
+            // All positions are always searched in a sorted GAM, so -A doesn't matter.
+            sorted_gam_index = unique_ptr<GAMIndex>(new GAMIndex());
+            sorted_gam_index->load(sorted_gam_index_stream);
+        } else {
+            gam_index.open_read_only(gam_file);
+        }
     }
     // Read the gam file directly if just splitting into simple chunks
     ifstream gam_stream;
@@ -557,7 +568,23 @@ int main_chunk(int argc, char** argv) {
                 cerr << "error[vg chunk]: can't open output gam file " << gam_name << endl;
                 exit(1);
             }
-            if (subgraph != NULL) {
+            if (sorted_gam_index.get() != nullptr) {
+                // Each thread reads the sorted GAM through its own stream
+                ifstream sorted_gam(gam_file);
+                if (!sorted_gam) {
+                    cerr << "error[vg chunk]: unable to open input gam: " << gam_file << endl;
+                    exit(1);
+                }
+                if (subgraph != NULL) {
+                    chunker.extract_gam_for_subgraph(*subgraph, *sorted_gam_index, sorted_gam, &out_gam_file,
+                                                     fully_contained);
+                } else {
+                    assert(id_range == true);
+                    vector<vg::id_t> region_id_range = {region.start, region.end};
+                    chunker.extract_gam_for_ids(region_id_range, *sorted_gam_index, sorted_gam, &out_gam_file,
+                                                true, fully_contained);
+                }
+            } else if (subgraph != NULL) {
                 chunker.extract_gam_for_subgraph(*subgraph, gam_index, &out_gam_file,
                                                  fully_contained, search_all_positions);
             } else {
@@ -11,6 +11,7 @@
 #include "../constructor.hpp"
 #include "../msa_converter.hpp"
 #include "../region.hpp"
+#include "../xg.hpp"
 
 using namespace std;
 using namespace vg;
@@ -41,6 +42,10 @@ void help_construct(char** argv) {
          << "    -m, --node-max N       limit the maximum allowable node sequence size (defaults to 1000)" << endl
          << "                           nodes greater than this threshold will be divided" << endl
          << "                           Note: nodes larger than ~1024 bp can't be GCSA2-indexed" << endl
+         << "    -x, --xg-out FILE      build an xg index directly and write it to FILE, instead of writing" << endl
+         << "                           the graph to standard output" << endl
+         << "    -X, --xg-memory N      with -x, hold about N MB of the graph in memory while indexing," << endl
+         << "                           spilling the rest to temp files (default: hold it all in memory)" << endl
          << "    -p, --progress         show progress" << endl;
 
 }
@@ -66,6 +71,8 @@ int main_construct(int argc, char** argv) {
     bool keep_paths = true;
     string msa_format = "fasta";
     bool show_progress = false;
+    string xg_name;
+    size_t xg_memory_mb = 0;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -90,11 +97,13 @@ int main_construct(int argc, char** argv) {
                 {"region-is-chrom", no_argument, 0, 'C'},
                 {"node-max", required_argument, 0, 'm'},\
                 {"flat-alts", no_argument, 0, 'f'},
+                {"xg-out", required_argument, 0, 'x'},
+                {"xg-memory", required_argument, 0, 'X'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "v:r:n:ph?z:t:R:m:as:CfSI:M:dF:",
+        c = getopt_long (argc, argv, "v:r:n:ph?z:t:R:m:as:CfSI:M:dF:x:X:",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -181,6 +190,14 @@ int main_construct(int argc, char** argv) {
             constructor.flat = true;
             break;
 
+        case 'x':
+            xg_name = optarg;
+            break;
+
+        case 'X':
+            xg_memory_mb = stoull(optarg);
+            break;
+
         case 'h':
         case '?':
             /* getopt_long already printed an error message. */
@@ -203,6 +220,18 @@ int main_construct(int argc, char** argv) {
         g->serialize_to_ostream(cout);
     };
     
+    // Or, if we are making an xg index, we feed the pieces straight into it.
+    auto build_xg = [&](function<void(function<void(Graph&)>)> get_chunks) {
+        ofstream xg_out(xg_name);
+        if (!xg_out) {
+            cerr << "error:[vg construct] could not open " << xg_name << " for writing" << endl;
+            exit(1);
+        }
+        xg::XG xg_index;
+        xg_index.from_callback(get_chunks, false, false, false, false, xg_memory_mb * 1024 * 1024);
+        xg_index.serialize(xg_out);
+    };
+    
     constructor.max_node_size = max_node_size;
     constructor.show_progress = show_progress;
     
@@ -212,6 +241,11 @@ int main_construct(int argc, char** argv) {
         exit(1);
     }
     
+    if (xg_name.empty() && xg_memory_mb != 0) {
+        cerr << "error:[vg construct] -X can only be used when building an xg index with -x" << endl;
+        exit(1);
+    }
+    
     if (!msa_filename.empty() && !fasta_filenames.empty()) {
         cerr << "error:[vg construct] cannot construct from a reference/VCF and an MSA simultaneously" << endl;
         exit(1);
@@ -318,8 +352,15 @@ int main_construct(int argc, char** argv) {
         }
         
         // Construct the graph.
-        constructor.construct_graph(fasta_pointers, vcf_pointers,
-                                    ins_pointers, callback);
+        if (xg_name.empty()) {
+            constructor.construct_graph(fasta_pointers, vcf_pointers,
+                                        ins_pointers, callback);
+        } else {
+            build_xg([&](function<void(Graph&)> handle_chunk) {
+                constructor.construct_graph(fasta_pointers, vcf_pointers,
+                                            ins_pointers, handle_chunk);
+            });
+        }
         
         // NB: If you worry about "still reachable but possibly lost" warnings in valgrind,
         // this would free all the memory used by protobuf:
@@ -339,7 +380,13 @@ int main_construct(int argc, char** argv) {
         msa_converter.load_alignments(msa_file, msa_format);
         VG msa_graph = msa_converter.make_graph(keep_paths, max_node_size);
         
-        callback(msa_graph.graph);
+        if (xg_name.empty()) {
+            callback(msa_graph.graph);
+        } else {
+            build_xg([&](function<void(Graph&)> handle_chunk) {
+                handle_chunk(msa_graph.graph);
+            });
+        }
     }
     else {
         cerr << "error:[vg construct] a reference or an MSA is required for construct" << endl;
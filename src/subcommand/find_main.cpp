@@ -4,6 +4,7 @@
 #include "../mapper.hpp"
 #include "../stream.hpp"
 #include "../region.hpp"
+#include "../gam_index.hpp"
 
 #include <unistd.h>
 #include <getopt.h>
@@ -30,7 +31,8 @@ void help_find(char** argv) {
          << "    -X, --approx-pos ID    get the approximate position of this node" << endl
          << "    -r, --node-range N:M   get nodes from N to M" << endl
          << "    -G, --gam GAM          accumulate the graph touched by the alignments in the GAM" << endl
-         << "alignments: (rocksdb only)" << endl
+         << "alignments: (rocksdb, or sorted GAM with -l)" << endl
+         << "    -l, --sorted-gam FILE  use this sorted and indexed GAM (from vg gamsort -i) instead of -d for -a, -o and -A" << endl
          << "    -a, --alignments       writes alignments from index, sorted by node id" << endl
          << "    -i, --alns-in N:M      writes alignments whose start nodes is between N and M (inclusive)" << endl
          << "    -o, --alns-on N:M      writes alignments which align to any of the nodes between N and M (inclusive)" << endl
@@ -95,6 +97,7 @@ int main_find(int argc, char** argv) {
     bool pairwise_distance = false;
     string haplotype_alignments;
     string gam_file;
+    string sorted_gam_name;
     int max_mem_length = 0;
     int min_mem_length = 1;
     string to_graph_file;
@@ -148,11 +151,12 @@ int main_find(int argc, char** argv) {
                 {"paths-named", required_argument, 0, 'Q'},
                 {"approx-pos", required_argument, 0, 'X'},
                 {"list-paths", no_argument, 0, 'I'},
+                {"sorted-gam", required_argument, 0, 'l'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "d:x:n:e:s:o:k:hc:LS:z:j:CTp:P:r:amg:M:R:B:fi:DH:G:N:A:Y:Z:tq:X:IQ:",
+        c = getopt_long (argc, argv, "d:x:n:e:s:o:k:hc:LS:z:j:CTp:P:r:amg:M:R:B:fi:DH:G:N:A:Y:Z:tq:X:IQ:l:",
                          long_options, &option_index);
 
         // Detect the end of the options.
@@ -264,6 +268,10 @@ int main_find(int argc, char** argv) {
             get_alignments = true;
             break;
 
+        case 'l':
+            sorted_gam_name = optarg;
+            break;
+
         case 'i':
             node_id_range = optarg;
             break;
@@ -329,10 +337,15 @@ int main_find(int argc, char** argv) {
         return 1;
     }
 
-    if (db_name.empty() && gcsa_in.empty() && xg_name.empty()) {
-        cerr << "[vg find] find requires -d, -g, or -x to know where to find its database" << endl;
+    if (db_name.empty() && gcsa_in.empty() && xg_name.empty() && sorted_gam_name.empty()) {
+        cerr << "[vg find] find requires -d, -g, -x, or -l to know where to find its database" << endl;
         return 1;
     }
+    
+    if (!sorted_gam_name.empty() && !node_id_range.empty()) {
+        cerr << "[vg find] error, -i is not supported with -l; use -o" << endl;
+        exit(1);
+    }
 
     if (context_size > 0 && use_length == true && xg_name.empty()) {
         cerr << "[vg find] error, -L not supported without -x" << endl;
@@ -376,7 +389,48 @@ int main_find(int argc, char** argv) {
         xindex.load(in);
     }
 
-    if (get_alignments) {
+    // Load the index for the sorted GAM, if we are using one
+    GAMIndex gam_index;
+    ifstream sorted_gam;
+    if (!sorted_gam_name.empty()) {
+        sorted_gam.open(sorted_gam_name);
+        if (!sorted_gam) {
+            cerr << "[vg find] error, unable to open sorted GAM " << sorted_gam_name << endl;
+            exit(1);
+        }
+        ifstream index_in(sorted_gam_name + ".gai");
+        if (!index_in) {
+            cerr << "[vg find] error, unable to open GAM index " << sorted_gam_name << ".gai; "
+                 << "index the sorted GAM with vg gamsort -i" << endl;
+            exit(1);
+        }
+        gam_index.load(index_in);
+    }
+    
+    // Write out the alignments in the sorted GAM touching the given node ID ranges
+    auto find_in_sorted_gam = [&](const vector<pair<vg::id_t, vg::id_t>>& ranges) {
+        vector<Alignment> output_buf;
+        // Start from the top of the file, in case we have read it already
+        sorted_gam.clear();
+        sorted_gam.seekg(0);
+        stream::ProtobufIterator<Alignment> cursor(sorted_gam);
+        gam_index.find(cursor, ranges, [&output_buf](const Alignment& aln) {
+            output_buf.push_back(aln);
+            stream::write_buffered(cout, output_buf, 100);
+        });
+        stream::write_buffered(cout, output_buf, 0);
+    };
+
+    if (get_alignments && !sorted_gam_name.empty()) {
+        // The sorted GAM is already in node ID order
+        vector<Alignment> output_buf;
+        function<void(Alignment&)> lambda = [&output_buf](Alignment& aln) {
+            output_buf.push_back(aln);
+            stream::write_buffered(cout, output_buf, 100);
+        };
+        stream::for_each(sorted_gam, lambda);
+        stream::write_buffered(cout, output_buf, 0);
+    } else if (get_alignments) {
         assert(!db_name.empty());
         vector<Alignment> output_buf;
         auto lambda = [&output_buf](const Alignment& aln) {
@@ -406,7 +460,17 @@ int main_find(int argc, char** argv) {
         stream::write_buffered(cout, output_buf, 0);
     }
 
-    if (!aln_on_id_range.empty()) {
+    if (!aln_on_id_range.empty() && !sorted_gam_name.empty()) {
+        vector<string> parts = split_delims(aln_on_id_range, ":");
+        if (parts.size() == 1) {
+            convert(parts.front(), start_id);
+            end_id = start_id;
+        } else {
+            convert(parts.front(), start_id);
+            convert(parts.back(), end_id);
+        }
+        find_in_sorted_gam({make_pair(start_id, end_id)});
+    } else if (!aln_on_id_range.empty()) {
         assert(!db_name.empty());
         vector<string> parts = split_delims(aln_on_id_range, ":");
         if (parts.size() == 1) {
@@ -429,7 +493,13 @@ int main_find(int argc, char** argv) {
         stream::write_buffered(cout, output_buf, 0);
     }
 
-    if (!to_graph_file.empty()) {
+    if (!to_graph_file.empty() && !sorted_gam_name.empty()) {
+        ifstream tgi(to_graph_file);
+        VG graph(tgi);
+        vector<pair<vg::id_t, vg::id_t>> ranges;
+        graph.for_each_node([&](Node* n) { ranges.emplace_back(n->id(), n->id()); });
+        find_in_sorted_gam(ranges);
+    } else if (!to_graph_file.empty()) {
         assert(vindex != nullptr);
         ifstream tgi(to_graph_file);
         VG graph(tgi);
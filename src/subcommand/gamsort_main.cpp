@@ -3,6 +3,8 @@
 #include <getopt.h>
 #include "subcommand.hpp"
 #include "index.hpp"
+#include "utility.hpp"
+#include <omp.h>
 #include "stream.hpp"
 
 /**
@@ -18,9 +20,13 @@ void help_gamsort(char **argv)
          << "Usage: " << argv[1] << " [Options] gamfile" << endl
          << "Options:" << endl
          << "  -p / --paired           Index a paired-end GAM." << endl
-         << "  -s / --sorted           Input GAM is already sorted." << endl
-         << "  -i / --index <INDEX>    produce a node-to-alignment index" << endl
+         << "  -s / --sorted           Input GAM is already sorted; don't sort it again." << endl
+         << "  -i / --index            produce a node-to-alignment index (.gai) of the sorted GAM" << endl
          << "  -d / --dumb-sort        use naive sorting algorithm (no tmp files, faster for small GAMs)" << endl
+         << "  -m / --memory N         buffer about N MB of serialized reads in memory [1024]" << endl
+         << "  -b / --temp-dir DIR     use DIR for temporary files" << endl
+         << "  -t / --threads N        sort runs of reads in N threads" << endl
+         << "  -P / --progress         report progress on standard error" << endl
          << "  -r / --rocks            Just use the old RocksDB-style indexing scheme for sorting." << endl
          << "  -a / --aln-index        Create the old RocksDB-style node-to-alignment index." << endl
          << endl;
@@ -35,21 +41,27 @@ int main_gamsort(int argc, char **argv)
     bool is_sorted = false;
     bool just_use_rocks = false;
     bool do_aln_index = false;
+    size_t max_buffer_mb = 1024;
+    bool show_progress = false;
     int c;
     optind = 2; // force optind past command positional argument
     while (true)
     {
         static struct option long_options[] =
             {
-                {"index", required_argument, 0, 'i'},
+                {"index", no_argument, 0, 'i'},
                 {"dumb-sort", no_argument, 0, 'd'},
                 {"paired", no_argument, 0, 'p'},
                 {"rocks", no_argument, 0, 'r'},
                 {"aln-index", no_argument, 0, 'a'},
                 {"is-sorted", no_argument, 0, 's'},
+                {"memory", required_argument, 0, 'm'},
+                {"temp-dir", required_argument, 0, 'b'},
+                {"threads", required_argument, 0, 't'},
+                {"progress", no_argument, 0, 'P'},
                 {0, 0, 0, 0}};
         int option_index = 0;
-        c = getopt_long(argc, argv, "idhraps",
+        c = getopt_long(argc, argv, "idhrapsm:b:t:P",
                         long_options, &option_index);
 
         // Detect the end of the options.
@@ -76,6 +88,18 @@ int main_gamsort(int argc, char **argv)
         case 'p':
             is_paired = true;
             break;
+        case 'm':
+            max_buffer_mb = stoull(optarg);
+            break;
+        case 'b':
+            temp_file::set_dir(optarg);
+            break;
+        case 't':
+            omp_set_num_threads(atoi(optarg));
+            break;
+        case 'P':
+            show_progress = true;
+            break;
         case 'h':
         case '?':
         default:
@@ -92,7 +116,7 @@ int main_gamsort(int argc, char **argv)
 
     gamfile = argv[optind];
 
-    GAMSorter gs;
+    GAMSorter gs(max_buffer_mb * 1024 * 1024, show_progress);
 
     if (just_use_rocks && !do_index)
     {
@@ -124,7 +148,11 @@ int main_gamsort(int argc, char **argv)
         index.close();
     }
 
-    if (dumb_sort)
+    if (is_sorted)
+    {
+        // Nothing to do
+    }
+    else if (dumb_sort)
     {
         gs.dumb_sort(gamfile);
     }
@@ -132,6 +160,7 @@ int main_gamsort(int argc, char **argv)
     {
         gs.stream_sort(gamfile);
     }
+    string sorted_gamfile = is_sorted ? gamfile : gamfile + ".sorted.gam";
 
     if (do_index && just_use_rocks)
     {
@@ -161,9 +190,9 @@ int main_gamsort(int argc, char **argv)
     }
     
     else if (do_index){
-        // Write a super simple index file of format
-        // node_d \tab firstAlnLineNumber \tab secondAlnLineNumber ...
-        gs.write_index(gamfile, gamfile + ".gai", false);
+        // Write a GAMIndex of node ID bins to group offsets in the sorted
+        // GAM, for vg find -l and vg chunk -a.
+        gs.write_index(sorted_gamfile, sorted_gamfile + ".gai");
     }
 
     return 1;
@@ -1,4 +1,4 @@
-// index.cpp: define the "vg index" subcommand, which makes xg, GCSA2, GBWT, and RocksDB indexes
+// index.cpp: define the "vg index" subcommand, which makes xg, GCSA2, GBWT, distance, and RocksDB indexes
 
 #include <omp.h>
 #include <unistd.h>
@@ -16,6 +16,8 @@
 #include "../vg_set.hpp"
 #include "../utility.hpp"
 #include "../region.hpp"
+#include "../snarls.hpp"
+#include "../distance_index.hpp"
 
 #include <gcsa/gcsa.h>
 #include <gcsa/algorithms.h>
@@ -37,6 +39,9 @@ void help_index(char** argv) {
          << "xg options:" << endl
          << "    -x, --xg-name FILE     use this file to store a succinct, queryable version of the graph(s)" << endl
          << "    -F, --thread-db FILE   read thread database from FILE (may repeat)" << endl
+         << "distance index options:" << endl
+         << "    -j, --dist-name FILE   store a minimum distance index in FILE (requires -x and -s)" << endl
+         << "    -s, --snarls FILE      build the distance index over the snarls in FILE (from vg snarls)" << endl
          << "gbwt options:" << endl
          << "    -v, --vcf-phasing FILE generate threads from the haplotypes in the VCF file FILE" << endl
          << "    -T, --store-threads    generate threads from the embedded paths" << endl
@@ -57,6 +62,7 @@ void help_index(char** argv) {
          << "    -k, --kmer-size N      index kmers of size N in the graph (default " << gcsa::Key::MAX_LENGTH << ")" << endl
          << "    -X, --doubling-steps N use this number of doubling steps for GCSA2 construction (default " << gcsa::ConstructionParameters::DOUBLING_STEPS << ")" << endl
          << "    -Z, --size-limit N     limit temporary disk space usage to N gigabytes (default " << gcsa::ConstructionParameters::SIZE_LIMIT << ")" << endl
+         << "    -K, --kmer-memory N    hold about N MB of kmers in memory while generating kmer files (default 1024)" << endl
          << "    -V, --verify-index     validate the GCSA2 index using the input kmers (important for testing)" << endl
          << "rocksdb options:" << endl
          << "    -d, --db-name  <X>     store the RocksDB index in <X>" << endl
@@ -124,12 +130,12 @@ int main_index(int argc, char** argv) {
     bool build_xg = false, build_gbwt = false, write_threads = false, build_gpbwt = false, build_gcsa = false, build_rocksdb = false;
 
     // Files we should read.
-    string vcf_name, mapping_name;
+    string vcf_name, mapping_name, snarls_name;
     vector<string> thread_db_names;
     vector<string> dbg_names;
 
     // Files we should write.
-    string xg_name, gbwt_name, threads_name, gcsa_name, rocksdb_name;
+    string xg_name, gbwt_name, threads_name, gcsa_name, rocksdb_name, distance_index_name;
 
     // General
     bool show_progress = false;
@@ -148,6 +154,7 @@ int main_index(int argc, char** argv) {
     gcsa::size_type kmer_size = gcsa::Key::MAX_LENGTH;
     gcsa::ConstructionParameters params;
     bool verify_gcsa = false;
+    size_t kmer_memory_limit = 1024 * 1024 * 1024;
 
     // RocksDB
     bool dump_index = false;
@@ -173,6 +180,10 @@ int main_index(int argc, char** argv) {
             {"xg-name", required_argument, 0, 'x'},
             {"thread-db", required_argument, 0, 'F'},
 
+            // Distance index
+            {"dist-name", required_argument, 0, 'j'},
+            {"snarls", required_argument, 0, 's'},
+
             // GBWT
             {"vcf-phasing", required_argument, 0, 'v'},
             {"store-threads", no_argument, 0, 'T'},
@@ -193,6 +204,7 @@ int main_index(int argc, char** argv) {
             {"kmer-size", required_argument, 0, 'k'},
             {"doubling-steps", required_argument, 0, 'X'},
             {"size-limit", required_argument, 0, 'Z'},
+            {"kmer-memory", required_argument, 0, 'K'},
             {"verify-index", no_argument, 0, 'V'},
 
             // RocksDB
@@ -207,7 +219,7 @@ int main_index(int argc, char** argv) {
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "b:t:px:F:v:TG:H:PB:R:r:I:E:g:i:f:k:X:Z:Vd:maANDP:CM:h",
+        c = getopt_long (argc, argv, "b:t:px:F:j:s:v:TG:H:PB:R:r:I:E:g:i:f:k:X:Z:K:Vd:maANDP:CM:h",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -236,6 +248,14 @@ int main_index(int argc, char** argv) {
             thread_db_names.push_back(optarg);
             break;
 
+        // Distance index
+        case 'j':
+            distance_index_name = optarg;
+            break;
+        case 's':
+            snarls_name = optarg;
+            break;
+
         // GBWT
         case 'v':
             index_haplotypes = true;
@@ -334,6 +354,9 @@ int main_index(int argc, char** argv) {
         case 'Z':
             params.setLimit(std::stoul(optarg));
             break;
+        case 'K':
+            kmer_memory_limit = std::max(std::stoul(optarg), 1ul) * 1024 * 1024;
+            break;
         case 'V':
             verify_gcsa = true;
             break;
@@ -379,11 +402,17 @@ int main_index(int argc, char** argv) {
         file_names.push_back(file_name);
     }
 
-    if (xg_name.empty() && gbwt_name.empty() && threads_name.empty() && gcsa_name.empty() && rocksdb_name.empty()) {
+    if (xg_name.empty() && gbwt_name.empty() && threads_name.empty() && gcsa_name.empty() && rocksdb_name.empty()
+        && distance_index_name.empty()) {
         cerr << "error: [vg index] index type not specified" << endl;
         return 1;
     }
 
+    if (!distance_index_name.empty() && (xg_name.empty() || snarls_name.empty())) {
+        cerr << "error: [vg index] building a distance index requires an xg index (-x) and snarls (-s)" << endl;
+        return 1;
+    }
+
     if ((build_gbwt || write_threads) && !(index_haplotypes || index_paths || index_gam)) {
         cerr << "error: [vg index] cannot build GBWT without threads" << endl;
         return 1;
@@ -788,6 +817,25 @@ int main_index(int argc, char** argv) {
         xg_index->serialize(db_out);
         db_out.close();
     }
+
+    // Build the distance index over the XG
+    if (!distance_index_name.empty()) {
+        ifstream snarl_stream(snarls_name);
+        if (!snarl_stream) {
+            cerr << "error: [vg index] cannot open snarls file " << snarls_name << endl;
+            return 1;
+        }
+        SnarlManager snarl_manager(snarl_stream);
+        if (show_progress) {
+            cerr << "Building distance index..." << endl;
+        }
+        DistanceIndex distance_index(xg_index, &snarl_manager);
+        if (show_progress) {
+            cerr << "Saving distance index to disk..." << endl;
+        }
+        ofstream distance_out(distance_index_name);
+        distance_index.save(distance_out);
+    }
     delete xg_index; xg_index = nullptr;
 
     // Build GCSA
@@ -812,7 +860,13 @@ int main_index(int argc, char** argv) {
             VGset graphs(file_names);
             graphs.show_progress = show_progress;
             size_t kmer_bytes = params.getLimitBytes();
-            dbg_names = graphs.write_gcsa_kmers_binary(kmer_size, kmer_bytes);
+            try {
+                dbg_names = graphs.write_gcsa_kmers_binary(kmer_size, kmer_bytes, 0, 0, kmer_memory_limit);
+            }
+            catch (const runtime_error& e) {
+                cerr << "error: [vg index] " << e.what() << endl;
+                return 1;
+            }
             params.reduceLimit(kmer_bytes);
             delete_kmer_files = true;
         }
@@ -9,6 +9,7 @@
 #include <getopt.h>
 
 #include <iostream>
+#include <sstream>
 
 #include "subcommand.hpp"
 
@@ -38,6 +39,8 @@ void help_kmers(char** argv) {
          << "    -B, --gcsa-binary     Write the GCSA graph in binary format." << endl
          << "    -F, --forward-only    When producing GCSA2 output, don't describe the reverse strand" << endl
          << "    -P, --path-only       Only consider kmers if they occur in a path embedded in the graph" << endl
+         << "    -K, --packed          list only kmers of ACGT and their starting positions, without context," << endl
+         << "                          using the faster 2-bit packed enumerator (requires -k <= 32)" << endl
          << "    -H, --head-id N       use the specified ID for the GCSA2 head sentinel node" << endl
          << "    -T, --tail-id N       use the specified ID for the GCSA2 tail sentinel node" << endl
          << "    -p, --progress        show progress" << endl;
@@ -64,6 +67,7 @@ int main_kmers(int argc, char** argv) {
     bool forward_only = false;
     bool gcsa_binary = false;
     bool handle_alg = false;
+    bool packed = false;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -85,11 +89,12 @@ int main_kmers(int argc, char** argv) {
             {"forward-only", no_argument, 0, 'F'},
             {"gcsa-binary", no_argument, 0, 'B'},
             {"path-only", no_argument, 0, 'P'},
+            {"packed", no_argument, 0, 'K'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hk:j:pt:e:gdnH:T:FBP",
+        c = getopt_long (argc, argv, "hk:j:pt:e:gdnH:T:FBPK",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -128,6 +133,10 @@ int main_kmers(int argc, char** argv) {
                 path_only = true;
                 break;
 
+            case 'K':
+                packed = true;
+                break;
+
             case 'd':
                 allow_dups = false;
                 break;
@@ -186,8 +195,32 @@ int main_kmers(int argc, char** argv) {
             graphs.write_gcsa_kmers_ascii(cout, kmer_size, head_id, tail_id);
         } else {
             size_t limit = ~(size_t)0;
-            graphs.write_gcsa_kmers_binary(cout, kmer_size, limit, head_id, tail_id);
+            try {
+                graphs.write_gcsa_kmers_binary(cout, kmer_size, limit, head_id, tail_id);
+            }
+            catch (const runtime_error& e) {
+                cerr << "error:[vg kmers] " << e.what() << endl;
+                exit(1);
+            }
         }
+    } else if (packed) {
+        if (kmer_size < 1 || kmer_size > 32) {
+            cerr << "error:[vg kmers] Packed kmers (-K) must be between 1 and 32 bases long." << endl;
+            exit(1);
+        }
+        graphs.for_each([&](VG* g) {
+            for_each_packed_kmer(*g, kmer_size, [&](const vector<packed_kmer_t>& batch) {
+                // format the whole batch before taking the lock
+                stringstream formatted;
+                for (auto& kmer : batch) {
+                    pos_t pos = packed_kmer_position(*g, kmer);
+                    formatted << packed_kmer_sequence(kmer.bases, kmer_size) << "\t"
+                              << id(pos) << ":" << (is_rev(pos) ? "-" : "") << offset(pos) << "\n";
+                }
+#pragma omp critical (cout)
+                cout << formatted.str();
+            });
+        });
     } else {
         //function<void(const kmer_t& kmer)>
         auto lambda = [](const kmer_t& kmer) {
@@ -4,6 +4,7 @@
 #include "../mapper.hpp"
 #include "../surjector.hpp"
 #include "../stream.hpp"
+#include "../batch_writer.hpp"
 
 #include <unistd.h>
 #include <getopt.h>
@@ -20,6 +21,8 @@ void help_map(char** argv) {
          << "    -x, --xg-name FILE      use this xg index (defaults to <graph>.vg.xg)" << endl
          << "    -g, --gcsa-name FILE    use this GCSA2 index (defaults to <graph>" << gcsa::GCSA::EXTENSION << ")" << endl
          << "    -1, --gbwt-name FILE    use this GBWT haplotype index (defaults to <graph>"<<gbwt::GBWT::EXTENSION << ")" << endl
+         << "    --dist-index FILE       use this minimum distance index (from vg index -j) for graph distances" << endl
+         << "    --minimizer-index FILE  find seeds with this minimizer index (from vg minimizer) instead of the GCSA2" << endl
          << "algorithm:" << endl
          << "    -t, --threads N         number of compute threads to use" << endl
          << "    -k, --min-mem INT       minimum MEM length (if 0 estimate via -e) [0]" << endl
@@ -33,10 +36,14 @@ void help_map(char** argv) {
          << "    --id-mq-weight N        scale mapping quality by the alignment score identity to this power [2]" << endl
          << "    -W, --min-chain INT     discard a chain if seeded bases shorter than INT [0]" << endl
          << "    -C, --drop-chain FLOAT  drop chains shorter than FLOAT fraction of the longest overlapping chain [0.45]" << endl
+         << "    --sparse-chain          chain MEMs of single reads with sparse dynamic programming over approximate positions" << endl
+         << "                            (paired reads still use the MEMChainModel)" << endl
          << "    -n, --mq-overlap FLOAT  scale MQ by count of alignments with this overlap in the query with the primary [0]" << endl
          << "    -P, --min-ident FLOAT   accept alignment only if the alignment identity is >= FLOAT [0]" << endl
          << "    -H, --max-target-x N    skip cluster subgraphs with length > N*read_length [100]" << endl
          << "    -m, --acyclic-graph     improves runtime when the graph is acyclic" << endl
+         << "    --cache-size INT        cache up to INT decoded nodes, shared between threads (0 for none) [65536]" << endl
+         << "    --mem-cache INT         reuse the MEMs found for up to INT distinct read sequences, for duplicate reads [0]" << endl
          << "    -w, --band-width INT    band width for long read alignment [256]" << endl
          << "    -O, --band-overlap INT  band overlap for long read alignment [{-w}/8]" << endl
          << "    -J, --band-jump INT     the maximum number of bands of insertion we consider in the alignment chain model [128]" << endl
@@ -61,6 +68,7 @@ void help_map(char** argv) {
          << "    --drop-full-l-bonus     remove the full length bonus from the score before sorting and MQ calculation" << endl
          << "    -a, --hap-exp FLOAT     the exponent for haplotype consistency likelihood in alignment score [1]" << endl
          << "    -A, --qual-adjust       perform base quality adjusted alignments (requires base quality input)" << endl
+         << "    --xdrop INT             abandon alignment DP cells that drop this far below the best on their path (0 = off) [0]" << endl
          << "input:" << endl
          << "    -s, --sequence STR      align a string to the graph in graph.vg using partial order alignment" << endl
          << "    -V, --seq-name STR      name the sequence using this value (for graph modification with new named paths)" << endl
@@ -76,6 +84,10 @@ void help_map(char** argv) {
          << "    -j, --output-json       output JSON rather than an alignment stream (helpful for debugging)" << endl
          << "    --surject-to TYPE       surject the output into the graph's paths, writing TYPE := bam |sam | cram" << endl
          << "    --buffer-size INT       buffer this many alignments together before outputting in GAM [512]" << endl
+         << "    --keep-order            write alignments in the same order as the input reads" << endl
+         << "    --stage-stats           report the time spent in each stage of mapping, and the integer" << endl
+         << "                            widths banded alignment needed, on stderr" << endl
+         << "    --annotate-stages       annotate each read with the time spent in each stage of mapping" << endl
          << "    -X, --compare           realign GAM input (-G), writing alignment with \"correct\" field set to overlap with input" << endl
          << "    -v, --refpos-table      for efficient testing output a table of name, chr, pos, mq, score" << endl
          << "    -K, --keep-secondary    produce alignments for secondary input alignments in addition to primary ones" << endl
@@ -93,6 +105,15 @@ int main_map(int argc, char** argv) {
     }
 
     #define OPT_SCORE_MATRIX 1000
+    #define OPT_CACHE_SIZE 1001
+    #define OPT_KEEP_ORDER 1002
+    #define OPT_STAGE_STATS 1003
+    #define OPT_ANNOTATE_STAGES 1004
+    #define OPT_XDROP 1005
+    #define OPT_SPARSE_CHAIN 1006
+    #define OPT_DIST_INDEX 1007
+    #define OPT_MINIMIZER_INDEX 1008
+    #define OPT_MEM_CACHE 1009
     string matrix_file_name;
     string seq;
     string qual;
@@ -101,6 +122,8 @@ int main_map(int argc, char** argv) {
     string xg_name;
     string gcsa_name;
     string gbwt_name;
+    string distance_index_name;
+    string minimizer_index_name;
     string read_file;
     string hts_file;
     string fasta_file;
@@ -133,6 +156,7 @@ int main_map(int argc, char** argv) {
     int8_t gap_open = default_gap_open;
     int8_t gap_extend = default_gap_extension;
     int8_t full_length_bonus = default_full_length_bonus;
+    int xdrop_threshold = 0;
     int unpaired_penalty = 17;
     double haplotype_consistency_exponent = 1;
     bool strip_bonuses = false;
@@ -153,6 +177,7 @@ int main_map(int argc, char** argv) {
     bool fragment_direction = true;
     float chance_match = 5e-4;
     bool use_fast_reseed = true;
+    bool use_sparse_chaining = false;
     float drop_chain = 0.45;
     float mq_overlap = 0.0;
     int kmer_size = 0; // if we set to positive, we'd revert to the old kmer based mapper
@@ -167,6 +192,11 @@ int main_map(int argc, char** argv) {
     bool patch_alignments = true;
     int min_banded_mq = 0;
     int max_sub_mem_recursion_depth = 2;
+    int cache_size = 65536;
+    int mem_cache_size = 0;
+    bool keep_order = false;
+    bool report_stage_stats = false;
+    bool annotate_stage_stats = false;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -212,6 +242,15 @@ int main_map(int argc, char** argv) {
                 {"match", required_argument, 0, 'q'},
                 {"mismatch", required_argument, 0, 'z'},
                 {"score-matrix", required_argument, 0, OPT_SCORE_MATRIX},
+                {"cache-size", required_argument, 0, OPT_CACHE_SIZE},
+                {"mem-cache", required_argument, 0, OPT_MEM_CACHE},
+                {"keep-order", no_argument, 0, OPT_KEEP_ORDER},
+                {"stage-stats", no_argument, 0, OPT_STAGE_STATS},
+                {"annotate-stages", no_argument, 0, OPT_ANNOTATE_STAGES},
+                {"xdrop", required_argument, 0, OPT_XDROP},
+                {"sparse-chain", no_argument, 0, OPT_SPARSE_CHAIN},
+                {"dist-index", required_argument, 0, OPT_DIST_INDEX},
+                {"minimizer-index", required_argument, 0, OPT_MINIMIZER_INDEX},
                 {"gap-open", required_argument, 0, 'o'},
                 {"gap-extend", required_argument, 0, 'y'},
                 {"qual-adjust", no_argument, 0, 'A'},
@@ -272,6 +311,14 @@ int main_map(int argc, char** argv) {
             gbwt_name = optarg;
             break;
 
+        case OPT_DIST_INDEX:
+            distance_index_name = optarg;
+            break;
+
+        case OPT_MINIMIZER_INDEX:
+            minimizer_index_name = optarg;
+            break;
+
         case 'V':
             seq_name = optarg;
             break;
@@ -434,6 +481,46 @@ int main_map(int argc, char** argv) {
             mismatch = atoi(optarg);
             break;
 
+        case OPT_CACHE_SIZE:
+            cache_size = atoi(optarg);
+            if (cache_size < 0) {
+                cerr << "error:[vg map] Cache size must not be negative." << endl;
+                exit(1);
+            }
+            break;
+
+        case OPT_MEM_CACHE:
+            mem_cache_size = atoi(optarg);
+            if (mem_cache_size < 0) {
+                cerr << "error:[vg map] MEM cache size must not be negative." << endl;
+                exit(1);
+            }
+            break;
+
+        case OPT_KEEP_ORDER:
+            keep_order = true;
+            break;
+
+        case OPT_STAGE_STATS:
+            report_stage_stats = true;
+            break;
+
+        case OPT_ANNOTATE_STAGES:
+            annotate_stage_stats = true;
+            break;
+
+        case OPT_SPARSE_CHAIN:
+            use_sparse_chaining = true;
+            break;
+
+        case OPT_XDROP:
+            xdrop_threshold = atoi(optarg);
+            if (xdrop_threshold < 0) {
+                cerr << "error:[vg map] X-drop threshold must not be negative." << endl;
+                exit(1);
+            }
+            break;
+
         case OPT_SCORE_MATRIX:
             matrix_file_name = optarg;
             if (matrix_file_name.empty()) {
@@ -550,6 +637,16 @@ int main_map(int argc, char** argv) {
     }
     // note: still possible that hts file types don't have quality, but have to check the file to know
 
+    if (keep_order && !hts_file.empty()) {
+        cerr << "error:[vg map] Output order can't be kept for BAM/SAM/CRAM input." << endl;
+        return 1;
+    }
+
+    if (keep_order && !surject_type.empty()) {
+        cerr << "error:[vg map] Output order can't be kept when surjecting." << endl;
+        return 1;
+    }
+
     MappingQualityMethod mapping_quality_method = Approx;
 
     string file_name;
@@ -595,9 +692,12 @@ int main_map(int argc, char** argv) {
     haplo::ScoreProvider* haplo_score_provider = nullptr;
 
     // We try opening the file, and then see if it worked
-    ifstream xg_stream(xg_name);
+    ifstream xg_stream;
+    if (xg_name != "-") {
+        xg_stream.open(xg_name);
+    }
 
-    if(xg_stream) {
+    if(xg_name == "-" || xg_stream) {
         // We have an xg index!
         
         // TODO: tell when the user asked for an XG vs. when we guessed one,
@@ -605,7 +705,14 @@ int main_map(int argc, char** argv) {
         if(debug) {
             cerr << "Loading xg index " << xg_name << "..." << endl;
         }
-        xgidx = new xg::XG(xg_stream);
+        xgidx = new xg::XG();
+        if (xg_name == "-") {
+            // Standard input can't be memory-mapped
+            xgidx->load(std::cin);
+        } else {
+            // Memory-map the XG if it's in the mappable layout
+            xgidx->load_file(xg_name);
+        }
         
         // TODO: Support haplo::XGScoreProvider?
     }
@@ -643,6 +750,46 @@ int main_map(int argc, char** argv) {
         haplo_score_provider = new haplo::GBWTScoreProvider<gbwt::GBWT>(*gbwt);
     }
 
+    DistanceIndex* distance_index = nullptr;
+    if (!distance_index_name.empty()) {
+        ifstream distance_index_stream(distance_index_name);
+        if (!distance_index_stream) {
+            cerr << "error:[vg map] Cannot open distance index file " << distance_index_name << endl;
+            exit(1);
+        }
+        if(debug) {
+            cerr << "Loading distance index " << distance_index_name << "..." << endl;
+        }
+        distance_index = new DistanceIndex();
+        try {
+            distance_index->load(distance_index_stream);
+        }
+        catch (const runtime_error& e) {
+            cerr << "error:[vg map] " << e.what() << endl;
+            exit(1);
+        }
+    }
+
+    MinimizerIndex* minimizer_index = nullptr;
+    if (!minimizer_index_name.empty()) {
+        ifstream minimizer_index_stream(minimizer_index_name);
+        if (!minimizer_index_stream) {
+            cerr << "error:[vg map] Cannot open minimizer index file " << minimizer_index_name << endl;
+            exit(1);
+        }
+        if(debug) {
+            cerr << "Loading minimizer index " << minimizer_index_name << "..." << endl;
+        }
+        minimizer_index = new MinimizerIndex();
+        try {
+            minimizer_index->load(minimizer_index_stream);
+        }
+        catch (const runtime_error& e) {
+            cerr << "error:[vg map] " << e.what() << endl;
+            exit(1);
+        }
+    }
+
     ifstream matrix_stream;
     if (!matrix_file_name.empty()) {
       matrix_stream.open(matrix_file_name);
@@ -858,75 +1005,99 @@ int main_map(int argc, char** argv) {
         }
     };
 
-    auto write_json = [](const vector<Alignment>& alns) {
-        for(auto& alignment : alns) {
-            string json = pb2json(alignment);
-            cout << json << "\n";
+    // Encode alignments in the output format, so that each worker thread can
+    // do its own serialization and compression without holding any lock.
+    auto encode_alignments = [&output_json, &refpos_table](const vector<Alignment>& alns) {
+        if (output_json) {
+            stringstream encoded;
+            for(auto& alignment : alns) {
+                encoded << pb2json(alignment) << "\n";
+            }
+            return encoded.str();
+        } else if (refpos_table) {
+            stringstream encoded;
+            for(auto& alignment : alns) {
+                Position refpos;
+                if (alignment.refpos_size()) {
+                    refpos = alignment.refpos(0);
+                }
+                encoded << alignment.name() << "\t"
+                        << refpos.name() << "\t"
+                        << refpos.offset() << "\t"
+                        << alignment.mapping_quality() << "\t"
+                        << alignment.score() << "\n";
+            }
+            return encoded.str();
+        } else {
+            return stream::write_to_string(alns);
         }
     };
 
-    auto write_refpos = [](const vector<Alignment>& alns) {
-        for(auto& alignment : alns) {
-            Position refpos;
-            if (alignment.refpos_size()) {
-                refpos = alignment.refpos(0);
+    // The writer stage gets encoded batches from all the workers and writes
+    // them to stdout in its own thread. Surjected output goes through htslib
+    // instead. In ordered mode it has to hold every batch the readers can
+    // have in flight while it waits on the oldest one.
+    unique_ptr<stream::BatchWriter> batch_writer;
+    if (surject_type.empty()) {
+        batch_writer.reset(new stream::BatchWriter(cout, keep_order, max_batches_in_flight(thread_count)));
+    }
+
+    // Send out the results for a numbered batch of input: the alignments for
+    // the first and (if paired) second end of each read. In ordered mode, each
+    // batch number must be sent exactly once, even if it has no results.
+    auto emit_batch = [&](size_t batch_number, const vector<pair<vector<Alignment>, vector<Alignment>>>& results) {
+        if (!surject_type.empty()) {
+            for (auto& result : results) {
+                surject_alignments(result.first, result.second);
+            }
+        } else {
+            vector<Alignment> alns;
+            for (auto& result : results) {
+                alns.insert(alns.end(), result.first.begin(), result.first.end());
+                alns.insert(alns.end(), result.second.begin(), result.second.end());
             }
-            cout << alignment.name() << "\t"
-            << refpos.name() << "\t"
-            << refpos.offset() << "\t"
-            << alignment.mapping_quality() << "\t"
-            << alignment.score() << "\n";
+            batch_writer->submit(batch_number, encode_alignments(alns));
         }
     };
 
-    // We have one function to dump alignments into
-    // Make sure to flush the buffer at the end of the program!
-    auto output_alignments = [&output_buffer,
-                              &output_json,
-                              &surject_type,
-                              &surject_alignments,
-                              &buffer_size,
-                              &refpos_table,
-                              &write_json,
-                              &write_refpos](const vector<Alignment>& alns1, const vector<Alignment>& alns2) {
-        if (output_json) {
-            // If we want to convert to JSON, convert them all to JSON and dump them to cout.
-#pragma omp critical (cout)
-            {
-                write_json(alns1);
-                write_json(alns2);
-            }
-        } else if (refpos_table) {
-            // keep multi alignments ordered appropriately
-#pragma omp critical (cout)
-            {
-                write_refpos(alns1);
-                write_refpos(alns2);
-            }
-        } else if (!surject_type.empty()) {
-            // surject
+    // Send out alignments that don't belong to a numbered batch, buffering
+    // them per thread. Only used when output order doesn't matter.
+    // Make sure to flush the buffers at the end of the program!
+    auto output_alignments = [&](const vector<Alignment>& alns1, const vector<Alignment>& alns2) {
+        if (!surject_type.empty()) {
             surject_alignments(alns1, alns2);
         } else {
-            // Otherwise write them through the buffer for our thread
-            int tid = omp_get_thread_num();
-            auto& output_buf = output_buffer[tid];
-
-            // Copy all the alignments over to the output buffer
+            auto& output_buf = output_buffer[omp_get_thread_num()];
             copy(alns1.begin(), alns1.end(), back_inserter(output_buf));
             copy(alns2.begin(), alns2.end(), back_inserter(output_buf));
-
-            stream::write_buffered(cout, output_buf, buffer_size);
+            if (output_buf.size() >= buffer_size) {
+                batch_writer->submit(0, encode_alignments(output_buf));
+                output_buf.clear();
+            }
         }
     };
 
+    // All the mappers share one cache of decoded nodes, so memory use doesn't
+    // grow with the thread count and each hot node is decoded only once.
+    shared_ptr<NodeCache> node_cache;
+    if (cache_size > 0) {
+        node_cache = make_shared<NodeCache>(cache_size);
+    }
+    // The mappers all find MEMs the same way, so they can share MEMs too
+    shared_ptr<MEMCache> mem_cache;
+    if (mem_cache_size > 0) {
+        mem_cache = make_shared<MEMCache>(mem_cache_size);
+    }
+
     for (int i = 0; i < thread_count; ++i) {
         Mapper* m = nullptr;
-        if(xgidx && gcsa && lcp) {
-            // We have the xg and GCSA indexes, so use them
+        if(xgidx && ((gcsa && lcp) || minimizer_index)) {
+            // We have the xg and a seeding index, so use them. The GCSA and
+            // LCP may be null if we're seeding with minimizers.
             m = new Mapper(xgidx, gcsa, lcp, haplo_score_provider);
         } else {
             // Can't continue with null
-            throw runtime_error("Need XG, GCSA, and LCP to create a Mapper");
+            throw runtime_error("Need XG and either GCSA and LCP or a minimizer index to create a Mapper");
         }
         m->hit_max = hit_max;
         m->max_multimaps = max_multimaps;
@@ -935,6 +1106,7 @@ int main_map(int argc, char** argv) {
         m->min_banded_mq = min_banded_mq;
         m->maybe_mq_threshold = maybe_mq_threshold;
         m->debug = debug;
+        m->annotate_stage_stats = annotate_stage_stats;
         m->min_identity = min_score;
         m->drop_chain = drop_chain;
         m->mq_overlap = mq_overlap;
@@ -948,10 +1120,14 @@ int main_map(int argc, char** argv) {
                  << ", min_cluster_length = " << m->min_cluster_length << endl;
         }
         m->fast_reseed = use_fast_reseed;
+        m->use_sparse_chaining = use_sparse_chaining;
+        m->distance_index = distance_index;
+        m->minimizer_index = minimizer_index;
         m->max_sub_mem_recursion_depth = max_sub_mem_recursion_depth;
         m->max_target_factor = max_target_factor;
         m->set_alignment_scores(match, mismatch, gap_open, gap_extend, full_length_bonus, haplotype_consistency_exponent);
         if(matrix_stream.is_open()) m->load_scoring_matrix(matrix_stream);
+        m->set_xdrop_threshold(xdrop_threshold);
         m->strip_bonuses = strip_bonuses;
         m->adjust_alignments_for_base_quality = qual_adjust_alignments;
         m->extra_multimaps = extra_multimaps;
@@ -975,9 +1151,137 @@ int main_map(int argc, char** argv) {
         m->identity_weight = identity_weight;
         m->assume_acyclic = acyclic_graph;
         m->patch_alignments = patch_alignments;
+        m->set_node_cache(node_cache);
+        m->set_mem_cache(mem_cache);
         mapper[i] = m;
     }
 
+    MappingStageStats::set_enabled(report_stage_stats || annotate_stage_stats);
+
+    // Batches of input are numbered consecutively across all the inputs, so
+    // that in ordered mode they can be written out in input order.
+    size_t batch_base = 0;
+
+    // Map a batch of single-end reads in the current thread and send out the
+    // results. If annotate is set, label the alignments with the sample and
+    // read group. If compare is set, mark how well each primary alignment
+    // agrees with the input alignment.
+    auto map_single_batch = [&](size_t batch_number, vector<Alignment>& batch, bool annotate, bool compare) {
+        Mapper* our_mapper = mapper[omp_get_thread_num()];
+        vector<pair<vector<Alignment>, vector<Alignment>>> results;
+        results.reserve(batch.size());
+        for (auto& alignment : batch) {
+            vector<Alignment> alignments = our_mapper->align_multi(alignment, kmer_size, kmer_stride, max_mem_length, band_width, band_overlap);
+            if (compare) {
+                alignments.front().set_correct(overlap(alignment.path(), alignments.front().path()));
+                alignment_set_distance_to_correct(alignments.front(), alignment);
+            }
+            if (annotate) {
+                for(auto& aln : alignments) {
+                    // Set the alignment metadata
+                    if (!sample_name.empty()) aln.set_sample_name(sample_name);
+                    if (!read_group.empty()) aln.set_read_group(read_group);
+                }
+            }
+            results.emplace_back(std::move(alignments), vector<Alignment>());
+        }
+        emit_batch(batch_number, results);
+    };
+
+    // Map a batch of read pairs in the current thread and send out the
+    // results. Pairs that the mapper defers until it knows the fragment length
+    // distribution are sent out later with whatever batch resolves them, or
+    // at the end of their own batch in ordered mode.
+    auto map_paired_batch = [&](size_t batch_number, vector<pair<Alignment, Alignment>>& batch, bool compare) {
+        Mapper* our_mapper = mapper[omp_get_thread_num()];
+        vector<pair<vector<Alignment>, vector<Alignment>>> results;
+        results.reserve(batch.size());
+
+        auto align_pair = [&](Alignment& aln1, Alignment& aln2, bool retrying, bool& queued_resolve_later) {
+            auto alnp = our_mapper->align_paired_multi(aln1, aln2, queued_resolve_later, max_mem_length, top_pairs_only, retrying);
+            if (compare && !queued_resolve_later) {
+                alnp.first.front().set_correct(overlap(aln1.path(), alnp.first.front().path()));
+                alnp.second.front().set_correct(overlap(aln2.path(), alnp.second.front().path()));
+                alignment_set_distance_to_correct(alnp.first.front(), aln1);
+                alignment_set_distance_to_correct(alnp.second.front(), aln2);
+            }
+            return alnp;
+        };
+
+        // Where the results for each deferred pair go, in ordered mode
+        vector<size_t> deferred;
+        for (auto& p : batch) {
+            bool queued_resolve_later = false;
+            auto alnp = align_pair(p.first, p.second, false, queued_resolve_later);
+            if (queued_resolve_later) {
+                if (keep_order) {
+                    deferred.push_back(results.size());
+                    results.emplace_back();
+                }
+                continue;
+            }
+            results.push_back(std::move(alnp));
+            // check if we should try to align the queued alignments
+            if (!keep_order && our_mapper->frag_stats.fragment_size != 0
+                && !our_mapper->imperfect_pairs_to_retry.empty()) {
+                for (auto& retry : our_mapper->imperfect_pairs_to_retry) {
+                    results.push_back(align_pair(retry.first, retry.second, true, queued_resolve_later));
+                }
+                our_mapper->imperfect_pairs_to_retry.clear();
+            }
+        }
+
+        if (!deferred.empty()) {
+            // Resolve the deferred pairs now so they can go out in order. If we
+            // don't have a fragment length distribution yet, use the maximum
+            // fragment length, as we would at the end of an unordered run.
+            auto& frag_stats = our_mapper->frag_stats;
+            bool use_max = (frag_stats.fragment_size == 0);
+            if (use_max) {
+                frag_stats.fragment_size = fragment_max;
+            }
+            auto& retries = our_mapper->imperfect_pairs_to_retry;
+            assert(retries.size() == deferred.size());
+            for (size_t i = 0; i < deferred.size(); i++) {
+                bool queued_resolve_later = false;
+                results[deferred[i]] = align_pair(retries[i].first, retries[i].second, true, queued_resolve_later);
+            }
+            retries.clear();
+            if (use_max) {
+                frag_stats.fragment_size = 0;
+            }
+        }
+
+        if (print_fragment_model) {
+            // We only want the fragment model, not the alignments
+            results.clear();
+        }
+        emit_batch(batch_number, results);
+    };
+
+    // Resolve any pairs still waiting on the fragment length distribution once
+    // all the input has been mapped.
+    auto flush_deferred_pairs = [&]() {
+#pragma omp parallel
+        {
+            auto our_mapper = mapper[omp_get_thread_num()];
+            // if we haven't yet computed these, assume we couldn't get an estimate for fragment size
+            our_mapper->frag_stats.fragment_size = fragment_max;
+            for (auto p : our_mapper->imperfect_pairs_to_retry) {
+                bool queued_resolve_later = false;
+                auto alnp = our_mapper->align_paired_multi(p.first, p.second,
+                                                           queued_resolve_later,
+                                                           max_mem_length,
+                                                           top_pairs_only,
+                                                           true);
+                if (!print_fragment_model) {
+                    output_alignments(alnp.first, alnp.second);
+                }
+            }
+            our_mapper->imperfect_pairs_to_retry.clear();
+        }
+    };
+
     if (!seq.empty()) {
         int tid = omp_get_thread_num();
 
@@ -1002,69 +1306,47 @@ int main_map(int argc, char** argv) {
         }
 
         // Output the alignments in JSON or protobuf as appropriate.
-        output_alignments(alignments, empty_alns);
+        emit_batch(batch_base++, {make_pair(alignments, empty_alns)});
     }
 
     if (!read_file.empty()) {
         ifstream in(read_file);
-        bool more_data = in.good();
-#pragma omp parallel shared(in)
-        {
+        // One read per line, skipping blank lines
+        function<bool(Alignment&)> get_read = [&in](Alignment& unaligned) {
             string line;
-            int tid = omp_get_thread_num();
-            while (in.good()) {
-                line.clear();
-#pragma omp critical (readq)
-                {
-                    std::getline(in,line);
-                }
+            while (std::getline(in, line)) {
                 if (!line.empty()) {
-                    // Make an alignment
-                    Alignment unaligned;
                     unaligned.set_sequence(line);
-
-                    vector<Alignment> alignments = mapper[tid]->align_multi(unaligned, kmer_size, kmer_stride, max_mem_length, band_width, band_overlap);
-
-                    for(auto& alignment : alignments) {
-                        // Set the alignment metadata
-                        if (!sample_name.empty()) alignment.set_sample_name(sample_name);
-                        if (!read_group.empty()) alignment.set_read_group(read_group);
-                    }
-
-
-                    // Output the alignments in JSON or protobuf as appropriate.
-                    output_alignments(alignments, empty_alns);
+                    return true;
                 }
             }
-        }
+            return false;
+        };
+        batch_base += unpaired_for_each_batch_parallel(get_read, [&](size_t batch_number, vector<Alignment>& batch) {
+            map_single_batch(batch_base + batch_number, batch, true, false);
+        });
     }
 
     if (!fasta_file.empty()) {
         FastaReference ref;
         ref.open(fasta_file);
-        auto align_seq = [&](const string& name, const string& seq) {
-            if (!seq.empty()) {
-                // Make an alignment
-                Alignment unaligned;
-                unaligned.set_sequence(seq);
-                unaligned.set_name(name);
-                int tid = omp_get_thread_num();
-                vector<Alignment> alignments = mapper[tid]->align_multi(unaligned, kmer_size, kmer_stride, max_mem_length, band_width, band_overlap);
-                for(auto& alignment : alignments) {
-                    // Set the alignment metadata
-                    if (!sample_name.empty()) alignment.set_sample_name(sample_name);
-                    if (!read_group.empty()) alignment.set_read_group(read_group);
-                }
-                // Output the alignments in JSON or protobuf as appropriate.
-                output_alignments(alignments, empty_alns);
-            }
-        };
-#pragma omp parallel for
-        for (size_t i = 0; i < ref.index->sequenceNames.size(); ++i) {
+        size_t sequence_count = ref.index->sequenceNames.size();
+        // Each sequence is its own batch. Hand them out in order, so with
+        // ordered output no thread gets far ahead of the batch being written.
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < sequence_count; ++i) {
             auto& name = ref.index->sequenceNames[i];
-            string seq = nonATGCNtoN(toUppercase(ref.getSequence(name)));
-            align_seq(name, seq);
+            vector<Alignment> batch(1);
+            batch.front().set_sequence(nonATGCNtoN(toUppercase(ref.getSequence(name))));
+            batch.front().set_name(name);
+            if (batch.front().sequence().empty()) {
+                // Nothing to map, but the batch still has to be accounted for
+                emit_batch(batch_base + i, {});
+            } else {
+                map_single_batch(batch_base + i, batch, true, false);
+            }
         }
+        batch_base += sequence_count;
     }
 
     if (!hts_file.empty()) {
@@ -1096,254 +1378,36 @@ int main_map(int argc, char** argv) {
     }
 
     if (!fastq1.empty()) {
+        auto paired_lambda = [&](size_t batch_number, vector<pair<Alignment, Alignment>>& batch) {
+            map_paired_batch(batch_base + batch_number, batch, false);
+        };
         if (interleaved_input) {
             // paired interleaved
-            auto output_func = [&output_alignments,
-                                &compare_gam,
-                                &print_fragment_model]
-                (Alignment& aln1,
-                 Alignment& aln2,
-                 pair<vector<Alignment>, vector<Alignment>>& alnp) {
-                if (!print_fragment_model) {
-                    // Output the alignments in JSON or protobuf as appropriate.
-                    output_alignments(alnp.first, alnp.second);
-                }
-            };
-            function<void(Alignment&,Alignment&)> lambda =
-                [&mapper,
-                 &output_alignments,
-                 &keep_secondary,
-                 &kmer_size,
-                 &kmer_stride,
-                 &max_mem_length,
-                 &band_width,
-                 &band_overlap,
-                 &pair_window,
-                 &top_pairs_only,
-                 &print_fragment_model,
-                 &output_func](Alignment& aln1, Alignment& aln2) {
-                auto our_mapper = mapper[omp_get_thread_num()];
-                bool queued_resolve_later = false;
-                auto alnp = our_mapper->align_paired_multi(aln1, aln2, queued_resolve_later, max_mem_length, top_pairs_only, false);
-                if (!queued_resolve_later) {
-                    output_func(aln1, aln2, alnp);
-                    // check if we should try to align the queued alignments
-                    if (our_mapper->frag_stats.fragment_size != 0
-                        && !our_mapper->imperfect_pairs_to_retry.empty()) {
-                        int i = 0;
-                        for (auto p : our_mapper->imperfect_pairs_to_retry) {
-                            auto alnp = our_mapper->align_paired_multi(p.first, p.second,
-                                                                       queued_resolve_later,
-                                                                       max_mem_length,
-                                                                       top_pairs_only,
-                                                                       true);
-                            output_func(p.first, p.second, alnp);
-                        }
-                        our_mapper->imperfect_pairs_to_retry.clear();
-                    }
-                }
-            };
-            fastq_paired_interleaved_for_each_parallel(fastq1, lambda);
-#pragma omp parallel
-            { // clean up buffered alignments that weren't perfect
-                auto our_mapper = mapper[omp_get_thread_num()];
-                // if we haven't yet computed these, assume we couldn't get an estimate for fragment size
-                our_mapper->frag_stats.fragment_size = fragment_max;
-                for (auto p : our_mapper->imperfect_pairs_to_retry) {
-                    bool queued_resolve_later = false;
-                    auto alnp = our_mapper->align_paired_multi(p.first, p.second,
-                                                               queued_resolve_later,
-                                                               max_mem_length,
-                                                               top_pairs_only,
-                                                               true);
-                    output_func(p.first, p.second, alnp);
-                }
-                our_mapper->imperfect_pairs_to_retry.clear();
-            }
+            batch_base += fastq_paired_interleaved_for_each_batch_parallel(fastq1, paired_lambda);
+            flush_deferred_pairs();
         } else if (fastq2.empty()) {
             // single
-            function<void(Alignment&)> lambda =
-                [&mapper,
-                 &output_alignments,
-                 &kmer_size,
-                 &kmer_stride,
-                 &max_mem_length,
-                 &band_width,
-                 &band_overlap,
-                 &empty_alns]
-                    (Alignment& alignment) {
-
-                        int tid = omp_get_thread_num();
-                        vector<Alignment> alignments = mapper[tid]->align_multi(alignment, kmer_size, kmer_stride, max_mem_length, band_width, band_overlap);
-                        //cerr << "This is just before output_alignments" << alignment.DebugString() << endl;
-                        output_alignments(alignments, empty_alns);
-                    };
-            fastq_unpaired_for_each_parallel(fastq1, lambda);
+            batch_base += fastq_unpaired_for_each_batch_parallel(fastq1, [&](size_t batch_number, vector<Alignment>& batch) {
+                map_single_batch(batch_base + batch_number, batch, false, false);
+            });
         } else {
             // paired two-file
-            auto output_func = [&output_alignments,
-                                &print_fragment_model]
-                (Alignment& aln1,
-                 Alignment& aln2,
-                 pair<vector<Alignment>, vector<Alignment>>& alnp) {
-                // Make sure we have unaligned "alignments" for things that don't align.
-                // Output the alignments in JSON or protobuf as appropriate.
-                if (!print_fragment_model) {
-                    output_alignments(alnp.first, alnp.second);
-                }
-            };
-            function<void(Alignment&,Alignment&)> lambda =
-                [&mapper,
-                 &output_alignments,
-                 &keep_secondary,
-                 &kmer_size,
-                 &kmer_stride,
-                 &max_mem_length,
-                 &band_width,
-                 &band_overlap,
-                 &pair_window,
-                 &top_pairs_only,
-                 &print_fragment_model,
-                 &output_func](Alignment& aln1, Alignment& aln2) {
-                auto our_mapper = mapper[omp_get_thread_num()];
-                bool queued_resolve_later = false;
-                auto alnp = our_mapper->align_paired_multi(aln1, aln2, queued_resolve_later, max_mem_length, top_pairs_only, false);
-                if (!queued_resolve_later) {
-                    output_func(aln1, aln2, alnp);
-                    // check if we should try to align the queued alignments
-                    if (our_mapper->frag_stats.fragment_size != 0
-                        && !our_mapper->imperfect_pairs_to_retry.empty()) {
-                        int i = 0;
-                        for (auto p : our_mapper->imperfect_pairs_to_retry) {
-                            auto alnp = our_mapper->align_paired_multi(p.first, p.second,
-                                                                       queued_resolve_later,
-                                                                       max_mem_length,
-                                                                       top_pairs_only,
-                                                                       true);
-                            output_func(p.first, p.second, alnp);
-                        }
-                        our_mapper->imperfect_pairs_to_retry.clear();
-                    }
-                }
-            };
-            fastq_paired_two_files_for_each_parallel(fastq1, fastq2, lambda);
-#pragma omp parallel
-            {
-                auto our_mapper = mapper[omp_get_thread_num()];
-                our_mapper->frag_stats.fragment_size = fragment_max;
-                for (auto p : our_mapper->imperfect_pairs_to_retry) {
-                    bool queued_resolve_later = false;
-                    auto alnp = our_mapper->align_paired_multi(p.first, p.second,
-                                                               queued_resolve_later,
-                                                               max_mem_length,
-                                                               top_pairs_only,
-                                                               true);
-                    output_func(p.first, p.second, alnp);
-                }
-                our_mapper->imperfect_pairs_to_retry.clear();
-            }
+            batch_base += fastq_paired_two_files_for_each_batch_parallel(fastq1, fastq2, paired_lambda);
+            flush_deferred_pairs();
         }
     }
 
     if (!gam_input.empty()) {
         ifstream gam_in(gam_input);
         if (interleaved_input) {
-            auto output_func = [&output_alignments,
-                                &compare_gam,
-                                &print_fragment_model]
-                (Alignment& aln1,
-                 Alignment& aln2,
-                 pair<vector<Alignment>, vector<Alignment>>& alnp) {
-                if (print_fragment_model) {
-                    // do nothing
-                } else {
-                    // Output the alignments in JSON or protobuf as appropriate.
-                    if (compare_gam) {
-                        alnp.first.front().set_correct(overlap(aln1.path(), alnp.first.front().path()));
-                        alnp.second.front().set_correct(overlap(aln2.path(), alnp.second.front().path()));
-                        alignment_set_distance_to_correct(alnp.first.front(), aln1);
-                        alignment_set_distance_to_correct(alnp.second.front(), aln2);
-                    }
-                    output_alignments(alnp.first, alnp.second);
-                }
-            };
-            function<void(Alignment&,Alignment&)> lambda =
-                [&mapper,
-                 &output_alignments,
-                 &keep_secondary,
-                 &kmer_size,
-                 &kmer_stride,
-                 &max_mem_length,
-                 &band_width,
-                 &band_overlap,
-                 &compare_gam,
-                 &pair_window,
-                 &top_pairs_only,
-                 &print_fragment_model,
-                 &output_func](Alignment& aln1, Alignment& aln2) {
-                auto our_mapper = mapper[omp_get_thread_num()];
-                bool queued_resolve_later = false;
-                auto alnp = our_mapper->align_paired_multi(aln1, aln2, queued_resolve_later, max_mem_length, top_pairs_only, false);
-                if (!queued_resolve_later) {
-                    output_func(aln1, aln2, alnp);
-                    // check if we should try to align the queued alignments
-                    if (our_mapper->frag_stats.fragment_size != 0
-                        && !our_mapper->imperfect_pairs_to_retry.empty()) {
-                        int i = 0;
-                        for (auto p : our_mapper->imperfect_pairs_to_retry) {
-                            auto alnp = our_mapper->align_paired_multi(p.first, p.second,
-                                                                       queued_resolve_later,
-                                                                       max_mem_length,
-                                                                       top_pairs_only,
-                                                                       true);
-                            output_func(p.first, p.second, alnp);
-                        }
-                        our_mapper->imperfect_pairs_to_retry.clear();
-                    }
-                }
-            };
-            stream::for_each_interleaved_pair_parallel(gam_in, lambda);
-#pragma omp parallel
-            {
-                auto our_mapper = mapper[omp_get_thread_num()];
-                our_mapper->frag_stats.fragment_size = fragment_max;
-                for (auto p : our_mapper->imperfect_pairs_to_retry) {
-                    bool queued_resolve_later = false;
-                    auto alnp = our_mapper->align_paired_multi(p.first, p.second,
-                                                               queued_resolve_later,
-                                                               max_mem_length,
-                                                               top_pairs_only,
-                                                               true);
-                    output_func(p.first, p.second, alnp);
-                }
-                our_mapper->imperfect_pairs_to_retry.clear();
-            }
+            batch_base += gam_paired_interleaved_for_each_batch_parallel(gam_in, [&](size_t batch_number, vector<pair<Alignment, Alignment>>& batch) {
+                map_paired_batch(batch_base + batch_number, batch, compare_gam);
+            });
+            flush_deferred_pairs();
         } else {
-            function<void(Alignment&)> lambda =
-                [&mapper,
-                 &output_alignments,
-                 &keep_secondary,
-                 &kmer_size,
-                 &kmer_stride,
-                 &max_mem_length,
-                 &band_width,
-                 &band_overlap,
-                 &compare_gam,
-                 &empty_alns]
-                (Alignment& alignment) {
-                int tid = omp_get_thread_num();
-                std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
-                vector<Alignment> alignments = mapper[tid]->align_multi(alignment, kmer_size, kmer_stride, max_mem_length, band_width, band_overlap);
-                std::chrono::time_point<std::chrono::system_clock> end = std::chrono::system_clock::now();
-                std::chrono::duration<double> elapsed_seconds = end-start;
-                // Output the alignments in JSON or protobuf as appropriate.
-                if (compare_gam) {
-                    alignments.front().set_correct(overlap(alignment.path(), alignments.front().path()));
-                    alignment_set_distance_to_correct(alignments.front(), alignment);
-                }
-                output_alignments(alignments, empty_alns);
-            };
-            stream::for_each_parallel(gam_in, lambda);
+            batch_base += gam_unpaired_for_each_batch_parallel(gam_in, [&](size_t batch_number, vector<Alignment>& batch) {
+                map_single_batch(batch_base + batch_number, batch, false, compare_gam);
+            });
         }
         gam_in.close();
     }
@@ -1357,14 +1421,33 @@ int main_map(int argc, char** argv) {
         }
     }
 
+    if (report_stage_stats) {
+        MappingStageStats::report(cerr, MappingStageStats::total());
+        BaseAligner::report_banded_widths(cerr, BaseAligner::banded_width_counts());
+    }
+
+    if (debug && node_cache) {
+        cerr << "[vg map] : node cache hits = " << node_cache->hits()
+             << ", misses = " << node_cache->misses() << endl;
+    }
+
+    if ((debug || report_stage_stats) && mem_cache) {
+        cerr << "[vg map] : MEM cache hits = " << mem_cache->hits()
+             << ", misses = " << mem_cache->misses() << endl;
+    }
+
     // clean up
     for (int i = 0; i < thread_count; ++i) {
         delete mapper[i];
         auto& output_buf = output_buffer[i];
-        if (!output_json && !refpos_table && surject_type.empty()) {
-            stream::write_buffered(cout, output_buf, 0);
+        if (batch_writer && !output_buf.empty()) {
+            batch_writer->submit(0, encode_alignments(output_buf));
         }
     }
+    if (batch_writer) {
+        // Wait for everything to be written
+        batch_writer->finish();
+    }
 
     // special cleanup for htslib outputs
     if (!surject_type.empty()) {
@@ -1381,6 +1464,14 @@ int main_map(int argc, char** argv) {
         delete gbwt;
         gbwt = nullptr;
     }
+    if (distance_index) {
+        delete distance_index;
+        distance_index = nullptr;
+    }
+    if (minimizer_index) {
+        delete minimizer_index;
+        minimizer_index = nullptr;
+    }
     if (lcp) {
         delete lcp;
         lcp = nullptr;
@@ -0,0 +1,164 @@
+/** \file minimizer_main.cpp
+ *
+ * Defines the "vg minimizer" subcommand, which builds a minimizer index of a
+ * graph for finding seeds without the GCSA2.
+ */
+
+#include <omp.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <iostream>
+#include <fstream>
+
+#include "subcommand.hpp"
+
+#include "../minimizer_index.hpp"
+#include "../utility.hpp"
+#include "../xg.hpp"
+
+using namespace std;
+using namespace vg;
+using namespace vg::subcommand;
+
+void help_minimizer(char** argv) {
+    cerr << "usage: " << argv[0] << " minimizer [options] -i index.min graph.xg" << endl
+         << "Builds an index of the (w, k)-minimizers of the walks in a graph, for use with" << endl
+         << "vg map --minimizer-index or vg mpmap --minimizer-index." << endl
+         << endl
+         << "options:" << endl
+         << "    -i, --index-name FILE  write the index to FILE (required)" << endl
+         << "    -k, --kmer-size N      index minimizers of length N (at most " << MinimizerIndex::MAX_K << ") [15]" << endl
+         << "    -w, --window-size N    take minimizers of windows of N consecutive kmers [11]" << endl
+         << "    -l, --walk-limit N     fail if the walks from a node cover more than N bases [" << MinimizerIndex::DEFAULT_MAX_WALK_BASES << "]" << endl
+         << "    -t, --threads N        number of threads to use" << endl
+         << "    -p, --progress         show progress" << endl;
+}
+
+int main_minimizer(int argc, char** argv) {
+
+    if (argc == 2) {
+        help_minimizer(argv);
+        return 1;
+    }
+
+    string index_name;
+    int kmer_size = 15;
+    int window_size = 11;
+    size_t walk_limit = MinimizerIndex::DEFAULT_MAX_WALK_BASES;
+    bool show_progress = false;
+
+    int c;
+    optind = 2; // force optind past command positional argument
+    while (true) {
+        static struct option long_options[] =
+        {
+            {"help", no_argument, 0, 'h'},
+            {"index-name", required_argument, 0, 'i'},
+            {"kmer-size", required_argument, 0, 'k'},
+            {"window-size", required_argument, 0, 'w'},
+            {"walk-limit", required_argument, 0, 'l'},
+            {"threads", required_argument, 0, 't'},
+            {"progress",  no_argument, 0, 'p'},
+            {0, 0, 0, 0}
+        };
+
+        int option_index = 0;
+        c = getopt_long (argc, argv, "hi:k:w:l:t:p",
+                long_options, &option_index);
+
+        // Detect the end of the options.
+        if (c == -1)
+            break;
+
+        switch (c)
+        {
+            case 'i':
+                index_name = optarg;
+                break;
+
+            case 'k':
+                kmer_size = atoi(optarg);
+                break;
+
+            case 'w':
+                window_size = atoi(optarg);
+                break;
+
+            case 'l':
+                walk_limit = atoll(optarg);
+                break;
+
+            case 't':
+                omp_set_num_threads(atoi(optarg));
+                break;
+
+            case 'p':
+                show_progress = true;
+                break;
+
+            case 'h':
+            case '?':
+                help_minimizer(argv);
+                exit(1);
+                break;
+
+            default:
+                abort ();
+        }
+    }
+
+    if (index_name.empty()) {
+        cerr << "error:[vg minimizer] An output file name (-i) is required." << endl;
+        exit(1);
+    }
+    if (kmer_size <= 0 || kmer_size > (int) MinimizerIndex::MAX_K) {
+        cerr << "error:[vg minimizer] Kmer size (-k) must be between 1 and " << MinimizerIndex::MAX_K << "." << endl;
+        exit(1);
+    }
+    if (window_size <= 0) {
+        cerr << "error:[vg minimizer] Window size (-w) must be a positive integer." << endl;
+        exit(1);
+    }
+    if (optind >= argc) {
+        cerr << "error:[vg minimizer] An xg graph is required." << endl;
+        exit(1);
+    }
+    string xg_name = get_input_file_name(optind, argc, argv);
+
+    xg::XG xg_index;
+    xg_index.load_file(xg_name);
+
+    if (show_progress) {
+        cerr << "Indexing " << window_size << " windows of " << kmer_size << "-mers in " << xg_name << "..." << endl;
+    }
+    MinimizerIndex index(kmer_size, window_size);
+    try {
+        index = MinimizerIndex(xg_index, kmer_size, window_size, walk_limit);
+    }
+    catch (const runtime_error& e) {
+        cerr << "error:[vg minimizer] " << e.what() << endl;
+        exit(1);
+    }
+    if (show_progress) {
+        cerr << "Indexed " << index.hit_count() << " positions of " << index.size() << " distinct minimizers" << endl;
+    }
+
+    ofstream out(index_name);
+    if (!out) {
+        cerr << "error:[vg minimizer] Cannot open " << index_name << " for writing." << endl;
+        exit(1);
+    }
+    try {
+        index.save(out);
+    }
+    catch (const runtime_error& e) {
+        cerr << "error:[vg minimizer] " << e.what() << endl;
+        exit(1);
+    }
+
+    return 0;
+}
+
+// Register subcommand
+static Subcommand vg_minimizer("minimizer", "build a minimizer index of a graph for seeding", TOOLKIT, main_minimizer);
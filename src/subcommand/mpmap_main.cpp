@@ -31,10 +31,12 @@ void help_mpmap(char** argv) {
     << "basic options:" << endl
     << "graph/index:" << endl
     << "  -x, --xg-name FILE        use this xg index (required)" << endl
-    << "  -g, --gcsa-name FILE      use this GCSA2/LCP index pair (required; both FILE and FILE.lcp)" << endl
+    << "  -g, --gcsa-name FILE      use this GCSA2/LCP index pair (required without --minimizer-index; both FILE and FILE.lcp)" << endl
     << "  -H, --gbwt-name FILE      use this GBWT haplotype index for population-based MAPQs" << endl
     << "      --linear-index FILE   use this sublinear Li and Stephens index file for population-based MAPQs" << endl
     << "      --linear-path PATH    use the given path name as the path that the linear index is against" << endl
+    << "      --dist-index FILE     use this minimum distance index (from vg index -j) for graph distances" << endl
+    << "      --minimizer-index FILE  find seeds with this minimizer index (from vg minimizer) instead of the GCSA2" << endl
     << "input:" << endl
     << "  -f, --fastq FILE          input FASTQ (possibly compressed), can be given twice for paired ends (for stdin use -)" << endl
     << "  -G, --gam-input FILE      input GAM (for stdin, use -)" << endl
@@ -53,6 +55,8 @@ void help_mpmap(char** argv) {
     << "  -X, --snarl-max-cut INT   do not align to alternate paths in a snarl if an exact match is at least this long (0 for no limit) [5]" << endl
     << "  -a, --alt-paths INT       align to (up to) this many alternate paths in between MEMs or in snarls [4]" << endl
     << "  -n, --unstranded          use lazy strand consistency when clustering MEMs" << endl
+    << "  --sparse-chain            cluster MEMs by sparse chaining over approximate positions instead of distance trees" << endl
+    << "  --mem-cache INT           reuse the MEMs found for up to INT distinct read sequences, for duplicate reads [0]" << endl
     << "  -b, --frag-sample INT     look for this many unambiguous mappings to estimate the fragment length distribution [1000]" << endl
     << "  -I, --frag-mean           mean for fixed fragment length distribution" << endl
     << "  -D, --frag-stddev         standard deviation for fixed fragment length distribution" << endl
@@ -81,9 +85,13 @@ void help_mpmap(char** argv) {
     << "  -y, --gap-extend INT      use this gap extension penalty [1]" << endl
     << "  -L, --full-l-bonus INT    add this score to alignments that use the full length of the read [5]" << endl
     << "  -m, --remove-bonuses      remove full length alignment bonuses in reported scores" << endl
+    << "  --xdrop INT               abandon alignment DP cells that drop this far below the best on their path (0 = off) [0]" << endl
     << "computational parameters:" << endl
     << "  -t, --threads INT         number of compute threads to use" << endl
-    << "  -Z, --buffer-size INT     buffer this many alignments together (per compute thread) before outputting to stdout [100]" << endl;
+    << "  -Z, --buffer-size INT     buffer this many alignments together (per compute thread) before outputting to stdout [100]" << endl
+    << "  --stage-stats             report the time spent in each stage of mapping, and the integer" << endl
+    << "                            widths banded alignment needed, on stderr" << endl
+    << "  --annotate-stages         annotate each read with the time spent in each stage of mapping" << endl;
     
 }
 
@@ -96,6 +104,13 @@ int main_mpmap(int argc, char** argv) {
 
     // initialize parameters with their default options
     #define OPT_SCORE_MATRIX 1000
+    #define OPT_STAGE_STATS 1001
+    #define OPT_ANNOTATE_STAGES 1002
+    #define OPT_XDROP 1003
+    #define OPT_SPARSE_CHAIN 1004
+    #define OPT_DIST_INDEX 1005
+    #define OPT_MINIMIZER_INDEX 1006
+    #define OPT_MEM_CACHE 1007
     string matrix_file_name;
     string xg_name;
     string gcsa_name;
@@ -103,6 +118,8 @@ int main_mpmap(int argc, char** argv) {
     string sublinearLS_name;
     string sublinearLS_ref_path;
     string snarls_name;
+    string distance_index_name;
+    string minimizer_index_name;
     string fastq_name_1;
     string fastq_name_2;
     string gam_file_name;
@@ -111,6 +128,7 @@ int main_mpmap(int argc, char** argv) {
     int gap_open_score = default_gap_open;
     int gap_extension_score = default_gap_extension;
     int full_length_bonus = default_full_length_bonus;
+    int xdrop_threshold = 0;
     bool interleaved_input = false;
     int snarl_cut_size = 5;
     int max_paired_end_map_attempts = 24;
@@ -151,6 +169,8 @@ int main_mpmap(int argc, char** argv) {
     size_t num_calibration_simulations = 250;
     size_t calibration_read_length = 150;
     bool unstranded_clustering = false;
+    bool use_sparse_chaining = false;
+    int mem_cache_size = 0;
     size_t order_length_repeat_hit_max = 3000;
     size_t sub_mem_count_thinning = 4;
     size_t sub_mem_thinning_burn_in = 16;
@@ -167,6 +187,8 @@ int main_mpmap(int argc, char** argv) {
     int secondary_rescue_subopt_diff = 25;
     int min_median_mem_coverage_for_split = 0;
     bool suppress_cluster_merging = false;
+    bool report_stage_stats = false;
+    bool annotate_stage_stats = false;
     
     int c;
     optind = 2; // force optind past command positional argument
@@ -213,6 +235,13 @@ int main_mpmap(int argc, char** argv) {
             {"match", required_argument, 0, 'q'},
             {"mismatch", required_argument, 0, 'z'},
             {"score-matrix", required_argument, 0, OPT_SCORE_MATRIX},
+            {"stage-stats", no_argument, 0, OPT_STAGE_STATS},
+            {"annotate-stages", no_argument, 0, OPT_ANNOTATE_STAGES},
+            {"xdrop", required_argument, 0, OPT_XDROP},
+            {"sparse-chain", no_argument, 0, OPT_SPARSE_CHAIN},
+            {"dist-index", required_argument, 0, OPT_DIST_INDEX},
+            {"minimizer-index", required_argument, 0, OPT_MINIMIZER_INDEX},
+            {"mem-cache", required_argument, 0, OPT_MEM_CACHE},
             {"gap-open", required_argument, 0, 'o'},
             {"gap-extend", required_argument, 0, 'y'},
             {"full-l-bonus", required_argument, 0, 'L'},
@@ -457,6 +486,50 @@ int main_mpmap(int argc, char** argv) {
                 }
                 break;
                 
+            case OPT_SPARSE_CHAIN:
+                use_sparse_chaining = true;
+                break;
+                
+            case OPT_DIST_INDEX:
+                distance_index_name = optarg;
+                if (distance_index_name.empty()) {
+                    cerr << "error:[vg mpmap] Must provide distance index file with --dist-index." << endl;
+                    exit(1);
+                }
+                break;
+                
+            case OPT_MINIMIZER_INDEX:
+                minimizer_index_name = optarg;
+                if (minimizer_index_name.empty()) {
+                    cerr << "error:[vg mpmap] Must provide minimizer index file with --minimizer-index." << endl;
+                    exit(1);
+                }
+                break;
+                
+            case OPT_XDROP:
+                xdrop_threshold = atoi(optarg);
+                if (xdrop_threshold < 0) {
+                    cerr << "error:[vg mpmap] X-drop threshold must not be negative." << endl;
+                    exit(1);
+                }
+                break;
+                
+            case OPT_MEM_CACHE:
+                mem_cache_size = atoi(optarg);
+                if (mem_cache_size < 0) {
+                    cerr << "error:[vg mpmap] MEM cache size must not be negative." << endl;
+                    exit(1);
+                }
+                break;
+                
+            case OPT_STAGE_STATS:
+                report_stage_stats = true;
+                break;
+                
+            case OPT_ANNOTATE_STAGES:
+                annotate_stage_stats = true;
+                break;
+                
             case 'o':
                 gap_open_score = atoi(optarg);
                 break;
@@ -697,30 +770,38 @@ int main_mpmap(int argc, char** argv) {
         exit(1);
     }
     
-    if (gcsa_name.empty()) {
-        cerr << "error:[vg mpmap] Multipath mapping requires a GCSA2 index, must provide GCSA2 file" << endl;
+    if (gcsa_name.empty() && minimizer_index_name.empty()) {
+        cerr << "error:[vg mpmap] Multipath mapping requires a GCSA2 index or a minimizer index, must provide GCSA2 file or minimizer index file" << endl;
         exit(1);
     }
     
     // create in-memory objects
     
-    ifstream xg_stream(xg_name);
-    if (!xg_stream) {
-        cerr << "error:[vg mpmap] Cannot open XG file " << xg_name << endl;
-        exit(1);
+    ifstream xg_stream;
+    if (xg_name != "-") {
+        xg_stream.open(xg_name);
     }
-    
-    ifstream gcsa_stream(gcsa_name);
-    if (!gcsa_stream) {
-        cerr << "error:[vg mpmap] Cannot open GCSA2 file " << gcsa_name << endl;
+    if (xg_name != "-" && !xg_stream) {
+        cerr << "error:[vg mpmap] Cannot open XG file " << xg_name << endl;
         exit(1);
     }
     
-    string lcp_name = gcsa_name + ".lcp";
-    ifstream lcp_stream(lcp_name);
-    if (!lcp_stream) {
-        cerr << "error:[vg mpmap] Cannot open LCP file " << lcp_name << endl;
-        exit(1);
+    // the GCSA2/LCP pair is optional when seeding with minimizers
+    ifstream gcsa_stream;
+    ifstream lcp_stream;
+    if (!gcsa_name.empty()) {
+        gcsa_stream.open(gcsa_name);
+        if (!gcsa_stream) {
+            cerr << "error:[vg mpmap] Cannot open GCSA2 file " << gcsa_name << endl;
+            exit(1);
+        }
+        
+        string lcp_name = gcsa_name + ".lcp";
+        lcp_stream.open(lcp_name);
+        if (!lcp_stream) {
+            cerr << "error:[vg mpmap] Cannot open LCP file " << lcp_name << endl;
+            exit(1);
+        }
     }
 
     ifstream matrix_stream;
@@ -738,11 +819,22 @@ int main_mpmap(int argc, char** argv) {
     // Configure its temp directory to the system temp directory
     gcsa::TempFile::setDirectory(temp_file::get_dir());
     
-    xg::XG xg_index(xg_stream);
-    gcsa::GCSA gcsa_index;
-    gcsa_index.load(gcsa_stream);
-    gcsa::LCPArray lcp_array;
-    lcp_array.load(lcp_stream);
+    xg::XG xg_index;
+    if (xg_name == "-") {
+        // Standard input can't be memory-mapped
+        xg_index.load(std::cin);
+    } else {
+        // Memory-map the XG if it's in the mappable layout
+        xg_index.load_file(xg_name);
+    }
+    gcsa::GCSA* gcsa_index = nullptr;
+    gcsa::LCPArray* lcp_array = nullptr;
+    if (gcsa_stream.is_open()) {
+        gcsa_index = new gcsa::GCSA();
+        gcsa_index->load(gcsa_stream);
+        lcp_array = new gcsa::LCPArray();
+        lcp_array->load(lcp_stream);
+    }
     
     gbwt::GBWT* gbwt = nullptr;
     haplo::linear_haplo_structure* sublinearLS = nullptr;
@@ -784,11 +876,46 @@ int main_mpmap(int argc, char** argv) {
         snarl_manager = new SnarlManager(snarl_stream);
     }
         
-    MultipathMapper multipath_mapper(&xg_index, &gcsa_index, &lcp_array, haplo_score_provider, snarl_manager);
+    DistanceIndex* distance_index = nullptr;
+    if (!distance_index_name.empty()) {
+        ifstream distance_index_stream(distance_index_name);
+        if (!distance_index_stream) {
+            cerr << "error:[vg mpmap] Cannot open distance index file " << distance_index_name << endl;
+            exit(1);
+        }
+        distance_index = new DistanceIndex();
+        try {
+            distance_index->load(distance_index_stream);
+        }
+        catch (const runtime_error& e) {
+            cerr << "error:[vg mpmap] " << e.what() << endl;
+            exit(1);
+        }
+    }
+    
+    MinimizerIndex* minimizer_index = nullptr;
+    if (!minimizer_index_name.empty()) {
+        ifstream minimizer_index_stream(minimizer_index_name);
+        if (!minimizer_index_stream) {
+            cerr << "error:[vg mpmap] Cannot open minimizer index file " << minimizer_index_name << endl;
+            exit(1);
+        }
+        minimizer_index = new MinimizerIndex();
+        try {
+            minimizer_index->load(minimizer_index_stream);
+        }
+        catch (const runtime_error& e) {
+            cerr << "error:[vg mpmap] " << e.what() << endl;
+            exit(1);
+        }
+    }
+    
+    MultipathMapper multipath_mapper(&xg_index, gcsa_index, lcp_array, haplo_score_provider, snarl_manager);
     
     // set alignment parameters
     multipath_mapper.set_alignment_scores(match_score, mismatch_score, gap_open_score, gap_extension_score, full_length_bonus);
     if(matrix_stream.is_open()) multipath_mapper.load_scoring_matrix(matrix_stream);
+    multipath_mapper.set_xdrop_threshold(xdrop_threshold);
     multipath_mapper.adjust_alignments_for_base_quality = qual_adjusted;
     multipath_mapper.strip_bonuses = strip_full_length_bonus;
     multipath_mapper.band_padding = band_padding;
@@ -829,8 +956,13 @@ int main_mpmap(int argc, char** argv) {
     multipath_mapper.log_likelihood_approx_factor = likelihood_approx_exp;
     multipath_mapper.num_mapping_attempts = max_map_attempts;
     multipath_mapper.unstranded_clustering = unstranded_clustering;
+    multipath_mapper.use_sparse_chaining = use_sparse_chaining;
+    multipath_mapper.set_mem_cache_size(mem_cache_size);
+    multipath_mapper.distance_index = distance_index;
+    multipath_mapper.minimizer_index = minimizer_index;
     multipath_mapper.min_median_mem_coverage_for_split = min_median_mem_coverage_for_split;
     multipath_mapper.suppress_cluster_merging = suppress_cluster_merging;
+    multipath_mapper.annotate_stage_stats = annotate_stage_stats;
     
     // set pair rescue parameters
     multipath_mapper.max_rescue_attempts = max_rescue_attempts;
@@ -855,6 +987,9 @@ int main_mpmap(int argc, char** argv) {
     int thread_count = get_thread_count();
     multipath_mapper.set_alignment_threads(thread_count);
     
+    // start recording stages now that calibration is done
+    MappingStageStats::set_enabled(report_stage_stats || annotate_stage_stats);
+    
     // are we doing paired ends?
     if (interleaved_input || !fastq_name_2.empty()) {
         // make sure buffer size is even (ensures that output will be interleaved)
@@ -1221,6 +1356,15 @@ int main_mpmap(int argc, char** argv) {
     read_time_file.close();
 #endif
     
+    if (report_stage_stats) {
+        MappingStageStats::report(cerr, MappingStageStats::total());
+        BaseAligner::report_banded_widths(cerr, BaseAligner::banded_width_counts());
+        if (multipath_mapper.get_mem_cache()) {
+            cerr << "[vg mpmap] MEM cache hits = " << multipath_mapper.get_mem_cache()->hits()
+                 << ", misses = " << multipath_mapper.get_mem_cache()->misses() << endl;
+        }
+    }
+    
     //cerr << "MEM length filtering efficiency: " << ((double) OrientedDistanceClusterer::MEM_FILTER_COUNTER) / OrientedDistanceClusterer::MEM_TOTAL << " (" << OrientedDistanceClusterer::MEM_FILTER_COUNTER << "/" << OrientedDistanceClusterer::MEM_TOTAL << ")" << endl;
     //cerr << "MEM cluster filtering efficiency: " << ((double) OrientedDistanceClusterer::PRUNE_COUNTER) / OrientedDistanceClusterer::CLUSTER_TOTAL << " (" << OrientedDistanceClusterer::PRUNE_COUNTER << "/" << OrientedDistanceClusterer::CLUSTER_TOTAL << ")" << endl;
     //cerr << "subgraph filtering efficiency: " << ((double) MultipathMapper::PRUNE_COUNTER) / MultipathMapper::SUBGRAPH_TOTAL << " (" << MultipathMapper::PRUNE_COUNTER << "/" << MultipathMapper::SUBGRAPH_TOTAL << ")" << endl;
@@ -1241,6 +1385,22 @@ int main_mpmap(int argc, char** argv) {
         delete gbwt;
     }
     
+    if (distance_index != nullptr) {
+        delete distance_index;
+    }
+    
+    if (minimizer_index != nullptr) {
+        delete minimizer_index;
+    }
+    
+    if (lcp_array != nullptr) {
+        delete lcp_array;
+    }
+    
+    if (gcsa_index != nullptr) {
+        delete gcsa_index;
+    }
+    
     return 0;
 }
 
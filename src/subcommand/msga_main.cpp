@@ -60,6 +60,7 @@ void help_msga(char** argv) {
          << "    -Q, --idx-prune-subs N  prune subgraphs shorter than this length from input graph to GCSA (default: off)" << endl
          << "    -m, --node-max N        chop nodes to be shorter than this length (default: 2* --idx-kmer-size)" << endl
          << "    -X, --idx-doublings N   use this many doublings when building the GCSA indexes [2]" << endl
+         << "    -j, --idx-kmer-mem N    hold about N MB of kmers in memory while building the GCSA indexes [1024]" << endl
          << "graph normalization:" << endl
          << "    -N, --normalize         normalize the graph after assembly" << endl
          << "    -Z, --circularize       the input sequences are from circular genomes, circularize them after inclusion" << endl
@@ -98,6 +99,7 @@ int main_msga(int argc, char** argv) {
     int max_band_jump = 128;
     int band_multimaps = 16;
     size_t doubling_steps = 3;
+    size_t kmer_memory_limit = 1024 * 1024 * 1024;
     bool debug = false;
     bool debug_align = false;
     size_t node_max = 0;
@@ -181,11 +183,12 @@ int main_msga(int argc, char** argv) {
                 {"align-progress", no_argument, 0, 'S'},
                 {"bigger-first", no_argument, 0, 'a'},
                 {"no-patch-aln", no_argument, 0, '8'},
+                {"idx-kmer-mem", required_argument, 0, 'j'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hf:n:s:g:b:K:X:w:DAc:P:E:Q:NY:H:t:m:M:q:O:I:i:o:y:ZW:z:k:L:e:r:u:l:C:F:SJ:B:a8",
+        c = getopt_long (argc, argv, "hf:n:s:g:b:K:X:w:DAc:P:E:Q:NY:H:t:m:M:q:O:I:i:o:y:ZW:z:k:L:e:r:u:l:C:F:SJ:B:a8j:",
                          long_options, &option_index);
 
         // Detect the end of the options.
@@ -292,6 +295,10 @@ int main_msga(int argc, char** argv) {
             idx_kmer_size = atoi(optarg);
             break;
 
+        case 'j':
+            kmer_memory_limit = max(atoi(optarg), 1) * (size_t) 1024 * 1024;
+            break;
+
         case 'O':
             band_overlap = atoi(optarg);
             break;
@@ -531,42 +538,49 @@ int main_msga(int argc, char** argv) {
         // Configure its temp directory to the system temp directory
         gcsa::TempFile::setDirectory(temp_file::get_dir());
 
-        if (idx_path_only) {
-            // make the index from only the kmers in the embedded paths
-            vector<string> tmpfiles;
-            // these must be compacted for this to work
-            vg::id_t head_id = graph->node_count() * 2;
-            vg::id_t tail_id = head_id+1;
-            graph->paths.for_each_name([&](const string& name) {
-                    VG path_graph = *graph;
-                    if (edge_max) path_graph.prune_complex_with_head_tail(idx_kmer_size, edge_max);
-                    path_graph.keep_path(name);
-                    size_t limit = ~(size_t)0;
-                    tmpfiles.push_back(
-                        write_gcsa_kmers_to_tmpfile(path_graph, idx_kmer_size, limit, head_id, tail_id));
-                });
-            // Make the index with the kmers
-            gcsa::InputGraph input_graph(tmpfiles, true);
-            gcsa::ConstructionParameters params;
-            params.setSteps(doubling_steps);
-            // build the GCSA index
-            gcsaidx = new gcsa::GCSA(input_graph, params);
-            // build the LCP array
-            lcpidx = new gcsa::LCPArray(input_graph, params);
-            // clean up the tmp files for the path kmers
-            for (auto& tfn : tmpfiles) {
-                temp_file::remove(tfn);
+        try {
+            if (idx_path_only) {
+                // make the index from only the kmers in the embedded paths
+                vector<string> tmpfiles;
+                // these must be compacted for this to work
+                vg::id_t head_id = graph->node_count() * 2;
+                vg::id_t tail_id = head_id+1;
+                graph->paths.for_each_name([&](const string& name) {
+                        VG path_graph = *graph;
+                        if (edge_max) path_graph.prune_complex_with_head_tail(idx_kmer_size, edge_max);
+                        path_graph.keep_path(name);
+                        size_t limit = ~(size_t)0;
+                        tmpfiles.push_back(
+                            write_gcsa_kmers_to_tmpfile(path_graph, idx_kmer_size, limit, head_id, tail_id,
+                                                        "vg-kmers-tmp-", kmer_memory_limit));
+                    });
+                // Make the index with the kmers
+                gcsa::InputGraph input_graph(tmpfiles, true);
+                gcsa::ConstructionParameters params;
+                params.setSteps(doubling_steps);
+                // build the GCSA index
+                gcsaidx = new gcsa::GCSA(input_graph, params);
+                // build the LCP array
+                lcpidx = new gcsa::LCPArray(input_graph, params);
+                // clean up the tmp files for the path kmers
+                for (auto& tfn : tmpfiles) {
+                    temp_file::remove(tfn);
+                }
+            } else if (edge_max) {
+                VG gcsa_graph = *graph; // copy the graph
+                // remove complex components
+                gcsa_graph.prune_complex_with_head_tail(idx_kmer_size, edge_max);
+                if (subgraph_prune) gcsa_graph.prune_short_subgraphs(subgraph_prune);
+                // then index
+                build_gcsa_lcp(gcsa_graph, gcsaidx, lcpidx, idx_kmer_size, doubling_steps, 500, kmer_memory_limit);
+            } else {
+                // if no complexity reduction is requested, just build the index
+                build_gcsa_lcp(*graph, gcsaidx, lcpidx, idx_kmer_size, doubling_steps, 500, kmer_memory_limit);
             }
-        } else if (edge_max) {
-            VG gcsa_graph = *graph; // copy the graph
-            // remove complex components
-            gcsa_graph.prune_complex_with_head_tail(idx_kmer_size, edge_max);
-            if (subgraph_prune) gcsa_graph.prune_short_subgraphs(subgraph_prune);
-            // then index
-            build_gcsa_lcp(gcsa_graph, gcsaidx, lcpidx, idx_kmer_size, doubling_steps);
-        } else {
-            // if no complexity reduction is requested, just build the index
-            build_gcsa_lcp(*graph, gcsaidx, lcpidx, idx_kmer_size, doubling_steps);
+        }
+        catch (const runtime_error& e) {
+            cerr << "error:[vg msga] " << e.what() << endl;
+            exit(1);
         }
         mapper = new Mapper(xgidx, gcsaidx, lcpidx);
         { // set mapper variables
@@ -34,6 +34,10 @@ void help_xg(char** argv) {
          << "    -v, --vg FILE              compress graph in vg FILE" << endl
          << "    -V, --validate             validate compression" << endl
          << "    -o, --out FILE             serialize graph to FILE in xg format" << endl
+         << "    -M, --mappable             serialize in a layout that can be memory-mapped by vg map and mpmap" << endl
+         << "    -m, --memory N             build holding about N MB of the graph in memory, spilling the rest to" << endl
+         << "                               temp files (default: hold the whole graph in memory)" << endl
+         << "    -j, --threads N            sort spilled parts of the graph in N threads" << endl
          << "    -i, --in FILE              use index in FILE" << endl
          << "    -X, --extract-vg FILE      serialize graph to FILE in vg format" << endl
          << "    -n, --node ID              graph neighborhood around node with ID" << endl
@@ -88,6 +92,8 @@ int main_xg(int argc, char** argv) {
     bool is_sorted_dag = false;
     string report_name;
     string b_array_name;
+    bool mappable = false;
+    size_t max_buffer_mb = 0;
     
     int c;
     optind = 2; // force optind past "xg" positional argument
@@ -97,6 +103,9 @@ int main_xg(int argc, char** argv) {
                 {"help", no_argument, 0, 'h'},
                 {"vg", required_argument, 0, 'v'},
                 {"out", required_argument, 0, 'o'},
+                {"mappable", no_argument, 0, 'M'},
+                {"memory", required_argument, 0, 'm'},
+                {"threads", required_argument, 0, 'j'},
                 {"in", required_argument, 0, 'i'},
                 {"extract-vg", required_argument, 0, 'X'},
                 {"node", required_argument, 0, 'n'},
@@ -123,7 +132,7 @@ int main_xg(int argc, char** argv) {
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hv:o:i:X:f:t:s:c:n:p:DxrdTO:S:E:VR:P:F:b:",
+        c = getopt_long (argc, argv, "hv:o:Mm:j:i:X:f:t:s:c:n:p:DxrdTO:S:E:VR:P:F:b:",
                          long_options, &option_index);
 
         // Detect the end of the options.
@@ -145,6 +154,18 @@ int main_xg(int argc, char** argv) {
             out_name = optarg;
             break;
 
+        case 'M':
+            mappable = true;
+            break;
+
+        case 'm':
+            max_buffer_mb = stoull(optarg);
+            break;
+
+        case 'j':
+            omp_set_num_threads(atoi(optarg));
+            break;
+
         case 'D':
             print_graph = true;
             break;
@@ -248,12 +269,14 @@ int main_xg(int argc, char** argv) {
     if (in_name.empty()) assert(!vg_in.empty());
     if (vg_in == "-") {
         graph = new XG;
-        graph->from_stream(std::cin, validate_graph, print_graph, store_threads, is_sorted_dag);
+        graph->from_stream(std::cin, validate_graph, print_graph, store_threads, is_sorted_dag,
+                           max_buffer_mb * 1024 * 1024);
     } else if (vg_in.size()) {
         ifstream in;
         in.open(vg_in.c_str());
         graph = new XG;
-        graph->from_stream(in, validate_graph, print_graph, store_threads, is_sorted_dag);
+        graph->from_stream(in, validate_graph, print_graph, store_threads, is_sorted_dag,
+                           max_buffer_mb * 1024 * 1024);
     }
 
     if (in_name.size()) {
@@ -261,9 +284,7 @@ int main_xg(int argc, char** argv) {
         if (in_name == "-") {
             graph->load(std::cin);
         } else {
-            ifstream in;
-            in.open(in_name.c_str());
-            graph->load(in);
+            graph->load_file(in_name);
         }
     }
 
@@ -289,13 +310,26 @@ int main_xg(int argc, char** argv) {
     }
 
     if (!out_name.empty()) {
+        if (out_name == in_name && out_name != "-") {
+            // The input may be memory-mapped, so we can't overwrite it.
+            cerr << "error [vg xg] cannot write the index back to its input file" << endl;
+            return 1;
+        }
         if (out_name == "-") {
-            graph->serialize(std::cout, structure.get(), "xg");
+            if (mappable) {
+                graph->serialize_mappable(std::cout);
+            } else {
+                graph->serialize(std::cout, structure.get(), "xg");
+            }
             std::cout.flush();
         } else {
             ofstream out;
             out.open(out_name.c_str());
-            graph->serialize(out, structure.get(), "xg");
+            if (mappable) {
+                graph->serialize_mappable(out);
+            } else {
+                graph->serialize(out, structure.get(), "xg");
+            }
             out.flush();
         }
     }
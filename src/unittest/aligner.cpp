@@ -315,6 +315,78 @@ TEST_CASE("Full-length bonus is applied to both ends by rescoring", "[aligner][a
     // And with a full length bonus at each end it's 139.
     REQUIRE(aligner1.score_ungapped_alignment(aln) == 139);
 }
+
+TEST_CASE("Aligner gives the same alignments whether or not it reuses graph memory", "[aligner][alignment][mapping]") {
+    
+    VG graph;
+    
+    Aligner aligner;
+    
+    // leave a gap in the IDs, and include an edge that has to be flipped
+    Node* n0 = graph.create_node("AGTG", 1);
+    Node* n1 = graph.create_node("C", 2);
+    Node* n2 = graph.create_node("A", 3);
+    Node* n3 = graph.create_node("TGAAGT", 1000);
+    
+    graph.create_edge(n0, n1);
+    graph.create_edge(n0, n2);
+    graph.create_edge(n3, n1, true, true);
+    graph.create_edge(n2, n3);
+    
+    size_t old_max_arena_bytes = GSSWGraphWorkspace::max_arena_bytes;
+    
+    for (string read : {"AGTGCTGAAGT", "AGTGATGAAGT", "GTGATGA"}) {
+        Alignment reused, fresh;
+        reused.set_sequence(read);
+        fresh.set_sequence(read);
+        
+        aligner.align(reused, graph.graph, true, false);
+        // make the graph too big for the workspace
+        GSSWGraphWorkspace::max_arena_bytes = 0;
+        aligner.align(fresh, graph.graph, true, false);
+        GSSWGraphWorkspace::max_arena_bytes = old_max_arena_bytes;
+        
+        REQUIRE(reused.score() == fresh.score());
+        REQUIRE(pb2json(reused.path()) == pb2json(fresh.path()));
+    }
+    
+    REQUIRE(GSSWGraphWorkspace::local().arena_capacity() > 0);
+}
+
+TEST_CASE("Aligners score exact matches on packed reads the same as on strings", "[aligner][alignment][scoring]") {
+    
+    Aligner aligner;
+    QualAdjAligner qual_adj_aligner;
+    
+    // long enough to use the vector kernel, with Ns and lower case bases
+    string sequence = "GATTACANCATTAGGCATGCAAGTCCAacgtGGATCCNNTTAGCATCGAGCTAGCATCGA"
+                      "TTGACCATGANNAGCTTAGGCATCGATCGGATTACAGATTACAtgcaGCTAGCNATCGCA";
+    string quality;
+    for (size_t i = 0; i < sequence.size(); i++) {
+        quality.push_back((char) ((i * 7) % 45));
+    }
+    PackedRead packed_read(sequence, quality);
+    REQUIRE(packed_read.size() == sequence.size());
+    
+    for (bool simd : {true, false}) {
+        set_score_kernel_simd(simd);
+        for (size_t begin : {0, 3, 31, 33}) {
+            for (size_t length : vector<size_t>{0, 1, 8, 20, sequence.size() - 33}) {
+                auto seq_begin = sequence.begin() + begin;
+                REQUIRE(aligner.score_exact_match(packed_read, begin, length)
+                        == aligner.score_exact_match(seq_begin, seq_begin + length));
+                REQUIRE(qual_adj_aligner.score_exact_match(packed_read, begin, length)
+                        == qual_adj_aligner.score_exact_match(seq_begin, seq_begin + length, quality.begin() + begin));
+            }
+        }
+    }
+    set_score_kernel_simd(true);
+    
+    // quality adjusted scores need qualities
+    PackedRead no_quality(sequence);
+    REQUIRE_THROWS(qual_adj_aligner.score_exact_match(no_quality, 0, sequence.size()));
+    REQUIRE_THROWS(PackedRead(sequence, "II"));
+}
    
 }
 }
@@ -3438,6 +3438,195 @@ namespace vg {
                 }
             }
         }
+        
+        TEST_CASE( "Banded global aligner gives the same alignments with and without vector instructions",
+                  "[alignment][banded][mapping]" ) {
+            
+            VG graph;
+            
+            Aligner aligner;
+            
+            // a chain of nodes with SNP bubbles, long enough to fill many vectors per column
+            string ref;
+            Node* prev = nullptr;
+            for (size_t i = 0; i < 20; i++) {
+                Node* n = graph.create_node("ACGTTGCAAGGCTACC");
+                if (prev != nullptr) {
+                    Node* ref_allele = graph.create_node("G");
+                    Node* alt_allele = graph.create_node("T");
+                    graph.create_edge(prev, ref_allele);
+                    graph.create_edge(prev, alt_allele);
+                    graph.create_edge(ref_allele, n);
+                    graph.create_edge(alt_allele, n);
+                    ref += ref_allele->sequence();
+                }
+                ref += n->sequence();
+                prev = n;
+            }
+            
+            // make a read with a few edits, and a short one that fits in 8 bit scores
+            string long_read = ref.substr(0, 100) + "A" + ref.substr(100, 150) + ref.substr(260);
+            long_read[40] = 'T';
+            string short_read = graph.graph.node(0).sequence();
+            short_read[3] = 'A';
+            
+            Graph short_graph;
+            *short_graph.add_node() = graph.graph.node(0);
+            
+            for (bool use_short : {false, true}) {
+                Alignment vectorized, scalar;
+                vectorized.set_sequence(use_short ? short_read : long_read);
+                scalar.set_sequence(use_short ? short_read : long_read);
+                Graph& g = use_short ? short_graph : graph.graph;
+                
+                aligner.align_global_banded(vectorized, g, 40, true);
+                set_banded_global_simd(false);
+                REQUIRE(string(banded_global_simd_kernel()) == "scalar");
+                aligner.align_global_banded(scalar, g, 40, true);
+                set_banded_global_simd(true);
+                
+                REQUIRE(vectorized.score() == scalar.score());
+                REQUIRE(pb2json(vectorized.path()) == pb2json(scalar.path()));
+            }
+        }
+        
+        TEST_CASE( "Banded global aligner kernels agree when 8 bit scores saturate",
+                  "[alignment][banded][mapping]" ) {
+            
+            Aligner aligner;
+            
+            // long nodes, so that most of the band is filled by the column kernels
+            string ref;
+            for (size_t i = 0; i < 12; i++) {
+                ref += "ACGTTGCAAGGCTACC";
+            }
+            VG long_graph;
+            long_graph.create_node(ref);
+            VG short_graph;
+            short_graph.create_node(ref.substr(0, 64));
+            
+            // the long read's score runs off the top of the range, so neither kernel can let it fit
+            string short_read = ref.substr(0, 60);
+            short_read[30] = 'A';
+            string long_read = ref;
+            
+            for (bool use_short : {false, true}) {
+                Alignment vectorized, scalar;
+                vectorized.set_sequence(use_short ? short_read : long_read);
+                scalar.set_sequence(use_short ? short_read : long_read);
+                Graph& g = use_short ? short_graph.graph : long_graph.graph;
+                
+                BandedGlobalAligner<int8_t> vectorized_band(vectorized, g, 10, true);
+                bool vectorized_fits = vectorized_band.align_if_fits(aligner.score_matrix, aligner.nt_table,
+                                                                     aligner.gap_open, aligner.gap_extension);
+                set_banded_global_simd(false);
+                BandedGlobalAligner<int8_t> scalar_band(scalar, g, 10, true);
+                bool scalar_fits = scalar_band.align_if_fits(aligner.score_matrix, aligner.nt_table,
+                                                             aligner.gap_open, aligner.gap_extension);
+                set_banded_global_simd(true);
+                
+                REQUIRE(vectorized_fits == scalar_fits);
+                if (!use_short) {
+                    REQUIRE(!vectorized_fits);
+                }
+                REQUIRE(vectorized.score() == scalar.score());
+                REQUIRE(pb2json(vectorized.path()) == pb2json(scalar.path()));
+            }
+        }
+        
+        TEST_CASE( "Banded global aligner moves to a wider integer type when the scores saturate",
+                  "[alignment][banded][mapping]" ) {
+            
+            VG graph;
+            
+            QualAdjAligner aligner;
+            
+            // a read long enough that its quality adjusted score doesn't fit in 16 bits
+            string ref;
+            while (aligner.score_exact_match(ref, string(ref.size(), (char) 40)) <= numeric_limits<int16_t>::max()) {
+                ref += "ACGTTGCAAGGCTACC";
+            }
+            graph.create_node(ref);
+            
+            Alignment aln;
+            aln.set_sequence(ref);
+            aln.set_quality(string(ref.size(), (char) 40));
+            
+            aligner.align_global_banded(aln, graph.graph, 1, true);
+            
+            REQUIRE(aln.score() >= aligner.score_exact_match(aln, 0, ref.size()));
+            REQUIRE(aln.path().mapping_size() == 1);
+            REQUIRE(mapping_from_length(aln.path().mapping(0)) == ref.size());
+            REQUIRE(mapping_to_length(aln.path().mapping(0)) == ref.size());
+        }
+        
+        TEST_CASE( "Banded global aligner gives the same alignments whether or not it picks its integer width adaptively",
+                  "[alignment][banded][mapping]" ) {
+            
+            VG graph;
+            
+            Aligner aligner;
+            
+            Node* n0 = graph.create_node("ACGTTGCAAGGCTACCTGAC");
+            Node* n1 = graph.create_node("G");
+            Node* n2 = graph.create_node("T");
+            Node* n3 = graph.create_node("CAGGTTACGATTGCAGTCAA");
+            graph.create_edge(n0, n1);
+            graph.create_edge(n0, n2);
+            graph.create_edge(n1, n3);
+            graph.create_edge(n2, n3);
+            
+            // a close match fits in 8 bit scores, but a read that is nothing like the graph does not
+            string good_read = "ACGTTGCAAGGCTACCTGACTCAGGTTACGATTGCAGTCAA";
+            good_read[10] = 'T';
+            string bad_read(60, 'G');
+            
+            for (bool multi : {false, true}) {
+                for (bool good : {true, false}) {
+                    const string& read = good ? good_read : bad_read;
+                    Alignment adaptive, fixed;
+                    adaptive.set_sequence(read);
+                    fixed.set_sequence(read);
+                    vector<Alignment> adaptive_alts, fixed_alts;
+                    
+                    BandedWidthCounts before = BaseAligner::banded_width_counts();
+                    aligner.adaptive_banded_width = true;
+                    if (multi) {
+                        aligner.align_global_banded_multi(adaptive, adaptive_alts, graph.graph, 5, 1, true);
+                    }
+                    else {
+                        aligner.align_global_banded(adaptive, graph.graph, 1, true);
+                    }
+                    BandedWidthCounts after = BaseAligner::banded_width_counts();
+                    
+                    aligner.adaptive_banded_width = false;
+                    if (multi) {
+                        aligner.align_global_banded_multi(fixed, fixed_alts, graph.graph, 5, 1, true);
+                    }
+                    else {
+                        aligner.align_global_banded(fixed, graph.graph, 1, true);
+                    }
+                    
+                    REQUIRE(adaptive.score() == fixed.score());
+                    REQUIRE(pb2json(adaptive.path()) == pb2json(fixed.path()));
+                    REQUIRE(adaptive_alts.size() == fixed_alts.size());
+                    for (size_t i = 0; i < adaptive_alts.size(); i++) {
+                        REQUIRE(adaptive_alts[i].score() == fixed_alts[i].score());
+                        REQUIRE(pb2json(adaptive_alts[i].path()) == pb2json(fixed_alts[i].path()));
+                    }
+                    
+                    if (good) {
+                        // the fixed width choice would have used 16 bits
+                        REQUIRE(after.finished[BandedWidth8] == before.finished[BandedWidth8] + 1);
+                        REQUIRE(after.retries == before.retries);
+                    }
+                    else {
+                        REQUIRE(after.finished[BandedWidth16] == before.finished[BandedWidth16] + 1);
+                        REQUIRE(after.retries == before.retries + 1);
+                    }
+                }
+            }
+        }
     }
 }
 
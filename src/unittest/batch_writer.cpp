@@ -0,0 +1,175 @@
+/** \file
+ *
+ * Unit tests for the BatchWriter, which writes encoded batches from many
+ * threads.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <omp.h>
+#include "../batch_writer.hpp"
+#include "../alignment.hpp"
+
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+TEST_CASE("BatchWriter writes ordered batches in order", "[stream][batchwriter]") {
+
+    stringstream out;
+    {
+        // Use a small backlog so that threads have to wait on each other
+        stream::BatchWriter writer(out, true, 4);
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < 1000; i++) {
+            // Leave some batches empty
+            writer.submit(i, i % 7 == 0 ? string() : to_string(i) + "\n");
+        }
+        writer.finish();
+    }
+
+    stringstream expected;
+    for (size_t i = 0; i < 1000; i++) {
+        if (i % 7 != 0) {
+            expected << i << "\n";
+        }
+    }
+    REQUIRE(out.str() == expected.str());
+}
+
+TEST_CASE("BatchWriter keeps batched reads in order on many threads", "[stream][batchwriter]") {
+
+    // Use more threads than the default backlog can cover
+    int old_threads = omp_get_max_threads();
+    size_t threads = 128;
+    omp_set_num_threads(threads);
+
+    size_t total_reads = 20000;
+    size_t reads_made = 0;
+    function<bool(Alignment&)> get_read = [&](Alignment& aln) {
+        if (reads_made == total_reads) {
+            return false;
+        }
+        aln.set_name(to_string(reads_made++));
+        return true;
+    };
+
+    stringstream out;
+    stream::BatchWriter writer(out, true, max_batches_in_flight(threads));
+    size_t batches = unpaired_for_each_batch_parallel(get_read, [&](size_t batch_number, vector<Alignment>& batch) {
+        if (batch_number % 100 == 0) {
+            // Hold up some batches so the ones after them pile up
+            this_thread::sleep_for(chrono::milliseconds(20));
+        }
+        stringstream encoded;
+        for (auto& aln : batch) {
+            encoded << aln.name() << "\n";
+        }
+        writer.submit(batch_number, encoded.str());
+    }, 8);
+    writer.finish();
+    omp_set_num_threads(old_threads);
+
+    stringstream expected;
+    for (size_t i = 0; i < total_reads; i++) {
+        expected << i << "\n";
+    }
+    REQUIRE(batches == total_reads / 8);
+    REQUIRE(out.str() == expected.str());
+}
+
+TEST_CASE("GAM batches come out numbered in input order", "[stream][batchwriter]") {
+
+    int old_threads = omp_get_max_threads();
+    omp_set_num_threads(8);
+
+    // Write the reads in several groups so the stream has several BGZF blocks
+    size_t total_reads = 10000;
+    stringstream gam;
+    for (size_t start = 0; start < total_reads; start += 1000) {
+        stream::write<Alignment>(gam, 1000, [&](uint64_t i) {
+            Alignment aln;
+            aln.set_name(to_string(start + i));
+            aln.set_sequence(string(50, 'A'));
+            return aln;
+        });
+    }
+    string data = gam.str();
+
+    SECTION("unpaired reads stay in order") {
+        stringstream in(data);
+        vector<string> encoded(total_reads / 8);
+        size_t batches = gam_unpaired_for_each_batch_parallel(in, [&](size_t batch_number, vector<Alignment>& batch) {
+            for (auto& aln : batch) {
+                encoded.at(batch_number) += aln.name() + "\n";
+            }
+        }, 8);
+
+        stringstream expected;
+        for (size_t i = 0; i < total_reads; i++) {
+            expected << i << "\n";
+        }
+        string got;
+        for (auto& batch : encoded) {
+            got += batch;
+        }
+        REQUIRE(batches == total_reads / 8);
+        REQUIRE(got == expected.str());
+    }
+
+    SECTION("interleaved reads come out as pairs in order") {
+        stringstream in(data);
+        vector<string> encoded(total_reads / 2 / 8);
+        size_t batches = gam_paired_interleaved_for_each_batch_parallel(in, [&](size_t batch_number,
+                                                                                vector<pair<Alignment, Alignment>>& batch) {
+            for (auto& p : batch) {
+                encoded.at(batch_number) += p.first.name() + "," + p.second.name() + "\n";
+            }
+        }, 8);
+
+        stringstream expected;
+        for (size_t i = 0; i < total_reads; i += 2) {
+            expected << i << "," << i + 1 << "\n";
+        }
+        string got;
+        for (auto& batch : encoded) {
+            got += batch;
+        }
+        REQUIRE(batches == total_reads / 2 / 8);
+        REQUIRE(got == expected.str());
+    }
+
+    omp_set_num_threads(old_threads);
+}
+
+TEST_CASE("BatchWriter writes every unordered batch", "[stream][batchwriter]") {
+
+    stringstream out;
+    stream::BatchWriter writer(out, false, 4);
+#pragma omp parallel for
+    for (size_t i = 0; i < 1000; i++) {
+        writer.submit(0, "x");
+    }
+    writer.finish();
+
+    REQUIRE(out.str() == string(1000, 'x'));
+}
+
+TEST_CASE("BatchWriter notices missing ordered batches", "[stream][batchwriter]") {
+
+    stringstream out;
+    stream::BatchWriter writer(out, true);
+    writer.submit(0, "a");
+    writer.submit(2, "c");
+    REQUIRE_THROWS(writer.finish());
+    REQUIRE(out.str() == "a");
+}
+
+}
+}
@@ -0,0 +1,262 @@
+/** \file
+ *
+ * Unit tests for the blocked gzip streams and the virtual offsets that
+ * stream.hpp exposes through them.
+ */
+
+#include <iostream>
+#include <sstream>
+#include "../stream.hpp"
+#include "../vg.pb.h"
+
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+/// Write some groups of named alignments, and return the serialized data.
+static string write_alignment_groups(size_t group_count, size_t group_size) {
+    stringstream out;
+    vector<Alignment> buffer;
+    for (size_t i = 0; i < group_count; i++) {
+        for (size_t j = 0; j < group_size; j++) {
+            Alignment aln;
+            aln.set_name("read" + to_string(i * group_size + j));
+            aln.set_sequence(string(50 + j % 13, "ACGT"[j % 4]));
+            buffer.push_back(aln);
+        }
+        stream::write_buffered(out, buffer, 0);
+    }
+    return out.str();
+}
+
+TEST_CASE("BlockedGzipOutputStream data can be read back", "[stream][bgzf]") {
+
+    string data;
+    {
+        stringstream out;
+        stream::BlockedGzipOutputStream bgzip_out(out);
+
+        // Write more than one block's worth of data
+        void* buffer;
+        int size;
+        size_t written = 0;
+        while (written < 200000) {
+            REQUIRE(bgzip_out.Next(&buffer, &size));
+            for (int i = 0; i < size; i++) {
+                ((char*) buffer)[i] = (char) ((written + i) % 251);
+            }
+            written += size;
+        }
+        bgzip_out.BackUp(written - 200000);
+        REQUIRE(bgzip_out.ByteCount() == 200000);
+        REQUIRE(bgzip_out.EndFile());
+        data = out.str();
+    }
+
+    SECTION("the data starts with a BGZF header") {
+        REQUIRE(data.size() > 18);
+        REQUIRE((unsigned char) data[0] == 0x1f);
+        REQUIRE((unsigned char) data[1] == 0x8b);
+        REQUIRE(data[12] == 'B');
+        REQUIRE(data[13] == 'C');
+    }
+
+    SECTION("BlockedGzipInputStream recovers all the bytes") {
+        istringstream in(data);
+        stream::BlockedGzipInputStream bgzip_in(in);
+
+        const void* buffer;
+        int size;
+        size_t read = 0;
+        bool all_correct = true;
+        while (bgzip_in.Next(&buffer, &size)) {
+            for (int i = 0; i < size; i++) {
+                all_correct &= (((const char*) buffer)[i] == (char) ((read + i) % 251));
+            }
+            read += size;
+        }
+        REQUIRE(all_correct);
+        REQUIRE(read == 200000);
+        REQUIRE(bgzip_in.ByteCount() == 200000);
+    }
+
+    SECTION("BlockedGzipInputStream can seek into the middle of a block") {
+        istringstream in(data);
+        stream::BlockedGzipInputStream bgzip_in(in);
+
+        // The first block starts at 0
+        REQUIRE(bgzip_in.Seek(1000));
+        REQUIRE(bgzip_in.Tell() == 1000);
+
+        const void* buffer;
+        int size;
+        REQUIRE(bgzip_in.Next(&buffer, &size));
+        REQUIRE(((const char*) buffer)[0] == (char) (1000 % 251));
+    }
+}
+
+TEST_CASE("Groups written by stream::write can be sought to", "[stream][bgzf]") {
+
+    string data = write_alignment_groups(20, 1000);
+
+    // Collect the virtual offset and first read name of each group
+    vector<int64_t> group_offsets;
+    vector<string> first_names;
+    size_t total = 0;
+    {
+        istringstream in(data);
+        function<void(int64_t, Alignment&)> lambda = [&](int64_t group_offset, Alignment& aln) {
+            if (group_offsets.empty() || group_offsets.back() != group_offset) {
+                group_offsets.push_back(group_offset);
+                first_names.push_back(aln.name());
+            }
+            total++;
+        };
+        stream::for_each_with_group_offsets(in, lambda);
+    }
+
+    REQUIRE(total == 20000);
+    REQUIRE(group_offsets.size() == 20);
+    REQUIRE(group_offsets.front() == 0);
+    for (size_t i = 0; i < group_offsets.size(); i++) {
+        // Each group starts its own block
+        REQUIRE((group_offsets[i] & 0xffff) == 0);
+        REQUIRE(first_names[i] == "read" + to_string(i * 1000));
+    }
+
+    SECTION("ProtobufIterator can seek to each group") {
+        istringstream in(data);
+        stream::ProtobufIterator<Alignment> iter(in);
+
+        for (size_t i = group_offsets.size(); i > 0; i--) {
+            REQUIRE(iter.seek_group(group_offsets[i - 1]));
+            REQUIRE(iter.has_next());
+            REQUIRE((*iter).name() == first_names[i - 1]);
+            REQUIRE(iter.tell_group() == group_offsets[i - 1]);
+        }
+    }
+
+    SECTION("Reading can start from a group") {
+        istringstream in(data);
+        stream::ProtobufIterator<Alignment> iter(in);
+        REQUIRE(iter.seek_group(group_offsets[15]));
+
+        size_t seen = 0;
+        while (iter.has_next()) {
+            seen++;
+            iter.get_next();
+        }
+        REQUIRE(seen == 5000);
+    }
+}
+
+TEST_CASE("Plain gzip protobuf streams can still be read", "[stream][bgzf]") {
+
+    stringstream out;
+    for (size_t i = 0; i < 3; i++) {
+        // Write a group the old way
+        ::google::protobuf::io::OstreamOutputStream raw_out(&out);
+        ::google::protobuf::io::GzipOutputStream gzip_out(&raw_out);
+        ::google::protobuf::io::CodedOutputStream coded_out(&gzip_out);
+
+        coded_out.WriteVarint64(100);
+        for (size_t j = 0; j < 100; j++) {
+            Alignment aln;
+            aln.set_name("old" + to_string(j));
+            string serialized;
+            aln.SerializeToString(&serialized);
+            coded_out.WriteVarint32(serialized.size());
+            coded_out.WriteRaw(serialized.data(), serialized.size());
+        }
+    }
+
+    istringstream in(out.str());
+    size_t count = 0;
+    function<void(Alignment&)> lambda = [&](Alignment& aln) {
+        REQUIRE(aln.name() == "old" + to_string(count % 100));
+        count++;
+    };
+    stream::for_each(in, lambda);
+
+    REQUIRE(count == 300);
+}
+
+TEST_CASE("Parallel reading keeps interleaved pairs together", "[stream][bgzf]") {
+
+    // Write pairs of reads, in groups that don't line up with pairs
+    stringstream out;
+    vector<Alignment> buffer;
+    for (size_t i = 0; i < 5000; i++) {
+        for (size_t end = 1; end <= 2; end++) {
+            Alignment aln;
+            aln.set_name("pair" + to_string(i) + "/" + to_string(end));
+            aln.set_sequence(string(100, 'A'));
+            buffer.push_back(aln);
+            stream::write_buffered(out, buffer, 333);
+        }
+    }
+    stream::write_buffered(out, buffer, 0);
+
+    istringstream in(out.str());
+    size_t pairs_seen = 0;
+    bool all_paired = true;
+    function<void(Alignment&, Alignment&)> lambda = [&](Alignment& aln1, Alignment& aln2) {
+        string name1 = aln1.name();
+        string name2 = aln2.name();
+        bool paired = name1.substr(0, name1.size() - 2) == name2.substr(0, name2.size() - 2) &&
+            name1.back() == '1' && name2.back() == '2';
+#pragma omp critical (test_pairs)
+        {
+            all_paired &= paired;
+            pairs_seen++;
+        }
+    };
+    stream::for_each_interleaved_pair_parallel(in, lambda);
+
+    REQUIRE(all_paired);
+    REQUIRE(pairs_seen == 5000);
+}
+
+TEST_CASE("MessageFramer can frame data fed in tiny pieces", "[stream][bgzf]") {
+
+    string data = write_alignment_groups(3, 100);
+
+    // Decompress it all
+    string decompressed;
+    {
+        istringstream in(data);
+        stream::BlockedGzipInputStream bgzip_in(in);
+        const void* buffer;
+        int size;
+        while (bgzip_in.Next(&buffer, &size)) {
+            decompressed.append((const char*) buffer, size);
+        }
+    }
+
+    stream::MessageFramer framer;
+    vector<stream::FramedMessage> framed;
+    size_t groups = 0;
+    function<void(uint64_t)> handle_count = [&](uint64_t count) {
+        REQUIRE(count == 100);
+        groups++;
+    };
+    for (size_t i = 0; i < decompressed.size(); i += 7) {
+        shared_ptr<const string> piece = make_shared<string>(decompressed.substr(i, 7));
+        framer.feed(piece, framed, handle_count);
+    }
+    framer.finish();
+
+    REQUIRE(groups == 3);
+    REQUIRE(framed.size() == 300);
+    for (size_t i = 0; i < framed.size(); i++) {
+        Alignment aln;
+        REQUIRE(aln.ParseFromArray(framed[i].data, framed[i].length));
+        REQUIRE(aln.name() == "read" + to_string(i));
+    }
+}
+
+}
+}
@@ -0,0 +1,115 @@
+/** \file
+ *
+ * Unit tests for the ClockCache, a sharded cache shared between threads.
+ */
+
+#include <iostream>
+#include <string>
+#include <omp.h>
+#include "../clock_cache.hpp"
+
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+TEST_CASE("ClockCache stores and retrieves values", "[cache]") {
+
+    ClockCache<int64_t, string> cache(100, 4);
+
+    REQUIRE(cache.retrieve(1) == nullptr);
+    REQUIRE(cache.misses() == 1);
+
+    cache.put(1, "one");
+    auto found = cache.retrieve(1);
+    REQUIRE(found != nullptr);
+    REQUIRE(*found == "one");
+    REQUIRE(cache.hits() == 1);
+
+    SECTION("putting an existing key keeps the old value") {
+        auto kept = cache.put(1, "uno");
+        REQUIRE(*kept == "one");
+        REQUIRE(*cache.retrieve(1) == "one");
+    }
+
+    SECTION("get_or_make only makes values that are missing") {
+        size_t made = 0;
+        auto make = [&]() {
+            made++;
+            return string("two");
+        };
+        REQUIRE(*cache.get_or_make(2, make) == "two");
+        REQUIRE(*cache.get_or_make(2, make) == "two");
+        REQUIRE(made == 1);
+    }
+
+    SECTION("clearing drops values and counters") {
+        cache.clear();
+        REQUIRE(cache.size() == 0);
+        REQUIRE(cache.hits() == 0);
+        REQUIRE(cache.retrieve(1) == nullptr);
+    }
+}
+
+TEST_CASE("ClockCache stays within its capacity and keeps hot values", "[cache]") {
+
+    ClockCache<int64_t, int64_t> cache(64, 1);
+
+    for (int64_t i = 0; i < 64; i++) {
+        cache.put(i, i);
+    }
+    REQUIRE(cache.size() == 64);
+
+    // Touch the first half, so the clock hand passes over them
+    for (int64_t i = 0; i < 32; i++) {
+        REQUIRE(cache.retrieve(i) != nullptr);
+    }
+
+    // Overflow with new values that are never used again
+    for (int64_t i = 64; i < 96; i++) {
+        cache.put(i, i);
+    }
+    REQUIRE(cache.size() == 64);
+
+    // The values we touched survived
+    for (int64_t i = 0; i < 32; i++) {
+        auto found = cache.retrieve(i);
+        REQUIRE(found != nullptr);
+        REQUIRE(*found == i);
+    }
+
+    SECTION("evicted values stay alive for whoever holds them") {
+        auto held = cache.retrieve(0);
+        for (int64_t i = 1000; i < 2000; i++) {
+            cache.put(i, i);
+        }
+        REQUIRE(*held == 0);
+        REQUIRE(cache.size() <= cache.capacity());
+    }
+}
+
+TEST_CASE("ClockCache can be shared between threads", "[cache]") {
+
+    ClockCache<int64_t, int64_t> cache(1000);
+
+    size_t wrong = 0;
+#pragma omp parallel for reduction(+:wrong)
+    for (int64_t i = 0; i < 100000; i++) {
+        int64_t key = (i * 7919) % 2000;
+        auto value = cache.get_or_make(key, [&]() {
+            return key * 2;
+        });
+        if (*value != key * 2) {
+            wrong++;
+        }
+    }
+
+    REQUIRE(wrong == 0);
+    REQUIRE(cache.hits() + cache.misses() == 100000);
+    REQUIRE(cache.size() <= cache.capacity());
+}
+
+}
+}
@@ -9,11 +9,13 @@
 #include "../utility.hpp"
 #include "../path.hpp"
 #include "../json2pb.h"
+#include "../xg.hpp"
 
 #include <vector>
 #include <sstream>
 #include <iostream>
 #include <unordered_map>
+#include <omp.h>
 
 namespace vg {
 namespace unittest {
@@ -1267,6 +1269,149 @@ GATTACACATTAG
 
 }
 
+TEST_CASE( "Chunks constructed in parallel make the same graph as chunks constructed serially", "[constructor]" ) {
+
+    auto vcf_data = R"(##fileformat=VCFv4.0
+##fileDate=20090805
+##source=myImputationProgramV3.1
+##reference=1000GenomesPilot-NCBI36
+##phasing=partial
+##FILTER=<ID=q10,Description="Quality below 10">
+##FILTER=<ID=s50,Description="Less than 50% of samples have data">
+##FORMAT=<ID=GT,Number=1,Type=String,Description="Genotype">
+#CHROM	POS	ID	REF	ALT	QUAL	FILTER	INFO	FORMAT
+ref1	1	.	GA	A	29	PASS	.	GT
+ref1	5	rs1337	AC	A	29	PASS	.	GT
+ref1	9	.	A	T	29	PASS	.	GT
+ref1	16	.	C	CTT	29	PASS	.	GT
+ref1	22	.	A	G	29	PASS	.	GT
+ref2	5	.	A	T	29	PASS	.	GT
+ref2	6	rs1338	C	G	29	PASS	.	GT
+ref2	11	.	TAG	T	29	PASS	.	GT
+)";
+
+    auto fasta_data = R"(>ref1
+GATTACACATTAGGATTACACATTAGGATTACA
+>ref2
+GATTACACATTAGGATTACA
+)";
+
+    string fasta_filename = temp_file::create();
+    ofstream fasta_stream(fasta_filename);
+    fasta_stream << fasta_data;
+    fasta_stream.close();
+
+    // Build the graph in many small chunks with the given number of threads
+    auto construct_with_threads = [&](int threads) {
+        std::stringstream vcf_stream(vcf_data);
+        vcflib::VariantCallFile vcf;
+        vcf.open(vcf_stream);
+        vector<vcflib::VariantCallFile*> vcf_pointers {&vcf};
+
+        FastaReference reference;
+        reference.open(fasta_filename);
+        vector<FastaReference*> fasta_pointers {&reference};
+        vector<FastaReference*> ins_pointers;
+
+        vector<string> emitted;
+        auto callback = [&](Graph& constructed) {
+            emitted.push_back(pb2json(constructed));
+        };
+
+        Constructor constructor;
+        constructor.alt_paths = true;
+        constructor.max_node_size = 3;
+        constructor.vars_per_chunk = 1;
+        constructor.bases_per_chunk = 4;
+
+        int old_threads = omp_get_max_threads();
+        omp_set_num_threads(threads);
+        constructor.construct_graph(fasta_pointers, vcf_pointers, ins_pointers, callback);
+        omp_set_num_threads(old_threads);
+
+        return emitted;
+    };
+
+    auto serial = construct_with_threads(1);
+    auto parallel = construct_with_threads(4);
+
+    REQUIRE(serial.size() > 8);
+    REQUIRE(parallel == serial);
+
+    temp_file::remove(fasta_filename);
+}
+
+TEST_CASE( "A graph can be constructed directly into an xg index", "[constructor][xg]" ) {
+
+    auto vcf_data = R"(##fileformat=VCFv4.0
+##fileDate=20090805
+##source=myImputationProgramV3.1
+##reference=1000GenomesPilot-NCBI36
+##phasing=partial
+##FILTER=<ID=q10,Description="Quality below 10">
+##FILTER=<ID=s50,Description="Less than 50% of samples have data">
+##FORMAT=<ID=GT,Number=1,Type=String,Description="Genotype">
+#CHROM	POS	ID	REF	ALT	QUAL	FILTER	INFO	FORMAT
+ref1	1	.	GA	A	29	PASS	.	GT
+ref1	5	rs1337	AC	A	29	PASS	.	GT
+ref1	16	.	C	CTT	29	PASS	.	GT
+ref2	5	.	A	T	29	PASS	.	GT
+ref2	11	.	TAG	T	29	PASS	.	GT
+)";
+
+    auto fasta_data = R"(>ref1
+GATTACACATTAGGATTACACATTAG
+>ref2
+GATTACACATTAGGATTACA
+)";
+
+    string fasta_filename = temp_file::create();
+    ofstream fasta_stream(fasta_filename);
+    fasta_stream << fasta_data;
+    fasta_stream.close();
+
+    // Run construction, sending the chunks to the given callback
+    auto construct = [&](function<void(Graph&)> callback) {
+        std::stringstream vcf_stream(vcf_data);
+        vcflib::VariantCallFile vcf;
+        vcf.open(vcf_stream);
+        vector<vcflib::VariantCallFile*> vcf_pointers {&vcf};
+
+        FastaReference reference;
+        reference.open(fasta_filename);
+        vector<FastaReference*> fasta_pointers {&reference};
+        vector<FastaReference*> ins_pointers;
+
+        Constructor constructor;
+        constructor.alt_paths = true;
+        constructor.max_node_size = 3;
+        constructor.vars_per_chunk = 1;
+        constructor.bases_per_chunk = 4;
+        constructor.construct_graph(fasta_pointers, vcf_pointers, ins_pointers, callback);
+    };
+
+    Graph built;
+    construct([&](Graph& constructed) {
+        built.MergeFrom(constructed);
+    });
+    size_t total_sequence = 0;
+    for (auto& node : built.node()) {
+        total_sequence += node.sequence().size();
+    }
+
+    for (size_t max_buffer_bytes : {0, 1}) {
+        xg::XG index;
+        index.from_callback(construct, false, false, false, false, max_buffer_bytes);
+
+        REQUIRE(index.node_count == (size_t) built.node_size());
+        REQUIRE(index.seq_length == total_sequence);
+        REQUIRE(index.path_length("ref1") == 26);
+        REQUIRE(index.path_length("ref2") == 20);
+    }
+
+    temp_file::remove(fasta_filename);
+}
+
 TEST_CASE( "A deletion is represented properly" , "[constructor]") {
 
     auto vcf_data = R"(##fileformat=VCFv4.2
@@ -0,0 +1,149 @@
+/// \file distance_index.cpp
+///
+/// Unit tests for the DistanceIndex, checked against searching the graph.
+///
+
+#include <iostream>
+#include <sstream>
+#include <queue>
+#include <limits>
+#include "../vg.hpp"
+#include "../genotypekit.hpp"
+#include "../snarls.hpp"
+#include "../distance_index.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+/// Find the minimum distance between positions by searching the whole graph
+static int64_t searched_distance(const HandleGraph& graph, const pos_t& pos1, const pos_t& pos2) {
+    int64_t best = numeric_limits<int64_t>::max();
+    if (id(pos1) == id(pos2) && is_rev(pos1) == is_rev(pos2) && offset(pos2) >= offset(pos1)) {
+        best = offset(pos2) - offset(pos1);
+    }
+
+    handle_t from = graph.get_handle(id(pos1), is_rev(pos1));
+    handle_t to = graph.get_handle(id(pos2), is_rev(pos2));
+
+    // distances to the starts of handles after the first one
+    unordered_map<handle_t, int64_t> distances;
+    priority_queue<pair<int64_t, handle_t>, vector<pair<int64_t, handle_t>>, greater<pair<int64_t, handle_t>>> queue;
+    int64_t leaving = graph.get_length(from) - offset(pos1);
+    graph.follow_edges(from, false, [&](const handle_t& next) {
+        queue.emplace(leaving, next);
+    });
+    while (!queue.empty()) {
+        int64_t distance = queue.top().first;
+        handle_t here = queue.top().second;
+        queue.pop();
+        if (distances.count(here)) {
+            continue;
+        }
+        distances[here] = distance;
+        graph.follow_edges(here, false, [&](const handle_t& next) {
+            queue.emplace(distance + graph.get_length(here), next);
+        });
+    }
+
+    if (distances.count(to)) {
+        best = min(best, distances[to] + (int64_t) offset(pos2));
+    }
+    return best;
+}
+
+TEST_CASE("DistanceIndex finds the same distances as searching the graph", "[distance][snarls]") {
+
+    VG graph;
+
+    Node* n1 = graph.create_node("GCA");
+    Node* n2 = graph.create_node("T");
+    Node* n3 = graph.create_node("GG");
+    Node* n4 = graph.create_node("CTGA");
+    Node* n5 = graph.create_node("GCAT");
+    Node* n6 = graph.create_node("TAC");
+    Node* n7 = graph.create_node("G");
+    Node* n8 = graph.create_node("AGTA");
+
+    graph.create_edge(n1, n2);
+    graph.create_edge(n1, n3);
+    graph.create_edge(n2, n4);
+    graph.create_edge(n3, n4);
+    graph.create_edge(n4, n5);
+    graph.create_edge(n4, n8);
+    graph.create_edge(n5, n6);
+    graph.create_edge(n5, n7);
+    graph.create_edge(n6, n8);
+    graph.create_edge(n7, n8);
+
+    CactusSnarlFinder bubble_finder(graph);
+
+    SECTION("distances between all positions in a graph of nested bubbles match") {
+        SnarlManager snarl_manager = bubble_finder.find_snarls();
+        DistanceIndex index(&graph, &snarl_manager);
+
+        REQUIRE(index.min_distance(make_pos_t(n1->id(), false, 0), make_pos_t(n4->id(), false, 0)) == 4);
+        REQUIRE(index.min_distance(make_pos_t(n4->id(), false, 3), make_pos_t(n8->id(), false, 1)) == 2);
+        REQUIRE(index.min_distance(make_pos_t(n8->id(), false, 0), make_pos_t(n1->id(), false, 0))
+                == numeric_limits<int64_t>::max());
+        REQUIRE(index.oriented_distance(make_pos_t(n8->id(), false, 0), make_pos_t(n1->id(), false, 0)) == -8);
+
+        graph.for_each_handle([&](const handle_t& handle1) {
+            for (bool rev1 : {false, true}) {
+                graph.for_each_handle([&](const handle_t& handle2) {
+                    for (bool rev2 : {false, true}) {
+                        for (size_t offset1 = 0; offset1 < graph.get_length(handle1); offset1++) {
+                            for (size_t offset2 = 0; offset2 < graph.get_length(handle2); offset2++) {
+                                pos_t pos1 = make_pos_t(graph.get_id(handle1), rev1, offset1);
+                                pos_t pos2 = make_pos_t(graph.get_id(handle2), rev2, offset2);
+                                REQUIRE(index.min_distance(pos1, pos2) == searched_distance(graph, pos1, pos2));
+                            }
+                        }
+                    }
+                });
+            }
+        });
+    }
+
+    SECTION("walks that turn around through an inversion are found") {
+        graph.create_edge(n6, n7, false, true);
+        graph.create_edge(n2, n3, false, true);
+        SnarlManager snarl_manager = bubble_finder.find_snarls();
+        DistanceIndex index(&graph, &snarl_manager);
+
+        graph.for_each_handle([&](const handle_t& handle1) {
+            for (bool rev1 : {false, true}) {
+                graph.for_each_handle([&](const handle_t& handle2) {
+                    for (bool rev2 : {false, true}) {
+                        pos_t pos1 = make_pos_t(graph.get_id(handle1), rev1, 0);
+                        pos_t pos2 = make_pos_t(graph.get_id(handle2), rev2, 0);
+                        REQUIRE(index.min_distance(pos1, pos2) == searched_distance(graph, pos1, pos2));
+                    }
+                });
+            }
+        });
+    }
+
+    SECTION("a saved index loads with the same distances") {
+        SnarlManager snarl_manager = bubble_finder.find_snarls();
+        DistanceIndex index(&graph, &snarl_manager);
+
+        stringstream serialized;
+        index.save(serialized);
+        DistanceIndex loaded;
+        loaded.load(serialized);
+
+        REQUIRE(loaded.has_node(n5->id()));
+        REQUIRE(!loaded.has_node(n8->id() + 1));
+        pos_t pos1 = make_pos_t(n2->id(), false, 0);
+        pos_t pos2 = make_pos_t(n7->id(), false, 0);
+        REQUIRE(loaded.min_distance(pos1, pos2) == index.min_distance(pos1, pos2));
+
+        stringstream garbage("not an index");
+        REQUIRE_THROWS(loaded.load(garbage));
+    }
+}
+
+}
+}
@@ -0,0 +1,153 @@
+/** \file
+ *
+ * Unit tests for the GAMIndex, which finds alignments in sorted GAM files.
+ */
+
+#include <iostream>
+#include <sstream>
+#include "../gam_index.hpp"
+#include "../gamsorter.hpp"
+#include "../stream.hpp"
+#include "../vg.pb.h"
+
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+/// Make an alignment visiting the given nodes in order
+static Alignment make_gam_index_alignment(const string& name, const vector<id_t>& nodes) {
+    Alignment aln;
+    aln.set_name(name);
+    for (auto& node : nodes) {
+        Mapping* mapping = aln.mutable_path()->add_mapping();
+        mapping->mutable_position()->set_node_id(node);
+    }
+    return aln;
+}
+
+TEST_CASE("GAMIndex finds alignments in a sorted GAM", "[gam][gamindex]") {
+
+    // Make a sorted GAM with a read starting at each node, spanning 3 nodes,
+    // written in small groups so there is something to seek over.
+    stringstream gam;
+    vector<Alignment> buffer;
+    for (id_t i = 1; i <= 2000; i++) {
+        buffer.push_back(make_gam_index_alignment("read" + to_string(i), {i, i + 1, i + 2}));
+        stream::write_buffered(gam, buffer, 10);
+    }
+    // And one that goes backward over a long way
+    buffer.push_back(make_gam_index_alignment("backward", {3000, 2500, 2001}));
+    // And an unmapped one
+    buffer.push_back(make_gam_index_alignment("unmapped", {}));
+    stream::write_buffered(gam, buffer, 0);
+
+    GAMIndex index(16);
+    index.index(gam);
+
+    // Collect the names found for some ranges
+    auto find_names = [&](const vector<pair<id_t, id_t>>& ranges) {
+        gam.clear();
+        gam.seekg(0);
+        stream::ProtobufIterator<Alignment> cursor(gam);
+        vector<string> names;
+        index.find(cursor, ranges, [&](const Alignment& aln) {
+            names.push_back(aln.name());
+        });
+        return names;
+    };
+
+    SECTION("a single range finds everything touching it") {
+        auto names = find_names({{100, 101}});
+        REQUIRE(names == vector<string>({"read98", "read99", "read100", "read101"}));
+    }
+
+    SECTION("several ranges report each read once, in order") {
+        auto names = find_names({{1500, 1500}, {10, 10}, {11, 11}});
+        REQUIRE(names == vector<string>({"read8", "read9", "read10", "read11",
+                                         "read1498", "read1499", "read1500"}));
+    }
+
+    SECTION("reads that sort before a range but reach into it are found") {
+        auto names = find_names({{2400, 2600}});
+        REQUIRE(names == vector<string>({"backward"}));
+    }
+
+    SECTION("ranges nothing touches find nothing") {
+        REQUIRE(find_names({{5000, 6000}}).empty());
+        REQUIRE(index.find_start(5000, 6000) == -1);
+    }
+
+    SECTION("the index can be saved and loaded") {
+        stringstream saved;
+        index.save(saved);
+
+        GAMIndex loaded;
+        loaded.load(saved);
+
+        for (id_t id : {1, 17, 500, 1999, 2600}) {
+            REQUIRE(loaded.find_start(id, id) == index.find_start(id, id));
+        }
+    }
+}
+
+TEST_CASE("GAMIndex finds reads that dip below their ends", "[gam][gamindex]") {
+
+    // Make reads starting at each node, and one whose lowest node is in the
+    // middle of its path, and sort them with the GAMSorter.
+    vector<Alignment> alns;
+    for (id_t i = 1; i <= 1000; i++) {
+        alns.push_back(make_gam_index_alignment("read" + to_string(i), {i, i + 1}));
+    }
+    alns.push_back(make_gam_index_alignment("dip", {900, 40, 901}));
+    GAMSorter sorter;
+    sorter.sort(alns);
+
+    stringstream gam;
+    vector<Alignment> buffer;
+    for (auto& aln : alns) {
+        buffer.push_back(aln);
+        stream::write_buffered(gam, buffer, 10);
+    }
+    stream::write_buffered(gam, buffer, 0);
+
+    GAMIndex index(16);
+    index.index(gam);
+
+    auto find_names = [&](id_t min_id, id_t max_id) {
+        gam.clear();
+        gam.seekg(0);
+        vector<string> names;
+        index.find(gam, min_id, max_id, [&](const Alignment& aln) {
+            names.push_back(aln.name());
+        });
+        return names;
+    };
+
+    SECTION("the read is found from its lowest node") {
+        auto names = find_names(40, 40);
+        REQUIRE(names == vector<string>({"read39", "read40", "dip"}));
+    }
+
+    SECTION("the read is found from its ends") {
+        auto names = find_names(901, 901);
+        REQUIRE(names == vector<string>({"dip", "read900", "read901"}));
+    }
+}
+
+TEST_CASE("GAMIndex rejects unsorted GAMs", "[gam][gamindex]") {
+
+    stringstream gam;
+    vector<Alignment> buffer;
+    buffer.push_back(make_gam_index_alignment("late", {10}));
+    buffer.push_back(make_gam_index_alignment("early", {5}));
+    stream::write_buffered(gam, buffer, 0);
+
+    GAMIndex index;
+    REQUIRE_THROWS(index.index(gam));
+}
+
+}
+}
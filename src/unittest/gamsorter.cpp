@@ -0,0 +1,140 @@
+/** \file
+ *
+ * Unit tests for the GAMSorter, which sorts GAM files by position.
+ */
+
+#include <iostream>
+#include <sstream>
+#include "../gamsorter.hpp"
+#include "../stream.hpp"
+#include "../vg.pb.h"
+
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+/// Make a bunch of alignments at pseudo-random positions, some unmapped
+static string make_unsorted_gam(size_t count) {
+    stringstream gam;
+    vector<Alignment> buffer;
+    size_t state = 12345;
+    for (size_t i = 0; i < count; i++) {
+        state = state * 1103515245 + 12345;
+        Alignment aln;
+        aln.set_name("read" + to_string(i));
+        aln.set_sequence(string(100, 'G'));
+        if (state % 17 != 0) {
+            id_t first = (state >> 8) % 500 + 1;
+            id_t last = (state >> 20) % 500 + 1;
+            for (id_t node : {first, last}) {
+                Mapping* mapping = aln.mutable_path()->add_mapping();
+                mapping->mutable_position()->set_node_id(node);
+                mapping->mutable_position()->set_offset((state >> 4) % 3);
+            }
+        }
+        buffer.push_back(aln);
+        stream::write_buffered(gam, buffer, 100);
+    }
+    stream::write_buffered(gam, buffer, 0);
+    return gam.str();
+}
+
+/// Read back the names and keys from a GAM
+static vector<pair<GAMSortKey, string>> read_sorted_gam(const string& data) {
+    vector<pair<GAMSortKey, string>> found;
+    istringstream in(data);
+    function<void(Alignment&)> lambda = [&](Alignment& aln) {
+        found.emplace_back(GAMSorter::get_sort_key(aln), aln.name());
+    };
+    stream::for_each(in, lambda);
+    return found;
+}
+
+TEST_CASE("GAMSorter sorts GAMs in and out of memory", "[gam][gamsorter]") {
+
+    string unsorted = make_unsorted_gam(5000);
+
+    string in_memory;
+    {
+        istringstream in(unsorted);
+        stringstream out;
+        GAMSorter sorter;
+        sorter.dumb_sort(in, out);
+        in_memory = out.str();
+    }
+
+    auto expected = read_sorted_gam(in_memory);
+    REQUIRE(expected.size() == 5000);
+
+    SECTION("the in-memory sort is sorted and stable") {
+        for (size_t i = 1; i < expected.size(); i++) {
+            auto& prev = expected[i - 1];
+            auto& here = expected[i];
+            REQUIRE(!(here.first < prev.first));
+            if (!(prev.first < here.first)) {
+                // Equal keys stay in input order
+                REQUIRE(stoi(prev.second.substr(4)) < stoi(here.second.substr(4)));
+            }
+        }
+        // Unmapped reads come last
+        REQUIRE(expected.back().first.node_id == numeric_limits<id_t>::max());
+    }
+
+    SECTION("the external sort produces the same order with many runs") {
+        istringstream in(unsorted);
+        stringstream out;
+        // Make runs of only a few KB each
+        GAMSorter sorter(64 * 1024);
+        sorter.stream_sort(in, out);
+
+        auto observed = read_sorted_gam(out.str());
+        REQUIRE(observed.size() == expected.size());
+        bool all_match = true;
+        for (size_t i = 0; i < observed.size(); i++) {
+            all_match &= (observed[i].second == expected[i].second);
+        }
+        REQUIRE(all_match);
+    }
+
+    SECTION("the external sort works when everything fits in memory") {
+        istringstream in(unsorted);
+        stringstream out;
+        GAMSorter sorter;
+        sorter.stream_sort(in, out);
+        REQUIRE(out.str() == in_memory);
+    }
+}
+
+TEST_CASE("GAMSorter can sort a big vector of alignments in parallel", "[gam][gamsorter]") {
+
+    vector<Alignment> alns;
+    string unsorted = make_unsorted_gam(40000);
+    istringstream in(unsorted);
+    function<void(Alignment&)> lambda = [&](Alignment& aln) {
+        alns.push_back(aln);
+    };
+    stream::for_each(in, lambda);
+
+    GAMSorter sorter;
+    sorter.sort(alns);
+
+    REQUIRE(alns.size() == 40000);
+    bool in_order = true;
+    for (size_t i = 1; i < alns.size(); i++) {
+        auto prev = GAMSorter::get_sort_key(alns[i - 1]);
+        auto here = GAMSorter::get_sort_key(alns[i]);
+        if (here < prev) {
+            in_order = false;
+        } else if (!(prev < here)) {
+            // Equal keys stay in input order
+            in_order &= (stoi(alns[i - 1].name().substr(4)) < stoi(alns[i].name().substr(4)));
+        }
+    }
+    REQUIRE(in_order);
+}
+
+}
+}
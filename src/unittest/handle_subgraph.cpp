@@ -0,0 +1,190 @@
+/// \file handle_subgraph.cpp
+///
+/// Unit tests for the HandleSubgraph.
+///
+
+#include <iostream>
+#include <set>
+#include "../vg.hpp"
+#include "../handle_subgraph.hpp"
+#include "../algorithms/extract_containing_graph.hpp"
+#include "../algorithms/split_strands.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+/// Collect the (ID, orientation) pairs of the handles next to a handle
+static set<pair<id_t, bool>> neighbors(const HandleGraph& graph, const handle_t& handle, bool go_left) {
+    set<pair<id_t, bool>> found;
+    graph.follow_edges(handle, go_left, [&](const handle_t& next) {
+        found.emplace(graph.get_id(next), graph.get_is_reverse(next));
+    });
+    return found;
+}
+
+TEST_CASE("HandleSubgraph matches the graph it was extracted from", "[handle][subgraph]") {
+
+    VG graph;
+
+    Node* n1 = graph.create_node("GCA");
+    Node* n2 = graph.create_node("T");
+    Node* n3 = graph.create_node("G");
+    Node* n4 = graph.create_node("CTGA");
+    Node* n5 = graph.create_node("GCATAC");
+
+    graph.create_edge(n1, n2);
+    graph.create_edge(n1, n3);
+    graph.create_edge(n2, n4);
+    graph.create_edge(n3, n4);
+    graph.create_edge(n4, n5);
+    graph.create_edge(n4, n2, false, true);
+    graph.create_edge(n3, n3, false, true);
+
+    SECTION("nodes and edges of an extracted subgraph agree with the backing graph") {
+        HandleSubgraph subgraph(&graph);
+        vector<pos_t> positions{make_pos_t(n4->id(), false, 1)};
+        vector<size_t> search_lengths{4};
+        algorithms::extract_containing_graph(&graph, subgraph, positions, search_lengths, search_lengths);
+
+        REQUIRE(subgraph.has_node(n4->id()));
+        REQUIRE(subgraph.min_node_id() <= n4->id());
+        REQUIRE(subgraph.max_node_id() >= n4->id());
+
+        subgraph.for_each_handle([&](const handle_t& handle) {
+            id_t node_id = subgraph.get_id(handle);
+            REQUIRE(subgraph.get_sequence(handle) == graph.get_sequence(graph.get_handle(node_id)));
+            for (bool is_reverse : {false, true}) {
+                handle_t here = subgraph.get_handle(node_id, is_reverse);
+                for (bool go_left : {false, true}) {
+                    // the subgraph has exactly the backing graph's edges between its nodes
+                    set<pair<id_t, bool>> expected;
+                    for (auto& neighbor : neighbors(graph, graph.get_handle(node_id, is_reverse), go_left)) {
+                        if (subgraph.has_node(neighbor.first)) {
+                            expected.insert(neighbor);
+                        }
+                    }
+                    REQUIRE(neighbors(subgraph, here, go_left) == expected);
+                }
+            }
+        });
+    }
+
+    SECTION("extending a subgraph merges nodes and edges without duplicates") {
+        HandleSubgraph left(&graph);
+        left.add_node(n1->id());
+        left.add_node(n2->id());
+        left.add_edge(graph.get_handle(n1->id()), graph.get_handle(n2->id()));
+
+        HandleSubgraph right(&graph);
+        right.add_node(n2->id());
+        right.add_node(n1->id());
+        // the same edge, seen from the other strand
+        right.add_edge(graph.get_handle(n2->id(), true), graph.get_handle(n1->id(), true));
+
+        left.extend(right);
+        left.finalize();
+
+        REQUIRE(left.node_size() == 2);
+        REQUIRE(neighbors(left, left.get_handle(n1->id()), false).size() == 1);
+        REQUIRE(neighbors(left, left.get_handle(n2->id()), true).size() == 1);
+
+        Graph copied;
+        left.to_graph(copied);
+        REQUIRE(copied.node_size() == 2);
+        REQUIRE(copied.edge_size() == 1);
+    }
+
+    SECTION("reversing self loops are followed once from each side") {
+        HandleSubgraph subgraph(&graph);
+        subgraph.add_node(n3->id());
+        subgraph.add_edge(graph.get_handle(n3->id()), graph.get_handle(n3->id(), true));
+        subgraph.finalize();
+
+        REQUIRE(neighbors(subgraph, subgraph.get_handle(n3->id()), false).size() == 1);
+        REQUIRE(neighbors(subgraph, subgraph.get_handle(n3->id()), true).empty());
+    }
+
+    SECTION("ranks follow the order nodes were added") {
+        HandleSubgraph subgraph(&graph);
+        subgraph.add_node(n4->id());
+        subgraph.add_node(n1->id());
+        subgraph.add_node(n4->id());
+        subgraph.add_node(n2->id());
+
+        REQUIRE(subgraph.get_rank(subgraph.get_handle(n4->id())) == 0);
+        REQUIRE(subgraph.get_rank(subgraph.get_handle(n1->id(), true)) == 1);
+        REQUIRE(subgraph.get_rank(subgraph.get_handle(n2->id())) == 2);
+    }
+
+    SECTION("splitting the strands of a subgraph matches splitting a VG") {
+        HandleSubgraph subgraph(&graph);
+        for (Node* node : {n1, n2, n3, n4, n5}) {
+            subgraph.add_node(node->id());
+        }
+        graph.for_each_handle([&](const handle_t& handle) {
+            graph.follow_edges(handle, false, [&](const handle_t& next) {
+                subgraph.add_edge(handle, next);
+            });
+        });
+        subgraph.finalize();
+
+        Graph copied;
+        subgraph.to_graph(copied);
+        VG copied_vg(copied);
+
+        REQUIRE(algorithms::is_single_stranded(&subgraph) == copied_vg.is_single_stranded());
+
+        unordered_map<id_t, pair<id_t, bool>> expected_trans;
+        VG expected = copied_vg.split_strands(expected_trans);
+        VG split;
+        unordered_map<id_t, pair<id_t, bool>> split_trans = algorithms::split_strands(&subgraph, &split);
+
+        REQUIRE(split_trans == expected_trans);
+        REQUIRE(split.node_size() == expected.node_size());
+        REQUIRE(algorithms::is_single_stranded(&split));
+        split.for_each_handle([&](const handle_t& handle) {
+            id_t node_id = split.get_id(handle);
+            REQUIRE(split.get_sequence(handle) == expected.get_sequence(expected.get_handle(node_id)));
+            for (bool go_left : {false, true}) {
+                REQUIRE(neighbors(split, handle, go_left) == neighbors(expected, expected.get_handle(node_id), go_left));
+            }
+        });
+    }
+
+    SECTION("a single stranded subgraph can be copied on either strand") {
+        HandleSubgraph subgraph(&graph);
+        subgraph.add_node(n1->id());
+        subgraph.add_node(n2->id());
+        subgraph.add_node(n4->id());
+        subgraph.add_edge(graph.get_handle(n1->id()), graph.get_handle(n2->id()));
+        subgraph.add_edge(graph.get_handle(n2->id()), graph.get_handle(n4->id()));
+        subgraph.finalize();
+
+        REQUIRE(algorithms::is_single_stranded(&subgraph));
+
+        VG forward;
+        auto forward_trans = algorithms::extract_strand(&subgraph, &forward, false);
+        REQUIRE(forward_trans[n2->id()] == make_pair(n2->id(), false));
+        REQUIRE(forward.get_sequence(forward.get_handle(n1->id())) == "GCA");
+        REQUIRE(neighbors(forward, forward.get_handle(n2->id()), false) == set<pair<id_t, bool>>{{n4->id(), false}});
+
+        VG reverse;
+        auto reverse_trans = algorithms::extract_strand(&subgraph, &reverse, true);
+        REQUIRE(reverse_trans[n2->id()] == make_pair(n2->id(), true));
+        REQUIRE(reverse.get_sequence(reverse.get_handle(n1->id())) == "TGC");
+        REQUIRE(neighbors(reverse, reverse.get_handle(n2->id()), false) == set<pair<id_t, bool>>{{n1->id(), false}});
+        REQUIRE(algorithms::is_single_stranded(&reverse));
+    }
+
+    SECTION("edges need both of their nodes and traversal needs finalizing") {
+        HandleSubgraph subgraph(&graph);
+        subgraph.add_node(n1->id());
+        REQUIRE_THROWS(subgraph.add_edge(graph.get_handle(n1->id()), graph.get_handle(n2->id())));
+        REQUIRE_THROWS(subgraph.follow_edges(subgraph.get_handle(n1->id()), false, [](const handle_t&) {}));
+    }
+}
+
+}
+}
@@ -0,0 +1,192 @@
+/// \file kmer.cpp
+///
+/// Unit tests for kmer enumeration.
+///
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+#include "../vg.hpp"
+#include "../kmer.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("Packed kmers match the kmers of ACGT found by for_each_kmer", "[kmer]") {
+
+    VG graph;
+
+    Node* n1 = graph.create_node("GCAT");
+    Node* n2 = graph.create_node("T");
+    Node* n3 = graph.create_node("GNA");
+    Node* n4 = graph.create_node("CTGA");
+    Node* n5 = graph.create_node("GCATACCAGT");
+
+    graph.create_edge(n1, n2);
+    graph.create_edge(n1, n3);
+    graph.create_edge(n2, n4);
+    graph.create_edge(n3, n4);
+    graph.create_edge(n4, n5);
+    graph.create_edge(n4, n2, false, true);
+    graph.create_edge(n5, n1);
+
+    for (size_t k : {1, 3, 5, 8}) {
+        multiset<tuple<string, id_t, bool, size_t>> expected;
+        for_each_kmer(graph, k, [&](const kmer_t& kmer) {
+            if (kmer.seq.find('N') == string::npos) {
+#pragma omp critical
+                expected.emplace(kmer.seq, id(kmer.begin), is_rev(kmer.begin), offset(kmer.begin));
+            }
+        });
+
+        multiset<tuple<string, id_t, bool, size_t>> found;
+        size_t biggest_batch = 0;
+        for_each_packed_kmer(graph, k, [&](const vector<packed_kmer_t>& batch) {
+#pragma omp critical
+            {
+                biggest_batch = max(biggest_batch, batch.size());
+                for (auto& kmer : batch) {
+                    pos_t pos = packed_kmer_position(graph, kmer);
+                    found.emplace(packed_kmer_sequence(kmer.bases, k), id(pos), is_rev(pos), offset(pos));
+                }
+            }
+        }, 4);
+
+        REQUIRE(biggest_batch <= 4);
+        REQUIRE(!found.empty());
+        REQUIRE(found == expected);
+    }
+}
+
+TEST_CASE("Packed kmers can be 32 bases long", "[kmer]") {
+
+    VG graph;
+    string seq = "ACGTTGCAACGTTGCAACGTTGCAACGTTGCAG";
+    graph.create_node(seq);
+
+    vector<string> found;
+    for_each_packed_kmer(graph, 32, [&](const vector<packed_kmer_t>& batch) {
+        for (auto& kmer : batch) {
+            found.push_back(packed_kmer_sequence(kmer.bases, 32));
+        }
+    });
+
+    // two on each strand
+    REQUIRE(found.size() == 4);
+    REQUIRE(count(found.begin(), found.end(), seq.substr(0, 32)) == 1);
+    REQUIRE(count(found.begin(), found.end(), seq.substr(1, 32)) == 1);
+}
+
+/// Split binary GCSA2 kmer output back into its blocks
+static vector<vector<gcsa::KMer>> read_gcsa_kmer_blocks(const string& data) {
+    vector<vector<gcsa::KMer>> blocks;
+    stringstream in(data);
+    while (in.peek() != EOF) {
+        gcsa::GraphFileHeader header(in);
+        blocks.emplace_back(header.kmer_count);
+        in.read((char*) blocks.back().data(), header.kmer_count * sizeof(gcsa::KMer));
+        REQUIRE(in);
+    }
+    return blocks;
+}
+
+TEST_CASE("GCSA kmers come out the same whether or not they are spilled in pieces", "[kmer][gcsa]") {
+
+    // A long random chain with some SNPs, so each partition holds more kmers
+    // than the smallest deduplication batch
+    VG graph;
+    default_random_engine gen(1234);
+    uniform_int_distribution<int> base(0, 3);
+    auto random_seq = [&](size_t length) {
+        string seq;
+        for (size_t i = 0; i < length; i++) {
+            seq.push_back("ACGT"[base(gen)]);
+        }
+        return seq;
+    };
+    Node* prev = nullptr;
+    for (size_t i = 0; i < 400; i++) {
+        Node* node = graph.create_node(random_seq(250));
+        if (prev != nullptr) {
+            graph.create_edge(prev, node);
+        }
+        if (i % 10 == 5) {
+            string ref = random_seq(1);
+            string alt(1, "CGTA"[string("ACGT").find(ref[0])]);
+            Node* ref_node = graph.create_node(ref);
+            Node* alt_node = graph.create_node(alt);
+            Node* next = graph.create_node(random_seq(250));
+            graph.create_edge(node, ref_node);
+            graph.create_edge(node, alt_node);
+            graph.create_edge(ref_node, next);
+            graph.create_edge(alt_node, next);
+            prev = next;
+        } else {
+            prev = node;
+        }
+    }
+    int kmer_size = 16;
+    id_t head_id = graph.max_node_id() + 1;
+    id_t tail_id = head_id + 1;
+    Node* head_node = nullptr; Node* tail_node = nullptr;
+    graph.add_start_end_markers(kmer_size, '#', '$', head_node, tail_node, head_id, tail_id);
+
+    auto kmer_set = [](const vector<vector<gcsa::KMer>>& blocks) {
+        set<tuple<gcsa::key_type, gcsa::node_type, gcsa::node_type>> kmers;
+        for (auto& block : blocks) {
+            for (auto& kmer : block) {
+                kmers.emplace(kmer.key, kmer.from, kmer.to);
+            }
+        }
+        return kmers;
+    };
+
+    stringstream in_memory;
+    size_t in_memory_size = ~(size_t) 0;
+    write_gcsa_kmers(graph, kmer_size, in_memory, in_memory_size, head_id, tail_id);
+    auto in_memory_blocks = read_gcsa_kmer_blocks(in_memory.str());
+    auto expected = kmer_set(in_memory_blocks);
+
+    // Everything fits in memory, so each partition is deduplicated completely.
+    size_t in_memory_kmers = 0;
+    for (auto& block : in_memory_blocks) {
+        in_memory_kmers += block.size();
+    }
+    REQUIRE(in_memory_blocks.size() <= 25);
+    REQUIRE(in_memory_kmers == expected.size());
+    REQUIRE(in_memory_size == in_memory.str().size());
+    REQUIRE(expected.size() > 25 * 1024);
+
+    SECTION("Spilling with no memory to spare deduplicates the same kmers a piece at a time") {
+        stringstream spilled;
+        size_t spilled_size = ~(size_t) 0;
+        write_gcsa_kmers(graph, kmer_size, spilled, spilled_size, head_id, tail_id, 1);
+        auto spilled_blocks = read_gcsa_kmer_blocks(spilled.str());
+
+        REQUIRE(spilled_blocks.size() > in_memory_blocks.size());
+        for (auto& block : spilled_blocks) {
+            REQUIRE(block.size() <= 2 * 1024);
+        }
+        REQUIRE(kmer_set(spilled_blocks) == expected);
+        REQUIRE(spilled_size == spilled.str().size());
+    }
+
+    SECTION("The size limit applies to the kmer file") {
+        stringstream out;
+        size_t size_limit = in_memory_size;
+        write_gcsa_kmers(graph, kmer_size, out, size_limit, head_id, tail_id);
+        REQUIRE(size_limit == in_memory_size);
+
+        size_limit = in_memory_size / 2;
+        REQUIRE_THROWS_AS(write_gcsa_kmers(graph, kmer_size, out, size_limit, head_id, tail_id), runtime_error);
+    }
+}
+
+}
+}
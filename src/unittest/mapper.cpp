@@ -7,6 +7,9 @@
 #include "vg.pb.h"
 #include "../mapper.hpp"
 #include "../build_index.hpp"
+#include "../distance_index.hpp"
+#include "../genotypekit.hpp"
+#include "../snarls.hpp"
 #include "catch.hpp"
 
 namespace vg {
@@ -144,11 +147,115 @@ TEST_CASE( "Mapper can map to a one-node graph", "[mapping][mapper]" ) {
     
     }
     
+    SECTION( "Mapper reuses cached MEMs for reads with the same sequence" ) {
+        
+        mapper.set_mem_cache_size(16);
+        
+        string read1 = "TTACA";
+        string read2 = "TTACA";
+        double lcp_avg, fraction_filtered;
+        auto mems1 = mapper.find_mems_deep(read1.begin(), read1.end(), lcp_avg, fraction_filtered, 0, 1);
+        auto mems2 = mapper.find_mems_deep(read2.begin(), read2.end(), lcp_avg, fraction_filtered, 0, 1);
+        
+        REQUIRE(mapper.get_mem_cache()->hits() == 1);
+        REQUIRE(mapper.get_mem_cache()->misses() == 1);
+        
+        // the cached MEMs should be the same, but in the second read
+        REQUIRE(mems1.size() == mems2.size());
+        for (size_t i = 0; i < mems1.size(); i++) {
+            REQUIRE(mems1[i].begin - read1.begin() == mems2[i].begin - read2.begin());
+            REQUIRE(mems1[i].end - read1.begin() == mems2[i].end - read2.begin());
+            REQUIRE(mems1[i].nodes == mems2[i].nodes);
+            REQUIRE(mems2[i].sequence() == mems1[i].sequence());
+        }
+        
+        // different parameters are a different search
+        mapper.find_mems_deep(read2.begin(), read2.end(), lcp_avg, fraction_filtered, 0, 2);
+        REQUIRE(mapper.get_mem_cache()->misses() == 2);
+        
+        // and the mapping is the same as without the cache
+        Alignment aln;
+        aln.set_sequence("GAT");
+        auto results = mapper.align_multi(aln);
+        REQUIRE(results.size() == 1);
+        REQUIRE(results.front().path().mapping(0).position().node_id() == 1);
+        
+        mapper.set_mem_cache_size(0);
+        REQUIRE(!mapper.get_mem_cache());
+    }
+    
     // Clean up the GCSA/LCP index
     delete gcsaidx;
     delete lcpidx;
 }
 
+TEST_CASE( "Mapper can seed with only a minimizer index", "[mapping][mapper][minimizer]" ) {
+    
+    string graph_json = R"({
+        "node": [
+            {"id": 1, "sequence": "GATTACACAT"},
+            {"id": 2, "sequence": "GGCCTTAA"},
+            {"id": 3, "sequence": "GATTACACAT"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2},
+            {"from": 2, "to": 3}
+        ],
+        "path": [
+            {"name": "ref", "mapping": [
+                {"position": {"node_id": 1}, "edit": [{"from_length": 10, "to_length": 10}], "rank": 1},
+                {"position": {"node_id": 2}, "edit": [{"from_length": 8, "to_length": 8}], "rank": 2},
+                {"position": {"node_id": 3}, "edit": [{"from_length": 10, "to_length": 10}], "rank": 3}
+            ]}
+        ]
+    })";
+    
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    VG graph;
+    graph.extend(proto_graph);
+    
+    xg::XG xg_index(proto_graph);
+    MinimizerIndex minimizer_index(graph, 5, 3);
+    
+    // there's no GCSA2 or LCP to fall back on
+    Mapper mapper(&xg_index, nullptr, nullptr);
+    mapper.minimizer_index = &minimizer_index;
+    
+    SECTION( "Minimizers with more than hit_max hits are left unlocated" ) {
+        
+        string read = "GATTACACAT";
+        double lcp_avg, fraction_filtered;
+        
+        mapper.hit_max = 0;
+        auto all_mems = mapper.find_mems_deep(read.begin(), read.end(), lcp_avg, fraction_filtered, 0, 1);
+        REQUIRE(!all_mems.empty());
+        for (auto& mem : all_mems) {
+            // the read occurs on both copies of the repeat
+            REQUIRE(mem.match_count >= 2);
+            REQUIRE(mem.nodes.size() == mem.match_count);
+        }
+        
+        mapper.hit_max = 1;
+        auto capped_mems = mapper.find_mems_deep(read.begin(), read.end(), lcp_avg, fraction_filtered, 0, 1);
+        REQUIRE(capped_mems.size() == all_mems.size());
+        for (auto& mem : capped_mems) {
+            REQUIRE(mem.match_count >= 2);
+            REQUIRE(mem.nodes.empty());
+        }
+    }
+    
+    SECTION( "Mapper can map a read without a GCSA2" ) {
+        
+        Alignment aln;
+        aln.set_sequence("CACATGGCCTTAAGATT");
+        
+        auto results = mapper.align_multi(aln);
+        REQUIRE(results.size() == 1);
+        REQUIRE(results.front().score() > 0);
+    }
+}
+
 TEST_CASE( "Mapper finds optimal mapping for read starting with node-border MEM", "[mapping][mapper]" ) {
     
     // We have a node 9999 in here to bust some MEM we don't want, to trigger the condition we are trying to test
@@ -297,6 +404,76 @@ TEST_CASE( "Mapper finds optimal mapping for read starting with node-border MEM"
     
 }
 
+TEST_CASE( "Mapper checks pair consistency with the distance index", "[mapping][mapper][distance]" ) {
+    
+    // a long insertion sits before the short reference allele in the node order, and a long
+    // node separates the last node from the rest
+    string insertion;
+    string spacer;
+    for (size_t i = 0; i < 50; i++) {
+        insertion += "ACGT";
+        spacer += "TTGC";
+    }
+    
+    VG graph;
+    Node* n1 = graph.create_node("GATTACACAT");
+    Node* n2 = graph.create_node(insertion);
+    Node* n3 = graph.create_node("G");
+    Node* n4 = graph.create_node("CATTAGACAG");
+    Node* n5 = graph.create_node(spacer);
+    Node* n6 = graph.create_node("GGCCTTAAGA");
+    graph.create_edge(n1, n2);
+    graph.create_edge(n1, n3);
+    graph.create_edge(n2, n4);
+    graph.create_edge(n3, n4);
+    graph.create_edge(n4, n5);
+    graph.create_edge(n5, n6);
+    
+    // without paths, the mapper falls back on the approximate positions of the nodes
+    xg::XG xg_index(graph.graph);
+    
+    CactusSnarlFinder bubble_finder(graph);
+    SnarlManager snarl_manager = bubble_finder.find_snarls();
+    DistanceIndex distance_index(&graph, &snarl_manager);
+    
+    Mapper mapper(&xg_index, nullptr, nullptr);
+    mapper.frag_stats.fragment_max = 100;
+    
+    // make a scored alignment starting at the given position
+    auto make_aln = [](id_t node_id, bool is_reverse) {
+        Alignment aln;
+        aln.set_sequence("ACGTA");
+        aln.set_score(5);
+        Mapping* mapping = aln.mutable_path()->add_mapping();
+        mapping->mutable_position()->set_node_id(node_id);
+        mapping->mutable_position()->set_is_reverse(is_reverse);
+        Edit* edit = mapping->add_edit();
+        edit->set_from_length(5);
+        edit->set_to_length(5);
+        return aln;
+    };
+    
+    Alignment aln1 = make_aln(n1->id(), false);
+    Alignment aln2 = make_aln(n4->id(), true);
+    Alignment far = make_aln(n6->id(), true);
+    
+    SECTION( "Mates across the short allele look too far apart without the distance index" ) {
+        REQUIRE(!mapper.pair_consistent(aln1, aln2, 0));
+    }
+    
+    SECTION( "Mates across the short allele are consistent with the distance index" ) {
+        mapper.distance_index = &distance_index;
+        REQUIRE(mapper.pair_consistent(aln1, aln2, 0));
+        REQUIRE(mapper.pair_consistent(aln2, aln1, 0));
+    }
+    
+    SECTION( "Mates separated by a long node are not consistent with the distance index" ) {
+        mapper.distance_index = &distance_index;
+        REQUIRE(!mapper.pair_consistent(aln1, far, 0));
+        REQUIRE(!mapper.pair_consistent(far, aln1, 0));
+    }
+}
+
 }
 
 }
@@ -173,5 +173,85 @@ TEST_CASE( "ShuffledPairs loops over all pairs", "[mem]" ) {
     }
     
 }
+
+TEST_CASE( "SparseChainClusterer chains colinear MEM hits", "[mem][cluster]" ) {
+    
+    Aligner aligner;
+    
+    Alignment aln;
+    aln.set_sequence("GATTACACATTAGCAGGCTTACCGATAGCTTAGCCATCGGATACGATTCAGGCATCAAG");
+    const string& seq = aln.sequence();
+    
+    // node 1 and node 3 are 60 bp long and far from node 2
+    auto approx_position = [](pos_t pos) {
+        if (is_rev(pos)) {
+            pos = reverse(pos, 60);
+        }
+        return (int64_t) (id(pos) * 1000 + offset(pos));
+    };
+    
+    vector<MaximalExactMatch> mems;
+    for (size_t i = 0; i < 3; i++) {
+        mems.emplace_back(seq.begin() + 20 * i, seq.begin() + 20 * (i + 1), gcsa::range_type(0, 0), 1);
+    }
+    
+    SECTION( "Colinear hits on the forward strand form one cluster" ) {
+        
+        for (size_t i = 0; i < 3; i++) {
+            mems[i].nodes.push_back(gcsa::Node::encode(1, 20 * i, false));
+        }
+        // a stray hit for the middle MEM
+        mems[1].nodes.push_back(gcsa::Node::encode(2, 5, false));
+        
+        SparseChainClusterer clusterer(aln, mems, aligner, approx_position);
+        vector<SparseChainClusterer::cluster_t> clusters = clusterer.clusters(aln);
+        
+        REQUIRE(clusters.size() == 1);
+        REQUIRE(clusters[0].size() == 3);
+        for (size_t i = 0; i < 3; i++) {
+            REQUIRE(clusters[0][i].first == &mems[i]);
+            REQUIRE(clusters[0][i].second == make_pos_t(1, false, 20 * i));
+        }
+        
+        SECTION( "The stray hit forms its own cluster when low scoring clusters are kept" ) {
+            
+            SparseChainClusterer clusterer(aln, mems, aligner, approx_position);
+            clusters = clusterer.clusters(aln, 60, 100.0);
+            
+            REQUIRE(clusters.size() == 2);
+            REQUIRE(clusters[0].size() == 3);
+            REQUIRE(clusters[1].size() == 1);
+            REQUIRE(clusters[1][0].first == &mems[1]);
+            REQUIRE(clusters[1][0].second == make_pos_t(2, false, 5));
+        }
+    }
+    
+    SECTION( "Colinear hits on the reverse strand form one cluster" ) {
+        
+        for (size_t i = 0; i < 3; i++) {
+            mems[i].nodes.push_back(gcsa::Node::encode(3, 20 * i, true));
+        }
+        
+        SparseChainClusterer clusterer(aln, mems, aligner, approx_position);
+        vector<SparseChainClusterer::cluster_t> clusters = clusterer.clusters(aln);
+        
+        REQUIRE(clusters.size() == 1);
+        REQUIRE(clusters[0].size() == 3);
+    }
+    
+    SECTION( "Hits that are out of order in the graph are not chained" ) {
+        
+        mems[0].nodes.push_back(gcsa::Node::encode(1, 40, false));
+        mems[2].nodes.push_back(gcsa::Node::encode(1, 0, false));
+        
+        SparseChainClusterer clusterer(aln, mems, aligner, approx_position);
+        vector<SparseChainClusterer::cluster_t> clusters = clusterer.clusters(aln, 60, 100.0);
+        
+        REQUIRE(clusters.size() == 2);
+        REQUIRE(clusters[0].size() == 1);
+        REQUIRE(clusters[1].size() == 1);
+    }
+}
+
 }
 }
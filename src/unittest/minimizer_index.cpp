@@ -0,0 +1,182 @@
+/// \file minimizer_index.cpp
+///
+/// Unit tests for the MinimizerIndex.
+///
+
+#include <iostream>
+#include <sstream>
+#include <functional>
+#include "../vg.hpp"
+#include "../minimizer_index.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+/// Return true if some walk in the graph spells out the sequence starting at the position
+static bool spells_from(const HandleGraph& graph, const pos_t& pos, const string& seq) {
+    function<bool(const handle_t&, size_t, size_t)> search = [&](const handle_t& handle, size_t node_offset, size_t seq_offset) {
+        string node_seq = graph.get_sequence(handle);
+        for (; node_offset < node_seq.size() && seq_offset < seq.size(); node_offset++, seq_offset++) {
+            if (node_seq[node_offset] != seq[seq_offset]) {
+                return false;
+            }
+        }
+        if (seq_offset == seq.size()) {
+            return true;
+        }
+        bool found = false;
+        graph.follow_edges(handle, false, [&](const handle_t& next) {
+            found = search(next, 0, seq_offset);
+            return !found;
+        });
+        return found;
+    };
+    return search(graph.get_handle(id(pos), is_rev(pos)), offset(pos), 0);
+}
+
+/// Decode a key back into its k-mer
+static string decode(uint64_t key, size_t k) {
+    string kmer(k, 'A');
+    for (size_t i = 0; i < k; i++) {
+        kmer[k - i - 1] = "ACGT"[key & 3];
+        key >>= 2;
+    }
+    return kmer;
+}
+
+TEST_CASE("MinimizerIndex finds minimizers of sequences", "[minimizer]") {
+
+    MinimizerIndex index(5, 3);
+
+    SECTION("every window has a minimizer in it") {
+        string seq = "GATTACACATTAGGCATGCAAGTCCA";
+        auto minimizers = index.minimizers(seq.begin(), seq.end());
+        REQUIRE(!minimizers.empty());
+        for (size_t i = 1; i < minimizers.size(); i++) {
+            REQUIRE(minimizers[i].offset > minimizers[i - 1].offset);
+            // windows of 3 kmers can't be skipped over
+            REQUIRE(minimizers[i].offset - minimizers[i - 1].offset <= 3);
+        }
+        for (auto& minimizer : minimizers) {
+            REQUIRE(decode(minimizer.key, 5) == seq.substr(minimizer.offset, 5));
+            REQUIRE(index.encode(seq.begin() + minimizer.offset) == minimizer.key);
+        }
+    }
+
+    SECTION("kmers with Ns are not minimizers") {
+        string seq = "GATTNCACAT";
+        for (auto& minimizer : index.minimizers(seq.begin(), seq.end())) {
+            REQUIRE(minimizer.offset > 4);
+        }
+        REQUIRE(index.encode(seq.begin()) == MinimizerIndex::NO_KEY);
+    }
+
+    SECTION("sequences shorter than a window still have a minimizer") {
+        string seq = "GATTAC";
+        REQUIRE(index.minimizers(seq.begin(), seq.end()).size() >= 1);
+        string too_short = "GAT";
+        REQUIRE(index.minimizers(too_short.begin(), too_short.end()).empty());
+    }
+}
+
+TEST_CASE("MinimizerIndex indexes the minimizers of a graph", "[minimizer]") {
+
+    VG graph;
+
+    Node* n1 = graph.create_node("GCATTAG");
+    Node* n2 = graph.create_node("T");
+    Node* n3 = graph.create_node("GG");
+    Node* n4 = graph.create_node("CTGACATT");
+    Node* n5 = graph.create_node("GCATAC");
+
+    graph.create_edge(n1, n2);
+    graph.create_edge(n1, n3);
+    graph.create_edge(n2, n4);
+    graph.create_edge(n3, n4);
+    graph.create_edge(n4, n5);
+    graph.create_edge(n4, n2, false, true);
+
+    MinimizerIndex index(graph, 4, 3);
+    REQUIRE(index.size() > 0);
+
+    SECTION("every hit spells out its minimizer in the graph") {
+        size_t hits = 0;
+        string walk = "GCATTAGTCTGACATTGCATAC";
+        for (auto& minimizer : index.minimizers(walk.begin(), walk.end())) {
+            MinimizerIndex::Hits positions = index.find(minimizer.key);
+            REQUIRE(!positions.empty());
+            for (auto& pos : positions) {
+                REQUIRE(spells_from(graph, pos, walk.substr(minimizer.offset, 4)));
+                hits++;
+            }
+        }
+        REQUIRE(hits > 0);
+    }
+
+    SECTION("minimizers of a read on the reverse strand are found at its position") {
+        // reverse complement of GGCTGACA, starting 2 bases into the reverse of node 4
+        string read = "TGTCAGCC";
+        bool found_true_position = false;
+        for (auto& minimizer : index.minimizers(read.begin(), read.end())) {
+            for (auto& pos : index.find(minimizer.key)) {
+                if (id(pos) == n4->id() && is_rev(pos) && offset(pos) == 2 + minimizer.offset) {
+                    found_true_position = true;
+                }
+                REQUIRE(spells_from(graph, pos, read.substr(minimizer.offset, 4)));
+            }
+        }
+        REQUIRE(found_true_position);
+    }
+
+    SECTION("a saved index loads with the same hits") {
+        stringstream serialized;
+        index.save(serialized);
+        MinimizerIndex loaded;
+        loaded.load(serialized);
+
+        REQUIRE(loaded.k() == 4);
+        REQUIRE(loaded.w() == 3);
+        REQUIRE(loaded.size() == index.size());
+        REQUIRE(loaded.hit_count() == index.hit_count());
+        string seq = "CTGACATT";
+        for (auto& minimizer : index.minimizers(seq.begin(), seq.end())) {
+            MinimizerIndex::Hits loaded_hits = loaded.find(minimizer.key);
+            MinimizerIndex::Hits hits = index.find(minimizer.key);
+            REQUIRE(vector<pos_t>(loaded_hits.begin(), loaded_hits.end()) == vector<pos_t>(hits.begin(), hits.end()));
+        }
+
+        stringstream garbage("not an index");
+        REQUIRE_THROWS(loaded.load(garbage));
+    }
+}
+
+TEST_CASE("MinimizerIndex bounds the walks it follows", "[minimizer]") {
+
+    // a chain of SNPs, where the number of walks doubles at each one
+    VG graph;
+    Node* last = graph.create_node("A");
+    for (size_t i = 0; i < 40; i++) {
+        Node* ref = graph.create_node("C");
+        Node* alt = graph.create_node("G");
+        Node* next = graph.create_node("T");
+        graph.create_edge(last, ref);
+        graph.create_edge(last, alt);
+        graph.create_edge(ref, next);
+        graph.create_edge(alt, next);
+        last = next;
+    }
+
+    REQUIRE_THROWS_AS(MinimizerIndex(graph, 15, 11, 1000), runtime_error);
+
+    MinimizerIndex index(graph, 15, 11);
+    REQUIRE(index.size() > 0);
+    string walk = "ACTCTGTCTGTCTGTCTGTCTGTCT";
+    for (auto& minimizer : index.minimizers(walk.begin(), walk.end())) {
+        REQUIRE(!index.find(minimizer.key).empty());
+    }
+}
+
+}
+}
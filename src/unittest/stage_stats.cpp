@@ -0,0 +1,76 @@
+/** \file
+ *
+ * Unit tests for the per-thread mapping stage counters.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <omp.h>
+#include "../stage_stats.hpp"
+#include "../vg.pb.h"
+
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+TEST_CASE("Mapping stages are only recorded when enabled", "[mapping][stagestats]") {
+
+    MappingStageStats::set_enabled(false);
+    MappingStageCounts before = MappingStageStats::local();
+    {
+        StageTimer timer(STAGE_FIND_MEMS);
+        timer.add_candidates(10);
+    }
+    MappingStageCounts difference = MappingStageStats::local() - before;
+    REQUIRE(difference.calls[STAGE_FIND_MEMS] == 0);
+    REQUIRE(difference.candidates[STAGE_FIND_MEMS] == 0);
+
+    SECTION("enabled timers count calls and candidates") {
+        MappingStageStats::set_enabled(true);
+        for (size_t i = 0; i < 3; i++) {
+            StageTimer timer(STAGE_CLUSTER);
+            timer.add_candidates(2);
+        }
+        MappingStageStats::set_enabled(false);
+
+        difference = MappingStageStats::local() - before;
+        REQUIRE(difference.calls[STAGE_CLUSTER] == 3);
+        REQUIRE(difference.candidates[STAGE_CLUSTER] == 6);
+        REQUIRE(difference.calls[STAGE_FIND_MEMS] == 0);
+
+        SECTION("the counters can be put on an alignment") {
+            Alignment aln;
+            MappingStageStats::annotate(&aln, difference);
+            REQUIRE(get_annotation<double>(aln, "stage_cluster_candidates") == 6);
+            REQUIRE(aln.annotation().fields().count("stage_cluster_us"));
+            REQUIRE(!aln.annotation().fields().count("stage_find_mems_us"));
+        }
+    }
+}
+
+TEST_CASE("Mapping stage counters from all threads can be added up", "[mapping][stagestats]") {
+
+    MappingStageCounts before = MappingStageStats::total();
+
+    MappingStageStats::set_enabled(true);
+#pragma omp parallel for
+    for (size_t i = 0; i < 1000; i++) {
+        StageTimer timer(STAGE_PAIR_RESCUE);
+        timer.add_candidates(1);
+    }
+    MappingStageStats::set_enabled(false);
+
+    MappingStageCounts difference = MappingStageStats::total() - before;
+    REQUIRE(difference.calls[STAGE_PAIR_RESCUE] == 1000);
+    REQUIRE(difference.candidates[STAGE_PAIR_RESCUE] == 1000);
+
+    stringstream report;
+    MappingStageStats::report(report, difference);
+    REQUIRE(report.str().find("pair_rescue") != string::npos);
+}
+
+}
+}
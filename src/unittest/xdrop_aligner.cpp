@@ -0,0 +1,270 @@
+/// \file xdrop_aligner.cpp
+///
+/// Unit tests for X-drop pruned alignment, on its own and through the Aligner.
+///
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include "../json2pb.h"
+#include "../vg.pb.h"
+#include "../gssw_aligner.hpp"
+#include "../xdrop_aligner.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("X-drop alignment scores the same as the full DP when nothing is pruned", "[aligner][alignment][xdrop]") {
+
+    VG graph;
+
+    Aligner aligner;
+    Aligner xdrop_aligner;
+    xdrop_aligner.xdrop_threshold = 1000;
+
+    Node* n0 = graph.create_node("AGTGCCATTAC");
+    Node* n1 = graph.create_node("C");
+    Node* n2 = graph.create_node("A");
+    Node* n3 = graph.create_node("TGAAGTCCA");
+    Node* n4 = graph.create_node("GATTACA");
+
+    graph.create_edge(n0, n1);
+    graph.create_edge(n0, n2);
+    graph.create_edge(n1, n3);
+    graph.create_edge(n2, n3);
+    graph.create_edge(n2, n4);
+    graph.create_edge(n3, n4);
+
+    for (string read : {string("AGTGCCATTACCTGAAGTCCAGATTACA"), string("GCCATTACATGAACTCCAGAT"),
+                        string("TTACATGAAGGGGGTCCAGATTA"), string("CCTTACAGATTACA"), string("GGGGG")}) {
+
+        Alignment aln, xdrop_aln;
+        aln.set_sequence(read);
+        xdrop_aln.set_sequence(read);
+
+        SECTION("local alignment of " + read) {
+            aligner.align(aln, graph.graph, true, false);
+            xdrop_aligner.align(xdrop_aln, graph.graph, true, false);
+            REQUIRE(xdrop_aln.score() == aln.score());
+        }
+
+        // gssw falls back on an empty alignment when no pinned alignment scores above 0, but the
+        // X-drop aligner returns the best one anyway
+
+        SECTION("left pinned alignment of " + read) {
+            aligner.align_pinned(aln, graph.graph, true);
+            xdrop_aligner.align_pinned(xdrop_aln, graph.graph, true);
+            REQUIRE(max(xdrop_aln.score(), 0) == aln.score());
+            REQUIRE(xdrop_aln.path().mapping(0).position().node_id() == n0->id());
+            REQUIRE(xdrop_aln.path().mapping(0).position().offset() == 0);
+        }
+
+        SECTION("right pinned alignment of " + read) {
+            aligner.align_pinned(aln, graph.graph, false);
+            xdrop_aligner.align_pinned(xdrop_aln, graph.graph, false);
+            REQUIRE(max(xdrop_aln.score(), 0) == aln.score());
+            const Mapping& last = xdrop_aln.path().mapping(xdrop_aln.path().mapping_size() - 1);
+            REQUIRE(last.position().node_id() == n4->id());
+        }
+    }
+
+    SECTION("an exact match gets the same path") {
+        Alignment aln, xdrop_aln;
+        aln.set_sequence("CATTACATGAAG");
+        xdrop_aln.set_sequence("CATTACATGAAG");
+        aligner.align(aln, graph.graph, true, false);
+        xdrop_aligner.align(xdrop_aln, graph.graph, true, false);
+        REQUIRE(pb2json(xdrop_aln.path()) == pb2json(aln.path()));
+        REQUIRE(xdrop_aln.identity() == 1.0);
+    }
+}
+
+TEST_CASE("X-drop alignment abandons nodes that only poor alignments reach", "[aligner][alignment][xdrop]") {
+
+    Aligner aligner;
+
+    // a long chain where the read only matches the beginning
+    string chain_seq = "GATTACACATTAGCAGGCTTACCGATAGCTTAGCCATCGGATACGATTCAGGCATCAAGGCTTAGCAATCGATCC";
+    Graph graph;
+    for (size_t i = 0; i < chain_seq.size(); i += 4) {
+        Node* node = graph.add_node();
+        node->set_id(graph.node_size());
+        node->set_sequence(chain_seq.substr(i, 4));
+        if (i > 0) {
+            Edge* edge = graph.add_edge();
+            edge->set_from(node->id() - 1);
+            edge->set_to(node->id());
+        }
+    }
+
+    Alignment aln;
+    aln.set_sequence(chain_seq.substr(0, 16));
+
+    XdropAligner xdrop(aln, graph, 10, true, true);
+    xdrop.align(aligner.score_matrix, aligner.nt_table, aligner.gap_open, aligner.gap_extension,
+                aligner.full_length_bonus);
+
+    REQUIRE(aln.score() == 16 * aligner.match + aligner.full_length_bonus);
+    REQUIRE(aln.path().mapping_size() == 4);
+    REQUIRE(xdrop.nodes_skipped() > 0);
+    REQUIRE(xdrop.cells_filled() < chain_seq.size() * (aln.sequence().size() + 1));
+
+    SECTION("a threshold that prunes nothing visits every node") {
+        Alignment full_aln;
+        full_aln.set_sequence(aln.sequence());
+        XdropAligner full_xdrop(full_aln, graph, 1000, true, true);
+        full_xdrop.align(aligner.score_matrix, aligner.nt_table, aligner.gap_open, aligner.gap_extension,
+                         aligner.full_length_bonus);
+        REQUIRE(full_aln.score() == aln.score());
+        REQUIRE(full_xdrop.nodes_skipped() == 0);
+        REQUIRE(full_xdrop.cells_filled() == chain_seq.size() * (aln.sequence().size() + 1));
+    }
+
+    SECTION("a local alignment abandons nodes once nothing can beat the best alignment") {
+        Alignment local_aln;
+        local_aln.set_sequence(aln.sequence());
+        XdropAligner local_xdrop(local_aln, graph, 10);
+        local_xdrop.align(aligner.score_matrix, aligner.nt_table, aligner.gap_open, aligner.gap_extension,
+                          aligner.full_length_bonus);
+        REQUIRE(local_aln.score() == 16 * aligner.match + 2 * aligner.full_length_bonus);
+        REQUIRE(local_aln.path().mapping_size() == 4);
+        REQUIRE(local_xdrop.nodes_skipped() > 0);
+        REQUIRE(local_xdrop.cells_filled() < chain_seq.size() * (local_aln.sequence().size() + 1));
+    }
+}
+
+TEST_CASE("X-drop alignment measures drops along each path", "[aligner][alignment][xdrop]") {
+
+    VG graph;
+
+    Aligner aligner;
+    Aligner xdrop_aligner;
+    xdrop_aligner.xdrop_threshold = 3;
+
+    SECTION("a local alignment can start on a later branch after another has scored well") {
+        Node* n0 = graph.create_node("CATTGA");
+        Node* n1 = graph.create_node("GGGGGG");
+        Node* n2 = graph.create_node("TTTTTTTTCCAGTCAGGATC");
+        Node* n3 = graph.create_node("AAAA");
+
+        graph.create_edge(n0, n1);
+        graph.create_edge(n0, n2);
+        graph.create_edge(n1, n3);
+        graph.create_edge(n2, n3);
+
+        // the start of the read matches the first node well, but the longer match on the second
+        // branch can only be had by starting over
+        Alignment aln, xdrop_aln;
+        aln.set_sequence("CATTGACCAGTCAGGATC");
+        xdrop_aln.set_sequence(aln.sequence());
+
+        aligner.align(aln, graph.graph, true, false);
+        xdrop_aligner.align(xdrop_aln, graph.graph, true, false);
+
+        REQUIRE(aln.score() == 12 * aligner.match + aligner.full_length_bonus);
+        REQUIRE(xdrop_aln.score() == aln.score());
+        REQUIRE(xdrop_aln.path().mapping_size() == 1);
+        REQUIRE(xdrop_aln.path().mapping(0).position().node_id() == n2->id());
+        REQUIRE(xdrop_aln.path().mapping(0).position().offset() == 8);
+    }
+
+    SECTION("a pinned alignment follows the branch that matches") {
+        Node* n0 = graph.create_node("GATTACA");
+        Node* n1 = graph.create_node("CCCC");
+        Node* n2 = graph.create_node("GGAT");
+        Node* n3 = graph.create_node("TACAGAT");
+
+        graph.create_edge(n0, n1);
+        graph.create_edge(n0, n2);
+        graph.create_edge(n1, n3);
+        graph.create_edge(n2, n3);
+
+        Alignment aln;
+        aln.set_sequence("GATTACAGGATTACA");
+
+        XdropAligner xdrop(aln, graph.graph, 2, true, true);
+        xdrop.align(aligner.score_matrix, aligner.nt_table, aligner.gap_open, aligner.gap_extension,
+                    aligner.full_length_bonus);
+
+        REQUIRE(aln.score() == 15 * aligner.match + aligner.full_length_bonus);
+        REQUIRE(aln.path().mapping_size() == 3);
+        REQUIRE(aln.path().mapping(0).position().node_id() == n0->id());
+        REQUIRE(aln.path().mapping(1).position().node_id() == n2->id());
+        REQUIRE(aln.path().mapping(2).position().node_id() == n3->id());
+
+        // the mismatched branch and the rest of the read's rows are pruned
+        size_t total_bases = 0;
+        for (int i = 0; i < graph.graph.node_size(); i++) {
+            total_bases += graph.graph.node(i).sequence().size();
+        }
+        REQUIRE(xdrop.cells_filled() < total_bases * (aln.sequence().size() + 1));
+    }
+
+    SECTION("a pinned alignment that never scores above 0 is still returned") {
+        Node* n0 = graph.create_node("AAAAA");
+
+        for (int32_t threshold : {1, 1000}) {
+            for (bool pin_left : {true, false}) {
+                Alignment aln;
+                aln.set_sequence("CCC");
+                xdrop_aligner.xdrop_threshold = threshold;
+                xdrop_aligner.align_pinned(aln, graph.graph, pin_left);
+
+                // one mismatch at the pinned end, and the rest soft clipped
+                REQUIRE(aln.score() == -aligner.mismatch);
+                REQUIRE(aln.path().mapping_size() == 1);
+                const Mapping& mapping = aln.path().mapping(0);
+                REQUIRE(mapping.position().node_id() == n0->id());
+                REQUIRE(mapping.position().offset() == (pin_left ? 0 : 4));
+                REQUIRE(mapping.edit_size() == 2);
+                const Edit& pinned_edit = mapping.edit(pin_left ? 0 : 1);
+                REQUIRE(pinned_edit.from_length() == 1);
+                REQUIRE(pinned_edit.to_length() == 1);
+                REQUIRE(pinned_edit.sequence() == "C");
+                const Edit& clip = mapping.edit(pin_left ? 1 : 0);
+                REQUIRE(clip.from_length() == 0);
+                REQUIRE(clip.to_length() == 2);
+            }
+        }
+    }
+}
+
+TEST_CASE("X-drop alignment only supports sorted DAGs without reversing edges", "[aligner][alignment][xdrop]") {
+
+    Graph graph;
+    Node* n0 = graph.add_node();
+    n0->set_id(1);
+    n0->set_sequence("GATT");
+    Node* n1 = graph.add_node();
+    n1->set_id(2);
+    n1->set_sequence("ACA");
+    Edge* edge = graph.add_edge();
+    edge->set_from(1);
+    edge->set_to(2);
+
+    REQUIRE(XdropAligner::is_supported(graph));
+
+    SECTION("backward edges are not supported") {
+        edge->set_from(2);
+        edge->set_to(1);
+        REQUIRE(!XdropAligner::is_supported(graph));
+    }
+
+    SECTION("reversing edges are not supported") {
+        edge->set_to_end(true);
+        REQUIRE(!XdropAligner::is_supported(graph));
+    }
+
+    SECTION("bad arguments throw") {
+        Alignment aln;
+        aln.set_sequence("GATTACA");
+        REQUIRE_THROWS_AS(XdropAligner(aln, graph, 10, false, true), invalid_argument);
+        aln.set_quality("IIII");
+        REQUIRE_THROWS_AS(XdropAligner(aln, graph, 10, false, false, true), invalid_argument);
+    }
+}
+
+}
+}
@@ -235,6 +235,225 @@ TEST_CASE("We can build the xg index on a small graph with discontinuous node id
 
 }
 
+TEST_CASE("An xg index can be saved in the mappable layout and memory-mapped", "[xg]") {
+
+    string graph_json = R"(
+    {"node":[{"id":10,"sequence":"GATT"},
+    {"id":20,"sequence":"ACA"},
+    {"id":30,"sequence":"CCCTTG"}],
+    "edge":[{"to":20,"from":10},{"to":30,"from":20},{"to":30,"from":10,"to_end":true}],
+    "path":[{"name":"p","mapping":[{"position":{"node_id":10},"rank":1},
+                                   {"position":{"node_id":20},"rank":2},
+                                   {"position":{"node_id":30},"rank":3}]}]}
+    )";
+
+    // Load the JSON
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+
+    // Build the xg index
+    xg::XG xg_index(proto_graph);
+
+    string mappable_name = temp_file::create("xg");
+    {
+        ofstream out(mappable_name);
+        xg_index.serialize_mappable(out);
+    }
+
+    // Check that the loaded index matches the original
+    auto check_same = [&](xg::XG& loaded) {
+        REQUIRE(loaded.node_count == xg_index.node_count);
+        REQUIRE(loaded.edge_count == xg_index.edge_count);
+        for (int64_t id : {10, 20, 30}) {
+            REQUIRE(loaded.has_node(id));
+            REQUIRE(loaded.node_sequence(id) == xg_index.node_sequence(id));
+            REQUIRE(loaded.edges_of(id).size() == xg_index.edges_of(id).size());
+        }
+        REQUIRE(!loaded.has_node(15));
+        REQUIRE(loaded.path_length("p") == 13);
+        REQUIRE(loaded.node_at_path_position("p", 7) == 30);
+    };
+
+    SECTION("the mappable layout can be loaded from a file") {
+        xg::XG loaded;
+        loaded.load_file(mappable_name);
+        check_same(loaded);
+    }
+
+    SECTION("the normal layout can be loaded from a file") {
+        string normal_name = temp_file::create("xg");
+        {
+            ofstream out(normal_name);
+            xg_index.serialize(out);
+        }
+        xg::XG loaded;
+        loaded.load_file(normal_name);
+        check_same(loaded);
+        temp_file::remove(normal_name);
+    }
+
+    SECTION("a mapped index can be saved in the normal layout") {
+        xg::XG mapped;
+        mapped.load_file(mappable_name);
+
+        stringstream normal;
+        mapped.serialize(normal);
+        xg::XG loaded(normal);
+        check_same(loaded);
+    }
+
+    SECTION("the mappable layout can't be loaded from a stream") {
+        ifstream in(mappable_name);
+        xg::XG loaded;
+        REQUIRE_THROWS_AS(loaded.load(in), xg::XGFormatError);
+    }
+
+    temp_file::remove(mappable_name);
+}
+
+TEST_CASE("Building an xg index with bounded memory gives the same index", "[xg]") {
+
+    // Chunks that share a node and an edge, and split a path between them
+    string chunk1_json = R"(
+    {"node":[{"id":30,"sequence":"CCCTTG"},
+    {"id":10,"sequence":"GATT"},
+    {"id":20,"sequence":"ACA"}],
+    "edge":[{"to":20,"from":10},{"to":30,"from":20},{"to":30,"from":10,"to_end":true}],
+    "path":[{"name":"q","mapping":[{"position":{"node_id":30,"is_reverse":true},"rank":2}]},
+            {"name":"p","mapping":[{"position":{"node_id":20},"rank":2},
+                                   {"position":{"node_id":10},"rank":1}]}]}
+    )";
+    string chunk2_json = R"(
+    {"node":[{"id":20,"sequence":"ACA"},
+    {"id":40,"sequence":"T"}],
+    "edge":[{"to":40,"from":30},{"to":20,"from":10},{"from":40,"to":10,"from_start":true}],
+    "path":[{"name":"p","mapping":[{"position":{"node_id":30},"rank":3},
+                                   {"position":{"node_id":40},"rank":4}]},
+            {"name":"q","mapping":[{"position":{"node_id":40,"is_reverse":true},"rank":1}]}]}
+    )";
+
+    vector<Graph> chunks(2);
+    json2pb(chunks[0], chunk1_json.c_str(), chunk1_json.size());
+    json2pb(chunks[1], chunk2_json.c_str(), chunk2_json.size());
+    auto get_chunks = [&](function<void(Graph&)> handle_chunk) {
+        for (auto& chunk : chunks) {
+            // the builders may consume the chunks
+            Graph copy = chunk;
+            handle_chunk(copy);
+        }
+    };
+
+    xg::XG in_memory;
+    in_memory.from_callback(get_chunks);
+    stringstream expected;
+    in_memory.serialize(expected);
+
+    for (size_t max_buffer_bytes : {1, 100, 1 << 20}) {
+        xg::XG bounded;
+        bounded.from_callback(get_chunks, false, false, false, false, max_buffer_bytes);
+
+        REQUIRE(bounded.node_count == 4);
+        REQUIRE(bounded.edge_count == 5);
+        REQUIRE(bounded.path_length("p") == 14);
+        REQUIRE(bounded.path_length("q") == 7);
+
+        stringstream observed;
+        bounded.serialize(observed);
+        REQUIRE(observed.str() == expected.str());
+    }
+}
+
+TEST_CASE("Edges can be visited in an xg index without making Edge objects", "[xg]") {
+
+    // Every edge type, plus a self loop
+    string graph_json = R"(
+    {"node":[{"id":1,"sequence":"GATT"},
+    {"id":2,"sequence":"ACA"},
+    {"id":3,"sequence":"CCCTTG"},
+    {"id":4,"sequence":"T"}],
+    "edge":[{"from":1,"to":2},
+    {"from":2,"to":3,"to_end":true},
+    {"from":3,"to":4,"from_start":true},
+    {"from":4,"to":1,"from_start":true,"to_end":true},
+    {"from":2,"to":2}]}
+    )";
+
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+
+    SECTION("for_each_edge_of visits the same edges as edges_of") {
+        for (int64_t id : {1, 2, 3, 4}) {
+            vector<Edge> visited;
+            xg_index.for_each_edge_of(id, [&](int64_t from, bool from_start, int64_t to, bool to_end) {
+                visited.push_back(xg::make_edge(from, from_start, to, to_end));
+                return true;
+            });
+            vector<Edge> expected = xg_index.edges_of(id);
+            REQUIRE(visited.size() == expected.size());
+            for (size_t i = 0; i < visited.size(); i++) {
+                REQUIRE(pb2json(visited[i]) == pb2json(expected[i]));
+            }
+        }
+    }
+
+    SECTION("edges on each side are found") {
+        size_t on_start = 0;
+        size_t on_end = 0;
+        xg_index.for_each_edge_on_start(2, [&](int64_t from, bool from_start, int64_t to, bool to_end) {
+            on_start++;
+            return true;
+        });
+        xg_index.for_each_edge_on_end(2, [&](int64_t from, bool from_start, int64_t to, bool to_end) {
+            on_end++;
+            return true;
+        });
+        REQUIRE(on_start == xg_index.edges_on_start(2).size());
+        REQUIRE(on_end == xg_index.edges_on_end(2).size());
+        REQUIRE(on_start > 0);
+        REQUIRE(on_end > 0);
+    }
+
+    SECTION("visiting stops when the iteratee returns false") {
+        size_t seen = 0;
+        bool finished = xg_index.for_each_edge_of(2, [&](int64_t from, bool from_start, int64_t to, bool to_end) {
+            seen++;
+            return false;
+        });
+        REQUIRE(!finished);
+        REQUIRE(seen == 1);
+    }
+
+    SECTION("follow_edges_inline agrees with follow_edges") {
+        for (int64_t id : {1, 2, 3, 4}) {
+            for (bool is_reverse : {false, true}) {
+                for (bool go_left : {false, true}) {
+                    handle_t handle = xg_index.get_handle(id, is_reverse);
+                    vector<handle_t> expected;
+                    xg_index.follow_edges(handle, go_left, [&](const handle_t& next) {
+                        expected.push_back(next);
+                        return true;
+                    });
+                    vector<handle_t> found;
+                    xg_index.follow_edges_inline(handle, go_left, [&](const handle_t& next) {
+                        found.push_back(next);
+                        return true;
+                    });
+                    REQUIRE(found == expected);
+                }
+            }
+        }
+        
+        // Reading through the end to end edge from 2 takes us to 3 backward
+        vector<handle_t> found;
+        xg_index.follow_edges_inline(xg_index.get_handle(2, false), false, [&](const handle_t& next) {
+            found.push_back(next);
+            return true;
+        });
+        REQUIRE(std::find(found.begin(), found.end(), xg_index.get_handle(3, true)) != found.end());
+    }
+}
+
 TEST_CASE("Target to alignment extraction", "[xg-target-to-aln]") {
 
     VG vg;
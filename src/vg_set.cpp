@@ -200,7 +200,7 @@ void VGset::write_gcsa_kmers_ascii(ostream& out, int kmer_size,
 
 // writes to a specific output stream
 void VGset::write_gcsa_kmers_binary(ostream& out, int kmer_size, size_t& size_limit,
-                                    id_t head_id, id_t tail_id) {
+                                    id_t head_id, id_t tail_id, size_t memory_limit) {
     if (filenames.size() > 1 && (head_id == 0 || tail_id == 0)) {
         id_t max_id = get_max_id(); // expensive, as we'll stream through all the files
         head_id = max_id + 1;
@@ -213,7 +213,7 @@ void VGset::write_gcsa_kmers_binary(ostream& out, int kmer_size, size_t& size_li
         Node* head_node = nullptr; Node* tail_node = nullptr;
         g->add_start_end_markers(kmer_size, '#', '$', head_node, tail_node, head_id, tail_id);
         size_t current_bytes = size_limit - total_size;
-        write_gcsa_kmers(*g, kmer_size, out, current_bytes, head_id, tail_id);
+        write_gcsa_kmers(*g, kmer_size, out, current_bytes, head_id, tail_id, memory_limit);
         total_size += current_bytes;
     });
     size_limit = total_size;
@@ -221,7 +221,7 @@ void VGset::write_gcsa_kmers_binary(ostream& out, int kmer_size, size_t& size_li
 
 // writes to a set of temp files and returns their names
 vector<string> VGset::write_gcsa_kmers_binary(int kmer_size, size_t& size_limit,
-                                              id_t head_id, id_t tail_id) {
+                                              id_t head_id, id_t tail_id, size_t memory_limit) {
     if (filenames.size() > 1 && (head_id == 0 || tail_id == 0)) {
         id_t max_id = get_max_id(); // expensive, as we'll stream through all the files
         head_id = max_id + 1;
@@ -234,7 +234,8 @@ vector<string> VGset::write_gcsa_kmers_binary(int kmer_size, size_t& size_limit,
         Node* head_node = nullptr; Node* tail_node = nullptr;
         g->add_start_end_markers(kmer_size, '#', '$', head_node, tail_node, head_id, tail_id);
         size_t current_bytes = size_limit - total_size;
-        tmpnames.push_back(write_gcsa_kmers_to_tmpfile(*g, kmer_size, current_bytes, head_id, tail_id));
+        tmpnames.push_back(write_gcsa_kmers_to_tmpfile(*g, kmer_size, current_bytes, head_id, tail_id,
+                                                       "vg-kmers-tmp-", memory_limit));
         total_size += current_bytes;
     });
     size_limit = total_size;
@@ -55,13 +55,16 @@ public:
      * Write out kmer lines to GCSA2.
      * size_limit is the maximum space usage for the kmer files in bytes. When the
      * function returns, size_limit is the total size of the kmer files in bytes.
+     * memory_limit is roughly how many bytes of kmers are held in memory at once.
      */
     void write_gcsa_kmers_ascii(ostream& out, int kmer_size,
                                 int64_t head_id=0, int64_t tail_id=0);
     void write_gcsa_kmers_binary(ostream& out, int kmer_size, size_t& size_limit,
-                                 int64_t head_id=0, int64_t tail_id=0);
+                                 int64_t head_id=0, int64_t tail_id=0,
+                                 size_t memory_limit = 1024 * 1024 * 1024);
     vector<string> write_gcsa_kmers_binary(int kmer_size, size_t& size_limit,
-                                           int64_t head_id=0, int64_t tail_id=0);
+                                           int64_t head_id=0, int64_t tail_id=0,
+                                           size_t memory_limit = 1024 * 1024 * 1024);
 
     // Should we show our progress running through each graph?             
     bool show_progress = false;
@@ -0,0 +1,694 @@
+//
+//  xdrop_aligner.cpp
+//
+//  Contains an X-drop pruned graph aligner to support Aligner in local and pinned
+//  alignment against a graph.
+//
+
+#include "xdrop_aligner.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+//#define debug_xdrop_fill
+//#define debug_xdrop_traceback
+
+using namespace vg;
+
+/// Score of cells that have been abandoned or never reached. It is far enough from the limits of
+/// int32_t that gap penalties can be subtracted from it without overflowing.
+static const int32_t XDROP_NEG_INF = numeric_limits<int32_t>::min() / 2;
+
+XdropAligner::XdropAligner(Alignment& alignment, const Graph& g, int32_t max_drop, bool pinned,
+                           bool pin_left, bool adjust_for_base_quality) :
+                           alignment(alignment), graph(g), max_drop(max_drop), pinned(pinned),
+                           pin_left(pin_left), adjust_for_base_quality(adjust_for_base_quality),
+                           reversed(pinned && !pin_left) {
+
+    if (pin_left && !pinned) {
+        throw invalid_argument("[vg::XdropAligner] cannot choose pinned end in non-pinned alignment");
+    }
+    if (adjust_for_base_quality && alignment.quality().size() != alignment.sequence().size()) {
+        throw invalid_argument("[vg::XdropAligner] read has " + to_string(alignment.quality().size())
+                               + " base qualities for " + to_string(alignment.sequence().size()) + " bases");
+    }
+
+    // a pinned end is always aligned at the start of the DP, so pinning on the right means aligning
+    // everything in reverse
+    read = alignment.sequence();
+    if (adjust_for_base_quality) {
+        quality = alignment.quality();
+    }
+    if (reversed) {
+        reverse(read.begin(), read.end());
+        reverse(quality.begin(), quality.end());
+    }
+
+    int64_t num_nodes = graph.node_size();
+    unordered_map<int64_t, int64_t> node_idx;
+    for (int64_t i = 0; i < num_nodes; i++) {
+        node_idx[graph.node(i).id()] = reversed ? num_nodes - i - 1 : i;
+    }
+
+    predecessors.resize(num_nodes);
+    for (int64_t i = 0; i < graph.edge_size(); i++) {
+        const Edge& edge = graph.edge(i);
+        int64_t from = node_idx.at(edge.from());
+        int64_t to = node_idx.at(edge.to());
+        if (reversed) {
+            predecessors[from].push_back(to);
+        }
+        else {
+            predecessors[to].push_back(from);
+        }
+    }
+}
+
+bool XdropAligner::is_supported(const Graph& g) {
+    unordered_map<int64_t, int64_t> node_idx;
+    for (int64_t i = 0; i < g.node_size(); i++) {
+        if (g.node(i).sequence().empty()) {
+            return false;
+        }
+        node_idx[g.node(i).id()] = i;
+    }
+    for (int64_t i = 0; i < g.edge_size(); i++) {
+        const Edge& edge = g.edge(i);
+        if (edge.from_start() || edge.to_end()) {
+            return false;
+        }
+        auto from = node_idx.find(edge.from());
+        auto to = node_idx.find(edge.to());
+        if (from == node_idx.end() || to == node_idx.end() || from->second >= to->second) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t XdropAligner::cells_filled() const {
+    return num_cells_filled;
+}
+
+size_t XdropAligner::nodes_skipped() const {
+    return num_nodes_skipped;
+}
+
+inline const Node& XdropAligner::node_at(int64_t node) const {
+    return graph.node(reversed ? graph.node_size() - node - 1 : node);
+}
+
+inline char XdropAligner::base_at(int64_t node, int64_t col) const {
+    const string& seq = node_at(node).sequence();
+    return reversed ? seq[seq.size() - col - 1] : seq[col];
+}
+
+inline int32_t XdropAligner::pair_score(int64_t read_idx, char graph_base) const {
+    int32_t score = adjust_for_base_quality ?
+                    score_mat[25 * quality[read_idx] + 5 * nt_table[graph_base] + nt_table[read[read_idx]]] :
+                    score_mat[5 * nt_table[graph_base] + nt_table[read[read_idx]]];
+    if (read_idx == 0) {
+        score += start_bonus;
+    }
+    if (read_idx + 1 == (int64_t) read.size()) {
+        score += end_bonus;
+    }
+    return score;
+}
+
+XdropAligner::Scores XdropAligner::scores_at(int64_t node, int64_t col, int64_t row) const {
+    if (col < 0) {
+        if (pinned) {
+            // the only way to start a pinned alignment is from the pinned corner, so the imaginary
+            // column before a source node is a chain of insertions of the read's first bases
+            if (row == 0) {
+                return Scores{0, XDROP_NEG_INF, XDROP_NEG_INF};
+            }
+            int64_t gap_score = -gap_open - (row - 1) * gap_extend;
+            if (gap_score < -max_drop) {
+                return Scores{XDROP_NEG_INF, XDROP_NEG_INF, XDROP_NEG_INF};
+            }
+            return Scores{(int32_t) gap_score, XDROP_NEG_INF, (int32_t) gap_score};
+        }
+        // local alignments can start fresh before any node
+        return Scores{0, XDROP_NEG_INF, XDROP_NEG_INF};
+    }
+
+    const NodeMatrix& matrix = matrices[node];
+    const Column& column = matrix.columns[col];
+    if (row < column.top || row > column.bottom) {
+        return Scores{XDROP_NEG_INF, XDROP_NEG_INF, XDROP_NEG_INF};
+    }
+    size_t idx = column.start + (row - column.top);
+    return Scores{matrix.match[idx], matrix.insert_col[idx], matrix.insert_row[idx]};
+}
+
+/// Add to a score, leaving unreachable cells unreachable
+static inline int32_t add_score(int32_t score, int32_t delta) {
+    return score == XDROP_NEG_INF ? XDROP_NEG_INF : score + delta;
+}
+
+/// Keep the better of two ways to reach a cell: the higher score, or on a tie the one that has
+/// dropped less below the best score on its path
+static inline void take_better(int32_t& score, int32_t& path_max, int32_t other_score, int32_t other_path_max) {
+    if (other_score > score || (other_score == score && other_path_max < path_max)) {
+        score = other_score;
+        path_max = other_path_max;
+    }
+}
+
+XdropAligner::Cell XdropAligner::fill(int32_t& best_score) {
+
+    int64_t num_rows = read.size() + 1;
+    int64_t num_nodes = graph.node_size();
+
+    // the previous column and the one being filled, indexed by row, along with the best score on
+    // the path to each cell, which is what the cell's drop is measured from
+    vector<int32_t> prev_match(num_rows), prev_insert_col(num_rows);
+    vector<int32_t> prev_max_match(num_rows), prev_max_insert_col(num_rows);
+    vector<int32_t> curr_match(num_rows), curr_insert_col(num_rows), curr_insert_row(num_rows);
+    vector<int32_t> curr_max_match(num_rows), curr_max_insert_col(num_rows);
+
+    // the most that the rest of the read from each row could add to a local alignment's score, if
+    // every base matched and the alignment stopped before any base that can't score above 0
+    vector<int64_t> best_remaining(num_rows, 0);
+    for (int64_t row = num_rows - 2; row >= 0; row--) {
+        int32_t best_pair = 0;
+        for (char graph_base : string("ACGTN")) {
+            best_pair = max(best_pair, pair_score(row, graph_base));
+        }
+        best_remaining[row] = best_remaining[row + 1] + best_pair;
+    }
+
+    Cell best;
+    // a pinned alignment has to align something, even if it scores below the empty alignment
+    best_score = pinned ? XDROP_NEG_INF : 0;
+    // local alignments can start fresh in the rows above this one, until they could no longer beat
+    // the best alignment
+    int64_t fresh_bottom = pinned ? -1 : num_rows - 1;
+
+    for (int64_t node = 0; node < num_nodes; node++) {
+        NodeMatrix& matrix = matrices[node];
+        int64_t node_length = node_at(node).sequence().size();
+        matrix.columns.resize(node_length);
+
+        // find the rows of the column before this node that could be reached
+        int64_t prev_top = num_rows;
+        int64_t prev_bottom = -1;
+        int64_t source_bottom = -1;
+        if (!pinned) {
+            while (fresh_bottom >= 0 && best_remaining[fresh_bottom] <= best_score) {
+                fresh_bottom--;
+            }
+            // local alignments can start fresh in the rows that could still win
+            source_bottom = fresh_bottom;
+            if (source_bottom >= 0) {
+                prev_top = 0;
+                prev_bottom = source_bottom;
+            }
+        }
+        else if (predecessors[node].empty()) {
+            // insertions from the pinned corner are reachable until they have dropped too far
+            source_bottom = 0;
+            while (source_bottom + 1 < num_rows &&
+                   scores_at(node, -1, source_bottom + 1).match != XDROP_NEG_INF) {
+                source_bottom++;
+            }
+            prev_top = 0;
+            prev_bottom = source_bottom;
+        }
+        for (int64_t pred : predecessors[node]) {
+            const Column& column = matrices[pred].columns.back();
+            if (column.top <= column.bottom) {
+                prev_top = min(prev_top, column.top);
+                prev_bottom = max(prev_bottom, column.bottom);
+            }
+        }
+
+        if (prev_top > prev_bottom) {
+            // nothing that reaches this node survived
+            num_nodes_skipped++;
+#ifdef debug_xdrop_fill
+            cerr << "[XdropAligner::fill] skipping node " << node_at(node).id() << endl;
+#endif
+            continue;
+        }
+
+        // merge the last columns of the predecessors
+        for (int64_t row = prev_top; row <= prev_bottom; row++) {
+            Scores scores = row <= source_bottom ? scores_at(node, -1, row)
+                                                 : Scores{XDROP_NEG_INF, XDROP_NEG_INF, XDROP_NEG_INF};
+            prev_match[row] = scores.match;
+            prev_insert_col[row] = scores.insert_col;
+            // alignments start from nothing
+            prev_max_match[row] = 0;
+            prev_max_insert_col[row] = 0;
+        }
+        for (int64_t pred : predecessors[node]) {
+            const NodeMatrix& pred_matrix = matrices[pred];
+            const Column& column = pred_matrix.columns.back();
+            for (int64_t row = column.top; row <= column.bottom; row++) {
+                size_t idx = column.start + (row - column.top);
+                take_better(prev_match[row], prev_max_match[row], pred_matrix.match[idx],
+                            pred_matrix.last_max_match[row - column.top]);
+                take_better(prev_insert_col[row], prev_max_insert_col[row], pred_matrix.insert_col[idx],
+                            pred_matrix.last_max_insert_col[row - column.top]);
+            }
+        }
+
+        for (int64_t col = 0; col < node_length; col++) {
+            if (prev_top > prev_bottom) {
+                // the alignments have all dropped off, the rest of the node is unreachable
+                break;
+            }
+
+            char graph_base = base_at(node, col);
+            // below this row, cells can only be reached by insertions
+            int64_t diagonal_bottom = min(num_rows - 1, prev_bottom + 1);
+            if (!pinned) {
+                while (fresh_bottom >= 0 && best_remaining[fresh_bottom] <= best_score) {
+                    fresh_bottom--;
+                }
+            }
+            // local alignments may also start fresh at the top of the column
+            int64_t first_row = fresh_bottom >= 0 ? 0 : prev_top;
+
+            auto prev_match_at = [&](int64_t row) {
+                return (row < prev_top || row > prev_bottom) ? XDROP_NEG_INF : prev_match[row];
+            };
+            auto prev_insert_col_at = [&](int64_t row) {
+                return (row < prev_top || row > prev_bottom) ? XDROP_NEG_INF : prev_insert_col[row];
+            };
+            auto prev_max_match_at = [&](int64_t row) {
+                return (row < prev_top || row > prev_bottom) ? 0 : prev_max_match[row];
+            };
+            auto prev_max_insert_col_at = [&](int64_t row) {
+                return (row < prev_top || row > prev_bottom) ? 0 : prev_max_insert_col[row];
+            };
+
+            int64_t alive_top = num_rows;
+            int64_t alive_bottom = -1;
+            int32_t above_match = XDROP_NEG_INF;
+            int32_t above_insert_row = XDROP_NEG_INF;
+            int32_t above_max_match = 0;
+            int32_t above_max_insert_row = 0;
+            for (int64_t row = first_row; row < num_rows; row++) {
+                int32_t match = XDROP_NEG_INF, insert_col = XDROP_NEG_INF, insert_row = XDROP_NEG_INF;
+                int32_t max_match = 0, max_insert_col = 0, max_insert_row = 0;
+                if (row > 0 || pinned) {
+                    // deletions, which at row 0 can only come from the pinned corner
+                    insert_col = add_score(prev_match_at(row), -gap_open);
+                    max_insert_col = prev_max_match_at(row);
+                    take_better(insert_col, max_insert_col, add_score(prev_insert_col_at(row), -gap_extend),
+                                prev_max_insert_col_at(row));
+                }
+                if (row > 0) {
+                    insert_row = add_score(above_match, -gap_open);
+                    max_insert_row = above_max_match;
+                    take_better(insert_row, max_insert_row, add_score(above_insert_row, -gap_extend),
+                                above_max_insert_row);
+                    match = add_score(prev_match_at(row - 1), pair_score(row - 1, graph_base));
+                    max_match = prev_max_match_at(row - 1);
+                }
+                take_better(match, max_match, insert_col, max_insert_col);
+                take_better(match, max_match, insert_row, max_insert_row);
+                max_match = max(max_match, match);
+                num_cells_filled++;
+
+                bool dropped = match == XDROP_NEG_INF || (int64_t) match < (int64_t) max_match - max_drop;
+                // the best pinned alignment so far is never abandoned, so that there is always one to
+                // return even if every alignment drops too far
+                if (dropped && !(pinned && row > 0 && match > best_score)) {
+                    // abandon the cell
+                    match = insert_col = insert_row = XDROP_NEG_INF;
+                }
+                if (!pinned) {
+                    // fresh starts keep local alignments from ever dropping far, so they are also
+                    // abandoned once nothing through them can beat the best alignment, which ties
+                    // never replace
+                    if (match != XDROP_NEG_INF && !(row > 0 && match > best_score)
+                        && match + best_remaining[row] <= best_score) {
+                        match = insert_col = insert_row = XDROP_NEG_INF;
+                    }
+                    if (best_remaining[row] > best_score) {
+                        // local alignments can start fresh here
+                        take_better(match, max_match, 0, 0);
+                    }
+                }
+
+                if (match == XDROP_NEG_INF) {
+                    if (row > diagonal_bottom) {
+                        break;
+                    }
+                }
+                else {
+                    alive_top = min(alive_top, row);
+                    alive_bottom = row;
+                    if (row > 0 && match > best_score) {
+                        best_score = match;
+                        best.node = node;
+                        best.col = col;
+                        best.row = row;
+                    }
+                }
+                curr_match[row] = match;
+                curr_insert_col[row] = insert_col;
+                curr_insert_row[row] = insert_row;
+                curr_max_match[row] = max_match;
+                curr_max_insert_col[row] = max_insert_col;
+                above_match = match;
+                above_insert_row = insert_row;
+                above_max_match = max_match;
+                above_max_insert_row = max_insert_row;
+            }
+
+            // keep the cells that survived
+            Column& column = matrix.columns[col];
+            column.start = matrix.match.size();
+            column.top = alive_top;
+            column.bottom = alive_bottom;
+            if (alive_top <= alive_bottom) {
+                matrix.match.insert(matrix.match.end(), curr_match.begin() + alive_top,
+                                    curr_match.begin() + alive_bottom + 1);
+                matrix.insert_col.insert(matrix.insert_col.end(), curr_insert_col.begin() + alive_top,
+                                         curr_insert_col.begin() + alive_bottom + 1);
+                matrix.insert_row.insert(matrix.insert_row.end(), curr_insert_row.begin() + alive_top,
+                                         curr_insert_row.begin() + alive_bottom + 1);
+            }
+
+#ifdef debug_xdrop_fill
+            cerr << "[XdropAligner::fill] node " << node_at(node).id() << " column " << col << " rows "
+                 << alive_top << ":" << alive_bottom << ", best score " << best_score << endl;
+#endif
+
+            prev_match.swap(curr_match);
+            prev_insert_col.swap(curr_insert_col);
+            prev_max_match.swap(curr_max_match);
+            prev_max_insert_col.swap(curr_max_insert_col);
+            prev_top = alive_top;
+            prev_bottom = alive_bottom;
+        }
+
+        // successors measure their drops from the path maxima in the last column
+        const Column& last = matrix.columns.back();
+        if (last.top <= last.bottom) {
+            matrix.last_max_match.assign(prev_max_match.begin() + last.top, prev_max_match.begin() + last.bottom + 1);
+            matrix.last_max_insert_col.assign(prev_max_insert_col.begin() + last.top,
+                                              prev_max_insert_col.begin() + last.bottom + 1);
+        }
+    }
+
+    return best;
+}
+
+vector<XdropAligner::Step> XdropAligner::traceback(const Cell& end) const {
+
+    vector<Step> steps;
+
+    // the columns before a cell, which are the other columns of its node or the last columns of
+    // its predecessors (and the imaginary column before a node where alignments can start)
+    auto prev_columns = [&](const Cell& cell) {
+        vector<pair<int64_t, int64_t>> columns;
+        if (cell.col > 0) {
+            columns.emplace_back(cell.node, cell.col - 1);
+        }
+        else {
+            for (int64_t pred : predecessors[cell.node]) {
+                columns.emplace_back(pred, matrices[pred].columns.size() - 1);
+            }
+            if (!pinned || predecessors[cell.node].empty()) {
+                columns.emplace_back(cell.node, -1);
+            }
+        }
+        return columns;
+    };
+
+    enum {Match, InsertCol, InsertRow} matrix = Match;
+    Cell cell = end;
+    while (true) {
+#ifdef debug_xdrop_traceback
+        cerr << "[XdropAligner::traceback] node " << node_at(cell.node).id() << " column " << cell.col
+             << " row " << cell.row << " matrix " << matrix << endl;
+#endif
+        if (cell.col < 0) {
+            // the imaginary column before a source node, where pinned alignments start with insertions
+            // and local alignments start fresh
+            if (pinned) {
+                for (int64_t row = cell.row; row > 0; row--) {
+                    steps.push_back(Step{'I', cell.node, cell.col, row - 1});
+                }
+            }
+            break;
+        }
+
+        Scores scores = scores_at(cell.node, cell.col, cell.row);
+        bool found = false;
+        if (matrix == Match) {
+            if (!pinned && scores.match == 0) {
+                // local alignment starts here
+                break;
+            }
+            if (cell.row > 0) {
+                int32_t match_score = pair_score(cell.row - 1, base_at(cell.node, cell.col));
+                for (const pair<int64_t, int64_t>& column : prev_columns(cell)) {
+                    if (scores_at(column.first, column.second, cell.row - 1).match + match_score == scores.match) {
+                        steps.push_back(Step{'M', cell.node, cell.col, cell.row - 1});
+                        cell.node = column.first;
+                        cell.col = column.second;
+                        cell.row--;
+                        found = true;
+                        break;
+                    }
+                }
+            }
+            if (!found) {
+                if (scores.match == scores.insert_col) {
+                    matrix = InsertCol;
+                    found = true;
+                }
+                else if (scores.match == scores.insert_row) {
+                    matrix = InsertRow;
+                    found = true;
+                }
+            }
+        }
+        else if (matrix == InsertCol) {
+            // deletion of the graph base in this column
+            steps.push_back(Step{'D', cell.node, cell.col, cell.row});
+            for (const pair<int64_t, int64_t>& column : prev_columns(cell)) {
+                Scores prev_scores = scores_at(column.first, column.second, cell.row);
+                if (prev_scores.match - gap_open == scores.insert_col) {
+                    matrix = Match;
+                    found = true;
+                }
+                else if (prev_scores.insert_col - gap_extend == scores.insert_col) {
+                    found = true;
+                }
+                if (found) {
+                    cell.node = column.first;
+                    cell.col = column.second;
+                    break;
+                }
+            }
+        }
+        else {
+            // insertion of the read base in this row
+            steps.push_back(Step{'I', cell.node, cell.col, cell.row - 1});
+            Scores above_scores = scores_at(cell.node, cell.col, cell.row - 1);
+            if (above_scores.match - gap_open == scores.insert_row) {
+                matrix = Match;
+                found = true;
+            }
+            else if (above_scores.insert_row - gap_extend == scores.insert_row) {
+                found = true;
+            }
+            cell.row--;
+        }
+
+        if (!found) {
+            throw runtime_error("[vg::XdropAligner] traceback failed at node " + to_string(node_at(cell.node).id())
+                                + ", column " + to_string(cell.col) + ", row " + to_string(cell.row)
+                                + " while aligning read " + alignment.name());
+        }
+    }
+
+    reverse(steps.begin(), steps.end());
+    return steps;
+}
+
+void XdropAligner::steps_to_path(const vector<Step>& steps) {
+
+    const string& sequence = alignment.sequence();
+    int64_t read_length = sequence.size();
+    int64_t num_nodes = graph.node_size();
+
+    // translate the steps back into the orientation of the graph, where they refer to node indexes,
+    // offsets in the node and read positions, and insertions are located before the graph base at
+    // their offset
+    vector<Step> path_steps;
+    path_steps.reserve(steps.size());
+    for (const Step& step : steps) {
+        Step path_step = step;
+        if (reversed) {
+            path_step.node = num_nodes - step.node - 1;
+            path_step.col = node_at(step.node).sequence().size() - step.col - 1;
+            if (step.op != 'D') {
+                path_step.row = read_length - step.row - 1;
+            }
+        }
+        else if (step.op == 'I') {
+            path_step.col = step.col + 1;
+        }
+        path_steps.push_back(path_step);
+    }
+    if (reversed) {
+        reverse(path_steps.begin(), path_steps.end());
+    }
+
+    int64_t first_read_idx = read_length;
+    int64_t last_read_idx = -1;
+    for (const Step& step : path_steps) {
+        if (step.op != 'D') {
+            first_read_idx = min(first_read_idx, step.row);
+            last_read_idx = max(last_read_idx, step.row);
+        }
+    }
+
+    Path* path = alignment.mutable_path();
+    Mapping* mapping = nullptr;
+    int64_t mapping_node = -1;
+    for (const Step& step : path_steps) {
+        const Node& node = graph.node(step.node);
+        if (step.node != mapping_node) {
+            mapping = path->add_mapping();
+            mapping->mutable_position()->set_node_id(node.id());
+            mapping->mutable_position()->set_offset(step.col);
+            mapping->set_rank(path->mapping_size());
+            mapping_node = step.node;
+            if (path->mapping_size() == 1 && first_read_idx > 0) {
+                // soft clip the start of the read
+                Edit* edit = mapping->add_edit();
+                edit->set_from_length(0);
+                edit->set_to_length(first_read_idx);
+                edit->set_sequence(sequence.substr(0, first_read_idx));
+            }
+        }
+
+        Edit* last_edit = mapping->edit_size() > 0 ? mapping->mutable_edit(mapping->edit_size() - 1) : nullptr;
+        if (step.op == 'M') {
+            if (node.sequence()[step.col] == sequence[step.row]) {
+                if (last_edit && last_edit->from_length() == last_edit->to_length() && last_edit->sequence().empty()) {
+                    last_edit->set_from_length(last_edit->from_length() + 1);
+                    last_edit->set_to_length(last_edit->to_length() + 1);
+                }
+                else {
+                    Edit* edit = mapping->add_edit();
+                    edit->set_from_length(1);
+                    edit->set_to_length(1);
+                }
+            }
+            else {
+                Edit* edit = mapping->add_edit();
+                edit->set_from_length(1);
+                edit->set_to_length(1);
+                edit->set_sequence(sequence.substr(step.row, 1));
+            }
+        }
+        else if (step.op == 'D') {
+            if (last_edit && last_edit->from_length() > 0 && last_edit->to_length() == 0) {
+                last_edit->set_from_length(last_edit->from_length() + 1);
+            }
+            else {
+                Edit* edit = mapping->add_edit();
+                edit->set_from_length(1);
+                edit->set_to_length(0);
+            }
+        }
+        else {
+            if (last_edit && last_edit->from_length() == 0 && last_edit->to_length() > 0
+                && (path->mapping_size() > 1 || mapping->edit_size() > 1 || first_read_idx == 0)) {
+                // extend the insertion, but don't merge it into a soft clip
+                last_edit->set_to_length(last_edit->to_length() + 1);
+                last_edit->mutable_sequence()->push_back(sequence[step.row]);
+            }
+            else {
+                Edit* edit = mapping->add_edit();
+                edit->set_from_length(0);
+                edit->set_to_length(1);
+                edit->set_sequence(sequence.substr(step.row, 1));
+            }
+        }
+    }
+
+    if (mapping && last_read_idx + 1 < read_length) {
+        // soft clip the end of the read
+        Edit* edit = mapping->add_edit();
+        edit->set_from_length(0);
+        edit->set_to_length(read_length - last_read_idx - 1);
+        edit->set_sequence(sequence.substr(last_read_idx + 1));
+    }
+}
+
+void XdropAligner::align(const int8_t* score_mat, const int8_t* nt_table, int8_t gap_open, int8_t gap_extend,
+                         int8_t full_length_bonus, bool traceback) {
+
+    this->score_mat = score_mat;
+    this->nt_table = nt_table;
+    this->gap_open = gap_open;
+    this->gap_extend = gap_extend;
+    // the pinned end of the read is at the start of the DP, and it does not get a bonus
+    start_bonus = pinned ? 0 : full_length_bonus;
+    end_bonus = full_length_bonus;
+
+    matrices.clear();
+    matrices.resize(graph.node_size());
+    num_cells_filled = 0;
+    num_nodes_skipped = 0;
+
+    int32_t best_score;
+    Cell best = fill(best_score);
+
+    alignment.clear_path();
+    alignment.set_query_position(0);
+
+    if (best.node < 0) {
+        // no alignment scores better than an empty one, which for a pinned alignment only happens
+        // when there is nothing to align
+        alignment.set_score(0);
+        if (pinned && traceback && graph.node_size() > 0) {
+            // locate at the beginning of a source node or the end of a sink node as appropriate,
+            // soft clipping the whole read
+            Mapping* mapping = alignment.mutable_path()->add_mapping();
+            mapping->set_rank(1);
+            Position* position = mapping->mutable_position();
+            if (pin_left) {
+                position->set_node_id(graph.node(0).id());
+                position->set_offset(0);
+            }
+            else {
+                const Node& sink = graph.node(graph.node_size() - 1);
+                position->set_node_id(sink.id());
+                position->set_offset(sink.sequence().size());
+            }
+            Edit* edit = mapping->add_edit();
+            edit->set_to_length(alignment.sequence().size());
+            edit->set_sequence(alignment.sequence());
+        }
+        return;
+    }
+
+    alignment.set_score(best_score);
+    if (traceback) {
+        steps_to_path(this->traceback(best));
+    }
+    else {
+        // mark the end position, like the gssw aligners do for de-duplication
+        const Node& node = node_at(best.node);
+        Position* position = alignment.mutable_path()->add_mapping()->mutable_position();
+        position->set_node_id(node.id());
+        position->set_offset(reversed ? node.sequence().size() - best.col - 1 : best.col);
+    }
+}
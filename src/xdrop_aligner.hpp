@@ -0,0 +1,173 @@
+//
+//  xdrop_aligner.hpp
+//
+//  Contains an X-drop pruned graph aligner to support Aligner in local and pinned
+//  alignment against a graph.
+//
+
+#ifndef xdrop_aligner_hpp
+#define xdrop_aligner_hpp
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include "vg.pb.h"
+
+using namespace std;
+
+namespace vg {
+
+    /**
+     * Local or pinned Smith-Waterman-Gotoh alignment of a read to a DAG with X-drop pruning. Cells
+     * whose score falls more than a maximum drop below the best score earlier on their own path are
+     * abandoned, and so are nodes that can only be reached through abandoned cells, so the work done
+     * on a large or repetitive graph is bounded by how far alignments can drift from their best
+     * rather than by the size of the graph.
+     *
+     * Pinned alignments are extended from the pinned end, so an alignment is only lost if its score
+     * drops by more than the maximum somewhere along the way. The best pinned alignment is returned
+     * even if it scores below zero, rather than the empty alignment that gssw falls back on. Local
+     * alignments may start fresh in any cell, which would keep them from ever dropping far, so local
+     * cells (and fresh starts) are also abandoned once they could not beat the best alignment so far
+     * even if the rest of the read matched. Once a good alignment is found, only the cells that
+     * could still improve on it are filled.
+     *
+     * The graph must be topologically sorted by node index (see is_supported()). Scoring follows
+     * the Aligner: the score matrix is indexed by 5 * graph base + read base (plus 25 * base quality
+     * for base quality adjusted alignment), a gap of length L scores -gap_open - (L - 1) * gap_extend,
+     * and a full length bonus is added for each unpinned end of the read that the alignment reaches.
+     */
+    class XdropAligner {
+    public:
+        /// Initializes X-drop alignment
+        ///
+        /// Args:
+        ///  alignment                   alignment with a sequence (and possibly base qualities), whose path
+        ///                              and score will be replaced
+        ///  g                           graph to align to, which must pass is_supported()
+        ///  max_drop                    how far below the best score so far a cell's score can fall before
+        ///                              it is abandoned
+        ///  pinned                      make the alignment reach one end of the read and a source or sink node
+        ///  pin_left                    pin the start of the read to a source node rather than the end of the
+        ///                              read to a sink node
+        ///  adjust_for_base_quality     perform base quality adjusted alignment (see QualAdjAligner)
+        ///
+        XdropAligner(Alignment& alignment, const Graph& g, int32_t max_drop, bool pinned = false,
+                     bool pin_left = false, bool adjust_for_base_quality = false);
+
+        /// Stores the optimal alignment that survived pruning in the alignment object given in the
+        /// constructor. Without a traceback, only the score and the node and offset where the
+        /// alignment ends are stored, like the gssw aligners do.
+        ///
+        /// Args:
+        ///  score_mat           matrix of match/mismatch scores from Aligner (if performing base quality
+        ///                      adjusted alignment, use QualAdjAligner's adjusted score matrix)
+        ///  nt_table            table of indices by DNA char from Aligner
+        ///  gap_open            gap open penalty from Aligner
+        ///  gap_extend          gap extension penalty from Aligner
+        ///  full_length_bonus   bonus for reaching an unpinned end of the read
+        ///  traceback           compute the path of the alignment
+        void align(const int8_t* score_mat, const int8_t* nt_table, int8_t gap_open, int8_t gap_extend,
+                   int8_t full_length_bonus, bool traceback = true);
+
+        /// Number of DP cells computed by the last align()
+        size_t cells_filled() const;
+        /// Number of nodes that the last align() abandoned without computing any cells
+        size_t nodes_skipped() const;
+
+        /// Returns true if the graph can be aligned to: edges must all run from the end of a node
+        /// to the start of a later node in the graph's node order, and no node can be empty
+        static bool is_supported(const Graph& g);
+
+    private:
+
+        /// The computed cells of one column of one node's matrix, rows top to bottom inclusive
+        struct Column {
+            size_t start = 0;
+            int64_t top = 0;
+            int64_t bottom = -1;
+        };
+
+        /// The DP matrices of one node. Rows are positions in the read (row 0 is before the first
+        /// base) and columns are bases of the node.
+        struct NodeMatrix {
+            vector<Column> columns;
+            vector<int32_t> match;
+            vector<int32_t> insert_col;
+            vector<int32_t> insert_row;
+            /// The best score on the path to each cell of the last column, in the match and column
+            /// gap matrices, which the drops in the successors' first columns are measured from
+            vector<int32_t> last_max_match;
+            vector<int32_t> last_max_insert_col;
+        };
+
+        /// A location in the matrices; column -1 is the imaginary column before a source node
+        struct Cell {
+            int64_t node = -1;
+            int64_t col = 0;
+            int64_t row = 0;
+        };
+
+        /// One step of the traceback
+        struct Step {
+            /// 'M' for an aligned pair of bases, 'I' for an inserted read base, 'D' for a deleted graph base
+            char op;
+            int64_t node;
+            int64_t col;
+            int64_t row;
+        };
+
+        /// Score of the best of the three matrices in a cell, and the two gap matrices
+        struct Scores {
+            int32_t match;
+            int32_t insert_col;
+            int32_t insert_row;
+        };
+
+        Alignment& alignment;
+        const Graph& graph;
+        int32_t max_drop;
+        bool pinned;
+        bool pin_left;
+        bool adjust_for_base_quality;
+        /// Do we align the reverse of everything, so that a pinned end is at the start?
+        bool reversed;
+
+        /// The read sequence and qualities in the order they are aligned
+        string read;
+        string quality;
+        /// Node indexes of each node's predecessors, in the order they are aligned
+        vector<vector<int64_t>> predecessors;
+        vector<NodeMatrix> matrices;
+
+        // scoring parameters for the current alignment
+        const int8_t* score_mat = nullptr;
+        const int8_t* nt_table = nullptr;
+        int32_t gap_open = 0;
+        int32_t gap_extend = 0;
+        int32_t start_bonus = 0;
+        int32_t end_bonus = 0;
+
+        size_t num_cells_filled = 0;
+        size_t num_nodes_skipped = 0;
+
+        /// The node at an index, in the order they are aligned
+        inline const Node& node_at(int64_t node) const;
+        /// The base of a node in a column, in the order they are aligned
+        inline char base_at(int64_t node, int64_t col) const;
+        /// Score of aligning a read base to a graph base, including any full length bonus
+        inline int32_t pair_score(int64_t read_idx, char graph_base) const;
+        /// Scores in a cell, or the scores of the imaginary column before a source node
+        Scores scores_at(int64_t node, int64_t col, int64_t row) const;
+
+        /// Fill the matrices and return the cell with the best score, which has node -1 if the best
+        /// score is the empty alignment
+        Cell fill(int32_t& best_score);
+        /// Trace back from a cell, returning the steps in the order they are aligned
+        vector<Step> traceback(const Cell& end) const;
+        /// Convert the steps of an alignment into the alignment's path
+        void steps_to_path(const vector<Step>& steps);
+    };
+}
+
+#endif
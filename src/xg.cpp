@@ -1,9 +1,18 @@
 #include "xg.hpp"
 #include "stream.hpp"
 #include "alignment.hpp"
+#include "utility.hpp"
 
 #include <bitset>
+#include <algorithm>
+#include <memory>
+#include <tuple>
+#include <cstring>
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 //#define VERBOSE_DEBUG
 //#define debug_algorithms
@@ -90,6 +99,45 @@ XG::~XG(void) {
         delete paths.back();
         paths.pop_back();
     }
+    
+    if (mapping != nullptr) {
+        // Drop the memory-mapped vectors
+        munmap(mapping, mapping_size);
+    }
+}
+
+int_vector<>& MappableIntVector::storage() {
+    mapped_words = nullptr;
+    mapped_size = 0;
+    mapped_width = 0;
+    return owned;
+}
+
+void MappableIntVector::map(const uint64_t* words, size_t size, uint8_t width) {
+    // Free the owned data
+    util::clear(owned);
+    mapped_words = words;
+    mapped_size = size;
+    mapped_width = width;
+}
+
+bool MappableIntVector::is_mapped() const {
+    return mapped_words != nullptr;
+}
+
+void MappableIntVector::load(istream& in) {
+    storage().load(in);
+}
+
+size_t MappableIntVector::serialize(std::ostream& out, sdsl::structure_tree_node* v, std::string name) const {
+    if (!is_mapped()) {
+        return owned.serialize(out, v, name);
+    }
+    
+    // Copy into a real int_vector<> so we get the same format.
+    int_vector<> copy(mapped_size, 0, mapped_width);
+    memcpy(copy.data(), mapped_words, ((bit_size() + 63) / 64) * sizeof(uint64_t));
+    return copy.serialize(out, v, name);
 }
 
 void XG::load(istream& in) {
@@ -110,6 +158,12 @@ void XG::load(istream& in) {
         if (buffer == 'G') {
             // We found the magic value!
             
+            if (in.peek() == 'M') {
+                // This is the start of the "XGMM" magic for the mappable
+                // layout, which we can't read from a stream.
+                throw XGFormatError("Memory-mappable XG index must be loaded from a file");
+            }
+            
             // Don't put it back, but the next 4 bytes are a version number.
             in.read((char*) &file_version, sizeof(file_version));
             // Make sure to convert from network to host byte order
@@ -454,7 +508,127 @@ id_t XGPath::external_id(id_t id) const {
     return id+min_node_id-1;
 }
 
+/// Magic number at the start of a memory-mappable XG file
+static const char XG_MAPPABLE_MAGIC[4] = {'X', 'G', 'M', 'M'};
+
+/// Header of a memory-mappable XG file. The mapped vectors are stored as
+/// arrays of int_vector<> words at the given byte offsets, and the rest of the
+/// index follows at tail_offset in the normal format, with those vectors left
+/// empty.
+struct XGMappableHeader {
+    char magic[4];
+    uint32_t version;
+    // Offset in bytes, size in integers, and width in bits of each mapped
+    // vector, in the order r_iv, g_iv, s_iv.
+    uint64_t vector_offset[3];
+    uint64_t vector_size[3];
+    uint64_t vector_width[3];
+    uint64_t tail_offset;
+};
+
+/// Alignment for the mapped vectors in the file
+static const size_t XG_MAPPABLE_ALIGNMENT = 4096;
+
+void XG::load_file(const string& filename) {
+    
+    ifstream in(filename);
+    if (!in) {
+        throw XGFormatError("Index file " + filename + " does not exist or cannot be read");
+    }
+    
+    XGMappableHeader header;
+    in.read((char*) &header, sizeof(header));
+    if (!in || !std::equal(header.magic, header.magic + sizeof(header.magic), XG_MAPPABLE_MAGIC)) {
+        // This is a normal XG
+        in.clear();
+        in.seekg(0);
+        load(in);
+        return;
+    }
+    
+    if (header.version != MAPPABLE_VERSION) {
+        throw XGFormatError("Memory-mappable XG index version " + to_string(header.version) +
+            " is not supported (expected " + to_string(MAPPABLE_VERSION) + ")");
+    }
+    
+    // Map the whole file
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat file_stats;
+    if (fd == -1 || fstat(fd, &file_stats) != 0) {
+        if (fd != -1) {
+            close(fd);
+        }
+        throw XGFormatError("Could not open " + filename + " for mapping");
+    }
+    mapping_size = file_stats.st_size;
+    mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid after the file is closed
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        throw XGFormatError("Could not memory-map " + filename);
+    }
+    
+    // Load everything else the normal way. This leaves the mapped vectors
+    // empty.
+    in.seekg(header.tail_offset);
+    load(in);
+    
+    // And point the mapped vectors into the file
+    MappableIntVector* mapped_vectors[3] = {&r_iv, &g_iv, &s_iv};
+    for (size_t i = 0; i < 3; i++) {
+        size_t words = (header.vector_size[i] * header.vector_width[i] + 63) / 64;
+        if (header.vector_width[i] == 0 || header.vector_width[i] > 64 ||
+            header.vector_offset[i] % sizeof(uint64_t) != 0 ||
+            header.vector_offset[i] + words * sizeof(uint64_t) > mapping_size) {
+            throw XGFormatError("Memory-mappable XG index " + filename + " is corrupt");
+        }
+        mapped_vectors[i]->map((const uint64_t*) ((const char*) mapping + header.vector_offset[i]),
+                               header.vector_size[i], header.vector_width[i]);
+    }
+}
+
+size_t XG::serialize_mappable(ostream& out) {
+    
+    XGMappableHeader header;
+    std::copy(XG_MAPPABLE_MAGIC, XG_MAPPABLE_MAGIC + sizeof(XG_MAPPABLE_MAGIC), header.magic);
+    header.version = MAPPABLE_VERSION;
+    
+    // Lay out the vectors on aligned boundaries after the header
+    const MappableIntVector* mapped_vectors[3] = {&r_iv, &g_iv, &s_iv};
+    size_t cursor = sizeof(header);
+    for (size_t i = 0; i < 3; i++) {
+        cursor = (cursor + XG_MAPPABLE_ALIGNMENT - 1) / XG_MAPPABLE_ALIGNMENT * XG_MAPPABLE_ALIGNMENT;
+        header.vector_offset[i] = cursor;
+        header.vector_size[i] = mapped_vectors[i]->size();
+        header.vector_width[i] = mapped_vectors[i]->width();
+        cursor += (mapped_vectors[i]->bit_size() + 63) / 64 * sizeof(uint64_t);
+    }
+    header.tail_offset = cursor;
+    
+    out.write((const char*) &header, sizeof(header));
+    size_t written = sizeof(header);
+    for (size_t i = 0; i < 3; i++) {
+        // Pad to the vector
+        string padding(header.vector_offset[i] - written, '\0');
+        out.write(padding.data(), padding.size());
+        written += padding.size();
+        
+        size_t bytes = (mapped_vectors[i]->bit_size() + 63) / 64 * sizeof(uint64_t);
+        out.write((const char*) mapped_vectors[i]->data(), bytes);
+        written += bytes;
+    }
+    
+    written += serialize_members(out, nullptr, "", false);
+    return written;
+}
+
 size_t XG::serialize(ostream& out, sdsl::structure_tree_node* s, std::string name) {
+    return serialize_members(out, s, name, true);
+}
+
+size_t XG::serialize_members(ostream& out, sdsl::structure_tree_node* s, std::string name,
+                             bool include_mapped_vectors) {
 
     sdsl::structure_tree_node* child = sdsl::structure_tree::add_child(s, name, sdsl::util::class_name(*this));
     size_t written = 0;
@@ -483,14 +657,19 @@ size_t XG::serialize(ostream& out, sdsl::structure_tree_node* s, std::string nam
     written += sdsl::write_member(min_id, out, child, "min_id");
     written += sdsl::write_member(max_id, out, child, "max_id");
 
-    written += r_iv.serialize(out, child, "rank_id_vector");
+    // These are stored separately in the mappable layout
+    int_vector<> empty;
+    written += include_mapped_vectors ? r_iv.serialize(out, child, "rank_id_vector") :
+        empty.serialize(out, child, "rank_id_vector");
 
-    written += g_iv.serialize(out, child, "graph_vector");
+    written += include_mapped_vectors ? g_iv.serialize(out, child, "graph_vector") :
+        empty.serialize(out, child, "graph_vector");
     written += g_bv.serialize(out, child, "graph_bit_vector");
     written += g_bv_rank.serialize(out, child, "graph_bit_vector_rank");
     written += g_bv_select.serialize(out, child, "graph_bit_vector_select");
     
-    written += s_iv.serialize(out, child, "seq_vector");
+    written += include_mapped_vectors ? s_iv.serialize(out, child, "seq_vector") :
+        empty.serialize(out, child, "seq_vector");
     written += s_bv.serialize(out, child, "seq_node_starts");
     written += s_bv_rank.serialize(out, child, "seq_node_starts_rank");
     written += s_bv_select.serialize(out, child, "seq_node_starts_select");
@@ -559,13 +738,13 @@ size_t XG::serialize(ostream& out, sdsl::structure_tree_node* s, std::string nam
 }
 
 void XG::from_stream(istream& in, bool validate_graph, bool print_graph,
-    bool store_threads, bool is_sorted_dag) {
+    bool store_threads, bool is_sorted_dag, size_t max_buffer_bytes) {
 
     from_callback([&](function<void(Graph&)> handle_chunk) {
         // TODO: should I be bandying about function references instead of
         // function objects here?
         stream::for_each(in, handle_chunk);
-    }, validate_graph, print_graph, store_threads, is_sorted_dag);
+    }, validate_graph, print_graph, store_threads, is_sorted_dag, max_buffer_bytes);
 }
 
 void XG::from_graph(Graph& graph, bool validate_graph, bool print_graph,
@@ -579,7 +758,14 @@ void XG::from_graph(Graph& graph, bool validate_graph, bool print_graph,
 }
 
 void XG::from_callback(function<void(function<void(Graph&)>)> get_chunks, 
-    bool validate_graph, bool print_graph, bool store_threads, bool is_sorted_dag) {
+    bool validate_graph, bool print_graph, bool store_threads, bool is_sorted_dag,
+    size_t max_buffer_bytes) {
+    
+    if (max_buffer_bytes) {
+        from_callback_bounded(get_chunks, max_buffer_bytes, validate_graph, print_graph, store_threads,
+                              is_sorted_dag);
+        return;
+    }
 
     // temporaries for construction
     vector<pair<id_t, string> > node_label;
@@ -684,6 +870,447 @@ void XG::from_callback(function<void(function<void(Graph&)>)> get_chunks,
     
 }
 
+/// A node, as spilled to disk during bounded memory construction
+struct NodeRecord {
+    id_t id;
+    string sequence;
+
+    bool operator<(const NodeRecord& other) const {
+        return id < other.id || (id == other.id && sequence < other.sequence);
+    }
+    bool operator==(const NodeRecord& other) const {
+        return id == other.id && sequence == other.sequence;
+    }
+    size_t bytes() const {
+        return sizeof(NodeRecord) + sequence.size();
+    }
+    void write(ostream& out) const {
+        uint64_t length = sequence.size();
+        out.write((const char*) &id, sizeof(id));
+        out.write((const char*) &length, sizeof(length));
+        out.write(sequence.data(), length);
+    }
+    bool read(istream& in) {
+        uint64_t length;
+        if (!in.read((char*) &id, sizeof(id)) || !in.read((char*) &length, sizeof(length))) {
+            return false;
+        }
+        sequence.resize(length);
+        return (bool) in.read(&sequence[0], length);
+    }
+};
+
+/// One side of an edge, filed under the node on the other side. Lists 0 and 1
+/// hold the sides reaching the start and end of the node, and lists 2 and 3
+/// the sides reached from its start and end, as in from_to and to_from.
+struct EdgeRecord {
+    id_t node;
+    int64_t list;
+    side_t other;
+    /// Order in which the edge was first seen, so we can keep the in-memory
+    /// build's edge order
+    uint64_t order;
+
+    bool operator<(const EdgeRecord& other_record) const {
+        return tie(node, list, other, order)
+            < tie(other_record.node, other_record.list, other_record.other, other_record.order);
+    }
+    size_t bytes() const {
+        return sizeof(EdgeRecord);
+    }
+    void write(ostream& out) const {
+        out.write((const char*) this, sizeof(EdgeRecord));
+    }
+    bool read(istream& in) {
+        return (bool) in.read((char*) this, sizeof(EdgeRecord));
+    }
+};
+
+/// A step of a path, by the number of the path in order of first appearance
+struct PathStepRecord {
+    uint64_t path;
+    int64_t rank;
+    int64_t trav;
+
+    bool operator<(const PathStepRecord& other) const {
+        return tie(path, rank, trav) < tie(other.path, other.rank, other.trav);
+    }
+    size_t bytes() const {
+        return sizeof(PathStepRecord);
+    }
+    void write(ostream& out) const {
+        out.write((const char*) this, sizeof(PathStepRecord));
+    }
+    bool read(istream& in) {
+        return (bool) in.read((char*) this, sizeof(PathStepRecord));
+    }
+};
+
+/**
+ * Collects records into runs of bounded size, and sorts and spills each full
+ * run to a temp file in an OpenMP task, in the same way as the GAMSorter. Must
+ * be filled from inside an omp single region. Once everything has been added
+ * and finish() has been called, all the spilling tasks must be waited for
+ * before merging.
+ */
+template<typename Record>
+class SortedRuns {
+public:
+    /// Make a collection of runs, each up to run_bytes in size. Spills wait
+    /// for the outstanding tasks when runs_in_flight, which is shared between
+    /// collections, reaches max_in_flight.
+    SortedRuns(const string& base, size_t run_bytes, size_t& runs_in_flight, size_t max_in_flight) :
+        base(base), run_bytes(run_bytes), runs_in_flight(runs_in_flight), max_in_flight(max_in_flight),
+        run(new vector<Record>()) {
+        // nothing to do
+    }
+
+    ~SortedRuns() {
+        delete run;
+        for (auto& filename : run_filenames) {
+            temp_file::remove(filename);
+        }
+    }
+
+    /// Add a record to the run being filled
+    void add(Record&& record) {
+        run_size += record.bytes();
+        run->emplace_back(std::move(record));
+        if (run_size >= run_bytes) {
+            spill();
+            run = new vector<Record>();
+            run_size = 0;
+        }
+    }
+
+    /// Spill the last partial run, unless everything fit in memory
+    void finish() {
+        if (!run_filenames.empty()) {
+            if (!run->empty()) {
+                spill();
+            } else {
+                delete run;
+            }
+            run = nullptr;
+        }
+    }
+
+    /// Call the iteratee on all the records in sorted order
+    void merge(const function<void(Record&)>& iteratee) {
+        if (run != nullptr) {
+            // Everything fit in memory
+            std::sort(run->begin(), run->end());
+            for (auto& record : *run) {
+                iteratee(record);
+            }
+            return;
+        }
+
+        vector<unique_ptr<ifstream>> run_streams;
+        for (auto& filename : run_filenames) {
+            run_streams.emplace_back(new ifstream(filename, ios::binary));
+            if (!*run_streams.back()) {
+                cerr << "[xg] error: could not read temp file " << filename << endl;
+                exit(1);
+            }
+        }
+        vector<Record> current(run_streams.size());
+
+        // Min-heap of runs by their current record, so ties go to the earlier run
+        auto heap_order = [&](size_t a, size_t b) {
+            return current[b] < current[a] || (!(current[a] < current[b]) && b < a);
+        };
+        priority_queue<size_t, vector<size_t>, decltype(heap_order)> heap(heap_order);
+        for (size_t i = 0; i < run_streams.size(); i++) {
+            if (current[i].read(*run_streams[i])) {
+                heap.push(i);
+            }
+        }
+        while (!heap.empty()) {
+            size_t i = heap.top();
+            heap.pop();
+            iteratee(current[i]);
+            if (current[i].read(*run_streams[i])) {
+                heap.push(i);
+            }
+        }
+    }
+
+private:
+
+    void spill() {
+        if (runs_in_flight >= max_in_flight) {
+            // Wait for the runs we have so we don't go over the memory limit.
+#pragma omp taskwait
+            runs_in_flight = 0;
+        }
+
+        // temp_file isn't thread safe, so make the file here.
+        string filename = temp_file::create(base);
+        run_filenames.push_back(filename);
+        runs_in_flight++;
+
+        vector<Record>* full_run = run;
+#pragma omp task firstprivate(full_run, filename)
+        {
+            std::sort(full_run->begin(), full_run->end());
+            ofstream run_out(filename, ios::binary);
+            for (auto& record : *full_run) {
+                record.write(run_out);
+            }
+            if (!run_out) {
+                cerr << "[xg] error: could not write temp file " << filename << endl;
+                exit(1);
+            }
+            delete full_run;
+        }
+    }
+
+    string base;
+    size_t run_bytes;
+    size_t& runs_in_flight;
+    size_t max_in_flight;
+    vector<Record>* run;
+    size_t run_size = 0;
+    vector<string> run_filenames;
+};
+
+/// Open a temp file for reading or writing, or die
+template<typename Stream>
+static void open_temp_file(Stream& stream, const string& filename) {
+    stream.open(filename, ios::binary);
+    if (!stream) {
+        cerr << "[xg] error: could not open temp file " << filename << endl;
+        exit(1);
+    }
+}
+
+void XG::from_callback_bounded(function<void(function<void(Graph&)>)> get_chunks, size_t max_buffer_bytes,
+    bool validate_graph, bool print_graph, bool store_threads, bool is_sorted_dag) {
+
+    // Each thread can be sorting a run while we fill one run of each kind, and
+    // all the runs together must fit in the buffer limit.
+    size_t threads = omp_get_max_threads();
+    size_t run_bytes = max<size_t>(max_buffer_bytes / (threads + 3), 1);
+    size_t runs_in_flight = 0;
+
+    SortedRuns<NodeRecord> node_runs("vg-xg-nodes-", run_bytes, runs_in_flight, threads);
+    SortedRuns<EdgeRecord> edge_runs("vg-xg-edges-", run_bytes, runs_in_flight, threads);
+    SortedRuns<PathStepRecord> path_runs("vg-xg-paths-", run_bytes, runs_in_flight, threads);
+
+    // Path names, numbered in order of first appearance
+    vector<string> path_names;
+    unordered_map<string, size_t> path_number;
+    uint64_t edges_seen = 0;
+
+    // Where the deduplicated, sorted records go
+    string node_filename;
+    string edge_filename;
+    string path_filename;
+    // Where the steps of each path start in the path file, and how many there are
+    vector<pair<size_t, size_t>> path_extents;
+
+#pragma omp parallel
+#pragma omp single
+    {
+        get_chunks([&](Graph& graph) {
+            for (int64_t i = 0; i < graph.node_size(); ++i) {
+                const Node& n = graph.node(i);
+                node_runs.add(NodeRecord{n.id(), n.sequence()});
+            }
+            for (int64_t i = 0; i < graph.edge_size(); ++i) {
+                // Canonicalize every edge, so only canonical edges are in the index.
+                Edge e = canonicalize(graph.edge(i));
+                edge_runs.add(EdgeRecord{e.from(), 2 + e.from_start(), make_side(e.to(), e.to_end()), edges_seen});
+                edge_runs.add(EdgeRecord{e.to(), e.to_end(), make_side(e.from(), e.from_start()), edges_seen});
+                ++edges_seen;
+            }
+            for (int64_t i = 0; i < graph.path_size(); ++i) {
+                const Path& p = graph.path(i);
+                auto found = path_number.find(p.name());
+                if (found == path_number.end()) {
+                    found = path_number.emplace(p.name(), path_names.size()).first;
+                    path_names.push_back(p.name());
+                }
+                for (int64_t j = 0; j < p.mapping_size(); ++j) {
+                    const Mapping& m = p.mapping(j);
+                    trav_t trav = make_trav(m.position().node_id(), m.position().is_reverse(), m.rank());
+                    path_runs.add(PathStepRecord{found->second, trav.second, trav.first});
+                }
+            }
+        });
+
+        node_runs.finish();
+        edge_runs.finish();
+        path_runs.finish();
+        // Everything has to be written before we merge
+#pragma omp taskwait
+
+        node_filename = temp_file::create("vg-xg-nodes-");
+        edge_filename = temp_file::create("vg-xg-edges-");
+        path_filename = temp_file::create("vg-xg-paths-");
+
+        // Merge the nodes, removing duplicates
+#pragma omp task
+        {
+            ofstream out;
+            open_temp_file(out, node_filename);
+            NodeRecord last;
+            bool have_last = false;
+            node_runs.merge([&](NodeRecord& node) {
+                if (have_last && node == last) {
+                    return;
+                }
+                node.write(out);
+                if (!have_last) {
+                    min_id = node.id;
+                }
+                max_id = node.id;
+                ++node_count;
+                seq_length += node.sequence.size();
+                swap(last, node);
+                have_last = true;
+            });
+        }
+
+        // Merge the edges, keeping the first time each was seen, and put each
+        // node's edge lists back in the order the edges were seen
+#pragma omp task
+        {
+            ofstream out;
+            open_temp_file(out, edge_filename);
+            vector<EdgeRecord> group;
+            auto write_group = [&]() {
+                std::sort(group.begin(), group.end(), [](const EdgeRecord& a, const EdgeRecord& b) {
+                    return a.order < b.order;
+                });
+                for (auto& edge : group) {
+                    edge.write(out);
+                }
+                group.clear();
+            };
+            edge_runs.merge([&](EdgeRecord& edge) {
+                if (!group.empty()) {
+                    auto& last = group.back();
+                    if (last.node == edge.node && last.list == edge.list) {
+                        if (last.other == edge.other) {
+                            // a duplicate edge
+                            return;
+                        }
+                    } else {
+                        write_group();
+                    }
+                }
+                if (edge.list >= 2) {
+                    // count each edge at its from side
+                    ++edge_count;
+                }
+                group.push_back(edge);
+            });
+            write_group();
+        }
+
+        // Merge the paths, checking for duplicate ranks
+#pragma omp task
+        {
+            ofstream out;
+            open_temp_file(out, path_filename);
+            path_extents.resize(path_names.size());
+            size_t written = 0;
+            PathStepRecord last;
+            bool have_last = false;
+            path_runs.merge([&](PathStepRecord& step) {
+                if (have_last && step.path == last.path && step.rank == last.rank) {
+                    cerr << "[xg] error: path " << path_names[step.path] << " contains duplicate node ranks" << endl;
+                    exit(1);
+                }
+                if (!have_last || step.path != last.path) {
+                    path_extents[step.path].first = written;
+                }
+                path_extents[step.path].second++;
+                step.write(out);
+                ++written;
+                last = step;
+                have_last = true;
+            });
+        }
+#pragma omp taskwait
+    }
+
+    if (node_count == 0) {
+        // Catch the empty graph with a sensible message instead of an assert fail
+        cerr << "[xg] error: cannot build an xg index from an empty graph" << endl;
+        exit(1);
+    }
+
+    path_count = path_names.size();
+
+    BuildSource source;
+    source.for_each_node = [&](const function<void(id_t, const string&)>& iteratee) {
+        ifstream in;
+        open_temp_file(in, node_filename);
+        NodeRecord node;
+        while (node.read(in)) {
+            iteratee(node.id, node.sequence);
+        }
+    };
+    source.for_each_node_edges = [&](const function<void(id_t, const vector<side_t>&, const vector<side_t>&,
+                                                          const vector<side_t>&, const vector<side_t>&)>& iteratee) {
+        ifstream node_in;
+        open_temp_file(node_in, node_filename);
+        ifstream edge_in;
+        open_temp_file(edge_in, edge_filename);
+        vector<vector<side_t>> lists(4);
+        EdgeRecord edge;
+        bool have_edge = edge.read(edge_in);
+        NodeRecord node;
+        while (node.read(node_in)) {
+            for (auto& list : lists) {
+                list.clear();
+            }
+            // skip edges on nodes that aren't in the graph
+            while (have_edge && edge.node <= node.id) {
+                if (edge.node == node.id) {
+                    lists[edge.list].push_back(edge.other);
+                }
+                have_edge = edge.read(edge_in);
+            }
+            iteratee(node.id, lists[0], lists[1], lists[2], lists[3]);
+        }
+    };
+    source.for_each_path = [&](const function<void(const string&, vector<trav_t>&)>& iteratee) {
+        // paths go in name order, as in the in-memory build
+        vector<size_t> by_name(path_names.size());
+        for (size_t i = 0; i < by_name.size(); i++) {
+            by_name[i] = i;
+        }
+        std::sort(by_name.begin(), by_name.end(), [&](size_t a, size_t b) {
+            return path_names[a] < path_names[b];
+        });
+        ifstream in;
+        open_temp_file(in, path_filename);
+        for (size_t number : by_name) {
+            vector<trav_t> path;
+            path.reserve(path_extents[number].second);
+            in.seekg(path_extents[number].first * sizeof(PathStepRecord));
+            PathStepRecord step;
+            for (size_t i = 0; i < path_extents[number].second && step.read(in); i++) {
+                path.push_back(make_pair(step.trav, (int32_t) step.rank));
+            }
+            iteratee(path_names[number], path);
+        }
+    };
+    source.release_nodes = []() {
+        // nodes are streamed from disk, so there's nothing to release
+    };
+
+    build_from_source(source, validate_graph, print_graph, store_threads, is_sorted_dag);
+
+    temp_file::remove(node_filename);
+    temp_file::remove(edge_filename);
+    temp_file::remove(path_filename);
+}
+
 void XG::build(vector<pair<id_t, string> >& node_label,
                unordered_map<side_t, vector<side_t> >& from_to,
                unordered_map<side_t, vector<side_t> >& to_from,
@@ -693,6 +1320,47 @@ void XG::build(vector<pair<id_t, string> >& node_label,
                bool store_threads,
                bool is_sorted_dag) {
 
+    // for mapping of ids to ranks using a vector rather than wavelet tree
+    assert(!node_label.empty());
+    min_id = node_label.begin()->first;
+    max_id = node_label.rbegin()->first;
+    
+    BuildSource source;
+    source.for_each_node = [&](const function<void(id_t, const string&)>& iteratee) {
+        for (auto& p : node_label) {
+            iteratee(p.first, p.second);
+        }
+    };
+    source.for_each_node_edges = [&](const function<void(id_t, const vector<side_t>&, const vector<side_t>&,
+                                                          const vector<side_t>&, const vector<side_t>&)>& iteratee) {
+        vector<side_t> no_sides;
+        auto sides_of = [&](unordered_map<side_t, vector<side_t> >& edges, id_t id, bool end) -> const vector<side_t>& {
+            auto found = edges.find(make_side(id, end));
+            return found == edges.end() ? no_sides : found->second;
+        };
+        for (auto& p : node_label) {
+            iteratee(p.first, sides_of(to_from, p.first, false), sides_of(to_from, p.first, true),
+                     sides_of(from_to, p.first, false), sides_of(from_to, p.first, true));
+        }
+    };
+    source.for_each_path = [&](const function<void(const string&, vector<trav_t>&)>& iteratee) {
+        for (auto& pathpair : path_nodes) {
+            iteratee(pathpair.first, pathpair.second);
+        }
+    };
+    source.release_nodes = [&]() {
+        node_label.clear();
+    };
+    
+    build_from_source(source, validate_graph, print_graph, store_threads, is_sorted_dag);
+}
+
+void XG::build_from_source(const BuildSource& source,
+                           bool validate_graph,
+                           bool print_graph,
+                           bool store_threads,
+                           bool is_sorted_dag) {
+
     size_t entity_count = node_count + edge_count;
 
 #ifdef VERBOSE_DEBUG
@@ -703,17 +1371,16 @@ void XG::build(vector<pair<id_t, string> >& node_label,
          << "for a total of " << entity_count << " entities" << endl;
 #endif
 
-    // for mapping of ids to ranks using a vector rather than wavelet tree
-    assert(!node_label.empty());
-    min_id = node_label.begin()->first;
-    max_id = node_label.rbegin()->first;
-    
-    // set up our compressed representation
+    // set up our compressed representation, in the storage of the vectors
+    // that can also be memory-mapped
     int_vector<> i_iv;
-    util::assign(s_iv, int_vector<>(seq_length, 0, 3));
+    int_vector<>& s_iv_out = s_iv.storage();
+    int_vector<>& r_iv_out = r_iv.storage();
+    int_vector<>& g_iv_out = g_iv.storage();
+    util::assign(s_iv_out, int_vector<>(seq_length, 0, 3));
     util::assign(s_bv, bit_vector(seq_length));
     util::assign(i_iv, int_vector<>(node_count));
-    util::assign(r_iv, int_vector<>(max_id-min_id+1)); // note possibly discontiguous
+    util::assign(r_iv_out, int_vector<>(max_id-min_id+1)); // note possibly discontiguous
     
     // for each node in the sequence
     // concatenate the labels into the s_iv
@@ -723,30 +1390,24 @@ void XG::build(vector<pair<id_t, string> >& node_label,
     size_t i = 0; // insertion point
     size_t r = 1;
     
-    // first make i_iv and r_iv
-    for (auto& p : node_label) {
-        int64_t id = p.first;
+    // make i_iv and r_iv, and s_bv and s_iv, in one pass over the nodes
+    source.for_each_node([&](id_t id, const string& l) {
         i_iv[r-1] = id;
         // store ids to rank mapping
-        r_iv[id-min_id] = r;
+        r_iv_out[id-min_id] = r;
         ++r;
-    }
-    util::bit_compress(i_iv);
-    util::bit_compress(r_iv);
-    
-    // then make s_bv and s_iv
-    for (auto& p : node_label) {
-        const string& l = p.second;
         s_bv[i] = 1; // record node start
         for (auto c : l) {
-            s_iv[i++] = dna3bit(c); // store sequence
+            s_iv_out[i++] = dna3bit(c); // store sequence
         }
-    }
+    });
+    util::bit_compress(i_iv);
+    util::bit_compress(r_iv_out);
     // keep only if we need to validate the graph
-    if (!validate_graph) node_label.clear();
+    if (!validate_graph) source.release_nodes();
 
     // to label the paths we'll need to compress and index our vectors
-    util::bit_compress(s_iv);
+    util::bit_compress(s_iv_out);
     util::assign(s_bv_rank, rank_support_v<1>(&s_bv));
     util::assign(s_bv_select, bit_vector::select_1_type(&s_bv));
     
@@ -755,17 +1416,17 @@ void XG::build(vector<pair<id_t, string> >& node_label,
     size_t g_iv_size =
         node_count * G_NODE_HEADER_LENGTH // record headers
         + edge_count * 2 * G_EDGE_LENGTH; // edges (stored twice)
-    util::assign(g_iv, int_vector<>(g_iv_size));
+    util::assign(g_iv_out, int_vector<>(g_iv_size));
     util::assign(g_bv, bit_vector(g_iv_size));
     int64_t g = 0; // pointer into g_iv and g_bv
-    for (int64_t i = 0; i < node_count; ++i) {
-        Node n = node(i_iv[i]);
+    source.for_each_node_edges([&](id_t id, const vector<side_t>& to_start, const vector<side_t>& to_end,
+                                   const vector<side_t>& from_start, const vector<side_t>& from_end) {
         
         // now build up the record
         g_bv[g] = 1; // mark record start for later query
-        g_iv[g++] = n.id(); // save id
-        g_iv[g++] = node_start(n.id());
-        g_iv[g++] = n.sequence().size(); // sequence length
+        g_iv_out[g++] = id; // save id
+        g_iv_out[g++] = node_start(id);
+        g_iv_out[g++] = node_length(id); // sequence length
         size_t to_edge_count = 0;
         size_t from_edge_count = 0;
         size_t to_edge_count_idx = g++;
@@ -773,24 +1434,24 @@ void XG::build(vector<pair<id_t, string> >& node_label,
         // write the edges in id-based format
         // we will next convert these into relative format
         for (auto end : { false, true }) {
-            auto& to_sides = to_from[make_side(n.id(), end)];
+            auto& to_sides = end ? to_end : to_start;
             for (auto& e : to_sides) {
-                g_iv[g++] = side_id(e);
-                g_iv[g++] = edge_type(side_is_end(e), end);
+                g_iv_out[g++] = side_id(e);
+                g_iv_out[g++] = edge_type(side_is_end(e), end);
                 ++to_edge_count;
             }
         }
-        g_iv[to_edge_count_idx] = to_edge_count;
+        g_iv_out[to_edge_count_idx] = to_edge_count;
         for (auto end : { false, true }) {
-            auto& from_sides = from_to[make_side(n.id(), end)];
+            auto& from_sides = end ? from_end : from_start;
             for (auto& e : from_sides) {
-                g_iv[g++] = side_id(e);
-                g_iv[g++] = edge_type(end, side_is_end(e));
+                g_iv_out[g++] = side_id(e);
+                g_iv_out[g++] = edge_type(end, side_is_end(e));
                 ++from_edge_count;
             }
         }
-        g_iv[from_edge_count_idx] = from_edge_count;
-    }
+        g_iv_out[from_edge_count_idx] = from_edge_count;
+    });
     
     // set up rank and select supports on g_bv so we can locate nodes in g_iv
     util::assign(g_bv_rank, rank_support_v<1>(&g_bv));
@@ -807,16 +1468,16 @@ void XG::build(vector<pair<id_t, string> >& node_label,
         int64_t t = g + G_NODE_HEADER_LENGTH;
         int64_t f = g + G_NODE_HEADER_LENGTH + G_EDGE_LENGTH * edges_to_count;
         for (int64_t j = t; j < f; ) {
-            g_iv[j] = g_bv_select(id_to_rank(g_iv[j])) - g;
+            g_iv_out[j] = g_bv_select(id_to_rank(g_iv_out[j])) - g;
             j += 2;
         }
         for (int64_t j = f; j < f + G_EDGE_LENGTH * edges_from_count; ) {
-            g_iv[j] = g_bv_select(id_to_rank(g_iv[j])) - g;
+            g_iv_out[j] = g_bv_select(id_to_rank(g_iv_out[j])) - g;
             j += 2;
         }
     }
     sdsl::util::clear(i_iv);
-    util::bit_compress(g_iv);
+    util::bit_compress(g_iv_out);
 
 #if GPBWT_MODE == MODE_SDSL
     // We have one B_s array for every side, but the first 2 numbers for sides
@@ -830,17 +1491,16 @@ void XG::build(vector<pair<id_t, string> >& node_label,
     // paths
     string path_names;
     size_t path_node_count = 0; // count of node path memberships
-    for (auto& pathpair : path_nodes) {
+    source.for_each_path([&](const string& path_name, vector<trav_t>& path_steps) {
         // add path name
-        const string& path_name = pathpair.first;
         //cerr << path_name << endl;
         path_names += start_marker + path_name + end_marker;
         // The path constructor helpfully counts unique path members for us
         size_t unique_member_count;
-        XGPath* path = new XGPath(path_name, pathpair.second, node_count, *this, &unique_member_count);
+        XGPath* path = new XGPath(path_name, path_steps, node_count, *this, &unique_member_count);
         paths.push_back(path);
         path_node_count += unique_member_count;
-    }
+    });
 
     // handle path names
     util::assign(pn_iv, int_vector<>(path_names.size()));
@@ -910,11 +1570,11 @@ void XG::build(vector<pair<id_t, string> >& node_label,
     
         // Just store all the paths that are all perfect mappings as threads.
         // We end up converting *back* into thread_t objects.
-        for (auto& pathpair : path_nodes) {
+        source.for_each_path([&](const string& path_name, vector<trav_t>& path_steps) {
             thread_t reconstructed;
             
             // Grab the trav_ts, which are now sorted by rank
-            for (auto& m : pathpair.second) {
+            for (auto& m : path_steps) {
                 // Convert the mapping to a ThreadMapping
                 // trav_ts are already rank sorted and deduplicated.
                 ThreadMapping mapping = {trav_id(m), trav_is_rev(m)};
@@ -925,15 +1585,15 @@ void XG::build(vector<pair<id_t, string> >& node_label,
             if(is_sorted_dag) {
                 // Save for a batch insert
                 batch.push_back(reconstructed);
-                batch_names.push_back(pathpair.first);
+                batch_names.push_back(path_name);
             }
             // TODO: else case!
 #elif GPBWT_MODE == MODE_DYNAMIC
             // Insert the thread right now
-            insert_thread(reconstructed, pathpair.first);
+            insert_thread(reconstructed, path_name);
 #endif
             
-        }
+        });
         
 #if GPBWT_MODE == MODE_SDSL
         if(is_sorted_dag) {
@@ -1024,7 +1684,9 @@ void XG::build(vector<pair<id_t, string> >& node_label,
             }
             cerr << endl;
         }
-        cerr << s_iv << endl;
+        for (size_t i = 0; i < s_iv.size(); ++i) {
+            cerr << s_iv[i] << " ";
+        } cerr << endl;
         for (size_t i = 0; i < s_iv.size(); ++i) {
             cerr << revdna3bit(s_iv[i]);
         } cerr << endl;
@@ -1062,9 +1724,7 @@ void XG::build(vector<pair<id_t, string> >& node_label,
     if (validate_graph) {
         cerr << "validating graph sequence" << endl;
         int max_id = s_bv_rank(s_bv.size());
-        for (auto& p : node_label) {
-            int64_t id = p.first;
-            const string& l = p.second;
+        source.for_each_node([&](id_t id, const string& l) {
             //size_t rank = node_rank[id];
             size_t rank = id_to_rank(id);
             //cerr << rank << endl;
@@ -1091,8 +1751,8 @@ void XG::build(vector<pair<id_t, string> >& node_label,
                     }
                 }
             }
-        }
-        node_label.clear();
+        });
+        source.release_nodes();
         
 #if GPBWT_MODE == MODE_SDSL
         if(store_threads && is_sorted_dag) {
@@ -1137,18 +1797,18 @@ void XG::build(vector<pair<id_t, string> >& node_label,
                 threads_found++;
             }
             
-            for (auto& pathpair : path_nodes) {
+            source.for_each_path([&](const string& path_name, vector<trav_t>& path_steps) {
                 Path reconstructed;
                 
                 // Grab the name
-                reconstructed.set_name(pathpair.first);
+                reconstructed.set_name(path_name);
                 
                 // This path should have been inserted. Look for it.
                 assert(count_matches(reconstructed) > 0);
                 
                 threads_expected += 2;
                 
-            }
+            });
             
             // Make sure we have the right number of threads.
             assert(threads_found == threads_expected);
@@ -1634,97 +2294,8 @@ string XG::get_sequence(const handle_t& handle) const {
     }
 }
 
-bool XG::edge_filter(int type, bool is_to, bool want_left, bool is_reverse) const {
-    // Return true if we want an edge of the given type, where we are the from
-    // or to node (according to is_to), when we are looking off the right or
-    // left side of the node (according to want_left), and when the node is
-    // forward or reverse (accoridng to is_reverse).
-    
-    // Edge type encoding:
-    // 1: end to start
-    // 2: end to end
-    // 3: start to start
-    // 4: start to end
-    
-    // First compute what we want looking off the right of a node in the forward direction.
-    bool wanted = !is_to && (type == 1 || type == 2) || is_to && (type == 2 || type == 4);
-    
-    // We computed whether we wanted it assuming we were looking off the right. The complement is what we want looking off the left.
-    wanted = wanted != want_left;
-    
-    // We computed whether we wanted ot assuming we were in the forward orientation. The complement is what we want in the reverse orientation.
-    wanted = wanted != is_reverse;
-    
-    return wanted;
-}
-
-bool XG::do_edges(const size_t& g, const size_t& start, const size_t& count, bool is_to,
-    bool want_left, bool is_reverse, const function<bool(const handle_t&)>& iteratee) const {
-    
-    // OK go over all those edges
-    for (size_t i = 0; i < count; i++) {
-        // What edge type is the edge?
-        int type = g_iv[start + i * G_EDGE_LENGTH + G_EDGE_TYPE_OFFSET];
-        
-        // Make sure we got a valid edge type and we haven't wandered off into non-edge data.
-        assert(type >= 0);
-        assert(type <= 3);
-        
-        if (edge_filter(type, is_to, want_left, is_reverse)) {
-            
-            // What's the offset to the other node?
-            int64_t offset = g_iv[start + i * G_EDGE_LENGTH + G_EDGE_OFFSET_OFFSET];
-            
-            // Make sure we haven't gone off the rails into non-edge data.
-            assert((int64_t) g + offset >= 0);
-            assert(g + offset < g_iv.size());
-            
-            // Should we invert?
-            // We only invert if we cross an end to end edge. Or a start to start edge
-            bool new_reverse = is_reverse != (type == 2 || type == 3);
-            
-            // Compose the handle for where we are going
-            handle_t next_handle = as_handle((g + offset) | (new_reverse ? HIGH_BIT : 0));
-            
-            // We want this edge
-            
-            if (!iteratee(next_handle)) {
-                // Stop iterating
-                return false;
-            }
-        }
-        else {
-            // TODO: delete this after using it to debug
-            int64_t offset = g_iv[start + i * G_EDGE_LENGTH + G_EDGE_OFFSET_OFFSET];
-            bool new_reverse = is_reverse != (type == 2 || type == 3);
-            handle_t next_handle = as_handle((g + offset) | (new_reverse ? HIGH_BIT : 0));
-        }
-    }
-    // Iteratee didn't stop us.
-    return true;
-}
-
 bool XG::follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const {
-
-    // Unpack the handle
-    size_t g = as_integer(handle) & LOW_BITS;
-    bool is_reverse = get_is_reverse(handle);
-
-    // How many edges are there of each type?
-    size_t edges_to_count = g_iv[g + G_NODE_TO_COUNT_OFFSET];
-    size_t edges_from_count = g_iv[g + G_NODE_FROM_COUNT_OFFSET];
-    
-    // Where does each edge run start?
-    size_t to_start = g + G_NODE_HEADER_LENGTH;
-    size_t from_start = g + G_NODE_HEADER_LENGTH + G_EDGE_LENGTH * edges_to_count;
-    
-    // We will look for all the edges on the appropriate side, which means we have to check the from and to edges
-    if (do_edges(g, to_start, edges_to_count, true, go_left, is_reverse, iteratee)) {
-        // All the edges where we're to were accepted, so do the edges where we're from
-        return do_edges(g, from_start, edges_from_count, false, go_left, is_reverse, iteratee);
-    } else {
-        return false;
-    }
+    return follow_edges_inline(handle, go_left, iteratee);
 }
 
 void XG::for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel) const {
@@ -1769,43 +2340,26 @@ size_t XG::node_size() const {
 
 vector<Edge> XG::edges_of(int64_t id) const {
     size_t g = g_bv_select(id_to_rank(id));
-    int edges_to_count = g_iv[g+G_NODE_TO_COUNT_OFFSET];
-    int edges_from_count = g_iv[g+G_NODE_FROM_COUNT_OFFSET];
-    int64_t t = g + G_NODE_HEADER_LENGTH;
-    int64_t f = g + G_NODE_HEADER_LENGTH + G_EDGE_LENGTH * edges_to_count;
     vector<Edge> edges;
-    for (int64_t j = t; j < f; ) {
-        int64_t from = g+g_iv[j++];
-        int type = g_iv[j++];
-        edges.push_back(edge_from_encoding(from, g, type));
-    }
-    for (int64_t j = f; j < f + G_EDGE_LENGTH * edges_from_count; ) {
-        int64_t to = g+g_iv[j++];
-        int type = g_iv[j++];
-        edges.push_back(edge_from_encoding(g, to, type));
-    }
-    for (auto& edge : edges) { 
-        edge.set_from(g_iv[edge.from()+G_NODE_ID_OFFSET]);
-        edge.set_to(g_iv[edge.to()+G_NODE_ID_OFFSET]);
-    }
+    edges.reserve(g_iv[g+G_NODE_TO_COUNT_OFFSET] + g_iv[g+G_NODE_FROM_COUNT_OFFSET]);
+    for_each_edge_of(id, [&](int64_t from, bool from_start, int64_t to, bool to_end) {
+        edges.push_back(make_edge(from, from_start, to, to_end));
+        return true;
+    });
     return edges;
 }
 
 vector<Edge> XG::edges_to(int64_t id) const {
     size_t g = g_bv_select(id_to_rank(id));
     int edges_to_count = g_iv[g+G_NODE_TO_COUNT_OFFSET];
-    int edges_from_count = g_iv[g+G_NODE_FROM_COUNT_OFFSET];
     int64_t t = g + G_NODE_HEADER_LENGTH;
     int64_t f = g + G_NODE_HEADER_LENGTH + G_EDGE_LENGTH * edges_to_count;
     vector<Edge> edges;
+    edges.reserve(edges_to_count);
     for (int64_t j = t; j < f; ) {
         int64_t from = g+g_iv[j++];
         int type = g_iv[j++];
-        edges.push_back(edge_from_encoding(from, g, type));
-    }
-    for (auto& edge : edges) { 
-        edge.set_from(g_iv[edge.from()+G_NODE_ID_OFFSET]);
-        edge.set_to(g_iv[edge.to()+G_NODE_ID_OFFSET]);
+        edges.push_back(edge_from_encoding(g_iv[from+G_NODE_ID_OFFSET], id, type));
     }
     return edges;
 }
@@ -1814,39 +2368,33 @@ vector<Edge> XG::edges_from(int64_t id) const {
     size_t g = g_bv_select(id_to_rank(id));
     int edges_to_count = g_iv[g+G_NODE_TO_COUNT_OFFSET];
     int edges_from_count = g_iv[g+G_NODE_FROM_COUNT_OFFSET];
-    //int64_t t = g + G_NODE_HEADER_LENGTH;
     int64_t f = g + G_NODE_HEADER_LENGTH + G_EDGE_LENGTH * edges_to_count;
     int64_t e = f + G_EDGE_LENGTH * edges_from_count;
     vector<Edge> edges;
+    edges.reserve(edges_from_count);
     for (int64_t j = f; j < e; ) {
         int64_t to = g+g_iv[j++];
         int type = g_iv[j++];
-        edges.push_back(edge_from_encoding(g, to, type));
-    }
-    for (auto& edge : edges) { 
-        edge.set_from(g_iv[edge.from()+G_NODE_ID_OFFSET]);
-        edge.set_to(g_iv[edge.to()+G_NODE_ID_OFFSET]);
+        edges.push_back(edge_from_encoding(id, g_iv[to+G_NODE_ID_OFFSET], type));
     }
     return edges;
 }
 
 vector<Edge> XG::edges_on_start(int64_t id) const {
     vector<Edge> edges;
-    for (auto& edge : edges_of(id)) {
-        if((edge.to() == id && !edge.to_end()) || (edge.from() == id && edge.from_start())) {
-            edges.push_back(edge);
-        }
-    }
+    for_each_edge_on_start(id, [&](int64_t from, bool from_start, int64_t to, bool to_end) {
+        edges.push_back(make_edge(from, from_start, to, to_end));
+        return true;
+    });
     return edges;
 }
 
 vector<Edge> XG::edges_on_end(int64_t id) const {
     vector<Edge> edges;
-    for (auto& edge : edges_of(id)) {
-        if((edge.to() == id && edge.to_end()) || (edge.from() == id && !edge.from_start())) {
-            edges.push_back(edge);
-        }
-    }
+    for_each_edge_on_end(id, [&](int64_t from, bool from_start, int64_t to, bool to_end) {
+        edges.push_back(make_edge(from, from_start, to, to_end));
+        return true;
+    });
     return edges;
 }
 
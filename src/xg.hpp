@@ -8,6 +8,7 @@
 #include <omp.h>
 #include <unordered_map>
 #include <unordered_set>
+#include <cassert>
 #include "cpp/vg.pb.h"
 #include "sdsl/bit_vectors.hpp"
 #include "sdsl/enc_vector.hpp"
@@ -60,6 +61,70 @@ class XGFormatError : public runtime_error {
     using runtime_error::runtime_error;
 };
 
+/**
+ * A read-only int_vector<> that can either own its data, or be a view of
+ * integers stored in memory it doesn't own, such as a memory-mapped file.
+ * Reads work the same way in both cases. Use storage() to fill in or resize
+ * the owned data.
+ */
+class MappableIntVector {
+public:
+    
+    typedef int_vector<>::size_type size_type;
+    
+    /// Get the integer at the given index.
+    inline uint64_t operator[](size_t i) const {
+        uint8_t int_width = width();
+        size_t bit = i * int_width;
+        return sdsl::bits::read_int(data() + (bit >> 6), bit & 0x3F, int_width);
+    }
+    
+    /// Get the number of integers stored.
+    inline size_t size() const {
+        return mapped_words == nullptr ? owned.size() : mapped_size;
+    }
+    
+    /// Get the width in bits of each integer.
+    inline uint8_t width() const {
+        return mapped_words == nullptr ? owned.width() : mapped_width;
+    }
+    
+    /// Get the packed words holding the integers.
+    inline const uint64_t* data() const {
+        return mapped_words == nullptr ? owned.data() : mapped_words;
+    }
+    
+    /// Get the number of bits used by the integers.
+    inline size_t bit_size() const {
+        return size() * width();
+    }
+    
+    /// Get the int_vector<> that holds our data when we aren't mapped, so it
+    /// can be modified. Drops any mapping.
+    int_vector<>& storage();
+    
+    /// Become a view of size integers of the given width, packed into the
+    /// given words the same way as in an int_vector<>. The words must outlive
+    /// this object, or the next call to storage() or load().
+    void map(const uint64_t* words, size_t size, uint8_t width);
+    
+    /// Return true if we are a view of memory we don't own.
+    bool is_mapped() const;
+    
+    /// Load owned data in int_vector<> format. Drops any mapping.
+    void load(istream& in);
+    
+    /// Save in int_vector<> format, whether mapped or not.
+    size_t serialize(std::ostream& out, sdsl::structure_tree_node* v = NULL,
+                     std::string name = "") const;
+    
+private:
+    int_vector<> owned;
+    const uint64_t* mapped_words = nullptr;
+    size_t mapped_size = 0;
+    uint8_t mapped_width = 0;
+};
+
 /**
  * Provides succinct storage for a graph, its positional paths, and a set of
  * embedded threads.
@@ -89,7 +154,7 @@ public:
     
     void from_stream(istream& in, bool validate_graph = false,
         bool print_graph = false, bool store_threads = false,
-        bool is_sorted_dag = false);
+        bool is_sorted_dag = false, size_t max_buffer_bytes = 0);
     void from_graph(Graph& graph, bool validate_graph = false,
         bool print_graph = false, bool store_threads = false,
         bool is_sorted_dag = false);
@@ -98,9 +163,15 @@ public:
     // If is_sorted_dag is true and store_threads is true, we store the threads
     // with an algorithm that only works on topologically sorted DAGs, but which
     // is faster.
+    // If max_buffer_bytes is nonzero, the nodes, edges and path steps are not
+    // collected in memory. They are spilled to temporary files in sorted runs
+    // holding about that many bytes in total, the runs are merged in parallel,
+    // and the index is written from the merged files, so peak memory is close
+    // to the size of the finished index.
     void from_callback(function<void(function<void(Graph&)>)> get_chunks,
         bool validate_graph = false, bool print_graph = false,
-        bool store_threads = false, bool is_sorted_dag = false); 
+        bool store_threads = false, bool is_sorted_dag = false,
+        size_t max_buffer_bytes = 0);
     void build(vector<pair<id_t, string> >& node_label,
                unordered_map<side_t, vector<side_t> >& from_to,
                unordered_map<side_t, vector<side_t> >& to_from,
@@ -121,6 +192,21 @@ public:
     size_t serialize(std::ostream& out,
                      sdsl::structure_tree_node* v = NULL,
                      std::string name = "");
+    
+    // What's the version of the memory-mappable layout we write?
+    const static uint32_t MAPPABLE_VERSION = 1;
+    
+    // Load this XG index from a file. If the file was written by
+    // serialize_mappable(), the graph and sequence vectors are memory-mapped
+    // read-only and used in place, so loading them is nearly free and
+    // processes on the same host share one copy in the page cache. Other
+    // files are loaded with load(). Throw an XGFormatError if the file is
+    // not a valid XG file.
+    void load_file(const string& filename);
+    // Save this XG index in the memory-mappable layout. The graph, sequence,
+    // and ID rank vectors are written as page-aligned arrays of words, and
+    // everything else follows in the normal serialized format.
+    size_t serialize_mappable(std::ostream& out);
                      
     
     ////////////////////////////////////////////////////////////////////////////
@@ -170,6 +256,22 @@ public:
     vector<Edge> edges_on_start(int64_t id) const;
     vector<Edge> edges_on_end(int64_t id) const;
     
+    /// Loop over the edges touching the given node, in the same order as
+    /// edges_of(), straight out of the graph vector without making any Edge
+    /// objects. The iteratee is called with (from, from_start, to, to_end)
+    /// and returns false to stop. Returns false if stopped early, and true
+    /// otherwise.
+    template<typename Iteratee>
+    bool for_each_edge_of(int64_t id, const Iteratee& iteratee) const;
+    /// Like for_each_edge_of(), but only visits edges that attach to the
+    /// start of the node, like edges_on_start().
+    template<typename Iteratee>
+    bool for_each_edge_on_start(int64_t id, const Iteratee& iteratee) const;
+    /// Like for_each_edge_of(), but only visits edges that attach to the end
+    /// of the node, like edges_on_end().
+    template<typename Iteratee>
+    bool for_each_edge_on_end(int64_t id, const Iteratee& iteratee) const;
+    
     /// Get the rank of the edge, or numeric_limits<size_t>.max() if no such edge exists.
     // Given an edge which is in the graph in some orientation, return the edge
     // oriented as it actually appears.
@@ -223,6 +325,11 @@ public:
     /// them to a callback which returns false to stop iterating and true to
     /// continue.
     virtual bool follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const;
+    /// Same as follow_edges(), but takes the iteratee as a template argument
+    /// so it can be inlined, and no std::function needs to be made for it.
+    /// Use this from hot loops that have a concrete XG.
+    template<typename Iteratee>
+    bool follow_edges_inline(const handle_t& handle, bool go_left, const Iteratee& iteratee) const;
     /// Loop over all the nodes in the graph in their local forward
     /// orientations, in their internal stored order. Stop if the iteratee returns false.
     virtual void for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel = false) const;
@@ -569,6 +676,31 @@ public:
     
 private:
 
+    /// Where build_from_source() reads the graph from. Each function calls its
+    /// iteratee once per item, and may be called more than once.
+    struct BuildSource {
+        /// Call with the ID and sequence of each node, in ID order
+        function<void(const function<void(id_t, const string&)>&)> for_each_node;
+        /// Call with the ID of each node, in ID order, and the sides on the
+        /// other ends of the edges into its start and end sides, and out of
+        /// its start and end sides, in the order they should be stored
+        function<void(const function<void(id_t, const vector<side_t>&, const vector<side_t>&,
+                                          const vector<side_t>&, const vector<side_t>&)>&)> for_each_node_edges;
+        /// Call with the name and rank-sorted steps of each path, in name order
+        function<void(const function<void(const string&, vector<trav_t>&)>&)> for_each_path;
+        /// Called when node sequences won't be asked for again, to free them
+        function<void(void)> release_nodes;
+    };
+    
+    /// Build the index from a source. The node, edge, path counts, sequence
+    /// length, and ID range must already be set.
+    void build_from_source(const BuildSource& source, bool validate_graph, bool print_graph,
+                           bool store_threads, bool is_sorted_dag);
+    
+    /// The bounded memory version of from_callback()
+    void from_callback_bounded(function<void(function<void(Graph&)>)> get_chunks, size_t max_buffer_bytes,
+                               bool validate_graph, bool print_graph, bool store_threads, bool is_sorted_dag);
+
     ////////////////////////////////////////////////////////////////////////////
     // Here is the New Way (locally traversable graph storage)
     // Everything should be rewritten in terms of these members
@@ -589,7 +721,7 @@ private:
     /// edges_from := { edge_from, ... }
     /// edge_to := { offset_to_previous_node, edge_type }
     /// edge_to := { offset_to_next_node, edge_type }
-    int_vector<> g_iv;
+    MappableIntVector g_iv;
     /// delimit node records to allow lookup of nodes in g_civ by rank
     bit_vector g_bv;
     rank_support_v<1> g_bv_rank;
@@ -615,22 +747,23 @@ private:
     /// want to visit an edge depending on its type, whether we're the to or
     /// from node, whether we want to look left or right, and whether we're
     /// forward or reverse on the node.
-    bool edge_filter(int type, bool is_to, bool want_left, bool is_reverse) const;
+    inline bool edge_filter(int type, bool is_to, bool want_left, bool is_reverse) const;
     
     // This loops over the given number of edge records for the given g node,
     // starting at the given start g vector position. For all the edges that are
     // wanted by edge_filter given the is_to, want_left, and is_reverse flags,
     // the iteratee is called. Returns true if the iteratee never returns false,
     // or false (and stops iteration) as soon as the iteratee returns false.
+    template<typename Iteratee>
     bool do_edges(const size_t& g, const size_t& start, const size_t& count,
-        bool is_to, bool want_left, bool is_reverse, const function<bool(const handle_t&)>& iteratee) const;
+        bool is_to, bool want_left, bool is_reverse, const Iteratee& iteratee) const;
     
     ////////////////////////////////////////////////////////////////////////////
     // Here are the bits we need to keep around to talk about the sequence
     ////////////////////////////////////////////////////////////////////////////
     
     // sequence/integer vector
-    int_vector<> s_iv;
+    MappableIntVector s_iv;
     // node starts in sequence, provides id schema
     // rank_1(i) = id
     // select_1(id) = i
@@ -645,7 +778,17 @@ private:
     // maintain old ids from input, ranked as in s_iv and s_bv
     int64_t min_id = 0; // id ranges don't have to start at 0
     int64_t max_id = 0;
-    int_vector<> r_iv; // ids-id_min is the rank
+    MappableIntVector r_iv; // ids-id_min is the rank
+    
+    // If we were loaded with load_file() from a mappable file, the mapping
+    // the vectors above point into, which we need to unmap.
+    void* mapping = nullptr;
+    size_t mapping_size = 0;
+    
+    // Serialize everything, optionally writing the vectors that
+    // serialize_mappable() stores separately as empty vectors.
+    size_t serialize_members(std::ostream& out, sdsl::structure_tree_node* s,
+                             std::string name, bool include_mapped_vectors);
 
     ////////////////////////////////////////////////////////////////////////////
     // Here is path storage
@@ -841,6 +984,144 @@ public:
     size_t offset_at_position(size_t pos) const;
 };
 
+inline bool XG::edge_filter(int type, bool is_to, bool want_left, bool is_reverse) const {
+    // Return true if we want an edge of the given type, where we are the from
+    // or to node (according to is_to), when we are looking off the right or
+    // left side of the node (according to want_left), and when the node is
+    // forward or reverse (accoridng to is_reverse).
+    
+    // Edge type encoding:
+    // 1: end to start
+    // 2: end to end
+    // 3: start to start
+    // 4: start to end
+    
+    // First compute what we want looking off the right of a node in the forward direction.
+    bool wanted = !is_to && (type == 1 || type == 2) || is_to && (type == 2 || type == 4);
+    
+    // We computed whether we wanted it assuming we were looking off the right. The complement is what we want looking off the left.
+    wanted = wanted != want_left;
+    
+    // We computed whether we wanted ot assuming we were in the forward orientation. The complement is what we want in the reverse orientation.
+    wanted = wanted != is_reverse;
+    
+    return wanted;
+}
+
+template<typename Iteratee>
+bool XG::do_edges(const size_t& g, const size_t& start, const size_t& count, bool is_to,
+    bool want_left, bool is_reverse, const Iteratee& iteratee) const {
+    
+    // OK go over all those edges
+    for (size_t i = 0; i < count; i++) {
+        // What edge type is the edge?
+        int type = g_iv[start + i * G_EDGE_LENGTH + G_EDGE_TYPE_OFFSET];
+        
+        // Make sure we got a valid edge type and we haven't wandered off into non-edge data.
+        assert(type >= 1);
+        assert(type <= 4);
+        
+        if (edge_filter(type, is_to, want_left, is_reverse)) {
+            
+            // What's the offset to the other node?
+            int64_t offset = g_iv[start + i * G_EDGE_LENGTH + G_EDGE_OFFSET_OFFSET];
+            
+            // Make sure we haven't gone off the rails into non-edge data.
+            assert((int64_t) g + offset >= 0);
+            assert(g + offset < g_iv.size());
+            
+            // Should we invert?
+            // We only invert if we cross an end to end edge. Or a start to start edge
+            bool new_reverse = is_reverse != (type == 2 || type == 3);
+            
+            // Compose the handle for where we are going
+            handle_t next_handle = as_handle((g + offset) | (new_reverse ? HIGH_BIT : 0));
+            
+            // We want this edge
+            
+            if (!iteratee(next_handle)) {
+                // Stop iterating
+                return false;
+            }
+        }
+    }
+    // Iteratee didn't stop us.
+    return true;
+}
+
+template<typename Iteratee>
+bool XG::follow_edges_inline(const handle_t& handle, bool go_left, const Iteratee& iteratee) const {
+
+    // Unpack the handle
+    size_t g = as_integer(handle) & LOW_BITS;
+    bool is_reverse = as_integer(handle) & HIGH_BIT;
+
+    // How many edges are there of each type?
+    size_t edges_to_count = g_iv[g + G_NODE_TO_COUNT_OFFSET];
+    size_t edges_from_count = g_iv[g + G_NODE_FROM_COUNT_OFFSET];
+    
+    // Where does each edge run start?
+    size_t to_start = g + G_NODE_HEADER_LENGTH;
+    size_t from_start = g + G_NODE_HEADER_LENGTH + G_EDGE_LENGTH * edges_to_count;
+    
+    // We will look for all the edges on the appropriate side, which means we have to check the from and to edges
+    if (do_edges(g, to_start, edges_to_count, true, go_left, is_reverse, iteratee)) {
+        // All the edges where we're to were accepted, so do the edges where we're from
+        return do_edges(g, from_start, edges_from_count, false, go_left, is_reverse, iteratee);
+    } else {
+        return false;
+    }
+}
+
+template<typename Iteratee>
+bool XG::for_each_edge_of(int64_t id, const Iteratee& iteratee) const {
+    size_t g = g_bv_select(id_to_rank(id));
+    size_t edges_to_count = g_iv[g + G_NODE_TO_COUNT_OFFSET];
+    size_t edges_from_count = g_iv[g + G_NODE_FROM_COUNT_OFFSET];
+    size_t t = g + G_NODE_HEADER_LENGTH;
+    size_t f = t + G_EDGE_LENGTH * edges_to_count;
+    size_t e = f + G_EDGE_LENGTH * edges_from_count;
+    
+    // Edges where we are the to node come first. The edge type says which
+    // sides are involved: 1 is end to start, 2 end to end, 3 start to start,
+    // and 4 start to end.
+    for (size_t j = t; j < f; j += G_EDGE_LENGTH) {
+        int64_t other = g_iv[(size_t) (g + g_iv[j + G_EDGE_OFFSET_OFFSET]) + G_NODE_ID_OFFSET];
+        int type = g_iv[j + G_EDGE_TYPE_OFFSET];
+        if (!iteratee(other, type == 3 || type == 4, id, type == 2 || type == 4)) {
+            return false;
+        }
+    }
+    // Then the edges where we are the from node
+    for (size_t j = f; j < e; j += G_EDGE_LENGTH) {
+        int64_t other = g_iv[(size_t) (g + g_iv[j + G_EDGE_OFFSET_OFFSET]) + G_NODE_ID_OFFSET];
+        int type = g_iv[j + G_EDGE_TYPE_OFFSET];
+        if (!iteratee(id, type == 3 || type == 4, other, type == 2 || type == 4)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename Iteratee>
+bool XG::for_each_edge_on_start(int64_t id, const Iteratee& iteratee) const {
+    return for_each_edge_of(id, [&](int64_t from, bool from_start, int64_t to, bool to_end) {
+        if ((to == id && !to_end) || (from == id && from_start)) {
+            return iteratee(from, from_start, to, to_end);
+        }
+        return true;
+    });
+}
+
+template<typename Iteratee>
+bool XG::for_each_edge_on_end(int64_t id, const Iteratee& iteratee) const {
+    return for_each_edge_of(id, [&](int64_t from, bool from_start, int64_t to, bool to_end) {
+        if ((to == id && to_end) || (from == id && !from_start)) {
+            return iteratee(from, from_start, to, to_end);
+        }
+        return true;
+    });
+}
 
 Mapping new_mapping(const string& name, int64_t id, size_t rank, bool is_reverse);
 void to_text(ostream& out, Graph& graph);
@@ -29,7 +29,7 @@ vector<Edge> xg_edges_on_end(id_t id, xg::XG* xgidx) {
 }
 
 string xg_node_sequence(id_t id, xg::XG* xgidx) {
-    return xgidx->node(id).sequence();
+    return xgidx->get_sequence(xgidx->get_handle(id, false));
 }
 
 size_t xg_node_length(id_t id, xg::XG* xgidx) {
@@ -47,89 +47,37 @@ char xg_pos_char(pos_t pos, xg::XG* xgidx) {
 map<pos_t, char> xg_next_pos_chars(pos_t pos, xg::XG* xgidx) {
 
     map<pos_t, char> nexts;
-    // See if the node is cached (did we just visit it?)
-    Node node = xgidx->node(id(pos));
+    handle_t handle = xgidx->get_handle(id(pos), is_rev(pos));
     // if we are still in the node, return the next position and character
-    if (offset(pos) < node.sequence().size()-1) {
+    if (offset(pos) < xgidx->get_length(handle)-1) {
         ++get_offset(pos);
-        //nexts[pos] = xg_pos_char(pos, xgidx, node_cache);
-        char c = node.sequence().at(offset(pos));
-        if (is_rev(pos)) c = reverse_complement(c);
-        nexts[pos] = c;
+        nexts[pos] = xg_pos_char(pos, xgidx);
     } else {
-        // helper
-        auto is_inverting = [](const Edge& e) {
-            return !(e.from_start() == e.to_end())
-            && (e.from_start() || e.to_end());
-        };
-        // check our cache
-        vector<Edge> edges = xgidx->edges_of(node.id());
-        // look at the next positions we could reach
-        if (!is_rev(pos)) {
-            // we are on the forward strand, the next things from this node come off the end
-            for (auto& edge : edges) {
-                if((edge.to() == id(pos) && edge.to_end()) || (edge.from() == id(pos) && !edge.from_start())) {
-                    id_t nid = (edge.from() == id(pos) ?
-                                edge.to()
-                                : edge.from());
-                    pos_t p = make_pos_t(nid, is_inverting(edge), 0);
-                    nexts[p] = xg_pos_char(p, xgidx);
-                }
-            }
-        } else {
-            // we are on the reverse strand, the next things from this node come off the start
-            for (auto& edge : edges) {
-                if((edge.to() == id(pos) && !edge.to_end()) || (edge.from() == id(pos) && edge.from_start())) {
-                    id_t nid = (edge.to() == id(pos) ?
-                                edge.from()
-                                : edge.to());
-                    pos_t p = make_pos_t(nid, !is_inverting(edge), 0);
-                    nexts[p] = xg_pos_char(p, xgidx);
-                }
-            }
-        }
+        // look at the next positions we could reach off the end of the node
+        // in our orientation, straight from the graph vector
+        xgidx->follow_edges_inline(handle, false, [&](const handle_t& next) {
+            pos_t p = make_pos_t(xgidx->get_id(next), xgidx->get_is_reverse(next), 0);
+            nexts[p] = xg_pos_char(p, xgidx);
+            return true;
+        });
     }
     return nexts;
 }
 
 set<pos_t> xg_next_pos(pos_t pos, bool whole_node, xg::XG* xgidx) {
     set<pos_t> nexts;
-    // See if the node is cached (did we just visit it?)
-    Node node = xgidx->node(id(pos));
-    // if we are still in the node, return the next position and character
-    if (!whole_node && offset(pos) < node.sequence().size()-1) {
+    handle_t handle = xgidx->get_handle(id(pos), is_rev(pos));
+    // if we are still in the node, return the next position
+    if (!whole_node && offset(pos) < xgidx->get_length(handle)-1) {
         ++get_offset(pos);
         nexts.insert(pos);
     } else {
-        // helper
-        auto is_inverting = [](const Edge& e) {
-            return !(e.from_start() == e.to_end())
-            && (e.from_start() || e.to_end());
-        };
-        // check our cache
-        auto edges = xgidx->edges_of(id(pos));
-        // look at the next positions we could reach
-        if (!is_rev(pos)) {
-            // we are on the forward strand, the next things from this node come off the end
-            for (auto& edge : edges) {
-                if((edge.to() == id(pos) && edge.to_end()) || (edge.from() == id(pos) && !edge.from_start())) {
-                    id_t nid = (edge.from() == id(pos) ?
-                                edge.to()
-                                : edge.from());
-                    nexts.insert(make_pos_t(nid, is_inverting(edge), 0));
-                }
-            }
-        } else {
-            // we are on the reverse strand, the next things from this node come off the start
-            for (auto& edge : edges) {
-                if((edge.to() == id(pos) && !edge.to_end()) || (edge.from() == id(pos) && edge.from_start())) {
-                    id_t nid = (edge.to() == id(pos) ?
-                                edge.from()
-                                : edge.to());
-                    nexts.insert(make_pos_t(nid, !is_inverting(edge), 0));
-                }
-            }
-        }
+        // look at the next positions we could reach off the end of the node
+        // in our orientation, straight from the graph vector
+        xgidx->follow_edges_inline(handle, false, [&](const handle_t& next) {
+            nexts.insert(make_pos_t(xgidx->get_id(next), xgidx->get_is_reverse(next), 0));
+            return true;
+        });
     }
     return nexts;
 }